@@ -26,7 +26,7 @@
 #include <sys/mman.h>
 
 #include <log/log.h>
-#include "drmutils.h"
+#include "buffer_info.h"
 
 
 namespace arm {
@@ -55,6 +55,16 @@ static const private_handle_t *getPrivateHandle(const hidl_handle &buffer_handle
 	return hnd;
 }
 
+static pb::PlaneLayout toPlaneLayout(const buffer_plane_layout &layout)
+{
+	pb::PlaneLayout plane;
+	plane.offset = layout.offset;
+	plane.byteStride = layout.byte_stride;
+	plane.allocWidth = layout.alloc_width;
+	plane.allocHeight = layout.alloc_height;
+	return plane;
+}
+
 Return<void> Accessor::getAllocation(const hidl_handle &buffer_handle, getAllocation_cb _hidl_cb)
 {
 	const private_handle_t *hnd = getPrivateHandle(buffer_handle);
@@ -77,13 +87,9 @@ Return<void> Accessor::getAllocatedFormat(const hidl_handle &buffer_handle, getA
 		return Void();
 	}
 
-	uint32_t drm_fourcc = drm_fourcc_from_handle(hnd);
 	uint64_t drm_modifier = 0;
-	if (drm_fourcc != DRM_FORMAT_INVALID)
-	{
-		drm_modifier |= drm_modifier_from_handle(hnd);
-	}
-	else
+	const uint32_t drm_fourcc = buffer_drm_format(hnd, &drm_modifier);
+	if (drm_fourcc == DRM_FORMAT_INVALID)
 	{
 		MALI_GRALLOC_LOGE("Error getting the allocated format: returning DRM_FORMAT_INVALID for 0x%" PRIx64 ".",
 		      hnd->alloc_format);
@@ -128,7 +134,7 @@ Return<void> Accessor::getUsage(const hidl_handle &buffer_handle, getUsage_cb _h
 		return Void();
 	}
 
-	pb::BufferUsage usage = static_cast<pb::BufferUsage>(hnd->producer_usage | hnd->consumer_usage);
+	pb::BufferUsage usage = static_cast<pb::BufferUsage>(buffer_usage(hnd));
 	_hidl_cb(pb::Error::NONE, usage);
 	return Void();
 }
@@ -156,15 +162,13 @@ Return<void> Accessor::getPlaneLayout(const hidl_handle &buffer_handle,
 		return Void();
 	}
 
-	std::vector<pb::PlaneLayout> plane_layout;
-	for (int i = 0; i < MAX_PLANES && hnd->plane_info[i].byte_stride > 0; ++i)
+	buffer_plane_layout planes[MAX_PLANES];
+	const uint32_t plane_count = buffer_plane_layouts(hnd, planes);
+
+	std::vector<pb::PlaneLayout> plane_layout(plane_count);
+	for (uint32_t i = 0; i < plane_count; ++i)
 	{
-		pb::PlaneLayout plane;
-		plane.offset = hnd->plane_info[i].offset;
-		plane.byteStride = hnd->plane_info[i].byte_stride;
-		plane.allocWidth = hnd->plane_info[i].alloc_width;
-		plane.allocHeight = hnd->plane_info[i].alloc_height;
-		plane_layout.push_back(plane);
+		plane_layout[i] = toPlaneLayout(planes[i]);
 	}
 
 	_hidl_cb(pb::Error::NONE, plane_layout);
@@ -192,6 +196,46 @@ Return<void> Accessor::getAttributeAccessor(const hidl_handle& bufferHandle, get
 	return Void();
 }
 
+Return<void> Accessor::getBufferInfo(const hidl_handle &buffer_handle, getBufferInfo_cb _hidl_cb)
+{
+	pb::BufferInfo info = {};
+
+	const private_handle_t *hnd = getPrivateHandle(buffer_handle);
+	if (hnd == nullptr)
+	{
+		_hidl_cb(pb::Error::BAD_HANDLE, info);
+		return Void();
+	}
+
+	buffer_info fields;
+	buffer_info_from_handle(hnd, &fields);
+	if (fields.drm_fourcc == DRM_FORMAT_INVALID)
+	{
+		MALI_GRALLOC_LOGE("Error getting the allocated format: returning DRM_FORMAT_INVALID for 0x%" PRIx64 ".",
+		      hnd->alloc_format);
+	}
+
+	info.fd = fields.fd;
+	info.size = fields.size;
+	info.drmFourcc = fields.drm_fourcc;
+	info.drmModifier = fields.drm_modifier;
+	info.width = fields.width;
+	info.height = fields.height;
+	info.requestedFormat = static_cast<PixelFormat>(fields.requested_format);
+	info.usage = static_cast<pb::BufferUsage>(fields.usage);
+	info.layerCount = fields.layer_count;
+
+	static_assert(MAX_PLANES == 3, "BufferInfo::planes must hold MAX_PLANES entries");
+	info.planeCount = fields.plane_count;
+	for (uint32_t i = 0; i < fields.plane_count; ++i)
+	{
+		info.planes[i] = toPlaneLayout(fields.planes[i]);
+	}
+
+	_hidl_cb(pb::Error::NONE, info);
+	return Void();
+}
+
 IAccessor *HIDL_FETCH_IAccessor(const char *)
 {
 #ifndef PLATFORM_SDK_VERSION
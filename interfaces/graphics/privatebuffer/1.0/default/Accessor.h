@@ -49,6 +49,7 @@ struct Accessor : public IAccessor {
     Return<void> getLayerCount(const hidl_handle& bufferHandle, getLayerCount_cb _hidl_cb) override;
     Return<void> getPlaneLayout(const hidl_handle& bufferHandle, getPlaneLayout_cb _hidl_cb) override;
     Return<void> getAttributeAccessor(const hidl_handle& bufferHandle, getAttributeAccessor_cb _hidl_cb) override;
+    Return<void> getBufferInfo(const hidl_handle& bufferHandle, getBufferInfo_cb _hidl_cb) override;
 
     // Methods from ::android::hidl::base::V1_0::IBase follow.
 };
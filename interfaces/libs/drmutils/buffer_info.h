@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 Arm Limited.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_LIBS_BUFFER_INFO_H
+#define GRALLOC_LIBS_BUFFER_INFO_H
+
+#include "mali_gralloc_buffer.h"
+
+/* Layout of a plane, as returned by the privatebuffer IAccessor. */
+struct buffer_plane_layout
+{
+	uint64_t offset;
+	uint32_t byte_stride;
+	uint32_t alloc_width;
+	uint32_t alloc_height;
+};
+
+/* Properties of a buffer, as returned by IAccessor::getBufferInfo(). */
+struct buffer_info
+{
+	int fd;
+	uint64_t size;
+	uint32_t drm_fourcc;
+	uint64_t drm_modifier;
+	uint32_t width;
+	uint32_t height;
+	int32_t requested_format;
+	uint64_t usage;
+	uint32_t layer_count;
+	uint32_t plane_count;
+	buffer_plane_layout planes[MAX_PLANES];
+};
+
+/**
+ * @brief Obtain the DRM format of a buffer.
+ *
+ * @param hnd          Valid private handle.
+ * @param drm_modifier Set to the DRM modifier, 0 when the format has no FOURCC.
+ *
+ * @return The DRM FOURCC format or DRM_FORMAT_INVALID if the format has none.
+ */
+uint32_t buffer_drm_format(const private_handle_t *hnd, uint64_t *drm_modifier);
+
+/**
+ * @brief Obtain the usage of a buffer, producer and consumer combined.
+ *
+ * @param hnd Valid private handle.
+ */
+uint64_t buffer_usage(const private_handle_t *hnd);
+
+/**
+ * @brief Obtain the layout of the planes of a buffer.
+ *
+ * @param hnd    Valid private handle.
+ * @param planes Set to the layout of each plane.
+ *
+ * @return The number of planes.
+ */
+uint32_t buffer_plane_layouts(const private_handle_t *hnd, buffer_plane_layout planes[MAX_PLANES]);
+
+/**
+ * @brief Obtain all the properties of a buffer at once.
+ *
+ * @param hnd  Valid private handle.
+ * @param info Set to the properties of the buffer.
+ */
+void buffer_info_from_handle(const private_handle_t *hnd, buffer_info *info);
+
+#endif
@@ -24,6 +24,25 @@
 /**
  * @brief Obtain the FOURCC corresponding to the given Gralloc internal format.
  *
+ * @param alloc_format The internal format, including the AFBC modifier bits.
+ *
+ * @return The DRM FOURCC format or DRM_FORMAT_INVALID if the format has none.
+ */
+uint32_t drm_fourcc_from_format(uint64_t alloc_format);
+
+/**
+ * @brief Obtain the DRM modifier corresponding to the given Gralloc internal format.
+ *
+ * @param alloc_format The internal format, including the AFBC modifier bits.
+ * @param multi_plane Whether the buffer has more than one plane.
+ *
+ * @return The DRM modifier, 0 for linear formats.
+ */
+uint64_t drm_modifier_from_format(uint64_t alloc_format, bool multi_plane);
+
+/**
+ * @brief Obtain the FOURCC of a buffer, derived from its internal format.
+ *
  * @param hnd Private handle where the format information is stored.
  *
  * @return The DRM FOURCC format or DRM_FORMAT_INVALID in case of errors.
@@ -31,10 +50,9 @@
 uint32_t drm_fourcc_from_handle(const private_handle_t *hnd);
 
 /**
- * @brief Extract the part of the DRM modifier stored inside the given internal format and private handle.
+ * @brief Obtain the DRM modifier of a buffer, derived from its internal format.
  *
- * @param hnd Private handle where part of the modifier information is stored.
- * @param internal_format The internal format, where part of the modifier information is stored.
+ * @param hnd Private handle where the modifier information is stored.
  *
  * @return The information extracted from the argument, in the form of a DRM modifier.
  */
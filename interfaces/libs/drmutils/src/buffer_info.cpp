@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 Arm Limited.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer_info.h"
+#include "drmutils.h"
+
+uint32_t buffer_drm_format(const private_handle_t *hnd, uint64_t *drm_modifier)
+{
+	const uint32_t drm_fourcc = drm_fourcc_from_handle(hnd);
+	*drm_modifier = drm_fourcc != DRM_FORMAT_INVALID ? drm_modifier_from_handle(hnd) : 0;
+	return drm_fourcc;
+}
+
+uint64_t buffer_usage(const private_handle_t *hnd)
+{
+	return hnd->producer_usage | hnd->consumer_usage;
+}
+
+uint32_t buffer_plane_layouts(const private_handle_t *hnd, buffer_plane_layout planes[MAX_PLANES])
+{
+	uint32_t count = 0;
+	for (int i = 0; i < MAX_PLANES && hnd->plane_info[i].byte_stride > 0; ++i)
+	{
+		planes[i].offset = hnd->plane_info[i].offset;
+		planes[i].byte_stride = hnd->plane_info[i].byte_stride;
+		planes[i].alloc_width = hnd->plane_info[i].alloc_width;
+		planes[i].alloc_height = hnd->plane_info[i].alloc_height;
+		count++;
+	}
+	return count;
+}
+
+void buffer_info_from_handle(const private_handle_t *hnd, buffer_info *info)
+{
+	info->fd = hnd->share_fd;
+	info->size = hnd->size;
+	info->drm_fourcc = buffer_drm_format(hnd, &info->drm_modifier);
+	info->width = hnd->width;
+	info->height = hnd->height;
+	info->requested_format = hnd->req_format;
+	info->usage = buffer_usage(hnd);
+	info->layer_count = hnd->layer_count;
+	info->plane_count = buffer_plane_layouts(hnd, info->planes);
+}
@@ -18,7 +18,7 @@
 #include "drmutils.h"
 #include "mali_gralloc_formats.h"
 
-uint32_t drm_fourcc_from_handle(const private_handle_t *hnd)
+uint32_t drm_fourcc_from_format(const uint64_t alloc_format)
 {
 	/* Clean the modifier bits in the internal format. */
 	struct table_entry
@@ -44,6 +44,7 @@ uint32_t drm_fourcc_from_handle(const private_handle_t *hnd)
 		{ MALI_GRALLOC_FORMAT_INTERNAL_Y210, DRM_FORMAT_Y210 },
 		{ MALI_GRALLOC_FORMAT_INTERNAL_P010, DRM_FORMAT_P010 },
 		{ MALI_GRALLOC_FORMAT_INTERNAL_P210, DRM_FORMAT_P210 },
+		{ MALI_GRALLOC_FORMAT_INTERNAL_NV15, DRM_FORMAT_NV15 },
 		{ MALI_GRALLOC_FORMAT_INTERNAL_Y410, DRM_FORMAT_Y410 },
 		{ MALI_GRALLOC_FORMAT_INTERNAL_YUV422_8BIT, DRM_FORMAT_YUYV },
 		{ MALI_GRALLOC_FORMAT_INTERNAL_YUV420_8BIT_I, DRM_FORMAT_YUV420_8BIT },
@@ -57,7 +58,7 @@ uint32_t drm_fourcc_from_handle(const private_handle_t *hnd)
 		{ HAL_PIXEL_FORMAT_YCBCR_P010, DRM_FORMAT_P010 },
 	};
 
-	const uint64_t unmasked_format = hnd->alloc_format;
+	const uint64_t unmasked_format = alloc_format;
 	const uint64_t internal_format = (unmasked_format & MALI_GRALLOC_INTFMT_FMT_MASK);
 	for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++)
 	{
@@ -76,9 +77,9 @@ uint32_t drm_fourcc_from_handle(const private_handle_t *hnd)
 	return DRM_FORMAT_INVALID;
 }
 
-uint64_t drm_modifier_from_handle(const private_handle_t *hnd)
+uint64_t drm_modifier_from_format(const uint64_t alloc_format, const bool multi_plane)
 {
-	const uint64_t internal_format = hnd->alloc_format;
+	const uint64_t internal_format = alloc_format;
 	if ((internal_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK) == 0)
 	{
 		return 0;
@@ -119,7 +120,7 @@ uint64_t drm_modifier_from_handle(const private_handle_t *hnd)
 	/* Extract the block-size modifiers. */
 	if (internal_format & MALI_GRALLOC_INTFMT_AFBC_WIDEBLK)
 	{
-		modifier |= (hnd->is_multi_plane() ? AFBC_FORMAT_MOD_BLOCK_SIZE_32x8_64x4 : AFBC_FORMAT_MOD_BLOCK_SIZE_32x8);
+		modifier |= (multi_plane ? AFBC_FORMAT_MOD_BLOCK_SIZE_32x8_64x4 : AFBC_FORMAT_MOD_BLOCK_SIZE_32x8);
 	}
 	else if (internal_format & MALI_GRALLOC_INTFMT_AFBC_EXTRAWIDEBLK)
 	{
@@ -132,3 +133,13 @@ uint64_t drm_modifier_from_handle(const private_handle_t *hnd)
 
 	return DRM_FORMAT_MOD_ARM_AFBC(modifier);
 }
+
+uint32_t drm_fourcc_from_handle(const private_handle_t *hnd)
+{
+	return drm_fourcc_from_format(hnd->alloc_format);
+}
+
+uint64_t drm_modifier_from_handle(const private_handle_t *hnd)
+{
+	return drm_modifier_from_format(hnd->alloc_format, hnd->is_multi_plane());
+}
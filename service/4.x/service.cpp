@@ -18,11 +18,26 @@
 
 #include <android/hardware/graphics/allocator/4.0/IAllocator.h>
 
+#include <cutils/properties.h>
 #include <hidl/LegacySupport.h>
 
 using android::hardware::defaultPassthroughServiceImplementation;
 using android::hardware::graphics::allocator::V4_0::IAllocator;
 
+/* Bounds of vendor.gralloc.allocator.threads. */
+static constexpr int32_t kDefaultThreads = 4;
+static constexpr int32_t kMaxThreads = 16;
+
 int main() {
-    return defaultPassthroughServiceImplementation<IAllocator>(/*maxThreads*/ 4);
+    /*
+     * When allocations are scheduled (vendor.gralloc.alloc_workers), use more
+     * threads than scheduling slots so urgent requests are received while the
+     * slots are busy.
+     */
+    int32_t threads = property_get_int32("vendor.gralloc.allocator.threads", kDefaultThreads);
+    if (threads < 1 || threads > kMaxThreads) {
+        threads = kDefaultThreads;
+    }
+
+    return defaultPassthroughServiceImplementation<IAllocator>(threads);
 }
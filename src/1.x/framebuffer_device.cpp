@@ -30,6 +30,7 @@
 #include <system/window.h>
 #include <log/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <hardware/hardware.h>
 #include <hardware/fb.h>
 
@@ -40,6 +41,7 @@
 #include "mali_gralloc_buffer.h"
 #include "gralloc_helper.h"
 #include "1.x/gralloc_vsync.h"
+#include "1.x/gralloc_flip_queue.h"
 #include "core/mali_gralloc_bufferaccess.h"
 #include "fbdev/mali_gralloc_framebuffer.h"
 #include "allocator/mali_gralloc_ion.h"
@@ -73,6 +75,88 @@ static int fb_set_swap_interval(struct framebuffer_device_t *dev, int interval)
 	return 0;
 }
 
+/*
+ * Scans out a framebuffer buffer and waits for vsync, as required by the swap interval.
+ */
+static int fb_pan(struct framebuffer_device_t *dev, buffer_handle_t buffer)
+{
+	private_handle_t const *hnd = reinterpret_cast<private_handle_t const *>(buffer);
+	private_module_t *m = reinterpret_cast<private_module_t *>(dev->common.module);
+
+	m->info.activate = FB_ACTIVATE_VBL;
+	m->info.yoffset = hnd->offset / m->finfo.line_length;
+
+#ifdef STANDARD_LINUX_SCREEN
+
+	if (ioctl(m->framebuffer->fd, FBIOPAN_DISPLAY, &m->info) == -1)
+	{
+		MALI_GRALLOC_LOGE("FBIOPAN_DISPLAY failed for fd: %d", m->framebuffer->fd);
+		return -errno;
+	}
+
+#else /*Standard Android way*/
+
+	if (ioctl(m->framebuffer->fd, FBIOPUT_VSCREENINFO, &m->info) == -1)
+	{
+		MALI_GRALLOC_LOGE("FBIOPUT_VSCREENINFO failed for fd: %d", m->framebuffer->fd);
+		return -errno;
+	}
+
+#endif
+
+	if (0 != gralloc_wait_for_vsync(dev))
+	{
+		MALI_GRALLOC_LOGE("Gralloc wait for vsync failed for fd: %d", m->framebuffer->fd);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int fb_flip_backend_flip(void *ctx, buffer_handle_t buffer)
+{
+	return fb_pan(static_cast<framebuffer_device_t *>(ctx), buffer);
+}
+
+static void fb_flip_backend_release(void *ctx, buffer_handle_t buffer)
+{
+	GRALLOC_UNUSED(ctx);
+	mali_gralloc_unlock(buffer);
+}
+
+static bool fb_flip_backend_vsync_enabled(void *ctx)
+{
+	framebuffer_device_t *dev = static_cast<framebuffer_device_t *>(ctx);
+	return reinterpret_cast<private_module_t *>(dev->common.module)->swapInterval != 0;
+}
+
+/*
+ * Flips are asynchronous with at least three buffers. fb_post() has no
+ * release fence: a post returns once at most numBuffers - 2 flips are
+ * pending, so that the buffer rendered into next, posted numBuffers - 1
+ * frames ago, is no longer on screen.
+ */
+static void fb_flip_queue_init(struct framebuffer_device_t *dev)
+{
+	private_module_t *m = reinterpret_cast<private_module_t *>(dev->common.module);
+
+	if (m->flipQueue != NULL || m->numBuffers < 3 || !property_get_bool("vendor.gralloc.fb_async_flip", true))
+	{
+		return;
+	}
+
+	fb_flip_backend backend;
+	backend.flip = fb_flip_backend_flip;
+	backend.release = fb_flip_backend_release;
+	backend.vsync_enabled = fb_flip_backend_vsync_enabled;
+	backend.ctx = dev;
+
+	const int64_t period_ns = m->fps > 0.0f ? (int64_t)(1000000000.0f / m->fps) : 0;
+
+	m->flipQueue = new fb_flip_queue(backend, m->numBuffers - 2, period_ns);
+	m->flipQueue->start();
+}
+
 static int fb_post(struct framebuffer_device_t *dev, buffer_handle_t buffer)
 {
 	if (private_handle_t::validate(buffer) < 0)
@@ -83,6 +167,23 @@ static int fb_post(struct framebuffer_device_t *dev, buffer_handle_t buffer)
 	private_handle_t const *hnd = reinterpret_cast<private_handle_t const *>(buffer);
 	private_module_t *m = reinterpret_cast<private_module_t *>(dev->common.module);
 
+	if (m->flipQueue != NULL && (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER))
+	{
+		/* Unlocked by the flip queue once no longer on screen. */
+#if GRALLOC_USE_LEGACY_LOCK != 1
+		mali_gralloc_lock(buffer, private_module_t::PRIV_USAGE_LOCKED_FOR_POST, 0, 0, 0, 0, NULL);
+#else
+		mali_gralloc_lock(buffer, private_module_t::PRIV_USAGE_LOCKED_FOR_POST, -1, -1, -1, -1, NULL);
+#endif
+		return m->flipQueue->post(buffer);
+	}
+
+	if (m->flipQueue != NULL)
+	{
+		/* Copies go straight to the framebuffer: let queued flips complete first. */
+		m->flipQueue->drain();
+	}
+
 	if (m->currentBuffer)
 	{
 		mali_gralloc_unlock(m->currentBuffer);
@@ -98,35 +199,11 @@ static int fb_post(struct framebuffer_device_t *dev, buffer_handle_t buffer)
 #else
 		mali_gralloc_lock(buffer, private_module_t::PRIV_USAGE_LOCKED_FOR_POST, -1, -1, -1, -1, NULL);
 #endif
-		int interrupt;
-		m->info.activate = FB_ACTIVATE_VBL;
-		m->info.yoffset = hnd->offset / m->finfo.line_length;
-
-#ifdef STANDARD_LINUX_SCREEN
-
-		if (ioctl(m->framebuffer->fd, FBIOPAN_DISPLAY, &m->info) == -1)
-		{
-			MALI_GRALLOC_LOGE("FBIOPAN_DISPLAY failed for fd: %d", m->framebuffer->fd);
-			mali_gralloc_unlock(buffer);
-			return -errno;
-		}
-
-#else /*Standard Android way*/
-
-		if (ioctl(m->framebuffer->fd, FBIOPUT_VSCREENINFO, &m->info) == -1)
-		{
-			MALI_GRALLOC_LOGE("FBIOPUT_VSCREENINFO failed for fd: %d", m->framebuffer->fd);
-			mali_gralloc_unlock(m, buffer);
-			return -errno;
-		}
-
-#endif
-
-		if (0 != gralloc_wait_for_vsync(dev))
+		const int err = fb_pan(dev, buffer);
+		if (err != 0)
 		{
-			MALI_GRALLOC_LOGE("Gralloc wait for vsync failed for fd: %d", m->framebuffer->fd);
 			mali_gralloc_unlock(buffer);
-			return -errno;
+			return err;
 		}
 
 		m->currentBuffer = buffer;
@@ -178,6 +255,12 @@ static int fb_close(struct hw_device_t *device)
 
 	if (dev)
 	{
+		private_module_t *m = reinterpret_cast<private_module_t *>(dev->common.module);
+
+		/* Completes the queued flips. The queue refers to the device. */
+		delete m->flipQueue;
+		m->flipQueue = NULL;
+
 		free(dev);
 	}
 
@@ -269,6 +352,7 @@ int framebuffer_device_open(hw_module_t const *module, const char *name, hw_devi
 	*device = &dev->common;
 
 	gralloc_vsync_enable(dev);
+	fb_flip_queue_init(dev);
 
 	return status;
 }
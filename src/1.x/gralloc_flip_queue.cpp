@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "1.x/gralloc_flip_queue.h"
+#include "mali_gralloc_log.h"
+
+/* Number of flips between two statistics reports in the log. */
+#define FLIP_STATS_LOG_INTERVAL 3600
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+fb_flip_queue::fb_flip_queue(const fb_flip_backend &_backend, const uint32_t _depth, const int64_t _period_ns)
+    : backend(_backend)
+    , depth(_depth > 0 ? _depth : 1)
+    , period_ns(_period_ns)
+    , stopping(false)
+    , front(nullptr)
+    , front_done_ns(0)
+    , error(0)
+    , total_latency_ns(0)
+{
+	memset(&counters, 0, sizeof(counters));
+}
+
+fb_flip_queue::~fb_flip_queue()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	queued.notify_all();
+
+	/* The worker completes the queued flips before exiting. */
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+
+	if (front != nullptr)
+	{
+		backend.release(backend.ctx, front);
+	}
+}
+
+void fb_flip_queue::start()
+{
+	thread = std::thread(&fb_flip_queue::worker, this);
+}
+
+int fb_flip_queue::post(const buffer_handle_t buffer)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	if (pending.size() >= depth)
+	{
+		counters.stalls++;
+		done.wait(guard, [this] { return pending.size() < depth; });
+	}
+
+	const int err = error;
+	error = 0;
+
+	pending.push_back({ buffer, now_ns() });
+	counters.posted++;
+
+	guard.unlock();
+	queued.notify_one();
+
+	return err;
+}
+
+void fb_flip_queue::drain()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return pending.empty(); });
+}
+
+fb_flip_stats fb_flip_queue::stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	fb_flip_stats result = counters;
+	result.avg_latency_ns = counters.flipped != 0 ? total_latency_ns / (int64_t)counters.flipped : 0;
+	return result;
+}
+
+void fb_flip_queue::complete(const entry &flipped, const int err, const int64_t done_ns)
+{
+	if (err != 0)
+	{
+		counters.failed++;
+		error = err;
+		return;
+	}
+
+	const int64_t latency_ns = done_ns - flipped.queued_ns;
+	counters.flipped++;
+	total_latency_ns += latency_ns;
+	if (latency_ns > counters.max_latency_ns)
+	{
+		counters.max_latency_ns = latency_ns;
+	}
+
+	/*
+	 * A frame posted before the previous flip completed was ready for the
+	 * next vsync: every further vsync it took to display it was missed.
+	 */
+	if (front_done_ns != 0 && period_ns > 0 && flipped.queued_ns < front_done_ns &&
+	    backend.vsync_enabled(backend.ctx))
+	{
+		const int64_t vsyncs = (done_ns - front_done_ns + period_ns / 2) / period_ns;
+		if (vsyncs > 1)
+		{
+			counters.missed += vsyncs - 1;
+		}
+	}
+	front_done_ns = done_ns;
+
+	if (counters.flipped % FLIP_STATS_LOG_INTERVAL == 0)
+	{
+		MALI_GRALLOC_LOGI("Flips %" PRIu64 " missed vsyncs %" PRIu64 " failed %" PRIu64 " stalls %" PRIu64
+		                  " latency avg %" PRId64 "us max %" PRId64 "us",
+		                  counters.flipped, counters.missed, counters.failed, counters.stalls,
+		                  total_latency_ns / (int64_t)counters.flipped / 1000, counters.max_latency_ns / 1000);
+	}
+}
+
+void fb_flip_queue::worker()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true)
+	{
+		queued.wait(guard, [this] { return stopping || !pending.empty(); });
+		if (pending.empty())
+		{
+			break;
+		}
+
+		const entry flipped = pending.front();
+
+		guard.unlock();
+		const int err = backend.flip(backend.ctx, flipped.buffer);
+		const int64_t done_ns = now_ns();
+		guard.lock();
+
+		complete(flipped, err, done_ns);
+
+		/* A failed flip leaves the previous buffer on screen. */
+		buffer_handle_t released = flipped.buffer;
+		if (err == 0)
+		{
+			released = front;
+			front = flipped.buffer;
+		}
+
+		guard.unlock();
+		if (released != nullptr)
+		{
+			backend.release(backend.ctx, released);
+		}
+		guard.lock();
+
+		pending.pop_front();
+		done.notify_all();
+	}
+}
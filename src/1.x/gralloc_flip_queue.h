@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_FLIP_QUEUE_H_
+#define _GRALLOC_FLIP_QUEUE_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <system/window.h>
+
+/*
+ * Display access of the flip queue. Kept separate from the framebuffer device
+ * so that the queue can be driven by a fake device.
+ */
+struct fb_flip_backend
+{
+	/*
+	 * Scans out a buffer and waits for it to be displayed, as required by
+	 * the swap interval.
+	 *
+	 * @return 0 on success, negative errno otherwise.
+	 */
+	int (*flip)(void *ctx, buffer_handle_t buffer);
+	/* Called once a buffer is not scanned out anymore, or failed to flip. */
+	void (*release)(void *ctx, buffer_handle_t buffer);
+	/* Whether flips wait for vsync, i.e. the swap interval is not 0. */
+	bool (*vsync_enabled)(void *ctx);
+	void *ctx;
+};
+
+struct fb_flip_stats
+{
+	uint64_t posted;
+	uint64_t flipped;
+	uint64_t failed;
+	/* Vsyncs a ready frame was not displayed on. */
+	uint64_t missed;
+	/* Time from post to display. */
+	int64_t avg_latency_ns;
+	int64_t max_latency_ns;
+	/* Posts that blocked on a full queue. */
+	uint64_t stalls;
+};
+
+/*
+ * Asynchronous page flips.
+ *
+ * fb_post() used to pan the display and wait for vsync on the compositor
+ * thread, so that composition of the next frame could not overlap the flip of
+ * the current one. Posts are queued instead and flipped in order by a worker
+ * thread; a post only blocks while 'depth' flips are pending.
+ *
+ * The buffer on screen is released when the next flip completes. The queue
+ * depth guarantees that the buffer rendered into next is not on screen
+ * anymore (see framebuffer_device.cpp).
+ */
+class fb_flip_queue
+{
+public:
+	/*
+	 * @param backend    [in]  Display access.
+	 * @param depth      [in]  Maximum number of pending flips, at least 1.
+	 * @param period_ns  [in]  Nominal vsync period, used to count missed frames.
+	 */
+	fb_flip_queue(const fb_flip_backend &backend, uint32_t depth, int64_t period_ns);
+	~fb_flip_queue();
+
+	fb_flip_queue(const fb_flip_queue &) = delete;
+	fb_flip_queue &operator=(const fb_flip_queue &) = delete;
+
+	/*
+	 * Starts the worker thread.
+	 */
+	void start();
+
+	/*
+	 * Queues a buffer for display, blocking while the queue is full.
+	 *
+	 * @param buffer  [in]  Buffer to display, released through the backend.
+	 *
+	 * @return 0 on success, or the error of a previous flip that failed.
+	 */
+	int post(buffer_handle_t buffer);
+
+	/*
+	 * Waits for all queued flips to complete.
+	 */
+	void drain();
+
+	fb_flip_stats stats();
+
+private:
+	struct entry
+	{
+		buffer_handle_t buffer;
+		int64_t queued_ns;
+	};
+
+	void complete(const entry &flipped, int err, int64_t done_ns);
+	void worker();
+
+	const fb_flip_backend backend;
+	const uint32_t depth;
+	const int64_t period_ns;
+
+	std::mutex lock;
+	std::condition_variable queued;
+	std::condition_variable done;
+	std::thread thread;
+	bool stopping;
+
+	std::deque<entry> pending;
+	/* The entry being flipped stays at the front of 'pending' until complete. */
+	bool flipping;
+	buffer_handle_t front;
+	int64_t front_done_ns;
+	int error;
+
+	fb_flip_stats counters;
+	int64_t total_latency_ns;
+};
+
+#endif /* _GRALLOC_FLIP_QUEUE_H_ */
@@ -25,7 +25,10 @@ struct framebuffer_device_t;
 int gralloc_vsync_enable(struct framebuffer_device_t *dev);
 /* Disables vsync interrupt. */
 int gralloc_vsync_disable(struct framebuffer_device_t *dev);
-/* Waits for the vsync interrupt. */
+/*
+ * Waits for the vsync interrupt, or for the predicted vsync once the vsync
+ * timestamp model is valid (see gralloc_vsync_model.h).
+ */
 int gralloc_wait_for_vsync(struct framebuffer_device_t *dev);
 
 #endif /* _GRALLOC_VSYNC_H_ */
@@ -31,6 +31,7 @@
 #include "mali_gralloc_buffer.h"
 #include "1.x/gralloc_vsync.h"
 #include "1.x/gralloc_vsync_report.h"
+#include "1.x/gralloc_vsync_model.h"
 
 #define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
 
@@ -61,12 +62,19 @@ int gralloc_wait_for_vsync(framebuffer_device_t *dev)
 		int crtc = 0;
 		gralloc_mali_vsync_report(MALI_VSYNC_EVENT_BEGIN_WAIT);
 
+		if (gralloc_vsync_wait_predicted())
+		{
+			gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
+			return 0;
+		}
+
 		if (ioctl(m->framebuffer->fd, FBIO_WAITFORVSYNC, &crtc) < 0)
 		{
 			gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
 			return -errno;
 		}
 
+		gralloc_vsync_sample_now();
 		gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
 	}
 
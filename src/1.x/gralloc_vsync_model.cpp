@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+
+#include "1.x/gralloc_vsync_model.h"
+
+/* Number of intervals needed before predicting. */
+#define VSYNC_MODEL_MIN_INTERVALS 4
+/*
+ * Largest gap between two samples, in periods, still considered part of the
+ * same sequence. Comfortably above VSYNC_RESYNC_INTERVAL, the gap between
+ * samples once predictions are used.
+ */
+#define VSYNC_MODEL_MAX_GAP 32
+/* Number of predicted waits between two waits for the display. */
+#define VSYNC_RESYNC_INTERVAL 16
+/* Waits end after the predicted vsync, so that the flip requested before has been latched. */
+#define VSYNC_WAKEUP_MARGIN_NS 500000
+
+static int64_t median(int64_t *values, const size_t count)
+{
+	std::nth_element(values, values + count / 2, values + count);
+	return values[count / 2];
+}
+
+vsync_model::vsync_model()
+{
+	reset();
+}
+
+void vsync_model::reset()
+{
+	num_timestamps = 0;
+	num_intervals = 0;
+	next_timestamp = 0;
+	next_interval = 0;
+	period = 0;
+	anchor_ns = 0;
+}
+
+bool vsync_model::valid() const
+{
+	return period > 0;
+}
+
+int64_t vsync_model::period_ns() const
+{
+	return period;
+}
+
+void vsync_model::sample(const int64_t timestamp_ns)
+{
+	if (num_timestamps != 0)
+	{
+		const int64_t last = timestamps[(next_timestamp + HISTORY - 1) % HISTORY];
+		const int64_t interval = timestamp_ns - last;
+		if (interval <= 0)
+		{
+			return;
+		}
+
+		/* Without an estimate yet, the latest intervals are the best guess of the period. */
+		int64_t reference = period;
+		if (reference == 0)
+		{
+			reference = num_intervals != 0 ? intervals[(next_interval + HISTORY - 1) % HISTORY] : interval;
+		}
+		const int64_t vsyncs = std::max<int64_t>(1, (interval + reference / 2) / reference);
+		if (vsyncs > VSYNC_MODEL_MAX_GAP)
+		{
+			reset();
+		}
+		else
+		{
+			intervals[next_interval] = interval / vsyncs;
+			next_interval = (next_interval + 1) % HISTORY;
+			if (num_intervals < HISTORY)
+			{
+				num_intervals++;
+			}
+		}
+	}
+
+	timestamps[next_timestamp] = timestamp_ns;
+	next_timestamp = (next_timestamp + 1) % HISTORY;
+	if (num_timestamps < HISTORY)
+	{
+		num_timestamps++;
+	}
+
+	update();
+}
+
+void vsync_model::update()
+{
+	if (num_intervals < VSYNC_MODEL_MIN_INTERVALS)
+	{
+		period = 0;
+		return;
+	}
+
+	int64_t values[HISTORY];
+	std::copy(intervals, intervals + num_intervals, values);
+	period = median(values, num_intervals);
+
+	/* Offsets of the samples from the grid through the latest one, in (-period/2, period/2]. */
+	const int64_t latest = timestamps[(next_timestamp + HISTORY - 1) % HISTORY];
+	for (size_t i = 0; i < num_timestamps; i++)
+	{
+		int64_t offset = (timestamps[i] - latest) % period;
+		if (offset > period / 2)
+		{
+			offset -= period;
+		}
+		else if (offset <= -period / 2)
+		{
+			offset += period;
+		}
+		values[i] = offset;
+	}
+	anchor_ns = latest + median(values, num_timestamps);
+}
+
+int64_t vsync_model::predict_next(const int64_t now_ns) const
+{
+	if (!valid())
+	{
+		return -1;
+	}
+
+	/* Rounded down, also before the anchor where the division rounds up. */
+	const int64_t elapsed = now_ns - anchor_ns;
+	int64_t vsyncs = elapsed / period;
+	if (elapsed >= 0 || elapsed % period == 0)
+	{
+		vsyncs++;
+	}
+
+	return anchor_ns + vsyncs * period;
+}
+
+static std::mutex vsync_lock;
+static vsync_model vsync;
+static uint32_t predicted_waits;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void gralloc_vsync_sample_now(void)
+{
+	const int64_t timestamp = now_ns();
+
+	std::lock_guard<std::mutex> guard(vsync_lock);
+	vsync.sample(timestamp);
+	predicted_waits = 0;
+}
+
+bool gralloc_vsync_wait_predicted(void)
+{
+	int64_t deadline;
+	{
+		std::lock_guard<std::mutex> guard(vsync_lock);
+		if (!vsync.valid() || predicted_waits >= VSYNC_RESYNC_INTERVAL)
+		{
+			return false;
+		}
+
+		deadline = vsync.predict_next(now_ns()) + VSYNC_WAKEUP_MARGIN_NS;
+		predicted_waits++;
+	}
+
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	{
+	}
+
+	return true;
+}
+
+int gralloc_vsync_predict(int64_t *next_vsync_ns)
+{
+	const int64_t now = now_ns();
+
+	std::lock_guard<std::mutex> guard(vsync_lock);
+	if (!vsync.valid())
+	{
+		return -EAGAIN;
+	}
+
+	*next_vsync_ns = vsync.predict_next(now);
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GRALLOC_VSYNC_MODEL_H_
+#define _GRALLOC_VSYNC_MODEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Vsync timestamp model.
+ *
+ * Estimates the vsync period and phase from sampled vsync timestamps, so that
+ * the next vsyncs can be predicted without waiting for them. Samples are the
+ * wake-up times of vsync waits, which jitter with scheduling latency and miss
+ * vsyncs under load: the period is the median of the sample intervals, each
+ * divided by the number of vsyncs it spans, and the phase the median offset
+ * of the samples from that period grid.
+ */
+class vsync_model
+{
+public:
+	vsync_model();
+
+	/*
+	 * Adds a vsync timestamp. Samples must be monotonic; a gap of many
+	 * periods (e.g. display off) restarts the estimation.
+	 */
+	void sample(int64_t timestamp_ns);
+
+	/* Discards all samples. */
+	void reset();
+
+	/* Whether enough samples were taken for predictions. */
+	bool valid() const;
+
+	/* Estimated period, 0 when not valid. */
+	int64_t period_ns() const;
+
+	/*
+	 * Predicts the first vsync strictly after a given time.
+	 *
+	 * @return predicted vsync time, -1 when not valid.
+	 */
+	int64_t predict_next(int64_t now_ns) const;
+
+private:
+	static const size_t HISTORY = 16;
+
+	void update();
+
+	int64_t timestamps[HISTORY];
+	int64_t intervals[HISTORY];
+	size_t num_timestamps;
+	size_t num_intervals;
+	size_t next_timestamp;
+	size_t next_interval;
+
+	/* Current estimate: vsyncs happen at anchor_ns + n * period. */
+	int64_t period;
+	int64_t anchor_ns;
+};
+
+/*
+ * Records a vsync that has just been waited for, timestamped now.
+ */
+void gralloc_vsync_sample_now(void);
+
+/*
+ * Waits for the predicted next vsync instead of the display, unless the model
+ * is not valid yet or a real vsync is due to correct drift.
+ *
+ * @return true when the wait was done, false when the caller has to wait for
+ *         the display and call gralloc_vsync_sample_now().
+ */
+bool gralloc_vsync_wait_predicted(void);
+
+/*
+ * Predicts the next vsync.
+ *
+ * @param next_vsync_ns [out] Predicted time of the next vsync, CLOCK_MONOTONIC.
+ *
+ * @return 0 on success, -EAGAIN when too few vsyncs were sampled.
+ */
+int gralloc_vsync_predict(int64_t *next_vsync_ns);
+
+#endif /* _GRALLOC_VSYNC_MODEL_H_ */
@@ -19,6 +19,7 @@
 #include "gralloc_priv.h"
 #include "1.x/gralloc_vsync.h"
 #include "1.x/gralloc_vsync_report.h"
+#include "1.x/gralloc_vsync_model.h"
 #include <sys/ioctl.h>
 #include <errno.h>
 
@@ -60,12 +61,19 @@ int gralloc_wait_for_vsync(framebuffer_device_t *dev)
 		int crtc = 0;
 		gralloc_mali_vsync_report(MALI_VSYNC_EVENT_BEGIN_WAIT);
 
+		if (gralloc_vsync_wait_predicted())
+		{
+			gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
+			return 0;
+		}
+
 		if (ioctl(m->framebuffer->fd, FBIO_WAITFORVSYNC, &crtc) < 0)
 		{
 			gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
 			return -errno;
 		}
 
+		gralloc_vsync_sample_now();
 		gralloc_mali_vsync_report(MALI_VSYNC_EVENT_END_WAIT);
 	}
 
@@ -46,6 +46,8 @@ typedef enum
 #if GRALLOC_VERSION_MAJOR == 1
 extern hw_module_methods_t mali_gralloc_module_methods;
 
+class fb_flip_queue;
+
 typedef struct
 {
 	struct hw_module_t common;
@@ -73,6 +75,10 @@ struct private_module_t
 	float fps;
 	int swapInterval;
 	uint64_t fbdev_format;
+#if GRALLOC_VERSION_MAJOR == 1
+	/* Asynchronous page flips, NULL when posts are synchronous. */
+	fb_flip_queue *flipQueue;
+#endif
 
 #ifdef __cplusplus
 	/* Never intended to be used from C code */
@@ -111,6 +117,9 @@ struct private_module_t
 		ydpi = 0.0f;
 		fps = 0.0f;
 		swapInterval = 1;
+	#if GRALLOC_VERSION_MAJOR == 1
+		flipQueue = NULL;
+	#endif
 	}
 	#undef INIT_ZERO
 #endif /* For #ifdef __cplusplus */
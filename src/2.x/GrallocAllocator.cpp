@@ -21,6 +21,7 @@
 #include "hidl_common/Allocator.h"
 #include "allocator/mali_gralloc_ion.h"
 #include "fbdev/mali_gralloc_framebuffer.h"
+#include "core/mali_gralloc_debug.h"
 
 namespace arm
 {
@@ -46,7 +47,11 @@ GrallocAllocator::~GrallocAllocator()
 
 Return<void> GrallocAllocator::dumpDebugInfo(dumpDebugInfo_cb hidl_cb)
 {
-	hidl_cb(hidl_string());
+	android::String8 dump;
+	uint32_t dump_size = 0;
+
+	mali_gralloc_dump_buffers(dump, &dump_size);
+	hidl_cb(hidl_string(dump.string(), dump_size));
 	return Void();
 }
 
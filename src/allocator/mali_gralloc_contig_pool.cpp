@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <algorithm>
+
+#include "mali_gralloc_contig_pool.h"
+#include "core/mali_gralloc_debug.h"
+#include "mali_gralloc_log.h"
+
+/* A chunk is only handed over when it is at most this many times larger than the request. */
+#define CONTIG_POOL_MAX_FIT_RATIO 2
+
+contig_pool::contig_pool(const contig_pool_backend &_backend, const std::vector<size_t> &chunk_sizes)
+    : backend(_backend)
+    , stopping(false)
+    , missing(chunk_sizes)
+    , refill_pending(true)
+    , target_bytes(0)
+    , hits(0)
+    , misses(0)
+    , wasted_bytes(0)
+    , refill_failures(0)
+{
+	for (const size_t size : chunk_sizes)
+	{
+		target_bytes += size;
+	}
+}
+
+contig_pool::~contig_pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	refill_needed.notify_all();
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+
+	trim();
+}
+
+void contig_pool::start()
+{
+	thread = std::thread(&contig_pool::worker, this);
+}
+
+int contig_pool::take(const size_t size, size_t *chunk_size)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	/* Best fit: the smallest free chunk large enough. */
+	auto it = free_chunks.lower_bound(size);
+	if (it == free_chunks.end() || it->first / CONTIG_POOL_MAX_FIT_RATIO > size)
+	{
+		misses++;
+		if (!missing.empty())
+		{
+			refill_pending = true;
+		}
+		guard.unlock();
+		refill_needed.notify_one();
+		return -1;
+	}
+
+	const int fd = it->second;
+	*chunk_size = it->first;
+	missing.push_back(it->first);
+	free_chunks.erase(it);
+
+	hits++;
+	wasted_bytes += *chunk_size - size;
+	refill_pending = true;
+
+	guard.unlock();
+	refill_needed.notify_one();
+	return fd;
+}
+
+size_t contig_pool::refill()
+{
+	size_t allocated = 0;
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (refill_pending && !stopping && !missing.empty())
+	{
+		const size_t size = missing.back();
+		missing.pop_back();
+
+		/* Allocating can be slow: requests are served meanwhile. */
+		guard.unlock();
+		const int fd = backend.alloc(size);
+		guard.lock();
+
+		if (fd < 0)
+		{
+			MALI_GRALLOC_LOGW("Unable to refill the contiguous pool with a chunk of %zu bytes", size);
+			missing.push_back(size);
+			refill_failures++;
+			break;
+		}
+
+		if (!refill_pending || stopping)
+		{
+			/* Cancelled by trim() or destruction while allocating. */
+			missing.push_back(size);
+			guard.unlock();
+			backend.free(fd);
+			guard.lock();
+			break;
+		}
+
+		free_chunks.emplace(size, fd);
+		allocated++;
+	}
+
+	refill_pending = false;
+	return allocated;
+}
+
+size_t contig_pool::trim()
+{
+	std::multimap<size_t, int> released;
+	size_t bytes = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		released.swap(free_chunks);
+		for (const auto &chunk : released)
+		{
+			missing.push_back(chunk.first);
+			bytes += chunk.first;
+		}
+		refill_pending = false;
+	}
+
+	for (const auto &chunk : released)
+	{
+		backend.free(chunk.second);
+	}
+
+	return bytes;
+}
+
+void contig_pool::worker()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (!stopping)
+	{
+		refill_needed.wait(guard, [this] { return stopping || refill_pending; });
+		if (stopping)
+		{
+			break;
+		}
+
+		guard.unlock();
+		refill();
+		guard.lock();
+	}
+}
+
+void contig_pool::dump(android::String8 &buf)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	uint64_t free_bytes = 0;
+	size_t largest = 0;
+	for (const auto &chunk : free_chunks)
+	{
+		free_bytes += chunk.first;
+		largest = std::max(largest, chunk.first);
+	}
+
+	/*
+	 * Occupancy: share of the reserve currently available.
+	 * Fragmentation: share of the free memory outside of the largest chunk.
+	 */
+	const uint64_t occupancy = target_bytes ? free_bytes * 100 / target_bytes : 0;
+	const uint64_t fragmentation = free_bytes ? (free_bytes - largest) * 100 / free_bytes : 0;
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc contiguous pool----------------------------------\n");
+	mali_gralloc_dump_string(buf, " free %zu chunks, %" PRIu64 " of %" PRIu64 " KiB (%" PRIu64 "%%), largest %zu KiB, "
+	                              "fragmentation %" PRIu64 "%%\n",
+	                         free_chunks.size(), free_bytes / 1024, target_bytes / 1024, occupancy, largest / 1024,
+	                         fragmentation);
+	mali_gralloc_dump_string(buf, " hits %" PRIu64 " misses %" PRIu64 " wasted %" PRIu64 " KiB refill failures %" PRIu64
+	                              "\n",
+	                         hits, misses, wasted_bytes / 1024, refill_failures);
+}
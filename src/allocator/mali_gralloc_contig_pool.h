@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_CONTIG_POOL_H_
+#define MALI_GRALLOC_CONTIG_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <utils/String8.h>
+
+/*
+ * Memory provider of a contig_pool. Kept separate from ION so that the pool
+ * can be driven by a stand-in backend.
+ */
+struct contig_pool_backend
+{
+	/* Allocates a physically contiguous buffer. Returns its fd, or a negative value on failure. */
+	int (*alloc)(size_t size);
+	/* Releases a buffer returned by alloc(). */
+	void (*free)(int fd);
+};
+
+/*
+ * Reserve of pre-allocated, physically contiguous buffers.
+ *
+ * Allocating from CMA can take hundreds of milliseconds under memory pressure,
+ * because pages have to be migrated first. The pool keeps a configured set of
+ * chunks allocated ahead of time, so that contiguous requests are served
+ * without a kernel allocation: the smallest free chunk that fits is handed
+ * over, and a worker thread allocates its replacement in the background.
+ *
+ * A chunk is a whole dma-buf, which cannot be split: ownership of the chunk
+ * moves to the buffer taking it, and its memory goes back to the kernel once
+ * the buffer is released.
+ */
+class contig_pool
+{
+public:
+	/*
+	 * @param backend     [in]  Memory provider.
+	 * @param chunk_sizes [in]  Size of each chunk kept in the pool, in bytes.
+	 */
+	contig_pool(const contig_pool_backend &backend, const std::vector<size_t> &chunk_sizes);
+	~contig_pool();
+
+	contig_pool(const contig_pool &) = delete;
+	contig_pool &operator=(const contig_pool &) = delete;
+
+	/*
+	 * Starts the worker thread, which fills the pool in the background.
+	 */
+	void start();
+
+	/*
+	 * Takes the best fitting chunk for a request.
+	 *
+	 * @param size       [in]   Requested size in bytes.
+	 * @param chunk_size [out]  Size of the chunk returned.
+	 *
+	 * @return fd of the chunk, now owned by the caller, or -1 when no chunk fits.
+	 */
+	int take(size_t size, size_t *chunk_size);
+
+	/*
+	 * Allocates the missing chunks synchronously. Called by the worker thread.
+	 *
+	 * @return number of chunks allocated.
+	 */
+	size_t refill();
+
+	/*
+	 * Releases all free chunks. Refilling resumes with the next request.
+	 *
+	 * @return number of bytes released.
+	 */
+	size_t trim();
+
+	void dump(android::String8 &buf);
+
+private:
+	void worker();
+
+	const contig_pool_backend backend;
+
+	std::mutex lock;
+	std::condition_variable refill_needed;
+	std::thread thread;
+	bool stopping;
+
+	/* Free chunks, by size. */
+	std::multimap<size_t, int> free_chunks;
+	/* Chunk sizes to allocate to get back to the configured reserve. */
+	std::vector<size_t> missing;
+	/* Set by requests, cleared once refill() completes, fails or is cancelled by trim(). */
+	bool refill_pending;
+
+	uint64_t target_bytes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t wasted_bytes;
+	uint64_t refill_failures;
+};
+
+#endif /* MALI_GRALLOC_CONTIG_POOL_H_ */
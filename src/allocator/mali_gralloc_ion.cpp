@@ -16,7 +16,6 @@
  * limitations under the License.
  */
 
-#define ENABLE_DEBUG_LOG
 #include "../custom_log.h"
 
 #include <string.h>
@@ -33,7 +32,11 @@
 #include <ion/ion_4.12.h>
 #include <linux/dma-buf.h>
 #include <vector>
+#include <atomic>
+#include <algorithm>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <hardware/hardware.h>
 #include <hardware/gralloc1.h>
@@ -46,6 +49,12 @@
 #include "mali_gralloc_usages.h"
 #include "core/mali_gralloc_bufferdescriptor.h"
 #include "core/mali_gralloc_bufferallocation.h"
+#include "core/mali_gralloc_perf.h"
+#include "core/mali_gralloc_budget.h"
+#include "core/mali_gralloc_debug.h"
+#include "mali_gralloc_contig_pool.h"
+
+#include <cutils/properties.h>
 
 #define INIT_ZERO(obj) (memset(&(obj), 0, sizeof((obj))))
 
@@ -105,16 +114,26 @@ struct ion_device
 	 *
 	 * @param usage     [in]    Producer and consumer combined usage.
 	 * @param size      [in]    Requested buffer size (in bytes).
-	 * @param heap_type [in]    Requested heap type.
+	 * @param heap_type [in/out] Requested heap type, updated with the heap actually used.
 	 * @param flags     [in]    ION allocation attributes defined by ION_FLAG_*.
 	 * @param min_pgsz  [out]   Minimum page size (in bytes).
 	 *
 	 * @return File handle which can be used for allocation, on success
 	 *         -1, otherwise.
 	 */
-	int alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_type heap_type, unsigned int flags,
+	int alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_type *heap_type, unsigned int flags,
 	                        int *min_pgsz);
 
+	/*
+	 *  Allocates physically contiguous memory from the DMA heap, without
+	 *  falling back to any other heap.
+	 *
+	 * @param size      [in]    Requested buffer size (in bytes).
+	 *
+	 * @return File handle of the buffer on success, -1 otherwise.
+	 */
+	int alloc_contiguous(size_t size);
+
 	enum ion_heap_type pick_ion_heap(uint64_t usage);
 	bool check_buffers_sharable(const gralloc_buffer_descriptor_t *descriptors, uint32_t numDescriptors);
 
@@ -179,7 +198,239 @@ static void set_ion_flags(enum ion_heap_type heap_type, uint64_t usage,
 	}
 }
 
-int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_type heap_type, unsigned int flags,
+/* Budget accounting category of an ION heap type. */
+static mali_gralloc_budget_heap budget_heap(const enum ion_heap_type heap_type)
+{
+	if (heap_type == ION_HEAP_TYPE_SECURE)
+	{
+		return MALI_GRALLOC_BUDGET_HEAP_SECURE;
+	}
+	if (heap_type == ION_HEAP_TYPE_DMA)
+	{
+		return MALI_GRALLOC_BUDGET_HEAP_DMA;
+	}
+#if defined(GRALLOC_USE_ION_COMPOUND_PAGE_HEAP) && GRALLOC_USE_ION_COMPOUND_PAGE_HEAP
+	if (heap_type == ION_HEAP_TYPE_COMPOUND_PAGE)
+	{
+		return MALI_GRALLOC_BUDGET_HEAP_COMPOUND;
+	}
+#endif
+	return MALI_GRALLOC_BUDGET_HEAP_SYSTEM;
+}
+
+/*
+ * Reserve of contiguous buffers for RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER, configured
+ * with vendor.gralloc.contig_pool_kb as a comma separated list of chunk sizes in KiB.
+ */
+static contig_pool *contig_reserve = NULL;
+static pthread_once_t contig_reserve_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Heap failure backoff.
+ *
+ * When a heap other than the system heap fails an allocation, further
+ * allocations of the same size class skip it for a while and go straight to
+ * the system heap, instead of paying for another doomed ioctl. The backoff
+ * doubles on each consecutive failure, and is cleared by a success or by
+ * mali_gralloc_ion_reset_heap_backoff().
+ *
+ * Requests for physically contiguous memory are never skipped: the system heap
+ * only gives them scattered pages, so they always retry the contiguous heap.
+ *
+ * Size classes are powers of two, from 64KiB (and below) upwards.
+ */
+#define BACKOFF_HEAPS 16
+#define BACKOFF_SIZE_CLASSES 12
+#define BACKOFF_MIN_SIZE_SHIFT 16
+#define BACKOFF_MIN_NS 16000000ULL      /* 16ms */
+#define BACKOFF_MAX_SHIFT 6             /* ~1s */
+
+struct heap_backoff
+{
+	std::atomic<uint32_t> failures;
+	std::atomic<uint64_t> retry_after_ns;
+};
+
+static heap_backoff heap_backoffs[BACKOFF_HEAPS][BACKOFF_SIZE_CLASSES];
+static std::atomic<uint64_t> heap_backoff_avoided[BACKOFF_HEAPS];
+static std::atomic<uint64_t> heap_backoff_failed[BACKOFF_HEAPS];
+
+static heap_backoff *get_heap_backoff(const enum ion_heap_type heap_type, const size_t size)
+{
+	/* The system heap is the last resort and the secure heap has no fallback: never skip them. */
+	if (heap_type == ION_HEAP_TYPE_SYSTEM || heap_type == ION_HEAP_TYPE_SECURE || (unsigned int)heap_type >= BACKOFF_HEAPS)
+	{
+		return NULL;
+	}
+
+	const size_t units = size >> BACKOFF_MIN_SIZE_SHIFT;
+	const int size_class = (units == 0) ? 0 : std::min(64 - __builtin_clzll(units), BACKOFF_SIZE_CLASSES - 1);
+	return &heap_backoffs[heap_type][size_class];
+}
+
+/*
+ * @return true when the heap failed recently for this size class and should be skipped.
+ */
+static bool heap_backoff_skip(const enum ion_heap_type heap_type, const size_t size)
+{
+	heap_backoff * const backoff = get_heap_backoff(heap_type, size);
+	if (backoff == NULL || backoff->failures.load(std::memory_order_relaxed) == 0 ||
+	    mali_gralloc_perf_now() >= backoff->retry_after_ns.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+
+	heap_backoff_avoided[heap_type].fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+static void heap_backoff_update(const enum ion_heap_type heap_type, const size_t size, const bool success)
+{
+	heap_backoff * const backoff = get_heap_backoff(heap_type, size);
+	if (backoff == NULL)
+	{
+		return;
+	}
+
+	if (success)
+	{
+		backoff->failures.store(0, std::memory_order_relaxed);
+		return;
+	}
+
+	const uint32_t failures = backoff->failures.fetch_add(1, std::memory_order_relaxed);
+	const uint64_t delay = BACKOFF_MIN_NS << std::min<uint32_t>(failures, BACKOFF_MAX_SHIFT);
+	backoff->retry_after_ns.store(mali_gralloc_perf_now() + delay, std::memory_order_relaxed);
+	heap_backoff_failed[heap_type].fetch_add(1, std::memory_order_relaxed);
+}
+
+void mali_gralloc_ion_reset_heap_backoff(void)
+{
+	for (auto &heap : heap_backoffs)
+	{
+		for (auto &backoff : heap)
+		{
+			backoff.failures.store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+/*
+ * Prefault of CPU mappings.
+ *
+ * Mappings are never populated when a buffer is imported, as most importers
+ * never touch the buffer with the CPU. Instead, the first lock of a mapping
+ * with CPU usage populates the region being locked, so that the first CPU
+ * pass over it does not take a page fault per page.
+ * vendor.gralloc.prefault=0 disables prefaulting altogether.
+ */
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+static pthread_once_t prefault_once = PTHREAD_ONCE_INIT;
+static bool prefault_enabled;
+/* Whether the kernel supports MADV_POPULATE_(READ|WRITE), since 5.14. Written once by prefault_init(). */
+static bool madv_populate_supported;
+static std::atomic<uint64_t> prefault_region_bytes;
+/* Regions only hinted with MADV_WILLNEED, because they could not be populated. */
+static std::atomic<uint64_t> prefault_hinted_bytes;
+
+static void prefault_init(void)
+{
+	prefault_enabled = property_get_int32("vendor.gralloc.prefault", 1) != 0;
+
+	/*
+	 * Probe the kernel on an anonymous page: EINVAL there means that the
+	 * advice is unknown, whereas EINVAL on a buffer mapping only means that
+	 * this mapping cannot be populated, e.g. VM_PFNMAP carveout buffers.
+	 */
+	const size_t page_size = getpagesize();
+	void *probe = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (probe != MAP_FAILED)
+	{
+		madv_populate_supported = madvise(probe, page_size, MADV_POPULATE_READ) == 0;
+		munmap(probe, page_size);
+	}
+}
+
+void mali_gralloc_ion_prefault(const private_handle_t *hnd, const size_t offset, const size_t size, const bool write)
+{
+	pthread_once(&prefault_once, prefault_init);
+
+	const uint64_t usage = hnd->producer_usage | hnd->consumer_usage;
+	if (!prefault_enabled || size == 0 || hnd->base == MAP_FAILED || hnd->base == NULL ||
+	    !(usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK)))
+	{
+		return;
+	}
+
+	/* Page align the region, clamped to the mapping. */
+	const uintptr_t page_size = getpagesize();
+	const uintptr_t map_start = uintptr_t(hnd->base) - hnd->offset;
+	const uintptr_t map_end = map_start + hnd->size;
+	const uintptr_t start = std::max(map_start, (uintptr_t(hnd->base) + offset) & ~(page_size - 1));
+	const uintptr_t end = std::min(map_end, (uintptr_t(hnd->base) + offset + size + page_size - 1) & ~(page_size - 1));
+	if (start >= end)
+	{
+		return;
+	}
+
+	if (madv_populate_supported)
+	{
+		if (madvise((void *)start, end - start, write ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0)
+		{
+			prefault_region_bytes.fetch_add(end - start, std::memory_order_relaxed);
+			return;
+		}
+
+		if (errno != EINVAL)
+		{
+			MALI_GRALLOC_LOGW("Unable to populate %zu bytes of buffer %p: %s", size_t(end - start), hnd,
+			                  strerror(errno));
+			return;
+		}
+	}
+
+	/* Only a hint: read-ahead of the pages, without mapping them. */
+	if (madvise((void *)start, end - start, MADV_WILLNEED) == 0)
+	{
+		prefault_hinted_bytes.fetch_add(end - start, std::memory_order_relaxed);
+	}
+}
+
+void mali_gralloc_ion_dump(android::String8 &buf)
+{
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc ION heap backoff---------------------------------\n");
+	mali_gralloc_dump_string(buf, " %-10s %12s %12s\n", "heap type", "failures", "avoided");
+
+	for (int heap = 0; heap < BACKOFF_HEAPS; heap++)
+	{
+		const uint64_t failed = heap_backoff_failed[heap].load(std::memory_order_relaxed);
+		const uint64_t avoided = heap_backoff_avoided[heap].load(std::memory_order_relaxed);
+
+		if (failed != 0 || avoided != 0)
+		{
+			mali_gralloc_dump_string(buf, " %-10d %12" PRIu64 " %12" PRIu64 "\n", heap, failed, avoided);
+		}
+	}
+
+	if (contig_reserve != NULL)
+	{
+		contig_reserve->dump(buf);
+	}
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc CPU mapping prefault-----------------------------\n");
+	mali_gralloc_dump_string(buf, " populated %" PRIu64 " KiB, hinted %" PRIu64 " KiB%s\n",
+	                         prefault_region_bytes.load(std::memory_order_relaxed) / 1024,
+	                         prefault_hinted_bytes.load(std::memory_order_relaxed) / 1024,
+	                         madv_populate_supported ? "" : " (no MADV_POPULATE)");
+}
+
+int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_type *p_heap_type, unsigned int flags,
                                     int *min_pgsz)
 {
 	int shared_fd = -1;
@@ -187,19 +438,45 @@ int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_t
 
 	if (ion_client < 0 ||
 	    size <= 0 ||
-	    heap_type == ION_HEAP_TYPE_INVALID ||
+	    p_heap_type == NULL ||
+	    *p_heap_type == ION_HEAP_TYPE_INVALID ||
 	    min_pgsz == NULL)
 	{
 		return -1;
 	}
 
+	enum ion_heap_type heap_type = *p_heap_type;
 	bool system_heap_exist = false;
+	bool attempted = false;
+	const uint64_t alloc_start = mali_gralloc_perf_now();
 
 	if (use_legacy_ion == false)
+	{
+		for (int i = 0; i < heap_cnt; i++)
+		{
+			if (heap_info[i].type == ION_HEAP_TYPE_SYSTEM)
+			{
+				system_heap_exist = true;
+			}
+		}
+	}
+
+	if (!mali_gralloc_budget_heap_allows(budget_heap(heap_type), size))
+	{
+		MALI_GRALLOC_LOGW("Allocation of %zu bytes exceeds the budget of heap type %d", size, heap_type);
+		mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_BUDGET, usage, size);
+	}
+	else if (!(usage & RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER) && heap_backoff_skip(heap_type, size))
+	{
+		MALI_GRALLOC_LOGV("Skipping heap type %d for %zu bytes after recent failures", heap_type, size);
+	}
+	else if (use_legacy_ion == false)
 	{
 		int i = 0;
 		bool is_heap_matched = false;
 
+		attempted = true;
+
 		/* Attempt to allocate memory from each matching heap type (of
 		 * enumerated heaps) until successful
 		 */
@@ -213,11 +490,6 @@ int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_t
 				                   flags, &shared_fd);
 			}
 
-			if (heap_info[i].type == ION_HEAP_TYPE_SYSTEM)
-			{
-				system_heap_exist = true;
-			}
-
 			i++;
 		} while ((ret < 0) && (i < heap_cnt));
 
@@ -234,9 +506,15 @@ int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_t
 		 */
 		unsigned int heap_mask = HEAP_MASK_FROM_TYPE(heap_type);
 
+		attempted = true;
 		ret = ion_alloc_fd(ion_client, size, 0, heap_mask, flags, &shared_fd);
 	}
 
+	if (attempted)
+	{
+		heap_backoff_update(heap_type, size, ret >= 0);
+	}
+
 	/* Check if allocation from selected heap failed and fall back to system
 	 * heap if possible.
 	 */
@@ -258,6 +536,14 @@ int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_t
 		}
 
 		heap_type = ION_HEAP_TYPE_SYSTEM;
+		mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_HEAP_FALLBACK, usage, size);
+
+		if (!mali_gralloc_budget_heap_allows(MALI_GRALLOC_BUDGET_HEAP_SYSTEM, size))
+		{
+			MALI_GRALLOC_LOGW("Fallback allocation of %zu bytes exceeds the system heap budget", size);
+			mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_BUDGET, usage, size);
+			return -1;
+		}
 
 		/* Set ION flags for system heap allocation */
 		set_ion_flags(heap_type, usage, NULL, &flags);
@@ -302,6 +588,10 @@ int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_t
 		}
 	}
 
+	mali_gralloc_perf_record(MALI_GRALLOC_STAGE_ION_ALLOC, usage, alloc_start);
+	mali_gralloc_perf_record_heap(heap_type, alloc_start);
+	*p_heap_type = heap_type;
+
 	switch (heap_type)
 	{
 	case ION_HEAP_TYPE_SYSTEM:
@@ -332,6 +622,82 @@ int ion_device::alloc_from_ion_heap(uint64_t usage, size_t size, enum ion_heap_t
 	return shared_fd;
 }
 
+int ion_device::alloc_contiguous(size_t size)
+{
+	int shared_fd = -1;
+	int ret = -1;
+
+	if (ion_client < 0 || size == 0)
+	{
+		return -1;
+	}
+
+	if (use_legacy_ion == false)
+	{
+		for (int i = 0; i < heap_cnt && ret < 0; i++)
+		{
+			if (heap_info[i].type == ION_HEAP_TYPE_DMA)
+			{
+				ret = ion_alloc_fd(ion_client, size, 0, HEAP_MASK_FROM_ID(heap_info[i].heap_id), 0, &shared_fd);
+			}
+		}
+	}
+	else
+	{
+		ret = ion_alloc_fd(ion_client, size, 0, HEAP_MASK_FROM_TYPE(ION_HEAP_TYPE_DMA), 0, &shared_fd);
+	}
+
+	return (ret < 0) ? -1 : shared_fd;
+}
+
+static int contig_reserve_alloc(size_t size)
+{
+	ion_device *dev = ion_device::get();
+	return dev ? dev->alloc_contiguous(size) : -1;
+}
+
+static void contig_reserve_free(int fd)
+{
+	close(fd);
+}
+
+static size_t contig_reserve_trim(void)
+{
+	return contig_reserve->trim();
+}
+
+static void contig_reserve_init(void)
+{
+	char value[PROPERTY_VALUE_MAX];
+	std::vector<size_t> chunk_sizes;
+
+	if (property_get("vendor.gralloc.contig_pool_kb", value, "") <= 0)
+	{
+		return;
+	}
+
+	char *saveptr = NULL;
+	for (char *token = strtok_r(value, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr))
+	{
+		const unsigned long kb = strtoul(token, NULL, 0);
+		if (kb > 0)
+		{
+			chunk_sizes.push_back((size_t)kb * 1024);
+		}
+	}
+
+	if (chunk_sizes.empty())
+	{
+		MALI_GRALLOC_LOGW("Ignoring invalid contiguous pool configuration '%s'", value);
+		return;
+	}
+
+	static const contig_pool_backend backend = { contig_reserve_alloc, contig_reserve_free };
+	contig_reserve = new contig_pool(backend, chunk_sizes);
+	contig_reserve->start();
+	mali_gralloc_budget_register_trim(contig_reserve_trim);
+}
+
 enum ion_heap_type ion_device::pick_ion_heap(uint64_t usage)
 {
 	enum ion_heap_type heap_type = ION_HEAP_TYPE_INVALID;
@@ -732,6 +1098,8 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 		return -1;
 	}
 
+	pthread_once(&contig_reserve_once, contig_reserve_init);
+
 	*shared_backend = dev->check_buffers_sharable(descriptors, numDescriptors);
 
 	if (*shared_backend)
@@ -749,16 +1117,19 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 			return -1;
 		}
 
-		set_ion_flags(heap_type, usage, &priv_heap_flag, &ion_flags);
+		set_ion_flags(heap_type, usage, NULL, &ion_flags);
 
-		shared_fd = dev->alloc_from_ion_heap(usage, max_bufDescriptor->size, heap_type, ion_flags, &min_pgsz);
+		shared_fd = dev->alloc_from_ion_heap(usage, max_bufDescriptor->size, &heap_type, ion_flags, &min_pgsz);
 
 		if (shared_fd < 0)
 		{
 			MALI_GRALLOC_LOGE("ion_alloc failed form client: ( %d )", dev->client());
-			return -1;
+			return -ENOMEM;
 		}
 
+		/* The handle flags describe the heap used, which differs from the requested one after a fallback. */
+		set_ion_flags(heap_type, usage, &priv_heap_flag, NULL);
+
 		for (i = 0; i < numDescriptors; i++)
 		{
 			buffer_descriptor_t *bufDescriptor = (buffer_descriptor_t *)(descriptors[i]);
@@ -835,9 +1206,23 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 				return -1;
 			}
 
-			set_ion_flags(heap_type, usage, &priv_heap_flag, &ion_flags);
+			ion_flags = 0;
+			set_ion_flags(heap_type, usage, NULL, &ion_flags);
+
+			/* Contiguous buffers are taken from the reserve when possible, to avoid waiting for CMA. */
+			shared_fd = -1;
+			size_t backing_store_size = bufDescriptor->size;
+			if (contig_reserve != NULL && heap_type == ION_HEAP_TYPE_DMA &&
+			    (usage & RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER))
+			{
+				shared_fd = contig_reserve->take(bufDescriptor->size, &backing_store_size);
+			}
 
-			shared_fd = dev->alloc_from_ion_heap(usage, bufDescriptor->size, heap_type, ion_flags, &min_pgsz);
+			if (shared_fd < 0)
+			{
+				backing_store_size = bufDescriptor->size;
+				shared_fd = dev->alloc_from_ion_heap(usage, bufDescriptor->size, &heap_type, ion_flags, &min_pgsz);
+			}
 
 			if (shared_fd < 0)
 			{
@@ -846,16 +1231,20 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 				/* need to free already allocated memory. not just this one */
 				mali_gralloc_ion_free_internal(pHandle, numDescriptors);
 
-				return -1;
+				return -ENOMEM;
 			}
 
+			/* The handle flags describe the heap used, which differs from the requested one after a fallback. */
+			priv_heap_flag = 0;
+			set_ion_flags(heap_type, usage, &priv_heap_flag, NULL);
+
 			private_handle_t *hnd = make_private_handle(
 			    private_handle_t::PRIV_FLAGS_USES_ION | priv_heap_flag, bufDescriptor->size,
 			    bufDescriptor->consumer_usage, bufDescriptor->producer_usage, shared_fd, bufDescriptor->hal_format,
 			    bufDescriptor->old_internal_format, bufDescriptor->alloc_format,
 			    bufDescriptor->width, bufDescriptor->height, bufDescriptor->pixel_stride,
 			    bufDescriptor->old_alloc_width, bufDescriptor->old_alloc_height, bufDescriptor->old_byte_stride,
-			    bufDescriptor->size, bufDescriptor->layer_count, bufDescriptor->plane_info);
+			    backing_store_size, bufDescriptor->layer_count, bufDescriptor->plane_info);
 
 			if (NULL == hnd)
 			{
@@ -892,8 +1281,10 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 
 		if (!(usage & GRALLOC_USAGE_PROTECTED))
 		{
+			uint64_t stage_start = mali_gralloc_perf_now();
 			cpu_ptr =
 			    (unsigned char *)mmap(NULL, bufDescriptor->size, PROT_READ | PROT_WRITE, MAP_SHARED, hnd->share_fd, 0);
+			mali_gralloc_perf_record(MALI_GRALLOC_STAGE_MMAP, usage, stage_start);
 
 			if (MAP_FAILED == cpu_ptr)
 			{
@@ -905,6 +1296,7 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 #if defined(GRALLOC_INIT_AFBC) && (GRALLOC_INIT_AFBC == 1)
 			if ((bufDescriptor->alloc_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK) && (!(*shared_backend)))
 			{
+				stage_start = mali_gralloc_perf_now();
 				mali_gralloc_ion_sync_start(hnd, true, true);
 
 				/* For separated plane YUV, there is a header to initialise per plane. */
@@ -936,6 +1328,7 @@ int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
 				}
 
 				mali_gralloc_ion_sync_end(hnd, true, true);
+				mali_gralloc_perf_record(MALI_GRALLOC_STAGE_INIT_AFBC, usage, stage_start);
 			}
 #endif
 			hnd->base = cpu_ptr;
@@ -965,6 +1358,7 @@ int mali_gralloc_ion_map(private_handle_t *hnd)
 		}
 
 		hnd->base = (void *)(uintptr_t(mappedAddress) + hnd->offset);
+		hnd->flags &= ~private_handle_t::PRIV_FLAGS_PREFAULTED;
 		retval = 0;
 		break;
 	}
@@ -987,6 +1381,7 @@ void mali_gralloc_ion_unmap(private_handle_t *hnd)
 		else
 		{
 			hnd->base = 0;
+			hnd->flags &= ~private_handle_t::PRIV_FLAGS_PREFAULTED;
 			hnd->cpu_read = 0;
 			hnd->cpu_write = 0;
 		}
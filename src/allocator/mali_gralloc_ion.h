@@ -19,6 +19,8 @@
 #ifndef MALI_GRALLOC_ION_H_
 #define MALI_GRALLOC_ION_H_
 
+#include <utils/String8.h>
+
 #include "core/mali_gralloc_bufferdescriptor.h"
 
 int mali_gralloc_ion_allocate(const gralloc_buffer_descriptor_t *descriptors,
@@ -30,6 +32,27 @@ int mali_gralloc_ion_sync_end(const private_handle_t * const hnd,
                               const bool read, const bool write);
 int mali_gralloc_ion_map(private_handle_t *hnd);
 void mali_gralloc_ion_unmap(private_handle_t *hnd);
+
+/*
+ * Prefaults part of the CPU mapping of a buffer about to be accessed.
+ * Only done for buffers with CPU usage.
+ *
+ * @param hnd    [in]  Mapped buffer.
+ * @param offset [in]  Offset of the region from the buffer base, in bytes.
+ * @param size   [in]  Size of the region in bytes.
+ * @param write  [in]  Whether the CPU will write the region.
+ */
+void mali_gralloc_ion_prefault(const private_handle_t *hnd, size_t offset, size_t size, bool write);
 void mali_gralloc_ion_close(void);
 
+/*
+ * Forgets recent heap failures, so that the next allocations try the preferred heaps again.
+ */
+void mali_gralloc_ion_reset_heap_backoff(void);
+
+/*
+ * Appends heap failure and backoff counters to a dump.
+ */
+void mali_gralloc_ion_dump(android::String8 &buf);
+
 #endif /* MALI_GRALLOC_ION_H_ */
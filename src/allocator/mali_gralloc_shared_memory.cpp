@@ -20,6 +20,7 @@
 #define GRALLOC_USE_MEMFD ((PLATFORM_SDK_VERSION > 29) || (GRALLOC_VERSION_MAJOR > 3))
 
 #if GRALLOC_USE_MEMFD
+#include <fcntl.h>
 #include <sys/syscall.h>
 #include <linux/memfd.h>
 #else
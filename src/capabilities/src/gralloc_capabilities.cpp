@@ -25,10 +25,10 @@
 #include <pthread.h>
 
 #include "core/format_info.h"
+#include "gralloc_capabilities_cache.h"
 
-/* Writing to runtime_caps_read is guarded by mutex caps_init_mutex. */
-static pthread_mutex_t caps_init_mutex = PTHREAD_MUTEX_INITIALIZER;
-static bool runtime_caps_read = false;
+/* Capabilities are written once, by init_ip_capabilities(), and only read afterwards. */
+static pthread_once_t caps_once = PTHREAD_ONCE_INIT;
 
 mali_gralloc_format_caps cpu_runtime_caps;
 mali_gralloc_format_caps dpu_runtime_caps;
@@ -42,11 +42,13 @@ mali_gralloc_format_caps cam_runtime_caps;
 #define MALI_GRALLOC_DPU_LIB_NAME "hwcomposer.drm.so"
 #define MALI_GRALLOC_DPU_AEU_LIB_NAME "dpu_aeu_fake_caps.so"
 
+#ifndef MALI_GRALLOC_VPU_LIBRARY_PATH
 #if defined(MALI_GRALLOC_VENDOR_VPU) && (MALI_GRALLOC_VENDOR_VPU == 1)
 #define MALI_GRALLOC_VPU_LIBRARY_PATH "/vendor/lib/"
 #else
 #define MALI_GRALLOC_VPU_LIBRARY_PATH "/system/lib/"
 #endif
+#endif
 
 static bool get_block_capabilities(const char *name, mali_gralloc_format_caps *block_caps)
 {
@@ -85,20 +87,8 @@ static bool get_block_capabilities(const char *name, mali_gralloc_format_caps *b
 	return rval;
 }
 
-void get_ip_capabilities(void)
+static void probe_ip_capabilities(void)
 {
-	/* Ensure capability setting is not interrupted by other
-	 * allocations during start-up.
-	 */
-	pthread_mutex_lock(&caps_init_mutex);
-
-	if (runtime_caps_read)
-	{
-		goto already_init;
-	}
-
-	sanitize_formats();
-
 	memset((void *)&cpu_runtime_caps, 0, sizeof(cpu_runtime_caps));
 	memset((void *)&dpu_runtime_caps, 0, sizeof(dpu_runtime_caps));
 	memset((void *)&dpu_aeu_runtime_caps, 0, sizeof(dpu_aeu_runtime_caps));
@@ -230,11 +220,49 @@ void get_ip_capabilities(void)
 #if defined(GRALLOC_CAMERA_WRITE_RAW16) && GRALLOC_CAMERA_WRITE_RAW16
 		cam_runtime_caps.caps_mask |= MALI_GRALLOC_FORMAT_CAPABILITY_OPTIONS_PRESENT;
 #endif
+}
 
-	runtime_caps_read = true;
+static void init_ip_capabilities(void)
+{
+	/* All libraries probe_ip_capabilities() may read. */
+	static const char *const libs[] = {
+		MALI_GRALLOC_DPU_LIBRARY_PATH MALI_GRALLOC_DPU_LIB_NAME,
+		MALI_GRALLOC_DPU_AEU_LIBRARY_PATH MALI_GRALLOC_DPU_AEU_LIB_NAME,
+		MALI_GRALLOC_GPU_LIBRARY_PATH1 MALI_GRALLOC_GPU_LIB_NAME,
+		MALI_GRALLOC_GPU_LIBRARY_PATH2 MALI_GRALLOC_GPU_LIB_NAME,
+		MALI_GRALLOC_VPU_LIBRARY_PATH MALI_GRALLOC_VPU_LIB_NAME,
+	};
+	mali_gralloc_format_caps *const runtime_caps[] = {
+		&cpu_runtime_caps,
+		&dpu_runtime_caps,
+		&dpu_aeu_runtime_caps,
+		&vpu_runtime_caps,
+		&gpu_runtime_caps,
+		&cam_runtime_caps,
+	};
+	const size_t num_libs = sizeof(libs) / sizeof(libs[0]);
+	const size_t num_caps = sizeof(runtime_caps) / sizeof(runtime_caps[0]);
+	mali_gralloc_format_caps caps[num_caps];
 
-already_init:
-	pthread_mutex_unlock(&caps_init_mutex);
+	sanitize_formats();
+
+	if (caps_cache_load(libs, num_libs, caps, num_caps))
+	{
+		for (size_t i = 0; i < num_caps; i++)
+		{
+			*runtime_caps[i] = caps[i];
+		}
+	}
+	else
+	{
+		probe_ip_capabilities();
+
+		for (size_t i = 0; i < num_caps; i++)
+		{
+			caps[i] = *runtime_caps[i];
+		}
+		caps_cache_store(libs, num_libs, caps, num_caps);
+	}
 
 	MALI_GRALLOC_LOGV("GPU format capabilities 0x%" PRIx64, gpu_runtime_caps.caps_mask);
 	MALI_GRALLOC_LOGV("DPU format capabilities 0x%" PRIx64, dpu_runtime_caps.caps_mask);
@@ -242,6 +270,12 @@ already_init:
 	MALI_GRALLOC_LOGV("CAM format capabilities 0x%" PRIx64, cam_runtime_caps.caps_mask);
 }
 
+void get_ip_capabilities(void)
+{
+	/* Lock-free once initialized: allocations during start-up wait for the first caller. */
+	pthread_once(&caps_once, init_ip_capabilities);
+}
+
 
 /* This is used by the unit tests to get the capabilities for each IP. */
 extern "C" {
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gralloc_capabilities_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include "mali_gralloc_log.h"
+
+#ifndef MALI_GRALLOC_CAPS_CACHE_DIR
+#define MALI_GRALLOC_CAPS_CACHE_DIR "/data/vendor/gralloc/"
+#endif
+
+/* 32 and 64-bit processes probe different libraries: each has its own cache. */
+#if defined(__LP64__)
+#define CAPS_CACHE_PATH MALI_GRALLOC_CAPS_CACHE_DIR "ip_caps64.bin"
+#else
+#define CAPS_CACHE_PATH MALI_GRALLOC_CAPS_CACHE_DIR "ip_caps32.bin"
+#endif
+
+#define CAPS_CACHE_MAGIC 0x50414347 /* "GCAP" */
+#define CAPS_CACHE_VERSION 1
+#define CAPS_CACHE_BOOT_ID_SIZE 40
+#define CAPS_CACHE_PATH_SIZE 128
+
+/*
+ * File layout: header, followed by 'num_libs' library entries, followed by
+ * 'num_caps' capabilities.
+ */
+struct caps_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t caps_size;
+	uint32_t num_libs;
+	uint32_t num_caps;
+	/* Keeps the entries that follow 8-byte aligned. */
+	uint32_t reserved;
+	char boot_id[CAPS_CACHE_BOOT_ID_SIZE];
+};
+
+struct caps_cache_lib
+{
+	char path[CAPS_CACHE_PATH_SIZE];
+	/* The library did not exist: its capabilities are the built-in defaults. */
+	uint32_t missing;
+	int64_t size;
+	int64_t mtime_ns;
+};
+
+static size_t caps_cache_size(const size_t num_libs, const size_t num_caps)
+{
+	return sizeof(caps_cache_header) + num_libs * sizeof(caps_cache_lib) + num_caps * sizeof(mali_gralloc_format_caps);
+}
+
+static void read_boot_id(char boot_id[CAPS_CACHE_BOOT_ID_SIZE])
+{
+	memset(boot_id, 0, CAPS_CACHE_BOOT_ID_SIZE);
+
+	const int fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return;
+	}
+
+	const ssize_t len = read(fd, boot_id, CAPS_CACHE_BOOT_ID_SIZE - 1);
+	if (len < 0)
+	{
+		boot_id[0] = '\0';
+	}
+	close(fd);
+}
+
+static bool describe_lib(const char *path, caps_cache_lib *lib)
+{
+	if (strlen(path) >= sizeof(lib->path))
+	{
+		return false;
+	}
+
+	memset(lib, 0, sizeof(*lib));
+	strcpy(lib->path, path);
+
+	struct stat st;
+	if (stat(path, &st) != 0)
+	{
+		lib->missing = 1;
+		return true;
+	}
+
+	lib->size = st.st_size;
+	lib->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	return true;
+}
+
+bool caps_cache_load(const char *const libs[], const size_t num_libs, mali_gralloc_format_caps caps[],
+                     const size_t num_caps)
+{
+	const int fd = open(CAPS_CACHE_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	const size_t size = caps_cache_size(num_libs, num_caps);
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size != size)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		return false;
+	}
+
+	const caps_cache_header *header = static_cast<const caps_cache_header *>(map);
+	const caps_cache_lib *cached_libs = reinterpret_cast<const caps_cache_lib *>(header + 1);
+	const mali_gralloc_format_caps *cached_caps = reinterpret_cast<const mali_gralloc_format_caps *>(cached_libs + num_libs);
+
+	char boot_id[CAPS_CACHE_BOOT_ID_SIZE];
+	read_boot_id(boot_id);
+
+	bool valid = header->magic == CAPS_CACHE_MAGIC && header->version == CAPS_CACHE_VERSION &&
+	             header->caps_size == sizeof(mali_gralloc_format_caps) && header->num_libs == num_libs &&
+	             header->num_caps == num_caps && memcmp(header->boot_id, boot_id, sizeof(boot_id)) == 0;
+
+	for (size_t i = 0; valid && i < num_libs; i++)
+	{
+		caps_cache_lib lib;
+		valid = describe_lib(libs[i], &lib) && memcmp(&lib, &cached_libs[i], sizeof(lib)) == 0;
+	}
+
+	if (valid)
+	{
+		memcpy(caps, cached_caps, num_caps * sizeof(mali_gralloc_format_caps));
+	}
+	else
+	{
+		MALI_GRALLOC_LOGV("Stale capabilities cache %s", CAPS_CACHE_PATH);
+	}
+
+	munmap(map, size);
+	return valid;
+}
+
+void caps_cache_store(const char *const libs[], const size_t num_libs, const mali_gralloc_format_caps caps[],
+                      const size_t num_caps)
+{
+	std::vector<uint8_t> data(caps_cache_size(num_libs, num_caps));
+
+	caps_cache_header *header = reinterpret_cast<caps_cache_header *>(data.data());
+	caps_cache_lib *cached_libs = reinterpret_cast<caps_cache_lib *>(header + 1);
+	mali_gralloc_format_caps *cached_caps = reinterpret_cast<mali_gralloc_format_caps *>(cached_libs + num_libs);
+
+	header->magic = CAPS_CACHE_MAGIC;
+	header->version = CAPS_CACHE_VERSION;
+	header->caps_size = sizeof(mali_gralloc_format_caps);
+	header->num_libs = num_libs;
+	header->num_caps = num_caps;
+	read_boot_id(header->boot_id);
+
+	for (size_t i = 0; i < num_libs; i++)
+	{
+		if (!describe_lib(libs[i], &cached_libs[i]))
+		{
+			return;
+		}
+	}
+	memcpy(cached_caps, caps, num_caps * sizeof(mali_gralloc_format_caps));
+
+	/* Readers never see a partial file: write a private copy and rename it over the cache. */
+	char tmp_path[sizeof(CAPS_CACHE_PATH) + 16];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", CAPS_CACHE_PATH, getpid());
+
+	const int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		/* Most processes may not write the cache. */
+		return;
+	}
+
+	const bool written = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+	close(fd);
+
+	if (!written || rename(tmp_path, CAPS_CACHE_PATH) != 0)
+	{
+		MALI_GRALLOC_LOGW("Unable to store the capabilities cache %s: %s", CAPS_CACHE_PATH, strerror(errno));
+		unlink(tmp_path);
+	}
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "mali_gralloc_formats.h"
+
+/*
+ * Persistent cache of the IP capabilities.
+ *
+ * Reading the capabilities dlopen()s the user-space driver of each IP, which
+ * costs every process tens of milliseconds on its first allocation or format
+ * query. The first process allowed to write the cache file (the allocator
+ * service) stores the resolved capabilities; other processes map the file and
+ * copy them instead of probing.
+ *
+ * The cache is keyed by the boot, and by the path, size and modification time
+ * of every library probed, so that it is rebuilt once per boot and whenever a
+ * driver is updated. Processes unable to read or write the file probe as before.
+ */
+
+/*
+ * Reads the capabilities from the cache.
+ *
+ * @param libs      [in]   Paths of the libraries the capabilities are read from.
+ * @param num_libs  [in]   Number of entries in 'libs'.
+ * @param caps      [out]  Capabilities, in the order they were stored.
+ * @param num_caps  [in]   Number of entries in 'caps'.
+ *
+ * @return true when a valid cache was found and 'caps' filled in, false otherwise.
+ */
+bool caps_cache_load(const char *const libs[], size_t num_libs, mali_gralloc_format_caps caps[], size_t num_caps);
+
+/*
+ * Stores the capabilities in the cache, replacing it atomically. Failures are ignored.
+ */
+void caps_cache_store(const char *const libs[], size_t num_libs, const mali_gralloc_format_caps caps[],
+                      size_t num_caps);
@@ -30,7 +30,7 @@
  * NOTE: This table should only be used within
  * the gralloc library and not by clients directly.
  */
-const format_info_t formats[] = {
+constexpr format_info_t formats[] = {
 	{
 		.id = MALI_GRALLOC_FORMAT_INTERNAL_RGB_565,
 		.npln = 1, .ncmp = { 3, 0, 0 }, .bps = 6, .bpp_afbc = { 16, 0, 0 }, .bpp = { 16, 0, 0 },
@@ -160,6 +160,19 @@ const format_info_t formats[] = {
 		.tile_size = 1, .has_alpha = false, .is_rgb = false, .is_yuv = true,
 		.afbc = true, .linear = true, .yuv_transform = false, .flex = true,
 	},
+	/*
+	 * Packed samples are not byte addressable: the format can be described to
+	 * neither android_ycbcr nor android_flex_layout. The AFBC equivalent is
+	 * YUV420_10BIT_I. Widths are a multiple of 4 samples in all planes, so that
+	 * rows end on a byte boundary and both planes get the same stride.
+	 */
+	{
+		.id = MALI_GRALLOC_FORMAT_INTERNAL_NV15,
+		.npln = 2, .ncmp = { 1, 2, 0 }, .bps = 10, .bpp_afbc = { 0, 0, 0 }, .bpp = { 10, 20, 0 },
+		.hsub = 2, .vsub = 2, .align_w = 8, .align_h = 2, .align_w_cpu = 4,
+		.tile_size = 1, .has_alpha = false, .is_rgb = false, .is_yuv = true,
+		.afbc = false, .linear = true, .yuv_transform = false, .flex = false,
+	},
 	/* 422 (10-bit) */
 	{
 		.id = MALI_GRALLOC_FORMAT_INTERNAL_Y210,
@@ -265,6 +278,86 @@ const format_info_t formats[] = {
 };
 const size_t num_formats = sizeof(formats)/sizeof(formats[0]);
 
+/* Shorthands to keep the component table readable. */
+#define R(off, size) { CMP_R, off, size }
+#define G(off, size) { CMP_G, off, size }
+#define B(off, size) { CMP_B, off, size }
+#define A(off, size) { CMP_A, off, size }
+#define Y(off, size) { CMP_Y, off, size }
+#define CB(off, size) { CMP_CB, off, size }
+#define CR(off, size) { CMP_CR, off, size }
+
+/*
+ * Component layout table, one entry per format in formats[] (same order).
+ *
+ * Formats without a component description (no DRM fourcc equivalent, or
+ * AFBC-only formats) have an empty component list.
+ */
+/* clang-format off */
+constexpr format_components_t format_components[] = {
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGB_565,           .cmp = { { B(0, 5), G(5, 6), R(11, 5) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGB_888,           .cmp = { { R(0, 8), G(8, 8), B(16, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888,         .cmp = { { R(0, 8), G(8, 8), B(16, 8), A(24, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_BGRA_8888,         .cmp = { { B(0, 8), G(8, 8), R(16, 8), A(24, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGBX_8888,         .cmp = { { R(0, 8), G(8, 8), B(16, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGBA_1010102,      .cmp = { { R(0, 10), G(10, 10), B(20, 10), A(30, 2) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGBA_16161616,     .cmp = { { R(0, 16), G(16, 16), B(32, 16), A(48, 16) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_Y8 },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_Y16 },
+	/* AFBC only */
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_YUV420_8BIT_I },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_NV12,              .cmp = { { Y(0, 8) }, { CB(0, 8), CR(8, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_NV21,              .cmp = { { Y(0, 8) }, { CR(0, 8), CB(8, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_YV12,              .cmp = { { Y(0, 8) }, { CR(0, 8) }, { CB(0, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_YUV422_8BIT,       .cmp = { { Y(0, 8), CB(8, 8), Y(16, 8), CR(24, 8) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_NV16,              .cmp = { { Y(0, 8) }, { CB(0, 8), CR(8, 8) } } },
+	/* AFBC only */
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_YUV420_10BIT_I },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_Y0L2,              .cmp = { {
+		Y(0, 10), CB(10, 10), Y(20, 10), A(30, 1), A(31, 1),
+		Y(32, 10), CR(42, 10), Y(52, 10), A(62, 1), A(63, 1) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_P010,              .cmp = { { Y(6, 10) }, { CB(6, 10), CB(22, 10) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_NV15,              .cmp = { { Y(0, 10) }, { CB(0, 10), CR(10, 10) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_Y210,              .cmp = { { Y(6, 10), CB(22, 10), Y(38, 10), CR(54, 10) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_P210,              .cmp = { { Y(6, 10) }, { CB(6, 10), CB(22, 10) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_YUV444_10BIT_I },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_Y410,              .cmp = { { CB(0, 10), Y(10, 10), CR(20, 10), A(30, 2) } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RAW16 },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RAW12,             .cmp = { { { CMP_RAW, 0, -1 } } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RAW10,             .cmp = { { { CMP_RAW, 0, -1 } } } },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_BLOB },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_DEPTH_16 },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_DEPTH_24 },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_DEPTH_24_STENCIL_8 },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_DEPTH_32F },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_DEPTH_32F_STENCIL_8 },
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_STENCIL_8 },
+};
+
+/* The internal RGB565 format is stored with the opposite component order when AFBC is used. */
+static constexpr format_components_t rgb565_afbc_components =
+	{ .id = MALI_GRALLOC_FORMAT_INTERNAL_RGB_565,           .cmp = { { R(0, 5), G(5, 6), B(11, 5) } } };
+/* clang-format on */
+
+#undef R
+#undef G
+#undef B
+#undef A
+#undef Y
+#undef CB
+#undef CR
+
+static constexpr bool format_components_match_formats(size_t idx = 0)
+{
+	return idx == sizeof(formats) / sizeof(formats[0]) ||
+	       (format_components[idx].id == formats[idx].id && format_components_match_formats(idx + 1));
+}
+
+static_assert(sizeof(format_components) / sizeof(format_components[0]) == sizeof(formats) / sizeof(formats[0]),
+              "format_components[] must have one entry per format in formats[]");
+static_assert(format_components_match_formats(),
+              "format_components[] must be in the same order as formats[]");
+
 /*
  * This table represents the superset of flags for each base format and producer/consumer.
  * Where IP does not support a capability, it should be defined and not set.
@@ -507,6 +600,19 @@ const format_ip_support_t formats_ip_support[] = {
 		.vpu_wr = F_LIN,
 		.cam_wr = F_NONE,
 	},
+	{
+		.id = MALI_GRALLOC_FORMAT_INTERNAL_NV15,
+		.cpu_rd = F_LIN,
+		.cpu_wr = F_LIN,
+		.gpu_rd = F_LIN,
+		.gpu_wr = F_NONE,
+		.dpu_rd = F_LIN,
+		.dpu_wr = F_NONE,
+		.dpu_aeu_wr = F_NONE,
+		.vpu_rd = F_LIN,
+		.vpu_wr = F_LIN,
+		.cam_wr = F_NONE,
+	},
 	/* 422 (10-bit) */
 	{
 		.id = MALI_GRALLOC_FORMAT_INTERNAL_Y210,
@@ -776,6 +882,26 @@ int32_t get_format_index(const uint32_t base_format)
 }
 
 
+/*
+ * Returns the component layout for an allocated format.
+ *
+ * @param alloc_format [in]   Allocated format, including modifiers.
+ * @param format_idx   [in]   Index of the base format, from get_format_index().
+ *
+ * @return component layout of the format, in the memory order implied by the modifiers.
+ */
+const format_components_t *get_format_components(const uint64_t alloc_format, const int32_t format_idx)
+{
+	if ((alloc_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK) &&
+	    (alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK) == MALI_GRALLOC_FORMAT_INTERNAL_RGB_565)
+	{
+		return &rgb565_afbc_components;
+	}
+
+	return &format_components[format_idx];
+}
+
+
 int32_t get_ip_format_index(const uint32_t base_format)
 {
 	int32_t format_idx;
@@ -1030,6 +1156,12 @@ bool sanitize_formats(void)
 				MALI_GRALLOC_LOGE("Format [id:0x%" PRIx32 "] which doesn't support afbc should not have bpp defined", format->id);
 				fail = true;
 			}
+
+			if ((pln >= format->npln) && (format_components[i].cmp[pln][0].type != CMP_NONE))
+			{
+				MALI_GRALLOC_LOGE("Format [id:0x%" PRIx32 "] should not have components described for plane: %d", format->id, pln);
+				fail = true;
+			}
 		}
 
 		if (format->is_yuv)
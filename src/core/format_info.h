@@ -96,15 +96,56 @@ typedef struct
 
 } format_ip_support_t;
 
+/*
+ * Pixel component types, as reported through the Gralloc 4 PLANE_LAYOUTS metadata.
+ * CMP_NONE terminates the component list of a plane.
+ */
+typedef enum : uint8_t
+{
+	CMP_NONE = 0,
+	CMP_R,
+	CMP_G,
+	CMP_B,
+	CMP_A,
+	CMP_Y,
+	CMP_CB,
+	CMP_CR,
+	CMP_RAW,
+} format_component_type_t;
+
+/* Maximum number of components described in a single plane (Y0L2 packs 10). */
+#define MAX_PLANE_COMPONENTS 10
+
+typedef struct
+{
+	format_component_type_t type;
+	uint8_t offset;                 /* Offset of the component within a sample (in bits). */
+	int8_t size;                    /* Size of the component (in bits). -1 when not well defined (RAW). */
+} format_component_t;
+
+/*
+ * Memory layout of the components in each plane of a format.
+ *
+ * Entries are in the same order as formats[], so that the description
+ * for a format is found at its get_format_index() position.
+ */
+typedef struct
+{
+	uint32_t id;                                              /* Format ID. */
+	format_component_t cmp[MAX_PLANES][MAX_PLANE_COMPONENTS]; /* Components in each plane, CMP_NONE terminated. */
+} format_components_t;
+
 
 extern const format_info_t formats[];
 extern const format_ip_support_t formats_ip_support[];
+extern const format_components_t format_components[];
 extern const size_t num_formats;
 extern const size_t num_ip_formats;
 
 extern int32_t get_format_index(const uint32_t base_format);
 extern int32_t get_ip_format_index(const uint32_t base_format);
 extern uint32_t get_internal_format(const uint32_t base_format, const bool map_to_internal);
+extern const format_components_t *get_format_components(const uint64_t alloc_format, const int32_t format_idx);
 void get_format_dataspace(uint32_t base_format,
                           uint64_t usage,
                           int width,
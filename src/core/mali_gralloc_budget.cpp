@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cutils/properties.h>
+
+#include "mali_gralloc_budget.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_usages.h"
+#include "mali_gralloc_debug.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_lifetime.h"
+#include "mali_gralloc_log.h"
+
+/* Maximum number of caches which can be trimmed on allocation failure. */
+#define MAX_TRIM_CALLBACKS 4
+
+/* Number of charges held for other processes after which released ones are swept. */
+#define HANDED_OVER_SWEEP_THRESHOLD 64
+
+struct budget_charge
+{
+	mali_gralloc_budget_heap heap;
+	int pid;
+	uint64_t bytes;
+	uint32_t refs;          /* Number of handles sharing the backing store. */
+	uint64_t lifetime_id;   /* Backing store of another process, 0 otherwise. See mali_gralloc_lifetime.h. */
+};
+
+static pthread_once_t budget_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Budgets in bytes, 0 for unlimited. Written once by budget_init(). */
+static uint64_t heap_budget[MALI_GRALLOC_BUDGET_HEAP_COUNT];
+static uint64_t pid_budget;
+static bool format_degrade;
+
+static uint64_t heap_bytes[MALI_GRALLOC_BUDGET_HEAP_COUNT];
+static std::unordered_map<int, uint64_t> pid_bytes;
+static std::unordered_map<uint64_t, budget_charge> charges;
+/* Charges without handle left in this process, held for another process. */
+static size_t handed_over_count;
+/* Sweep point, doubled while the handed over backing stores stay alive. */
+static size_t handed_over_sweep_at = HANDED_OVER_SWEEP_THRESHOLD;
+
+static std::atomic<int> injected_failures(0);
+/* Written once by budget_init(). */
+static uint32_t injected_failure_period;
+static uint32_t injected_delay_us;
+static std::atomic<uint64_t> injection_count(0);
+static std::atomic<uint64_t> step_counts[MALI_GRALLOC_DEGRADE_COUNT];
+
+static mali_gralloc_trim_fn trim_callbacks[MAX_TRIM_CALLBACKS];
+static int trim_callback_count;
+
+static const char *const heap_names[MALI_GRALLOC_BUDGET_HEAP_COUNT] = {
+	"system", "dma", "compound", "secure",
+};
+
+static const char *const step_names[MALI_GRALLOC_DEGRADE_COUNT] = {
+	"budget", "injected", "trim", "retry", "heap_fallback", "format", "recovered", "failed",
+};
+
+static void budget_init(void)
+{
+	char name[PROPERTY_KEY_MAX];
+
+	for (int heap = 0; heap < MALI_GRALLOC_BUDGET_HEAP_COUNT; heap++)
+	{
+		snprintf(name, sizeof(name), "vendor.gralloc.budget.%s_kb", heap_names[heap]);
+		heap_budget[heap] = (uint64_t)property_get_int64(name, 0) * 1024;
+	}
+
+	pid_budget = (uint64_t)property_get_int64("vendor.gralloc.budget.pid_kb", 0) * 1024;
+	format_degrade = property_get_int32("vendor.gralloc.degrade_format", 0) != 0;
+	injected_failures.store(property_get_int32("vendor.gralloc.inject_alloc_failures", 0));
+	injected_failure_period = std::max(0, property_get_int32("vendor.gralloc.inject_alloc_failure_period", 0));
+	injected_delay_us = std::max(0, property_get_int32("vendor.gralloc.inject_alloc_delay_us", 0));
+}
+
+static void charge_remove_locked(std::unordered_map<uint64_t, budget_charge>::iterator it)
+{
+	const budget_charge &charge = it->second;
+
+	heap_bytes[charge.heap] -= charge.bytes;
+	auto pid_it = pid_bytes.find(charge.pid);
+	pid_it->second -= charge.bytes;
+	if (pid_it->second == 0)
+	{
+		pid_bytes.erase(pid_it);
+	}
+
+	charges.erase(it);
+}
+
+/*
+ * Drops the charges of backing stores handed over to other processes, which
+ * have been released since.
+ *
+ * @return true when any charge was dropped.
+ */
+static bool charges_sweep_locked(void)
+{
+	bool swept = false;
+
+	for (auto it = charges.begin(); it != charges.end();)
+	{
+		auto next = std::next(it);
+		if (it->second.refs == 0 && !mali_gralloc_lifetime_alive(it->second.lifetime_id))
+		{
+			charge_remove_locked(it);
+			handed_over_count--;
+			swept = true;
+		}
+		it = next;
+	}
+
+	return swept;
+}
+
+mali_gralloc_budget_heap mali_gralloc_budget_heap_of(const private_handle_t *hnd)
+{
+	if ((hnd->producer_usage | hnd->consumer_usage) & GRALLOC_USAGE_PROTECTED)
+	{
+		return MALI_GRALLOC_BUDGET_HEAP_SECURE;
+	}
+	if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_ION_DMA_HEAP)
+	{
+		return MALI_GRALLOC_BUDGET_HEAP_DMA;
+	}
+	if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_ION_COMPOUND_HEAP)
+	{
+		return MALI_GRALLOC_BUDGET_HEAP_COMPOUND;
+	}
+	return MALI_GRALLOC_BUDGET_HEAP_SYSTEM;
+}
+
+const char *mali_gralloc_budget_heap_name(const mali_gralloc_budget_heap heap)
+{
+	if (heap >= MALI_GRALLOC_BUDGET_HEAP_COUNT)
+	{
+		return "unknown";
+	}
+
+	return heap_names[heap];
+}
+
+bool mali_gralloc_budget_heap_allows(const mali_gralloc_budget_heap heap, const uint64_t bytes)
+{
+	pthread_once(&budget_once, budget_init);
+
+	if (heap >= MALI_GRALLOC_BUDGET_HEAP_COUNT || heap_budget[heap] == 0)
+	{
+		return true;
+	}
+
+	pthread_mutex_lock(&budget_lock);
+	bool allowed = heap_bytes[heap] + bytes <= heap_budget[heap];
+	if (!allowed && charges_sweep_locked())
+	{
+		allowed = heap_bytes[heap] + bytes <= heap_budget[heap];
+	}
+	pthread_mutex_unlock(&budget_lock);
+
+	return allowed;
+}
+
+bool mali_gralloc_budget_pid_allows(const int pid, const uint64_t bytes)
+{
+	pthread_once(&budget_once, budget_init);
+
+	if (pid_budget == 0)
+	{
+		return true;
+	}
+
+	pthread_mutex_lock(&budget_lock);
+	auto it = pid_bytes.find(pid);
+	bool allowed = it == pid_bytes.end() || it->second + bytes <= pid_budget;
+	if (!allowed && charges_sweep_locked())
+	{
+		it = pid_bytes.find(pid);
+		allowed = it == pid_bytes.end() || it->second + bytes <= pid_budget;
+	}
+	pthread_mutex_unlock(&budget_lock);
+
+	return allowed;
+}
+
+void mali_gralloc_budget_charge(const private_handle_t *hnd, const int pid)
+{
+	const int owner = (pid > 0) ? pid : getpid();
+	const uint64_t lifetime_id = (owner != getpid()) ? mali_gralloc_lifetime_id(hnd) : 0;
+
+	pthread_mutex_lock(&budget_lock);
+
+	auto result = charges.emplace(hnd->backing_store_id, budget_charge());
+	budget_charge &charge = result.first->second;
+	if (result.second)
+	{
+		charge.heap = mali_gralloc_budget_heap_of(hnd);
+		charge.pid = owner;
+		charge.bytes = hnd->backing_store_size;
+		charge.refs = 0;
+		charge.lifetime_id = lifetime_id;
+
+		heap_bytes[charge.heap] += charge.bytes;
+		pid_bytes[charge.pid] += charge.bytes;
+	}
+	charge.refs++;
+
+	pthread_mutex_unlock(&budget_lock);
+}
+
+void mali_gralloc_budget_transfer(const private_handle_t *hnd, const int pid)
+{
+	const int owner = (pid > 0) ? pid : getpid();
+	const uint64_t lifetime_id = (owner != getpid()) ? mali_gralloc_lifetime_id(hnd) : 0;
+
+	pthread_mutex_lock(&budget_lock);
+
+	auto it = charges.find(hnd->backing_store_id);
+	if (it != charges.end() && it->second.pid != owner)
+	{
+		budget_charge &charge = it->second;
+
+		auto pid_it = pid_bytes.find(charge.pid);
+		pid_it->second -= charge.bytes;
+		if (pid_it->second == 0)
+		{
+			pid_bytes.erase(pid_it);
+		}
+
+		charge.pid = owner;
+		charge.lifetime_id = lifetime_id;
+		pid_bytes[charge.pid] += charge.bytes;
+	}
+
+	pthread_mutex_unlock(&budget_lock);
+}
+
+void mali_gralloc_budget_uncharge(const private_handle_t *hnd)
+{
+	pthread_mutex_lock(&budget_lock);
+
+	auto it = charges.find(hnd->backing_store_id);
+	if (it != charges.end() && --it->second.refs == 0)
+	{
+		/*
+		 * A backing store handed over stays charged until the other process
+		 * releases it, which is detected by charges_sweep_locked().
+		 */
+		if (it->second.lifetime_id == 0)
+		{
+			charge_remove_locked(it);
+		}
+		else if (++handed_over_count >= handed_over_sweep_at)
+		{
+			/* Bounds the charges kept when no budget is ever exceeded. */
+			charges_sweep_locked();
+			handed_over_sweep_at = std::max<size_t>(HANDED_OVER_SWEEP_THRESHOLD, 2 * handed_over_count);
+		}
+	}
+
+	pthread_mutex_unlock(&budget_lock);
+}
+
+void mali_gralloc_budget_register_trim(const mali_gralloc_trim_fn trim)
+{
+	pthread_mutex_lock(&budget_lock);
+
+	if (trim_callback_count < MAX_TRIM_CALLBACKS)
+	{
+		trim_callbacks[trim_callback_count++] = trim;
+	}
+	else
+	{
+		MALI_GRALLOC_LOGE("Too many trim callbacks, ignoring the last one");
+	}
+
+	pthread_mutex_unlock(&budget_lock);
+}
+
+size_t mali_gralloc_budget_trim(void)
+{
+	mali_gralloc_trim_fn callbacks[MAX_TRIM_CALLBACKS];
+	int count;
+
+	/* Callbacks free buffers, which takes the budget lock. */
+	pthread_mutex_lock(&budget_lock);
+	count = trim_callback_count;
+	std::copy(trim_callbacks, trim_callbacks + count, callbacks);
+	pthread_mutex_unlock(&budget_lock);
+
+	size_t trimmed = 0;
+	for (int i = 0; i < count; i++)
+	{
+		trimmed += callbacks[i]();
+	}
+
+	return trimmed;
+}
+
+bool mali_gralloc_budget_inject_failure(void)
+{
+	pthread_once(&budget_once, budget_init);
+
+	int remaining = injected_failures.load(std::memory_order_relaxed);
+	while (remaining > 0)
+	{
+		if (injected_failures.compare_exchange_weak(remaining, remaining - 1, std::memory_order_relaxed))
+		{
+			return true;
+		}
+	}
+
+	if (injected_failure_period != 0)
+	{
+		return injection_count.fetch_add(1, std::memory_order_relaxed) % injected_failure_period ==
+		       injected_failure_period - 1;
+	}
+
+	return false;
+}
+
+void mali_gralloc_budget_inject_delay(void)
+{
+	pthread_once(&budget_once, budget_init);
+
+	if (injected_delay_us != 0)
+	{
+		usleep(injected_delay_us);
+	}
+}
+
+bool mali_gralloc_budget_format_degrade_enabled(void)
+{
+	pthread_once(&budget_once, budget_init);
+
+	return format_degrade;
+}
+
+void mali_gralloc_budget_record(const mali_gralloc_degrade_step step, const uint64_t usage, const uint64_t bytes)
+{
+	if (step >= MALI_GRALLOC_DEGRADE_COUNT)
+	{
+		return;
+	}
+
+	step_counts[step].fetch_add(1, std::memory_order_relaxed);
+
+	if (step == MALI_GRALLOC_DEGRADE_FAILED)
+	{
+		MALI_GRALLOC_LOGE("Allocation of %" PRIu64 " bytes for %s usage 0x%" PRIx64 " failed after all degradation steps",
+		                  bytes, mali_gralloc_perf_usage_class_name(mali_gralloc_perf_usage_class(usage)), usage);
+	}
+	else
+	{
+		MALI_GRALLOC_LOGW("Allocation degradation step '%s' (%" PRIu64 " bytes) for %s usage 0x%" PRIx64,
+		                  step_names[step], bytes, mali_gralloc_perf_usage_class_name(mali_gralloc_perf_usage_class(usage)),
+		                  usage);
+	}
+}
+
+void mali_gralloc_budget_dump(android::String8 &buf)
+{
+	pthread_once(&budget_once, budget_init);
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc memory budgets (KiB)-----------------------------\n");
+	mali_gralloc_dump_string(buf, " %-16s %12s %12s\n", "heap/pid", "used", "budget");
+
+	pthread_mutex_lock(&budget_lock);
+
+	charges_sweep_locked();
+
+	for (int heap = 0; heap < MALI_GRALLOC_BUDGET_HEAP_COUNT; heap++)
+	{
+		mali_gralloc_dump_string(buf, " %-16s %12" PRIu64 " %12" PRIu64 "\n", heap_names[heap], heap_bytes[heap] / 1024,
+		                         heap_budget[heap] / 1024);
+	}
+
+	for (const auto &entry : pid_bytes)
+	{
+		mali_gralloc_dump_string(buf, " pid %-12d %12" PRIu64 " %12" PRIu64 "\n", entry.first, entry.second / 1024,
+		                         pid_budget / 1024);
+	}
+
+	pthread_mutex_unlock(&budget_lock);
+
+	mali_gralloc_dump_string(buf, " degradation steps:");
+	for (int step = 0; step < MALI_GRALLOC_DEGRADE_COUNT; step++)
+	{
+		mali_gralloc_dump_string(buf, " %s %" PRIu64, step_names[step], step_counts[step].load(std::memory_order_relaxed));
+	}
+	mali_gralloc_dump_string(buf, "\n");
+}
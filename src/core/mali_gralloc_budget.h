@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_BUDGET_H_
+#define MALI_GRALLOC_BUDGET_H_
+
+/*
+ * Memory budgets and allocation failure handling.
+ *
+ * Bytes of live backing stores are tracked per heap and per owning pid: the
+ * process a buffer is allocated for, which is the client of the allocator
+ * service. Backing stores handed over to a client stay charged until the
+ * client releases them, when this can be detected (see mali_gralloc_lifetime.h).
+ * Budgets are read once from properties, in KiB, 0 meaning unlimited:
+ *
+ *   vendor.gralloc.budget.<heap>_kb   Per heap (system, dma, compound, secure).
+ *   vendor.gralloc.budget.pid_kb      Per owning process.
+ *
+ * An allocation exceeding a budget fails like an out of memory allocation, and
+ * goes down the same degradation ladder (see mali_gralloc_degrade_step).
+ *
+ * For testing, vendor.gralloc.inject_alloc_failures makes the given number of
+ * backing store allocations fail after the process starts, and
+ * vendor.gralloc.inject_alloc_failure_period makes every Nth one fail after
+ * that. vendor.gralloc.inject_alloc_delay_us delays every backing store
+ * allocation, to reproduce a slow or contended heap.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/String8.h>
+
+struct private_handle_t;
+
+typedef enum
+{
+	MALI_GRALLOC_BUDGET_HEAP_SYSTEM,
+	MALI_GRALLOC_BUDGET_HEAP_DMA,
+	MALI_GRALLOC_BUDGET_HEAP_COMPOUND,
+	MALI_GRALLOC_BUDGET_HEAP_SECURE,
+	MALI_GRALLOC_BUDGET_HEAP_COUNT
+} mali_gralloc_budget_heap;
+
+/*
+ * Steps taken when a backing store allocation fails, in order.
+ */
+typedef enum
+{
+	MALI_GRALLOC_DEGRADE_BUDGET,         /* Allocation refused by a budget. */
+	MALI_GRALLOC_DEGRADE_INJECTED,       /* Allocation failed by fault injection. */
+	MALI_GRALLOC_DEGRADE_TRIM,           /* Internal caches trimmed. */
+	MALI_GRALLOC_DEGRADE_RETRY,          /* Allocation retried. */
+	MALI_GRALLOC_DEGRADE_HEAP_FALLBACK,  /* Requested heap failed, system heap tried instead. */
+	MALI_GRALLOC_DEGRADE_FORMAT,         /* Allocation retried with a cheaper format. */
+	MALI_GRALLOC_DEGRADE_RECOVERED,      /* Allocation succeeded after failing at first. */
+	MALI_GRALLOC_DEGRADE_FAILED,         /* Allocation failed after all steps. */
+	MALI_GRALLOC_DEGRADE_COUNT
+} mali_gralloc_degrade_step;
+
+/*
+ * Releases memory held by an internal cache.
+ *
+ * @return number of bytes released.
+ */
+typedef size_t (*mali_gralloc_trim_fn)(void);
+
+mali_gralloc_budget_heap mali_gralloc_budget_heap_of(const private_handle_t *hnd);
+const char *mali_gralloc_budget_heap_name(mali_gralloc_budget_heap heap);
+
+/*
+ * Checks whether an allocation fits in the remaining budget.
+ *
+ * @return true when the allocation is allowed.
+ */
+bool mali_gralloc_budget_heap_allows(mali_gralloc_budget_heap heap, uint64_t bytes);
+bool mali_gralloc_budget_pid_allows(int pid, uint64_t bytes);
+
+/*
+ * Accounts the backing store of a buffer against its heap and owning
+ * process. Handles sharing a backing store are only accounted once.
+ *
+ * @param hnd  [in]  Allocated buffer.
+ * @param pid  [in]  Process the buffer is allocated for, 0 for the calling process.
+ */
+void mali_gralloc_budget_charge(const private_handle_t *hnd, int pid);
+
+/*
+ * Charges an allocated backing store to another owning process.
+ */
+void mali_gralloc_budget_transfer(const private_handle_t *hnd, int pid);
+
+/*
+ * Releases the charge of a freed handle. The backing store stays charged to
+ * its owner while another process still uses it.
+ */
+void mali_gralloc_budget_uncharge(const private_handle_t *hnd);
+
+/*
+ * Registers a cache to trim when allocations fail.
+ */
+void mali_gralloc_budget_register_trim(mali_gralloc_trim_fn trim);
+
+/*
+ * Trims all registered caches.
+ *
+ * @return number of bytes released.
+ */
+size_t mali_gralloc_budget_trim(void);
+
+/*
+ * Consumes one injected failure.
+ *
+ * @return true when the allocation must fail.
+ */
+bool mali_gralloc_budget_inject_failure(void);
+
+/*
+ * Waits for the injected allocation delay, if any.
+ */
+void mali_gralloc_budget_inject_delay(void);
+
+/*
+ * Returns whether allocations may fall back to a cheaper format (vendor.gralloc.degrade_format).
+ */
+bool mali_gralloc_budget_format_degrade_enabled(void);
+
+/*
+ * Logs and counts a step of the degradation ladder.
+ *
+ * @param step  [in]  Step taken.
+ * @param usage [in]  Combined usage of the allocation.
+ * @param bytes [in]  Size of the allocation, or bytes trimmed.
+ */
+void mali_gralloc_budget_record(mali_gralloc_degrade_step step, uint64_t usage, uint64_t bytes);
+
+/*
+ * Appends budget usage and degradation counters to a dump.
+ */
+void mali_gralloc_budget_dump(android::String8 &buf);
+
+#endif /* MALI_GRALLOC_BUDGET_H_ */
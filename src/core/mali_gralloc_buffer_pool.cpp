@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "mali_gralloc_buffer_pool.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_debug.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_log.h"
+
+/* Maximum number of descriptors pooled at the same time. */
+#define BUFFER_POOLS_MAX 8
+
+buffer_pools::buffer_pools(const buffer_pool_backend &_backend, const uint32_t _max_buffers, const uint32_t idle_ms)
+    : backend(_backend)
+    , max_buffers(_max_buffers)
+    , idle_ns(uint64_t(idle_ms) * 1000000)
+    , stopping(false)
+    , refill_pending(false)
+    , allocated(0)
+    , expired(0)
+    , refill_failures(0)
+    , refused(0)
+{
+}
+
+buffer_pools::~buffer_pools()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	refill_needed.notify_all();
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+
+	trim();
+}
+
+void buffer_pools::start()
+{
+	thread = std::thread(&buffer_pools::worker, this);
+}
+
+bool buffer_pools::matches(const buffer_descriptor_t &a, const buffer_descriptor_t &b)
+{
+	return a.width == b.width && a.height == b.height && a.hal_format == b.hal_format &&
+	       a.producer_usage == b.producer_usage && a.consumer_usage == b.consumer_usage &&
+	       a.layer_count == b.layer_count && a.format_type == b.format_type && a.reserved_size == b.reserved_size &&
+	       a.name == b.name;
+}
+
+std::shared_ptr<buffer_pools::pool> buffer_pools::find(const buffer_descriptor_t &descriptor)
+{
+	for (const auto &p : pools)
+	{
+		if (matches(p->descriptor, descriptor))
+		{
+			return p;
+		}
+	}
+
+	return nullptr;
+}
+
+void buffer_pools::reserve(const buffer_descriptor_t &descriptor, const uint32_t count)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	std::shared_ptr<pool> p = find(descriptor);
+	if (p == nullptr)
+	{
+		if (pools.size() >= BUFFER_POOLS_MAX)
+		{
+			MALI_GRALLOC_LOGW("Too many buffer pools, not pooling '%s'", descriptor.name.c_str());
+			return;
+		}
+
+		p = std::make_shared<pool>();
+		p->descriptor = descriptor;
+		/* Spare buffers belong to this process until taken. */
+		p->descriptor.owner_pid = 0;
+		p->derived = false;
+		p->alive = true;
+		p->hits = 0;
+		p->misses = 0;
+		pools.push_back(p);
+	}
+
+	p->target = std::min(count, max_buffers);
+	p->last_use_ns = mali_gralloc_perf_now();
+
+	if (p->buffers.size() < p->target)
+	{
+		refill_pending = true;
+		guard.unlock();
+		refill_needed.notify_one();
+	}
+}
+
+buffer_handle_t buffer_pools::take(buffer_descriptor_t *descriptor)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	std::shared_ptr<pool> p = find(*descriptor);
+	if (p == nullptr)
+	{
+		return nullptr;
+	}
+
+	p->last_use_ns = mali_gralloc_perf_now();
+
+	if (p->buffers.empty())
+	{
+		p->misses++;
+		refill_pending = true;
+		guard.unlock();
+		refill_needed.notify_one();
+		return nullptr;
+	}
+
+	/* Left for the next request: the caller allocates through the degradation ladder instead. */
+	const buffer_handle_t handle = p->buffers.back();
+	if (!backend.hand_over(*descriptor, handle))
+	{
+		refused++;
+		return nullptr;
+	}
+
+	p->buffers.pop_back();
+	p->hits++;
+
+	/* Same requested parameters: the calculated ones are the same as well. */
+	descriptor->size = p->descriptor.size;
+	descriptor->pixel_stride = p->descriptor.pixel_stride;
+	descriptor->alloc_format = p->descriptor.alloc_format;
+	memcpy(descriptor->plane_info, p->descriptor.plane_info, sizeof(descriptor->plane_info));
+	descriptor->old_byte_stride = p->descriptor.old_byte_stride;
+	descriptor->old_alloc_width = p->descriptor.old_alloc_width;
+	descriptor->old_alloc_height = p->descriptor.old_alloc_height;
+	descriptor->old_internal_format = p->descriptor.old_internal_format;
+
+	refill_pending = true;
+	guard.unlock();
+	refill_needed.notify_one();
+
+	return handle;
+}
+
+size_t buffer_pools::refill()
+{
+	size_t count = 0;
+	std::unique_lock<std::mutex> guard(lock);
+
+	refill_pending = false;
+
+	/* Pools may be destroyed while allocating: iterate over a copy. */
+	const std::vector<std::shared_ptr<pool>> current = pools;
+	for (const auto &p : current)
+	{
+		while (!stopping && p->alive && p->buffers.size() < p->target)
+		{
+			buffer_descriptor_t descriptor = p->descriptor;
+			buffer_handle_t handle = nullptr;
+
+			/* Allocating is slow: requests are served meanwhile. */
+			guard.unlock();
+			const int err = backend.alloc(&descriptor, &handle);
+			guard.lock();
+
+			if (err != 0)
+			{
+				MALI_GRALLOC_LOGW("Unable to refill the buffer pool of '%s'", p->descriptor.name.c_str());
+				refill_failures++;
+				break;
+			}
+
+			if (!p->alive || stopping)
+			{
+				guard.unlock();
+				backend.free(handle);
+				guard.lock();
+				break;
+			}
+
+			if (!p->derived)
+			{
+				p->descriptor = descriptor;
+				p->derived = true;
+			}
+			p->buffers.push_back(handle);
+			allocated++;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void buffer_pools::release(std::vector<std::shared_ptr<pool>> &destroyed)
+{
+	for (const auto &p : destroyed)
+	{
+		for (const buffer_handle_t handle : p->buffers)
+		{
+			backend.free(handle);
+		}
+		p->buffers.clear();
+	}
+}
+
+size_t buffer_pools::trim()
+{
+	std::vector<std::shared_ptr<pool>> destroyed;
+	size_t bytes = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		destroyed.swap(pools);
+		for (const auto &p : destroyed)
+		{
+			p->alive = false;
+			for (const buffer_handle_t handle : p->buffers)
+			{
+				bytes += static_cast<const private_handle_t *>(handle)->backing_store_size;
+			}
+		}
+	}
+
+	release(destroyed);
+	return bytes;
+}
+
+void buffer_pools::expire(const uint64_t now_ns)
+{
+	std::vector<std::shared_ptr<pool>> destroyed;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		auto idle = std::stable_partition(pools.begin(), pools.end(), [this, now_ns](const std::shared_ptr<pool> &p)
+		                                  { return now_ns - p->last_use_ns < idle_ns; });
+		for (auto it = idle; it != pools.end(); ++it)
+		{
+			(*it)->alive = false;
+			destroyed.push_back(*it);
+		}
+		pools.erase(idle, pools.end());
+		expired += destroyed.size();
+	}
+
+	release(destroyed);
+}
+
+void buffer_pools::worker()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (!stopping)
+	{
+		/* Without anything to refill, wake up to expire unused pools. */
+		refill_needed.wait_for(guard, std::chrono::nanoseconds(idle_ns),
+		                       [this] { return stopping || refill_pending; });
+		if (stopping)
+		{
+			break;
+		}
+
+		guard.unlock();
+		refill();
+		expire(mali_gralloc_perf_now());
+		guard.lock();
+	}
+}
+
+void buffer_pools::dump(android::String8 &buf)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc buffer pools-------------------------------------\n");
+	mali_gralloc_dump_string(buf, " allocated %" PRIu64 " expired pools %" PRIu64 " refill failures %" PRIu64
+	                              " refused %" PRIu64 "\n",
+	                         allocated, expired, refill_failures, refused);
+
+	for (const auto &p : pools)
+	{
+		const buffer_descriptor_t &d = p->descriptor;
+		mali_gralloc_dump_string(buf, " %-24s %5ux%-5u fmt 0x%" PRIx64 " usage 0x%" PRIx64 " ready %zu/%u hits %" PRIu64
+		                              " misses %" PRIu64 "\n",
+		                         d.name.c_str(), d.width, d.height, d.hal_format, d.producer_usage | d.consumer_usage,
+		                         p->buffers.size(), p->target, p->hits, p->misses);
+	}
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_BUFFER_POOL_H_
+#define MALI_GRALLOC_BUFFER_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <utils/String8.h>
+
+#include "core/mali_gralloc_bufferdescriptor.h"
+
+/*
+ * Buffer provider of buffer_pools. Kept separate from the allocation code so
+ * that the pools can be driven by a stand-in backend.
+ */
+struct buffer_pool_backend
+{
+	/*
+	 * Allocates a buffer without going through the pools. Fills in the
+	 * calculated fields of the descriptor, as mali_gralloc_buffer_allocate().
+	 *
+	 * @return 0 on success, negative value otherwise.
+	 */
+	int (*alloc)(buffer_descriptor_t *descriptor, buffer_handle_t *handle);
+	/* Releases a buffer returned by alloc(). */
+	void (*free)(buffer_handle_t handle);
+	/*
+	 * Hands a ready buffer over to the requesting process, within its budget:
+	 * the buffer is charged to it from then on. Called before the pool is
+	 * refilled, which charges new buffers to this process.
+	 *
+	 * @param descriptor [in]  Requested buffer parameters, 'owner_pid' is the requesting process.
+	 * @param handle     [in]  Buffer to hand over.
+	 *
+	 * @return false when refused, the buffer then stays in the pool.
+	 */
+	bool (*hand_over)(const buffer_descriptor_t &descriptor, buffer_handle_t handle);
+};
+
+/*
+ * Pools of ready to use buffers, one per buffer descriptor.
+ *
+ * Codecs and cameras allocate the same set of buffers again on every seek,
+ * resolution change or reconfiguration. Clients opt in with
+ * MALI_GRALLOC_USAGE_POOLED: the allocator reserves a pool holding as many
+ * buffers as the set, which a worker thread fills in the background. The
+ * next allocation of the set draws from the pool, which is filled up again
+ * behind it.
+ *
+ * Buffers drawn from a pool belong to the client. The allocator is never told
+ * when a client releases its buffers, so they cannot go back to the pool: a
+ * pool holds spare buffers only, and is destroyed once unused for a while.
+ */
+class buffer_pools
+{
+public:
+	/*
+	 * @param backend     [in]  Buffer provider.
+	 * @param max_buffers [in]  Maximum number of buffers kept by a pool.
+	 * @param idle_ms     [in]  Time after which an unused pool is destroyed.
+	 */
+	buffer_pools(const buffer_pool_backend &backend, uint32_t max_buffers, uint32_t idle_ms);
+	~buffer_pools();
+
+	buffer_pools(const buffer_pools &) = delete;
+	buffer_pools &operator=(const buffer_pools &) = delete;
+
+	/*
+	 * Starts the worker thread, which fills and expires pools in the background.
+	 */
+	void start();
+
+	/*
+	 * Creates the pool of a descriptor, or updates the number of buffers it keeps.
+	 *
+	 * @param descriptor [in]  Requested buffer parameters.
+	 * @param count      [in]  Number of buffers to keep ready, clamped to max_buffers.
+	 */
+	void reserve(const buffer_descriptor_t &descriptor, uint32_t count);
+
+	/*
+	 * Takes a buffer from the pool of a descriptor.
+	 *
+	 * @param descriptor [inout]  Requested buffer parameters. Calculated fields
+	 *                            are filled in when a buffer is returned.
+	 *
+	 * @return buffer, now owned by the caller, or nullptr when none is ready
+	 *         or the backend refuses it to the caller.
+	 */
+	buffer_handle_t take(buffer_descriptor_t *descriptor);
+
+	/*
+	 * Allocates the missing buffers of all pools synchronously. Called by the worker thread.
+	 *
+	 * @return number of buffers allocated.
+	 */
+	size_t refill();
+
+	/*
+	 * Destroys all pools.
+	 *
+	 * @return number of bytes released.
+	 */
+	size_t trim();
+
+	void dump(android::String8 &buf);
+
+private:
+	struct pool
+	{
+		/* Requested parameters, and calculated ones once a buffer has been allocated. */
+		buffer_descriptor_t descriptor;
+		bool derived;
+		std::vector<buffer_handle_t> buffers;
+		uint32_t target;
+		uint64_t last_use_ns;
+		/* Cleared when destroyed while the worker allocates for it. */
+		bool alive;
+		uint64_t hits;
+		uint64_t misses;
+	};
+
+	static bool matches(const buffer_descriptor_t &a, const buffer_descriptor_t &b);
+	std::shared_ptr<pool> find(const buffer_descriptor_t &descriptor);
+	void expire(uint64_t now_ns);
+	void release(std::vector<std::shared_ptr<pool>> &destroyed);
+	void worker();
+
+	const buffer_pool_backend backend;
+	const uint32_t max_buffers;
+	const uint64_t idle_ns;
+
+	std::mutex lock;
+	std::condition_variable refill_needed;
+	std::thread thread;
+	bool stopping;
+	bool refill_pending;
+
+	std::vector<std::shared_ptr<pool>> pools;
+
+	uint64_t allocated;
+	uint64_t expired;
+	uint64_t refill_failures;
+	uint64_t refused;
+};
+
+#endif /* MALI_GRALLOC_BUFFER_POOL_H_ */
@@ -28,6 +28,8 @@
 #include "allocator/mali_gralloc_ion.h"
 #include "gralloc_helper.h"
 #include "format_info.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_trace.h"
 
 #if GRALLOC_USE_LEGACY_LOCK == 1
 #include "legacy/buffer_access.h"
@@ -75,6 +77,7 @@ static void buffer_sync(private_handle_t * const hnd,
 			hnd->cpu_read = (direction == TX_FROM_DEVICE || direction == TX_BOTH) ? 1 : 0;
 			hnd->cpu_write = (direction == TX_TO_DEVICE || direction == TX_BOTH) ? 1 : 0;
 
+			const uint64_t sync_start = mali_gralloc_perf_now();
 			const int status = mali_gralloc_ion_sync_start(hnd,
 			                                               hnd->cpu_read ? true : false,
 			                                               hnd->cpu_write ? true : false);
@@ -82,9 +85,11 @@ static void buffer_sync(private_handle_t * const hnd,
 			{
 				return;
 			}
+			mali_gralloc_trace(MALI_GRALLOC_TRACE_LOCK, hnd, mali_gralloc_perf_now() - sync_start);
 		}
 		else if (hnd->cpu_read || hnd->cpu_write)
 		{
+			const uint64_t sync_start = mali_gralloc_perf_now();
 			const int status = mali_gralloc_ion_sync_end(hnd,
 			                                             hnd->cpu_read ? true : false,
 			                                             hnd->cpu_write ? true : false);
@@ -92,6 +97,7 @@ static void buffer_sync(private_handle_t * const hnd,
 			{
 				return;
 			}
+			mali_gralloc_trace(MALI_GRALLOC_TRACE_UNLOCK, hnd, mali_gralloc_perf_now() - sync_start);
 
 			hnd->cpu_read = 0;
 			hnd->cpu_write = 0;
@@ -99,6 +105,48 @@ static void buffer_sync(private_handle_t * const hnd,
 	}
 }
 
+/*
+ * Prefaults the rows of each plane covered by a lock region, so that the
+ * first CPU pass over them does not take a page fault per page. Only done by
+ * the first lock of a mapping, and again by the first lock for writing: the
+ * pages stay mapped until the buffer is unmapped.
+ *
+ * @param hnd        [in]  Locked buffer.
+ * @param format_idx [in]  Index of the buffer format in formats[].
+ * @param usage      [in]  Lock usage.
+ * @param t          [in]  Access region top offset (in pixels).
+ * @param h          [in]  Access region height (in pixels), 0 for the whole buffer.
+ */
+static void prefault_lock_region(private_handle_t * const hnd, const int32_t format_idx,
+                                 const uint64_t usage, const int t, const int h)
+{
+	const bool write = (usage & GRALLOC_USAGE_SW_WRITE_MASK) != 0;
+	const int prefaulted = write ? private_handle_t::PRIV_FLAGS_PREFAULTED : private_handle_t::PRIV_FLAGS_PREFAULTED_READ;
+
+	/* Locks may race: at worst, the region is prefaulted twice. */
+	if ((__atomic_fetch_or(&hnd->flags, prefaulted, __ATOMIC_RELAXED) & prefaulted) == prefaulted)
+	{
+		return;
+	}
+
+	/* Compressed buffers have no row layout. */
+	if (h == 0 || (hnd->alloc_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK))
+	{
+		mali_gralloc_ion_prefault(hnd, 0, hnd->size, write);
+		return;
+	}
+
+	for (int plane = 0; plane < formats[format_idx].npln && plane < MAX_PLANES; plane++)
+	{
+		const int vsub = (plane == 0) ? 1 : formats[format_idx].vsub;
+		const size_t first_row = t / vsub;
+		const size_t rows = (t + h + vsub - 1) / vsub - first_row;
+		const size_t byte_stride = hnd->plane_info[plane].byte_stride;
+
+		mali_gralloc_ion_prefault(hnd, hnd->plane_info[plane].offset + first_row * byte_stride, rows * byte_stride,
+		                          write);
+	}
+}
 
 /*
  *  Validates input parameters of lock request.
@@ -244,7 +292,10 @@ int mali_gralloc_lock(buffer_handle_t buffer,
 		}
 		*vaddr = (void *)hnd->base;
 
+		const uint64_t lock_start = mali_gralloc_perf_now();
 		buffer_sync(hnd, get_tx_direction(usage));
+		prefault_lock_region(hnd, format_idx, usage, t, h);
+		mali_gralloc_perf_record(MALI_GRALLOC_STAGE_LOCK, hnd->producer_usage | hnd->consumer_usage, lock_start);
 	}
 
 	return 0;
@@ -365,7 +416,10 @@ int mali_gralloc_lock_ycbcr(const buffer_handle_t buffer,
 			return -EINVAL;
 		}
 
+		const uint64_t lock_start = mali_gralloc_perf_now();
 		buffer_sync(hnd, get_tx_direction(usage));
+		prefault_lock_region(hnd, format_idx, usage, t, h);
+		mali_gralloc_perf_record(MALI_GRALLOC_STAGE_LOCK, hnd->producer_usage | hnd->consumer_usage, lock_start);
 	}
 	else
 	{
@@ -411,7 +465,9 @@ int mali_gralloc_unlock(buffer_handle_t buffer)
 	}
 
 	private_handle_t *hnd = (private_handle_t *)buffer;
+	const uint64_t unlock_start = mali_gralloc_perf_now();
 	buffer_sync(hnd, TX_NONE);
+	mali_gralloc_perf_record(MALI_GRALLOC_STAGE_UNLOCK, hnd->producer_usage | hnd->consumer_usage, unlock_start);
 
 	return 0;
 }
@@ -21,9 +21,12 @@
 
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 #include <atomic>
 #include <algorithm>
 
+#include <cutils/properties.h>
+
 #include <hardware/hardware.h>
 #include <hardware/gralloc1.h>
 
@@ -35,6 +38,10 @@
 #include "gralloc_buffer_priv.h"
 #include "mali_gralloc_bufferdescriptor.h"
 #include "mali_gralloc_debug.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_budget.h"
+#include "mali_gralloc_trace.h"
+#include "mali_gralloc_buffer_pool.h"
 #include "mali_gralloc_log.h"
 #include "format_info.h"
 
@@ -124,40 +131,107 @@ static rect_t get_afbc_sb_size(alloc_type_t alloc_type, const uint8_t plane)
 	}
 }
 
+/*
+ * Layout of the output buffers of the rk video decoder: the picture, followed
+ * by side-band data the decoder stores with it (co-located motion vectors,
+ * w * h / 2 bytes), with 'w' the pixel stride given by the client.
+ *
+ * Sizes are in eighths of a byte per pixel.
+ */
+struct rk_video_buffer_layout
+{
+	uint32_t base_format;
+	uint8_t picture;
+	uint8_t sideband;
+};
+
+static const rk_video_buffer_layout rk_video_buffer_layouts[] =
+{
+	{ MALI_GRALLOC_FORMAT_INTERNAL_NV12, 12, 4 },   /* 2 * w * h */
+	{ MALI_GRALLOC_FORMAT_INTERNAL_NV16, 16, 4 },   /* 2.5 * w * h */
+	{ MALI_GRALLOC_FORMAT_INTERNAL_NV15, 15, 4 },   /* 2.375 * w * h */
+};
+
+/*
+ * Buffers given room for the side-band data, selected by vendor.gralloc.rk_video_sideband.
+ */
+enum rk_video_sideband_policy
+{
+	RK_VIDEO_SIDEBAND_NONE = 0,      /* No buffer: picture sizes only. */
+	RK_VIDEO_SIDEBAND_VIDEO = 1,     /* Decoder output and camera buffers, without RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND. */
+	RK_VIDEO_SIDEBAND_ALL = 2,       /* Every buffer with a stride specified by the client (previous behaviour). */
+};
+
+static rk_video_sideband_policy rk_video_sideband = RK_VIDEO_SIDEBAND_VIDEO;
+static pthread_once_t rk_video_sideband_once = PTHREAD_ONCE_INIT;
+
+static void rk_video_sideband_init(void)
+{
+	const int32_t policy = property_get_int32("vendor.gralloc.rk_video_sideband", RK_VIDEO_SIDEBAND_VIDEO);
+	if (policy >= RK_VIDEO_SIDEBAND_NONE && policy <= RK_VIDEO_SIDEBAND_ALL)
+	{
+		rk_video_sideband = static_cast<rk_video_sideband_policy>(policy);
+	}
+}
+
+/*
+ * Returns whether a buffer holds the side-band data of the video decoder.
+ *
+ * Camera buffers keep the room: camera HALs pass their NV12 buffers on to
+ * the decoder and the encoder, which expect the decoder's layout.
+ */
+static bool rk_video_buffer_has_sideband(const uint64_t producer_usage, const uint64_t consumer_usage)
+{
+	pthread_once(&rk_video_sideband_once, rk_video_sideband_init);
+
+	switch (rk_video_sideband)
+	{
+	case RK_VIDEO_SIDEBAND_ALL:
+		return true;
+	case RK_VIDEO_SIDEBAND_VIDEO:
+	{
+		const uint64_t usage = producer_usage | consumer_usage;
+		const bool is_decoder_output = (producer_usage & GRALLOC_USAGE_VIDEO_DECODER) ||
+		                               (usage & GRALLOC_USAGE_DECODER) == GRALLOC_USAGE_DECODER;
+		const bool is_camera = usage & (GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_CAMERA_READ);
+		return (is_decoder_output || is_camera) && !(usage & RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND);
+	}
+	default:
+		return false;
+	}
+}
+
+/*
+ * Grows a buffer of the rk video decoder to the size its layout requires.
+ */
 static void adjust_rk_video_buffer_size(buffer_descriptor_t* const bufDescriptor)
 {
-	const uint32_t width = bufDescriptor->width;
-	const uint32_t height = bufDescriptor->height;
 	const uint32_t base_format = bufDescriptor->alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK;
-	size_t size_needed_by_rk_video = 0;
 
-	switch ( base_format )
+	if (!rk_video_buffer_has_sideband(bufDescriptor->producer_usage, bufDescriptor->consumer_usage))
+	{
+		return;
+	}
+
+	for (const rk_video_buffer_layout &layout : rk_video_buffer_layouts)
 	{
-		case MALI_GRALLOC_FORMAT_INTERNAL_NV12:
+		if (layout.base_format != base_format)
 		{
-			/*
-			 * .KP : from CSY : video_decoder 需要的 NV12 buffer 中除了 YUV 数据还有其他 metadata, 要更多的空间.
-			 *		    2 * w * h 一定够.
-			 */
-			size_needed_by_rk_video = 2 * width * height;
-			break;
+			continue;
 		}
-		case MALI_GRALLOC_FORMAT_INTERNAL_NV16:
+
+		const size_t pixels = (size_t)bufDescriptor->width * bufDescriptor->height;
+		const size_t size_needed_by_rk_video = pixels * (layout.picture + layout.sideband) / 8;
+
+		if ( size_needed_by_rk_video > bufDescriptor->size )
 		{
-			size_needed_by_rk_video = 2.5 * width * height; // 根据 陈锦森的 要求
-			break;
+			D("to enlarge size of rk_video_buffer with base_format(0x%x) from %zd to %zd",
+			  base_format,
+			  bufDescriptor->size,
+			  size_needed_by_rk_video);
+			bufDescriptor->size = size_needed_by_rk_video;
 		}
-		default:
-			return;
-	}
-
-	if ( size_needed_by_rk_video > bufDescriptor->size )
-	{
-		D("to enlarge size of rk_video_buffer with base_format(0x%x) from %zd to %zd",
-		  base_format,
-		  bufDescriptor->size,
-		  size_needed_by_rk_video);
-		bufDescriptor->size = size_needed_by_rk_video;
+		return;
 	}
 }
 
@@ -736,6 +810,67 @@ static bool validate_format(const format_info_t * const format,
 	return true;
 }
 
+int mali_gralloc_estimate_pass_bytes(const uint64_t alloc_format,
+                                     const int width,
+                                     const int height,
+                                     const uint64_t usage,
+                                     const uint32_t afbc_body_percent,
+                                     uint64_t * const bytes)
+{
+	alloc_type_t alloc_type{};
+	int pixel_stride;
+	size_t size;
+	plane_info_t plane_info[MAX_PLANES] = {};
+
+	const int32_t format_idx = get_format_index(alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
+	if (format_idx == -1)
+	{
+		return -EINVAL;
+	}
+
+	const format_info_t &format = formats[format_idx];
+	if (!get_alloc_type(alloc_format & MALI_GRALLOC_INTFMT_EXT_MASK, format_idx, usage, &alloc_type) ||
+	    (alloc_type.is_afbc() && !format.afbc) || (!alloc_type.is_afbc() && !format.linear))
+	{
+		return -EINVAL;
+	}
+
+	calc_allocation_size(width,
+	                     height,
+	                     alloc_type,
+	                     format,
+	                     false,
+	                     true,
+	                     usage & RK_GRALLOC_USAGE_SPECIFY_STRIDE,
+	                     &pixel_stride,
+	                     &size,
+	                     plane_info);
+
+	*bytes = 0;
+	for (uint8_t plane = 0; plane < format.npln; plane++)
+	{
+		const uint64_t pixels = (uint64_t)plane_info[plane].alloc_width * plane_info[plane].alloc_height;
+
+		if (alloc_type.is_afbc())
+		{
+			/* Headers are always transferred in full, bodies as far as compressed. */
+			const rect_t sb = get_afbc_sb_size(alloc_type, plane);
+			const uint64_t sb_num = pixels / AFBC_PIXELS_PER_BLOCK;
+			const uint64_t sb_bytes = (format.bpp_afbc[plane] * sb.width * sb.height) / 8;
+
+			*bytes += sb_num * AFBC_HEADER_BUFFER_BYTES_PER_BLOCKENTRY;
+			*bytes += sb_num * sb_bytes * afbc_body_percent / 100;
+		}
+		else
+		{
+			/* Row padding up to the byte stride is not fetched. */
+			*bytes += pixels * format.bpp[plane] / 8;
+		}
+	}
+
+	return 0;
+}
+
 int mali_gralloc_derive_format_and_size(buffer_descriptor_t * const bufDescriptor)
 {
 	alloc_type_t alloc_type{};
@@ -749,11 +884,14 @@ int mali_gralloc_derive_format_and_size(buffer_descriptor_t * const bufDescripto
 	* Select optimal internal pixel format based upon
 	* usage and requested format.
 	*/
+	uint64_t stage_start = mali_gralloc_perf_now();
 	bufDescriptor->alloc_format = mali_gralloc_select_format(bufDescriptor->hal_format,
 	                                                         bufDescriptor->format_type,
 	                                                         usage,
-	                                                         bufDescriptor->width * bufDescriptor->height,
+	                                                         bufDescriptor->width,
+	                                                         bufDescriptor->height,
 	                                                         &bufDescriptor->old_internal_format);
+	mali_gralloc_perf_record(MALI_GRALLOC_STAGE_SELECT_FORMAT, usage, stage_start);
 
 	if(((bufDescriptor->alloc_format == 0x30 || bufDescriptor->alloc_format == 0x31 || bufDescriptor->alloc_format == 0x32 ||
 		bufDescriptor->alloc_format == 0x33 || bufDescriptor->alloc_format == 0x34 || bufDescriptor->alloc_format == 0x35) &&
@@ -800,6 +938,7 @@ int mali_gralloc_derive_format_and_size(buffer_descriptor_t * const bufDescripto
 	 * If using AFBC, further adjustments to the allocation width and height will be made later
 	 * based on AFBC alignment requirements and, for YUV, the plane properties.
 	 */
+	stage_start = mali_gralloc_perf_now();
 	mali_gralloc_adjust_dimensions(bufDescriptor->alloc_format,
 	                               usage,
 	                               &alloc_width,
@@ -816,6 +955,7 @@ int mali_gralloc_derive_format_and_size(buffer_descriptor_t * const bufDescripto
 	                     &bufDescriptor->pixel_stride,
 	                     &bufDescriptor->size,
 	                     bufDescriptor->plane_info);
+	mali_gralloc_perf_record(MALI_GRALLOC_STAGE_CALC_SIZE, usage, stage_start);
 
 	/*-------------------------------------------------------*/
 	/* <为满足 implicit_requirement_for_rk_gralloc_alloc_interface_from_rk_video_decoder 的特殊处理.> */
@@ -1034,9 +1174,126 @@ int mali_gralloc_derive_format_and_size(buffer_descriptor_t * const bufDescripto
 	return 0;
 }
 
+/*
+ * Switches opaque RGB buffers, which are only accessed by hardware, to
+ * RGB_565 in order to halve their footprint. Requires vendor.gralloc.degrade_format.
+ *
+ * @return true when at least one descriptor was degraded.
+ */
+static bool degrade_buffer_formats(const gralloc_buffer_descriptor_t *descriptors, uint32_t numDescriptors)
+{
+	const uint64_t excluded_usage = GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK | GRALLOC_USAGE_PROTECTED |
+	                                GRALLOC_USAGE_HW_VIDEO_ENCODER | GRALLOC_USAGE_HW_CAMERA_WRITE |
+	                                GRALLOC_USAGE_HW_CAMERA_READ;
+	bool degraded = false;
 
-int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
-                                 uint32_t numDescriptors, buffer_handle_t *pHandle, bool *shared_backend)
+	if (!mali_gralloc_budget_format_degrade_enabled())
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < numDescriptors; i++)
+	{
+		buffer_descriptor_t * const bufDescriptor = (buffer_descriptor_t *)(descriptors[i]);
+		const uint64_t usage = bufDescriptor->consumer_usage | bufDescriptor->producer_usage;
+
+		if ((usage & excluded_usage) != 0 || bufDescriptor->format_type != MALI_GRALLOC_FORMAT_TYPE_USAGE ||
+		    (bufDescriptor->hal_format != HAL_PIXEL_FORMAT_RGBX_8888 &&
+		     bufDescriptor->hal_format != HAL_PIXEL_FORMAT_RGB_888))
+		{
+			continue;
+		}
+
+		/* The requested format is kept, so that clients still see the format they asked for. */
+		const uint64_t hal_format = bufDescriptor->hal_format;
+		bufDescriptor->hal_format = HAL_PIXEL_FORMAT_RGB_565;
+		const int err = mali_gralloc_derive_format_and_size(bufDescriptor);
+		bufDescriptor->hal_format = hal_format;
+
+		if (err != 0)
+		{
+			/* Restore the original layout. */
+			mali_gralloc_derive_format_and_size(bufDescriptor);
+			continue;
+		}
+
+		degraded = true;
+	}
+
+	return degraded;
+}
+
+/*
+ * Single attempt at allocating the backing stores, within the process budget.
+ */
+static int backing_store_try_allocate(const gralloc_buffer_descriptor_t *descriptors, uint32_t numDescriptors,
+                                      buffer_handle_t *pHandle, bool *shared)
+{
+	const buffer_descriptor_t * const first = (buffer_descriptor_t *)(descriptors[0]);
+	const uint64_t usage = first->consumer_usage | first->producer_usage;
+	uint64_t bytes = 0;
+
+	for (uint32_t i = 0; i < numDescriptors; i++)
+	{
+		pHandle[i] = NULL;
+		bytes += ((buffer_descriptor_t *)(descriptors[i]))->size;
+	}
+
+	mali_gralloc_budget_inject_delay();
+
+	if (mali_gralloc_budget_inject_failure())
+	{
+		mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_INJECTED, usage, bytes);
+		return -ENOMEM;
+	}
+
+	if (!mali_gralloc_budget_pid_allows(first->owner_pid > 0 ? first->owner_pid : getpid(), bytes))
+	{
+		mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_BUDGET, usage, bytes);
+		return -ENOMEM;
+	}
+
+	return mali_gralloc_ion_allocate(descriptors, numDescriptors, pHandle, shared);
+}
+
+/*
+ * Allocates the backing stores, going down the degradation ladder when memory
+ * runs out: trim internal caches and retry, then retry with a cheaper format.
+ * Falling back to the system heap is done by the ION allocator on each attempt.
+ */
+static int backing_store_allocate(const gralloc_buffer_descriptor_t *descriptors, uint32_t numDescriptors,
+                                  buffer_handle_t *pHandle, bool *shared)
+{
+	const buffer_descriptor_t * const first = (buffer_descriptor_t *)(descriptors[0]);
+	const uint64_t usage = first->consumer_usage | first->producer_usage;
+
+	int err = backing_store_try_allocate(descriptors, numDescriptors, pHandle, shared);
+	if (err != -ENOMEM)
+	{
+		return err;
+	}
+
+	const size_t trimmed = mali_gralloc_budget_trim();
+	mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_TRIM, usage, trimmed);
+
+	/* Forget recent heap failures, so that the retry tries the preferred heaps again. */
+	mali_gralloc_ion_reset_heap_backoff();
+	mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_RETRY, usage, first->size);
+	err = backing_store_try_allocate(descriptors, numDescriptors, pHandle, shared);
+
+	if (err == -ENOMEM && degrade_buffer_formats(descriptors, numDescriptors))
+	{
+		mali_gralloc_budget_record(MALI_GRALLOC_DEGRADE_FORMAT, usage, first->size);
+		err = backing_store_try_allocate(descriptors, numDescriptors, pHandle, shared);
+	}
+
+	mali_gralloc_budget_record(err < 0 ? MALI_GRALLOC_DEGRADE_FAILED : MALI_GRALLOC_DEGRADE_RECOVERED, usage,
+	                           first->size);
+	return err;
+}
+
+static int buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
+                           uint32_t numDescriptors, buffer_handle_t *pHandle, bool *shared_backend)
 {
 	bool shared = false;
 	uint64_t backing_store_id = 0x0;
@@ -1055,7 +1312,7 @@ int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
 	}
 
 	/* Allocate ION backing store memory */
-	err = mali_gralloc_ion_allocate(descriptors, numDescriptors, pHandle, &shared);
+	err = backing_store_allocate(descriptors, numDescriptors, pHandle, &shared);
 	if (err < 0)
 	{
 		return err;
@@ -1072,8 +1329,6 @@ int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
 		private_handle_t *hnd = (private_handle_t *)pHandle[i];
 		uint64_t usage = bufDescriptor->consumer_usage | bufDescriptor->producer_usage;
 
-		mali_gralloc_dump_buffer_add(hnd);
-
 		if (shared)
 		{
 			/*each buffer will share the same backing store id.*/
@@ -1084,6 +1339,9 @@ int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
 			/* each buffer will have an unique backing store id.*/
 			hnd->backing_store_id = getUniqueId();
 		}
+
+		mali_gralloc_dump_buffer_add(hnd, bufDescriptor->name.c_str(), bufDescriptor->owner_pid);
+		mali_gralloc_budget_charge(hnd, bufDescriptor->owner_pid);
 	}
 
 	if (NULL != shared_backend)
@@ -1094,6 +1352,104 @@ int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
 	return 0;
 }
 
+/*
+ * Pools for MALI_GRALLOC_USAGE_POOLED buffers, configured by
+ * vendor.gralloc.pool.max_buffers (buffers per pool, 0 to disable) and
+ * vendor.gralloc.pool.idle_ms.
+ */
+static buffer_pools *pools = NULL;
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+static int pools_alloc(buffer_descriptor_t *descriptor, buffer_handle_t *handle)
+{
+	const gralloc_buffer_descriptor_t descriptors[1] = { (gralloc_buffer_descriptor_t)descriptor };
+	return buffer_allocate(descriptors, 1, handle, NULL);
+}
+
+static void pools_free(buffer_handle_t handle)
+{
+	mali_gralloc_buffer_free(handle);
+	native_handle_delete(const_cast<native_handle_t *>(handle));
+}
+
+static bool pools_hand_over(const buffer_descriptor_t &descriptor, buffer_handle_t handle)
+{
+	private_handle_t *hnd = (private_handle_t *)handle;
+	if (!mali_gralloc_budget_pid_allows(descriptor.owner_pid > 0 ? descriptor.owner_pid : getpid(),
+	                                    hnd->backing_store_size))
+	{
+		return false;
+	}
+
+	/* Spare buffers are accounted to the allocating process until taken. */
+	mali_gralloc_dump_buffer_set_owner(hnd, descriptor.owner_pid);
+	mali_gralloc_budget_transfer(hnd, descriptor.owner_pid);
+	return true;
+}
+
+static size_t pools_trim(void)
+{
+	return pools->trim();
+}
+
+static void pools_init(void)
+{
+	const int32_t max_buffers = property_get_int32("vendor.gralloc.pool.max_buffers", 8);
+	if (max_buffers <= 0)
+	{
+		return;
+	}
+
+	static const buffer_pool_backend backend = { pools_alloc, pools_free, pools_hand_over };
+	pools = new buffer_pools(backend, max_buffers, property_get_int32("vendor.gralloc.pool.idle_ms", 3000));
+	pools->start();
+	mali_gralloc_budget_register_trim(pools_trim);
+}
+
+void mali_gralloc_buffer_pool_reserve(const buffer_descriptor_t *descriptor, const uint32_t count)
+{
+	if (!((descriptor->producer_usage | descriptor->consumer_usage) & MALI_GRALLOC_USAGE_POOLED))
+	{
+		return;
+	}
+
+	pthread_once(&pools_once, pools_init);
+	if (pools != NULL)
+	{
+		pools->reserve(*descriptor, count);
+	}
+}
+
+void mali_gralloc_buffer_pool_dump(android::String8 &buf)
+{
+	if (pools != NULL)
+	{
+		pools->dump(buf);
+	}
+}
+
+int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
+                                 uint32_t numDescriptors, buffer_handle_t *pHandle, bool *shared_backend)
+{
+	buffer_descriptor_t * const first = (buffer_descriptor_t *)(descriptors[0]);
+
+	if (numDescriptors == 1 && ((first->producer_usage | first->consumer_usage) & MALI_GRALLOC_USAGE_POOLED))
+	{
+		pthread_once(&pools_once, pools_init);
+		/* Refused by the client's budget: allocated through the degradation ladder. */
+		if (pools != NULL && (pHandle[0] = pools->take(first)) != NULL)
+		{
+			if (NULL != shared_backend)
+			{
+				*shared_backend = false;
+			}
+			return 0;
+		}
+	}
+
+	return buffer_allocate(descriptors, numDescriptors, pHandle, shared_backend);
+}
+
 int mali_gralloc_buffer_free(buffer_handle_t pHandle)
 {
 	auto *hnd = const_cast<private_handle_t *>(
@@ -1104,10 +1460,15 @@ int mali_gralloc_buffer_free(buffer_handle_t pHandle)
 		return -1;
 	}
 
+	const uint64_t free_start = mali_gralloc_perf_now();
+	mali_gralloc_trace(MALI_GRALLOC_TRACE_FREE, hnd, 0);
+	mali_gralloc_dump_buffer_erase(hnd);
+	mali_gralloc_budget_uncharge(hnd);
 	mali_gralloc_ion_free(hnd);
 	gralloc_shared_memory_free(hnd->share_attr_fd, hnd->attr_base, hnd->attr_size);
 	hnd->share_fd = hnd->share_attr_fd = -1;
 	hnd->base = hnd->attr_base = MAP_FAILED;
+	mali_gralloc_perf_record(MALI_GRALLOC_STAGE_FREE, hnd->producer_usage | hnd->consumer_usage, free_start);
 
 	return 0;
 }
@@ -23,6 +23,8 @@
 #include "mali_gralloc_buffer.h"
 #include "core/mali_gralloc_bufferdescriptor.h"
 
+#include <utils/String8.h>
+
 /* Compression scheme */
 enum class AllocBaseType
 {
@@ -99,11 +101,34 @@ using alloc_type_t = AllocType;
 
 int mali_gralloc_derive_format_and_size(buffer_descriptor_t * const bufDescriptor);
 
+/*
+ * Estimates the DRAM traffic of one pass (a producer writing, or a consumer
+ * reading a whole frame) over a buffer allocated with 'alloc_format', from the
+ * plane sizes of the allocation.
+ *
+ * AFBC buffers are counted superblock padding included: headers in full, and
+ * bodies in proportion to 'afbc_body_percent', the expected size of compressed
+ * superblocks relative to uncompressed ones. Linear buffers are counted
+ * without the row padding up to the byte stride, which is never fetched.
+ *
+ * @return 0 on success, -EINVAL when 'alloc_format' can't be allocated.
+ */
+int mali_gralloc_estimate_pass_bytes(uint64_t alloc_format, int width, int height, uint64_t usage,
+                                     uint32_t afbc_body_percent, uint64_t *bytes);
+
 int mali_gralloc_buffer_allocate(const gralloc_buffer_descriptor_t *descriptors,
                                  uint32_t numDescriptors, buffer_handle_t *pHandle, bool *shared_backend);
 
 int mali_gralloc_buffer_free(buffer_handle_t pHandle);
 
+/*
+ * Keeps 'count' buffers of a MALI_GRALLOC_USAGE_POOLED descriptor ready for
+ * the next allocations of the same descriptor. No-op for other descriptors.
+ */
+void mali_gralloc_buffer_pool_reserve(const buffer_descriptor_t *descriptor, uint32_t count);
+
+void mali_gralloc_buffer_pool_dump(android::String8 &buf);
+
 void init_afbc(uint8_t *buf, uint64_t internal_format, const bool is_multi_plane, int w, int h);
 
 uint32_t lcm(uint32_t a, uint32_t b);
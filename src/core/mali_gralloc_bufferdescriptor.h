@@ -44,6 +44,9 @@ struct buffer_descriptor_t
 	std::string name;
 	uint64_t reserved_size;
 
+	/* Process the buffers are allocated for, 0 for the calling process. Not part of the encoded descriptor. */
+	int owner_pid;
+
 	/*
 	 * Calculated values that will be passed to the allocator in order to
 	 * allocate the buffer.
@@ -70,6 +73,7 @@ struct buffer_descriptor_t
 	    format_type(MALI_GRALLOC_FORMAT_TYPE_USAGE),
 	    name("Unnamed"),
 	    reserved_size(0),
+	    owner_pid(0),
 	    size(0),
 	    pixel_stride(0),
 	    alloc_format(0),
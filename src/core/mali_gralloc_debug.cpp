@@ -18,18 +18,144 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <map>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 
 #include <hardware/hardware.h>
 
 #include "mali_gralloc_debug.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_budget.h"
+#include "mali_gralloc_trace.h"
+#include "mali_gralloc_reaper.h"
+#include "mali_gralloc_scheduler.h"
+#include "mali_gralloc_lifetime.h"
+#include "mali_gralloc_bufferallocation.h"
+#include "mali_gralloc_usages.h"
+#include "format_info.h"
+#include "allocator/mali_gralloc_ion.h"
+
+#include <cutils/properties.h>
+
+/*
+ * Attribution of a live backing store.
+ *
+ * Buffers allocated together with a shared backend have the same backing
+ * store ID, so a record may be referenced by several handles. Records of
+ * backing stores handed over to another process have no handle left, and
+ * last until that process releases the backing store.
+ */
+struct buffer_record
+{
+	std::vector<private_handle_t *> handles;
+	uint64_t create_ns;
+	int pid;                    /* Owning process. */
+	uint64_t lifetime_id;       /* Backing store of another process, 0 otherwise. See mali_gralloc_lifetime.h. */
+	std::string name;
+	const char *heap;
+	uint64_t usage;             /* Combined usage of all the handles. */
+	uint64_t alloc_format;
+	uint64_t requested_bytes;   /* Unpadded size of the requested dimensions, for all handles. */
+	uint64_t allocated_bytes;   /* Size of the backing store. */
+};
+
+/* Totals of one aggregation key. */
+struct buffer_totals
+{
+	size_t count;
+	uint64_t requested_bytes;
+	uint64_t allocated_bytes;
+};
 
 static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
-static std::vector<private_handle_t *> dump_buffers;
+static std::unordered_map<uint64_t, buffer_record> dump_buffers;
+
+/* Number of records held for other processes after which released ones are swept. */
+#define HANDED_OVER_SWEEP_THRESHOLD 64
+
+/* Records without handle left in this process, and the point they are next swept at. */
+static size_t handed_over_count;
+static size_t handed_over_sweep_at = HANDED_OVER_SWEEP_THRESHOLD;
+
+static void dump_buffers_sweep_locked(void);
 static android::String8 dumpStrings;
 
-void mali_gralloc_dump_buffer_add(private_handle_t *handle)
+/*
+ * Size the buffer would have without any alignment, padding or compression
+ * overhead: requested dimensions, at the allocated format bits per pixel.
+ */
+static uint64_t buffer_requested_bytes(const private_handle_t *handle)
+{
+	const int32_t format_idx = get_format_index(handle->alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
+	if (format_idx < 0)
+	{
+		return 0;
+	}
+
+	const format_info_t &info = formats[format_idx];
+	uint64_t bits = 0;
+
+	for (int plane = 0; plane < info.npln; plane++)
+	{
+		const uint64_t hsub = (plane == 0) ? 1 : info.hsub;
+		const uint64_t vsub = (plane == 0) ? 1 : info.vsub;
+
+		bits += ((handle->width + hsub - 1) / hsub) * ((handle->height + vsub - 1) / vsub) * info.bpp[plane];
+	}
+
+	return (bits / 8) * std::max(handle->layer_count, 1u);
+}
+
+/* Short description of the AFBC layout, "-" for uncompressed buffers. */
+static std::string buffer_afbc_mode(const uint64_t alloc_format)
+{
+	if (!(alloc_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK))
+	{
+		return "-";
+	}
+
+	std::string mode;
+	if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_EXTRAWIDEBLK)
+	{
+		mode = "64x4";
+	}
+	else if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_WIDEBLK)
+	{
+		mode = "32x8";
+	}
+	else
+	{
+		mode = "16x16";
+	}
+
+	if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_SPLITBLK)
+	{
+		mode += ",split";
+	}
+	if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS)
+	{
+		mode += ",tiled";
+	}
+	if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_YUV_TRANSFORM)
+	{
+		mode += ",ytr";
+	}
+	if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_SPARSE)
+	{
+		mode += ",sparse";
+	}
+	if (alloc_format & MALI_GRALLOC_INTFMT_AFBC_DOUBLE_BODY)
+	{
+		mode += ",db";
+	}
+
+	return mode;
+}
+
+void mali_gralloc_dump_buffer_add(private_handle_t *handle, const char *name, const int pid)
 {
 	if (NULL == handle)
 	{
@@ -37,8 +163,32 @@ void mali_gralloc_dump_buffer_add(private_handle_t *handle)
 		return;
 	}
 
+	const uint64_t now = mali_gralloc_perf_now();
+	const uint64_t requested_bytes = buffer_requested_bytes(handle);
+	const int owner = (pid > 0) ? pid : getpid();
+	const uint64_t lifetime_id = (owner != getpid()) ? mali_gralloc_lifetime_id(handle) : 0;
+
 	pthread_mutex_lock(&dump_lock);
-	dump_buffers.push_back(handle);
+
+	auto result = dump_buffers.emplace(handle->backing_store_id, buffer_record());
+	buffer_record &record = result.first->second;
+	if (result.second)
+	{
+		record.create_ns = now;
+		record.pid = owner;
+		record.lifetime_id = lifetime_id;
+		record.name = (name != NULL) ? name : "";
+		record.heap = mali_gralloc_budget_heap_name(mali_gralloc_budget_heap_of(handle));
+		record.usage = 0;
+		record.alloc_format = handle->alloc_format;
+		record.requested_bytes = 0;
+		record.allocated_bytes = handle->backing_store_size;
+	}
+
+	record.handles.push_back(handle);
+	record.usage |= handle->producer_usage | handle->consumer_usage;
+	record.requested_bytes += requested_bytes;
+
 	pthread_mutex_unlock(&dump_lock);
 }
 
@@ -51,10 +201,105 @@ void mali_gralloc_dump_buffer_erase(private_handle_t *handle)
 	}
 
 	pthread_mutex_lock(&dump_lock);
-	dump_buffers.erase(std::remove(dump_buffers.begin(), dump_buffers.end(), handle), dump_buffers.end());
+
+	auto it = dump_buffers.find(handle->backing_store_id);
+	if (it != dump_buffers.end())
+	{
+		std::vector<private_handle_t *> &handles = it->second.handles;
+		const auto last = std::remove(handles.begin(), handles.end(), handle);
+		const bool removed = last != handles.end();
+		handles.erase(last, handles.end());
+		if (handles.empty() && it->second.lifetime_id == 0)
+		{
+			dump_buffers.erase(it);
+		}
+		else if (removed && handles.empty() && ++handed_over_count >= handed_over_sweep_at)
+		{
+			/* Bounds the records kept when buffers are never dumped. */
+			dump_buffers_sweep_locked();
+			handed_over_sweep_at = std::max<size_t>(HANDED_OVER_SWEEP_THRESHOLD, 2 * handed_over_count);
+		}
+	}
+
 	pthread_mutex_unlock(&dump_lock);
 }
 
+void mali_gralloc_dump_buffer_set_owner(private_handle_t *handle, const int pid)
+{
+	const int owner = (pid > 0) ? pid : getpid();
+	const uint64_t lifetime_id = (owner != getpid()) ? mali_gralloc_lifetime_id(handle) : 0;
+
+	pthread_mutex_lock(&dump_lock);
+
+	auto it = dump_buffers.find(handle->backing_store_id);
+	if (it != dump_buffers.end())
+	{
+		it->second.pid = owner;
+		it->second.lifetime_id = lifetime_id;
+	}
+
+	pthread_mutex_unlock(&dump_lock);
+}
+
+/*
+ * Drops the records of backing stores handed over to other processes, which
+ * have been released since.
+ */
+static void dump_buffers_sweep_locked(void)
+{
+	for (auto it = dump_buffers.begin(); it != dump_buffers.end();)
+	{
+		if (it->second.handles.empty() && !mali_gralloc_lifetime_alive(it->second.lifetime_id))
+		{
+			it = dump_buffers.erase(it);
+			handed_over_count--;
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+static void buffer_totals_add(buffer_totals &totals, const buffer_record &record)
+{
+	totals.count++;
+	totals.requested_bytes += record.requested_bytes;
+	totals.allocated_bytes += record.allocated_bytes;
+}
+
+template <typename Key>
+static void buffer_totals_dump(android::String8 &buf, const char *title, const std::map<Key, buffer_totals> &totals,
+                               std::string (*key_name)(const Key &))
+{
+	mali_gralloc_dump_string(buf, " %-32s %7s %12s %12s %12s\n", title, "count", "alloc KiB", "req KiB", "pad KiB");
+
+	for (const auto &entry : totals)
+	{
+		const buffer_totals &t = entry.second;
+		const uint64_t padding = (t.allocated_bytes > t.requested_bytes) ? t.allocated_bytes - t.requested_bytes : 0;
+
+		mali_gralloc_dump_string(buf, " %-32s %7zu %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+		                         key_name(entry.first).c_str(), t.count, t.allocated_bytes / 1024,
+		                         t.requested_bytes / 1024, padding / 1024);
+	}
+}
+
+static std::string pid_key_name(const int &pid)
+{
+	return std::to_string(pid);
+}
+
+static std::string string_key_name(const std::string &name)
+{
+	return name.empty() ? "<unnamed>" : name;
+}
+
+static std::string usage_key_name(const int &usage_class)
+{
+	return mali_gralloc_perf_usage_class_name(static_cast<mali_gralloc_usage_class>(usage_class));
+}
+
 void mali_gralloc_dump_string(android::String8 &buf, const char *fmt, ...)
 {
 	va_list args;
@@ -74,30 +319,93 @@ void mali_gralloc_dump_buffers(android::String8 &dumpStrings, uint32_t *outSize)
 	dumpStrings.clear();
 	mali_gralloc_dump_string(dumpStrings,
 	                         "-------------------------Start to dump Gralloc buffers info------------------------\n");
-	private_handle_t *hnd;
-	size_t num;
+	size_t num = 0;
 
 	mali_gralloc_dump_string(dumpStrings, "    handle  | width | height | stride |   req format   |internal "
 	                                      "format|consumer usage|producer usage| shared fd | AFBC "
 	                                      "|\n");
 	mali_gralloc_dump_string(dumpStrings, "------------+-------+--------+--------+----------------+---------------+----"
 	                                      "----------+--------------+-----------+------+\n");
+
+	std::map<int, buffer_totals> pid_totals;
+	std::map<std::string, buffer_totals> name_totals;
+	std::map<int, buffer_totals> usage_totals;
+	std::map<std::string, buffer_totals> heap_totals;
+	android::String8 records;
+	const uint64_t now = mali_gralloc_perf_now();
+
 	pthread_mutex_lock(&dump_lock);
 
-	for (num = 0; num < dump_buffers.size(); num++)
+	dump_buffers_sweep_locked();
+
+	for (const auto &entry : dump_buffers)
 	{
-		hnd = dump_buffers[num];
-		mali_gralloc_dump_string(dumpStrings, " %08" PRIxPTR " | %5d |  %5d |  %5d |    %08x    |    %09" PRIx64
-		                                      "  |   %09" PRIx64 "  |   %09" PRIx64 "  |  %08x | %4d |\n",
-		                         hnd, hnd->width, hnd->height, hnd->stride, hnd->req_format, hnd->internal_format,
-		                         hnd->consumer_usage, hnd->producer_usage, hnd->share_fd,
-		                         (hnd->internal_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK) ? true : false);
+		const buffer_record &record = entry.second;
+
+		for (const private_handle_t *hnd : record.handles)
+		{
+			mali_gralloc_dump_string(dumpStrings, " %08" PRIxPTR " | %5d |  %5d |  %5d |    %08x    |    %09" PRIx64
+			                                      "  |   %09" PRIx64 "  |   %09" PRIx64 "  |  %08x | %4d |\n",
+			                         hnd, hnd->width, hnd->height, hnd->stride, hnd->req_format, hnd->internal_format,
+			                         hnd->consumer_usage, hnd->producer_usage, hnd->share_fd,
+			                         (hnd->internal_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK) ? true : false);
+			num++;
+		}
+
+		mali_gralloc_dump_string(records, " %016" PRIx64 " %6d %10" PRIu64 " %-8s %10" PRIu64 " %10" PRIu64 " %-22s %s\n",
+		                         entry.first, record.pid, (now - record.create_ns) / 1000000, record.heap,
+		                         record.allocated_bytes, record.requested_bytes,
+		                         buffer_afbc_mode(record.alloc_format).c_str(), record.name.c_str());
+
+		buffer_totals_add(pid_totals[record.pid], record);
+		buffer_totals_add(name_totals[record.name], record);
+		buffer_totals_add(usage_totals[mali_gralloc_perf_usage_class(record.usage)], record);
+		buffer_totals_add(heap_totals[record.heap], record);
 	}
 
+	const size_t num_backing_stores = dump_buffers.size();
 	pthread_mutex_unlock(&dump_lock);
+
 	mali_gralloc_dump_string(
 	    dumpStrings, "---------------------End dump Gralloc buffers info with num %zu----------------------\n", num);
 
+	mali_gralloc_dump_string(dumpStrings,
+	                         "-------------------------Gralloc backing stores (%zu)------------------------------\n",
+	                         num_backing_stores);
+	mali_gralloc_dump_string(dumpStrings, " %-16s %6s %10s %-8s %10s %10s %-22s %s\n", "id", "pid", "age ms", "heap",
+	                         "alloc B", "req B", "afbc", "name");
+	dumpStrings.append(records);
+
+	mali_gralloc_dump_string(dumpStrings,
+	                         "-------------------------Gralloc memory attribution-------------------------------\n");
+	buffer_totals_dump(dumpStrings, "pid", pid_totals, pid_key_name);
+	buffer_totals_dump(dumpStrings, "name", name_totals, string_key_name);
+	buffer_totals_dump(dumpStrings, "usage", usage_totals, usage_key_name);
+	buffer_totals_dump(dumpStrings, "heap", heap_totals, string_key_name);
+
+	mali_gralloc_budget_dump(dumpStrings);
+	mali_gralloc_ion_dump(dumpStrings);
+	mali_gralloc_reaper_dump(dumpStrings);
+	mali_gralloc_buffer_pool_dump(dumpStrings);
+	mali_gralloc_sched_dump(dumpStrings);
+
+	mali_gralloc_perf_dump(dumpStrings);
+	mali_gralloc_trace_dump(dumpStrings);
+
+	/* Optionally keep the latencies as CSV, to track them across releases. */
+	char perf_file[PROPERTY_VALUE_MAX];
+	if (property_get("vendor.gralloc.perf_file", perf_file, NULL) > 0)
+	{
+		mali_gralloc_perf_save(perf_file);
+	}
+
+	/* Optionally keep the complete binary trace, for gralloc_trace_decode. */
+	char trace_file[PROPERTY_VALUE_MAX];
+	if (property_get("vendor.gralloc.trace_file", trace_file, NULL) > 0)
+	{
+		mali_gralloc_trace_save(trace_file);
+	}
+
 	*outSize = dumpStrings.size();
 }
 
@@ -24,9 +24,26 @@
 
 #include <hardware/gralloc1.h>
 
-void mali_gralloc_dump_buffer_add(private_handle_t *handle);
+/*
+ * Live buffer registry, keyed by backing store ID.
+ *
+ * Buffers are added once their backing store ID is assigned and erased when
+ * their backing store is freed. Both operations are O(1). Buffers allocated
+ * for another process stay listed until that process releases them, when
+ * this can be detected (see mali_gralloc_lifetime.h).
+ *
+ * @param handle [in]  Allocated buffer.
+ * @param name   [in]  Name given by the client to the buffer.
+ * @param pid    [in]  Process the buffer is allocated for, 0 for the calling process.
+ */
+void mali_gralloc_dump_buffer_add(private_handle_t *handle, const char *name, int pid);
 void mali_gralloc_dump_buffer_erase(private_handle_t *handle);
 
+/*
+ * Attributes a listed buffer to another owning process.
+ */
+void mali_gralloc_dump_buffer_set_owner(private_handle_t *handle, int pid);
+
 void mali_gralloc_dump_string(android::String8 &buf, const char *fmt, ...);
 void mali_gralloc_dump_buffers(android::String8 &dumpBuffer, uint32_t *outSize);
 void mali_gralloc_dump_internal(uint32_t *outSize, char *outBuffer);
@@ -25,6 +25,7 @@
 #include <log/log.h>
 #include <assert.h>
 #include <vector>
+#include <algorithm>
 
 #include <cutils/properties.h>
 
@@ -556,6 +557,7 @@ bool is_base_format_used_by_rk_video(const uint32_t base_format)
 {
 	if ( MALI_GRALLOC_FORMAT_INTERNAL_NV12 == base_format
 		|| MALI_GRALLOC_FORMAT_INTERNAL_NV16 == base_format
+		|| MALI_GRALLOC_FORMAT_INTERNAL_NV15 == base_format
 		|| MALI_GRALLOC_FORMAT_INTERNAL_YUV420_8BIT_I == base_format
 		|| MALI_GRALLOC_FORMAT_INTERNAL_YUV420_10BIT_I == base_format
 		|| MALI_GRALLOC_FORMAT_INTERNAL_YUV422_8BIT == base_format
@@ -886,11 +888,15 @@ static uint64_t get_afbc_format(const uint32_t base_format,
 				}
 
 				/*
-				 * NOTE: assume that all AFBC layers are pre-rotated. 16x16 SB
-				 * must be used with DPU consumer when rotation is required.
+				 * Wide blocks suit the line by line reads of unrotated scanout,
+				 * but a DPU rotating by 90/270 degrees reads columns, which span
+				 * twice as many 32x8 blocks: 16x16 SB must be used with DPU
+				 * consumer when rotation is required.
+				 * Layers without MALI_GRALLOC_USAGE_ROTATED_90 are assumed pre-rotated.
 				 */
 				if (producer_caps & MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_WIDEBLK &&
-				    consumer_caps & MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_WIDEBLK)
+				    consumer_caps & MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_WIDEBLK &&
+				    !(usage & MALI_GRALLOC_USAGE_ROTATED_90))
 				{
 					alloc_format |= MALI_GRALLOC_INTFMT_AFBC_WIDEBLK;
 				}
@@ -1663,32 +1669,52 @@ static bool is_not_to_use_non_afbc_for_small_buffers_required_via_prop()
 }
 
 /*
- * 从 size 角度判断 当前 buffer_of_fb_target_layer 是否 应该使用 AFBC.
+ * Policy of the AFBC cost model, see should_sf_client_layer_use_afbc_format_by_cost().
+ *
+ * vendor.gralloc.afbc_cost.body_percent   : expected size of compressed AFBC bodies,
+ *                                           in percent of the uncompressed size.
+ * vendor.gralloc.afbc_cost.margin_percent : minimum traffic AFBC must save, in percent
+ *                                           of the traffic of the linear buffer.
+ * vendor.gralloc.afbc_cost.min_saving_kb  : minimum traffic AFBC must save per frame.
+ *                                           By default, what a RGBA_8888 layer covering
+ *                                           a quarter of the framebuffer saves.
+ */
+#define AFBC_COST_DEFAULT_BODY_PERCENT 60
+#define AFBC_COST_DEFAULT_MARGIN_PERCENT 10
+
+/*
+ * 判断 当前 buffer_of_sf_client_layer 是否 应该使用 AFBC.
  *
  * 用于配合 HWC 的合成策略的实现,
- * 具体判断逻辑 来自 邮件列表 "要求Gralloc针对GraphicBuffer-Size动态开关AFBCD编码标识".
- * 基本的行为是对 size 较小的 buffer 不使用 AFBC 格式, 记为 use_non_afbc_for_small_buffers.
+ * 具体需求 来自 邮件列表 "要求Gralloc针对GraphicBuffer-Size动态开关AFBCD编码标识":
+ * AFBC layers are limited on the VOP, and should only go to the buffers for
+ * which AFBC saves enough DRAM traffic.
+ *
+ * The per-frame traffic of the linear and AFBC candidates is estimated from
+ * their allocation sizes: one write by the producer, and one read by each
+ * consumer. The GPU and the VOP are counted as one consumer, composing the
+ * layer in turn. Layers expected to be rotated by 90/270 degrees
+ * (MALI_GRALLOC_USAGE_ROTATED_90) are charged a GPU composition pass when linear.
  *
  * 预期 本函数 只会在 rk356x 运行时被调用.
  */
-static bool should_sf_client_layer_use_afbc_format_by_size(const uint64_t base_format, const int buffer_size)
+static bool should_sf_client_layer_use_afbc_format_by_cost(const uint64_t base_format,
+							   const uint64_t usage,
+							   const int width,
+							   const int height)
 {
-	int fb_size = get_fb_size();
-
-        /* 若格式 "不是" rgba_8888, 则 */
-        if ( MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 != base_format )
-        {
-                /* 将使用 AFBC 格式, 即 不参与 use_non_afbc_for_small_buffers. */
-                return true;
-        }
-        // 至此, base_format 都是 MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888
+	const int32_t format_idx = get_format_index(base_format);
+	if ( format_idx < 0 || !formats[format_idx].afbc )
+	{
+		return false;
+	}
 
 	/* 若外部 "有" '通过属性要求 对 sf_client_layer "不" 使用 AFBC 格式', 则... */
-        if ( is_no_afbc_for_sf_client_layer_required_via_prop() )
-        {
-                /* 将 "不" 使用 AFBC .*/
-                return false;
-        }
+	if ( is_no_afbc_for_sf_client_layer_required_via_prop() )
+	{
+		/* 将 "不" 使用 AFBC .*/
+		return false;
+	}
 
 	/* 若有 属性要求 禁用 use_non_afbc_for_small_buffers , 则... */
 	if ( is_not_to_use_non_afbc_for_small_buffers_required_via_prop() )
@@ -1698,24 +1724,62 @@ static bool should_sf_client_layer_use_afbc_format_by_size(const uint64_t base_f
 		return true;
 	}
 
-	/* 若 当前 buffer 足够 "小", 则... */
-	if ( buffer_size < (fb_size / 4) )
+	const uint32_t body_percent = std::min(100, std::max(1, property_get_int32("vendor.gralloc.afbc_cost.body_percent",
+										     AFBC_COST_DEFAULT_BODY_PERCENT)));
+	const uint32_t margin_percent = std::max(0, property_get_int32("vendor.gralloc.afbc_cost.margin_percent",
+								       AFBC_COST_DEFAULT_MARGIN_PERCENT));
+	const int32_t min_saving_kb = property_get_int32("vendor.gralloc.afbc_cost.min_saving_kb", -1);
+
+	uint64_t linear_bytes = 0;
+	uint64_t afbc_bytes = 0;
+	if ( mali_gralloc_estimate_pass_bytes(base_format, width, height, usage, body_percent, &linear_bytes) != 0
+		|| mali_gralloc_estimate_pass_bytes(base_format | MALI_GRALLOC_INTFMT_AFBC_BASIC, width, height, usage,
+						    body_percent, &afbc_bytes) != 0 )
 	{
-		D("should NOT to use AFBC: buffer_size : %d, fb_size : %d", buffer_size, fb_size);
-		/* 预期 "不" 使用 AFBC 格式. */
 		return false;
 	}
+
+	const uint16_t consumers = get_consumers(usage);
+	const uint16_t composers = MALI_GRALLOC_CONSUMER_GPU | MALI_GRALLOC_CONSUMER_DPU;
+	const uint64_t passes = 1 + ((consumers & composers) ? 1 : 0) + __builtin_popcount(consumers & ~composers);
+
+	uint64_t linear_traffic = linear_bytes * passes;
+	if ( (usage & MALI_GRALLOC_USAGE_ROTATED_90) && (consumers & MALI_GRALLOC_CONSUMER_DPU) )
+	{
+		/* The VOP rotates AFBC layers only: a linear layer is rotated by GPU composition, read and written once more. */
+		linear_traffic += linear_bytes * 2;
+	}
+	const uint64_t afbc_traffic = afbc_bytes * passes;
+	const uint64_t saving = (linear_traffic > afbc_traffic) ? linear_traffic - afbc_traffic : 0;
+
+	uint64_t min_saving;
+	if ( min_saving_kb >= 0 )
+	{
+		min_saving = (uint64_t)min_saving_kb * 1024;
+	}
 	else
 	{
-		D("SHOULD use AFBC: buffer_size : %d, fb_size : %d", buffer_size, fb_size);
-		return true;
+		/* Quarter of the framebuffer at 4 bytes per pixel, written and read once. */
+		min_saving = (uint64_t)get_fb_size() * 2 * (100 - body_percent) / 100;
 	}
+
+	const bool use_afbc = saving > 0
+		&& saving * 100 >= linear_traffic * margin_percent
+		&& saving >= min_saving;
+
+	D("%s use AFBC: %dx%d format 0x%" PRIx64 ", linear %" PRIu64 " bytes, AFBC %" PRIu64 " bytes, min saving %" PRIu64,
+	  use_afbc ? "SHOULD" : "should NOT to",
+	  width, height, base_format, linear_traffic, afbc_traffic, min_saving);
+
+	return use_afbc;
 }
 
 static uint64_t rk_gralloc_select_format(const uint64_t req_format,
 					 const uint64_t usage,
-					 const int buffer_size) // Buffer resolution (w x h, in pixels).
+					 const int width,
+					 const int height)
 {
+	const int buffer_size = width * height; // Buffer resolution (w x h, in pixels).
 	uint64_t internal_format = req_format;
 
 	/*-------------------------------------------------------*/
@@ -1733,8 +1797,8 @@ static uint64_t rk_gralloc_select_format(const uint64_t req_format,
 	}
 	else if ( HAL_PIXEL_FORMAT_YCrCb_NV12_10 == req_format )
 	{
-		I("to use 'MALI_GRALLOC_FORMAT_INTERNAL_P010' as internal_format for req_format of 'HAL_PIXEL_FORMAT_YCrCb_NV12_10'");
-		internal_format = MALI_GRALLOC_FORMAT_INTERNAL_P010; // 但实际上 这两种格式在 buffer layout 上 并不相同.
+		D("to use 'MALI_GRALLOC_FORMAT_INTERNAL_NV15' as internal_format for req_format of 'HAL_PIXEL_FORMAT_YCrCb_NV12_10'");
+		internal_format = MALI_GRALLOC_FORMAT_INTERNAL_NV15;
 	}
         else if ( req_format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED )
 	{
@@ -1818,6 +1882,7 @@ static uint64_t rk_gralloc_select_format(const uint64_t req_format,
 				|| (GRALLOC_USAGE_HW_CAMERA_READ == (usage & GRALLOC_USAGE_HW_CAMERA_READ) )
 				|| (internal_format == MALI_GRALLOC_FORMAT_INTERNAL_NV12)
 				|| (internal_format == MALI_GRALLOC_FORMAT_INTERNAL_P010)
+				|| (internal_format == MALI_GRALLOC_FORMAT_INTERNAL_NV15)
 				|| (internal_format == MALI_GRALLOC_FORMAT_INTERNAL_RGBA_16161616)
 				|| (internal_format == MALI_GRALLOC_FORMAT_INTERNAL_NV16) )
 			{
@@ -1892,15 +1957,19 @@ static uint64_t rk_gralloc_select_format(const uint64_t req_format,
                                 {
                                         /* 若 internal_format 不是 nv12,
                                            且 不是 MALI_GRALLOC_FORMAT_INTERNAL_P010,
+                                           且 不是 MALI_GRALLOC_FORMAT_INTERNAL_NV15,
                                            且 不是 MALI_GRALLOC_FORMAT_INTERNAL_NV16,
-                                           且 根据 size 判断 当前的 buffer_of_sf_client_layer 应该 使用 AFBC 格式,
+                                           且 根据 cost model 判断 当前的 buffer_of_sf_client_layer 应该 使用 AFBC 格式,
                                            则... */
                                         if ( internal_format != MALI_GRALLOC_FORMAT_INTERNAL_NV12
                                                 && internal_format != MALI_GRALLOC_FORMAT_INTERNAL_P010
+                                                && internal_format != MALI_GRALLOC_FORMAT_INTERNAL_NV15
                                                 && internal_format != MALI_GRALLOC_FORMAT_INTERNAL_RGBA_16161616
                                                 && internal_format != MALI_GRALLOC_FORMAT_INTERNAL_NV16
-                                                && should_sf_client_layer_use_afbc_format_by_size(internal_format,
-                                                                                                  buffer_size) )
+                                                && should_sf_client_layer_use_afbc_format_by_cost(internal_format,
+                                                                                                  usage,
+                                                                                                  width,
+                                                                                                  height) )
                                         {
                                                 /* 强制将 'internal_format' 设置为对应的 AFBC 格式. */
                                                 internal_format = internal_format | MALI_GRALLOC_INTFMT_AFBC_BASIC;
@@ -1923,7 +1992,8 @@ static uint64_t rk_gralloc_select_format(const uint64_t req_format,
  * @param req_format       [in]   Format (base + optional modifiers) requested by client.
  * @param type             [in]   Format type (public usage or internal).
  * @param usage            [in]   Buffer usage.
- * @param buffer_size      [in]   Buffer resolution (w x h, in pixels).
+ * @param width            [in]   Buffer width, in pixels.
+ * @param height           [in]   Buffer height, in pixels.
  * @param internal_format  [out]  Legacy format (base format as requested).
  *
  * @return alloc_format, format to be used in allocation;
@@ -1933,7 +2003,8 @@ static uint64_t rk_gralloc_select_format(const uint64_t req_format,
 uint64_t mali_gralloc_select_format(const uint64_t req_format,
                                     const mali_gralloc_format_type type,
                                     const uint64_t usage,
-                                    const int buffer_size,
+                                    const int width,
+                                    const int height,
                                     uint64_t * const internal_format)
 {
 /* < 若 USE_RK_SELECTING_FORMAT_MANNER 为 1, 则将使用 rk 的方式来选择 alloc_format 和 internal_format.> */
@@ -1941,15 +2012,15 @@ uint64_t mali_gralloc_select_format(const uint64_t req_format,
 // #error
 
 	GRALLOC_UNUSED(type);
-	GRALLOC_UNUSED(buffer_size);
 	uint64_t alloc_format;
 
-	*internal_format = rk_gralloc_select_format(req_format, usage, buffer_size);
+	*internal_format = rk_gralloc_select_format(req_format, usage, width, height);
 
 	alloc_format = *internal_format;
 
 	return alloc_format;
 #else
+	const int buffer_size = width * height;
 	uint64_t alloc_format = MALI_GRALLOC_FORMAT_INTERNAL_UNDEFINED;
 
 	/*
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+
+#include "mali_gralloc_lifetime.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_log.h"
+
+#define DMABUF_SYSFS_BUFFERS "/sys/kernel/dmabuf/buffers"
+
+static pthread_once_t sysfs_once = PTHREAD_ONCE_INIT;
+/* Written once by sysfs_init(). */
+static bool sysfs_available;
+
+static void sysfs_init(void)
+{
+	sysfs_available = access(DMABUF_SYSFS_BUFFERS, F_OK) == 0;
+	if (!sysfs_available)
+	{
+		MALI_GRALLOC_LOGI("dma-buf sysfs statistics not available: buffers are only accounted while allocated here");
+	}
+}
+
+static bool sysfs_lifetime_available(void *)
+{
+	pthread_once(&sysfs_once, sysfs_init);
+	return sysfs_available;
+}
+
+static bool sysfs_lifetime_alive(void *, const uint64_t inode)
+{
+	char path[64];
+	snprintf(path, sizeof(path), DMABUF_SYSFS_BUFFERS "/%" PRIu64, inode);
+	return access(path, F_OK) == 0;
+}
+
+static const mali_gralloc_lifetime_backend sysfs_backend = { sysfs_lifetime_available, sysfs_lifetime_alive, nullptr };
+static std::atomic<const mali_gralloc_lifetime_backend *> lifetime_backend(&sysfs_backend);
+
+void mali_gralloc_lifetime_set_backend(const mali_gralloc_lifetime_backend *backend)
+{
+	lifetime_backend.store(backend != nullptr ? backend : &sysfs_backend, std::memory_order_release);
+}
+
+uint64_t mali_gralloc_lifetime_id(const private_handle_t *hnd)
+{
+	const mali_gralloc_lifetime_backend *backend = lifetime_backend.load(std::memory_order_acquire);
+	struct stat st;
+
+	if (hnd->share_fd < 0 || !backend->available(backend->ctx) || fstat(hnd->share_fd, &st) != 0)
+	{
+		return 0;
+	}
+
+	return st.st_ino;
+}
+
+bool mali_gralloc_lifetime_alive(const uint64_t id)
+{
+	const mali_gralloc_lifetime_backend *backend = lifetime_backend.load(std::memory_order_acquire);
+	return id != 0 && backend->alive(backend->ctx, id);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_LIFETIME_H_
+#define MALI_GRALLOC_LIFETIME_H_
+
+/*
+ * Lifetime of backing stores allocated on behalf of other processes.
+ *
+ * The allocator service frees its own handle as soon as a buffer has been sent
+ * to the client, but the client keeps the backing store alive. Accounting
+ * attributed to the client (memory budgets, dump records) lasts until the
+ * dma-buf itself is released, which is probed through the dma-buf sysfs
+ * statistics (/sys/kernel/dmabuf/buffers/<inode>, CONFIG_DMABUF_SYSFS_STATS).
+ *
+ * Without them, the accounting of a buffer ends when the service frees its
+ * handle: budgets and attribution then only cover buffers allocated for the
+ * process itself.
+ */
+
+#include <stdint.h>
+
+struct private_handle_t;
+
+/*
+ * Probe of dma-buf lifetimes. Kept separate from the accounting so that it
+ * can be driven by a stand-in backend.
+ */
+struct mali_gralloc_lifetime_backend
+{
+	/* Whether released dma-bufs can be detected at all. */
+	bool (*available)(void *ctx);
+	/* Whether the dma-buf of the given inode is still allocated. */
+	bool (*alive)(void *ctx, uint64_t inode);
+	void *ctx;
+};
+
+/*
+ * Replaces the dma-buf sysfs probe, nullptr to restore it.
+ */
+void mali_gralloc_lifetime_set_backend(const mali_gralloc_lifetime_backend *backend);
+
+/*
+ * Returns the identifier of the backing store of a buffer, to be given to
+ * mali_gralloc_lifetime_alive() once the handle is freed, or 0 when its
+ * lifetime cannot be tracked.
+ */
+uint64_t mali_gralloc_lifetime_id(const private_handle_t *hnd);
+
+/*
+ * @return true when the backing store of a freed handle is still used by another process.
+ */
+bool mali_gralloc_lifetime_alive(uint64_t id);
+
+#endif /* MALI_GRALLOC_LIFETIME_H_ */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+#include <atomic>
+#include <algorithm>
+
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_usages.h"
+#include "mali_gralloc_debug.h"
+#include "mali_gralloc_log.h"
+
+/*
+ * Log-linear histogram of latencies.
+ *
+ * Each power of two from 2^MIN_SHIFT ns up to 2^MAX_SHIFT ns is split in
+ * SUB_BUCKETS linear buckets, giving a relative error below 25%. Bucket 0
+ * collects everything faster than 2^MIN_SHIFT ns and the last bucket
+ * everything slower than 2^MAX_SHIFT ns.
+ *
+ * Updates are relaxed atomics only, so recording never blocks an allocation.
+ */
+#define HIST_MIN_SHIFT 10    /* ~1us */
+#define HIST_MAX_SHIFT 34    /* ~17s */
+#define HIST_SUB_SHIFT 2
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_SHIFT)
+#define HIST_NUM_BUCKETS (2 + (HIST_MAX_SHIFT - HIST_MIN_SHIFT) * HIST_SUB_BUCKETS)
+
+struct latency_histogram
+{
+	std::atomic<uint32_t> buckets[HIST_NUM_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum_ns;
+	std::atomic<uint64_t> max_ns;
+};
+
+static latency_histogram stage_histograms[MALI_GRALLOC_STAGE_COUNT][MALI_GRALLOC_USAGE_CLASS_COUNT];
+static latency_histogram heap_histograms[MALI_GRALLOC_PERF_MAX_HEAPS];
+
+static const char *const stage_names[MALI_GRALLOC_STAGE_COUNT] = {
+	"select_format", "calc_size", "ion_alloc", "mmap", "init_afbc", "shared_memory", "total",
+	"import", "lock", "unlock", "free",
+};
+
+static const char *const usage_class_names[MALI_GRALLOC_USAGE_CLASS_COUNT] = {
+	"cpu", "gpu", "composer", "video", "camera", "protected",
+};
+
+static unsigned int hist_bucket(const uint64_t ns)
+{
+	if (ns < (1ULL << HIST_MIN_SHIFT))
+	{
+		return 0;
+	}
+
+	const unsigned int shift = 63 - __builtin_clzll(ns);
+	if (shift >= HIST_MAX_SHIFT)
+	{
+		return HIST_NUM_BUCKETS - 1;
+	}
+
+	const unsigned int sub = (ns >> (shift - HIST_SUB_SHIFT)) & (HIST_SUB_BUCKETS - 1);
+	return 1 + (shift - HIST_MIN_SHIFT) * HIST_SUB_BUCKETS + sub;
+}
+
+/* Upper bound of a bucket, in nanoseconds. */
+static uint64_t hist_bucket_limit(const unsigned int bucket)
+{
+	if (bucket == 0)
+	{
+		return 1ULL << HIST_MIN_SHIFT;
+	}
+	if (bucket >= HIST_NUM_BUCKETS - 1)
+	{
+		return UINT64_MAX;
+	}
+
+	const unsigned int shift = HIST_MIN_SHIFT + (bucket - 1) / HIST_SUB_BUCKETS;
+	const unsigned int sub = (bucket - 1) % HIST_SUB_BUCKETS;
+	return (1ULL << shift) + ((uint64_t)(sub + 1) << (shift - HIST_SUB_SHIFT));
+}
+
+static void hist_add(latency_histogram &hist, const uint64_t ns)
+{
+	hist.buckets[hist_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	hist.count.fetch_add(1, std::memory_order_relaxed);
+	hist.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+	uint64_t max = hist.max_ns.load(std::memory_order_relaxed);
+	while (ns > max && !hist.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+	{
+	}
+}
+
+/* Returns the upper bound of the bucket containing the given percentile. */
+static uint64_t hist_percentile(const latency_histogram &hist, const uint64_t count, const unsigned int percent)
+{
+	const uint64_t target = (count * percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for (unsigned int i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+		seen += hist.buckets[i].load(std::memory_order_relaxed);
+		if (seen >= target)
+		{
+			return hist_bucket_limit(i);
+		}
+	}
+
+	return hist.max_ns.load(std::memory_order_relaxed);
+}
+
+struct hist_summary
+{
+	uint64_t count;
+	uint64_t mean_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+};
+
+/* @return false when nothing was recorded. */
+static bool hist_summarize(const latency_histogram &hist, hist_summary *summary)
+{
+	const uint64_t count = hist.count.load(std::memory_order_relaxed);
+	if (count == 0)
+	{
+		return false;
+	}
+
+	const uint64_t max = hist.max_ns.load(std::memory_order_relaxed);
+	summary->count = count;
+	summary->mean_ns = hist.sum_ns.load(std::memory_order_relaxed) / count;
+	summary->p50_ns = std::min(hist_percentile(hist, count, 50), max);
+	summary->p90_ns = std::min(hist_percentile(hist, count, 90), max);
+	summary->p99_ns = std::min(hist_percentile(hist, count, 99), max);
+	summary->max_ns = max;
+	return true;
+}
+
+static void hist_dump(android::String8 &buf, const char *name, const char *sub_name, const latency_histogram &hist)
+{
+	hist_summary s;
+	if (!hist_summarize(hist, &s))
+	{
+		return;
+	}
+
+	mali_gralloc_dump_string(buf, " %-14s %-10s %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64
+	                              " %9" PRIu64 "\n",
+	                         name, sub_name, s.count, s.mean_ns / 1000, s.p50_ns / 1000, s.p90_ns / 1000,
+	                         s.p99_ns / 1000, s.max_ns / 1000);
+}
+
+static void hist_save(FILE *file, const char *name, const char *sub_name, const latency_histogram &hist)
+{
+	hist_summary s;
+	if (!hist_summarize(hist, &s))
+	{
+		return;
+	}
+
+	fprintf(file, "%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", name, sub_name,
+	        s.count, s.mean_ns, s.p50_ns, s.p90_ns, s.p99_ns, s.max_ns);
+}
+
+uint64_t mali_gralloc_perf_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+mali_gralloc_usage_class mali_gralloc_perf_usage_class(const uint64_t usage)
+{
+	if (usage & GRALLOC_USAGE_PROTECTED)
+	{
+		return MALI_GRALLOC_USAGE_CLASS_PROTECTED;
+	}
+	if ((usage & GRALLOC_USAGE_HW_VIDEO_ENCODER) || (usage & GRALLOC_USAGE_DECODER) == GRALLOC_USAGE_DECODER)
+	{
+		return MALI_GRALLOC_USAGE_CLASS_VIDEO;
+	}
+	if (usage & (GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_CAMERA_READ))
+	{
+		return MALI_GRALLOC_USAGE_CLASS_CAMERA;
+	}
+	if (usage & (GRALLOC_USAGE_HW_FB | GRALLOC_USAGE_HW_COMPOSER))
+	{
+		return MALI_GRALLOC_USAGE_CLASS_COMPOSER;
+	}
+	if (usage & (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_GPU_DATA_BUFFER))
+	{
+		return MALI_GRALLOC_USAGE_CLASS_GPU;
+	}
+	return MALI_GRALLOC_USAGE_CLASS_CPU;
+}
+
+const char *mali_gralloc_perf_usage_class_name(const mali_gralloc_usage_class usage_class)
+{
+	if (usage_class >= MALI_GRALLOC_USAGE_CLASS_COUNT)
+	{
+		return "unknown";
+	}
+
+	return usage_class_names[usage_class];
+}
+
+void mali_gralloc_perf_record(const mali_gralloc_alloc_stage stage, const uint64_t usage, const uint64_t start_ns)
+{
+	if (stage >= MALI_GRALLOC_STAGE_COUNT)
+	{
+		return;
+	}
+
+	hist_add(stage_histograms[stage][mali_gralloc_perf_usage_class(usage)], mali_gralloc_perf_now() - start_ns);
+}
+
+void mali_gralloc_perf_record_heap(const unsigned int heap_type, const uint64_t start_ns)
+{
+	const unsigned int slot = std::min(heap_type, (unsigned int)MALI_GRALLOC_PERF_MAX_HEAPS - 1);
+
+	hist_add(heap_histograms[slot], mali_gralloc_perf_now() - start_ns);
+}
+
+void mali_gralloc_perf_dump(android::String8 &buf)
+{
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc latency (us)-------------------------------------\n");
+	mali_gralloc_dump_string(buf, " %-14s %-10s %9s %9s %9s %9s %9s %9s\n",
+	                         "stage", "class", "count", "mean", "p50", "p90", "p99", "max");
+
+	for (int stage = 0; stage < MALI_GRALLOC_STAGE_COUNT; stage++)
+	{
+		for (int usage_class = 0; usage_class < MALI_GRALLOC_USAGE_CLASS_COUNT; usage_class++)
+		{
+			hist_dump(buf, stage_names[stage], usage_class_names[usage_class], stage_histograms[stage][usage_class]);
+		}
+	}
+
+	for (int heap = 0; heap < MALI_GRALLOC_PERF_MAX_HEAPS; heap++)
+	{
+		char heap_name[16];
+		snprintf(heap_name, sizeof(heap_name), "heap %d", heap);
+		hist_dump(buf, "ion_heap", heap_name, heap_histograms[heap]);
+	}
+}
+
+int mali_gralloc_perf_save(const char *path)
+{
+	FILE *file = fopen(path, "we");
+	if (file == NULL)
+	{
+		const int err = errno;
+		MALI_GRALLOC_LOGE("Unable to open latency file %s: %s", path, strerror(err));
+		return -err;
+	}
+
+	fprintf(file, "stage,class,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+
+	for (int stage = 0; stage < MALI_GRALLOC_STAGE_COUNT; stage++)
+	{
+		for (int usage_class = 0; usage_class < MALI_GRALLOC_USAGE_CLASS_COUNT; usage_class++)
+		{
+			hist_save(file, stage_names[stage], usage_class_names[usage_class], stage_histograms[stage][usage_class]);
+		}
+	}
+
+	for (int heap = 0; heap < MALI_GRALLOC_PERF_MAX_HEAPS; heap++)
+	{
+		char heap_name[16];
+		snprintf(heap_name, sizeof(heap_name), "heap%d", heap);
+		hist_save(file, "ion_heap", heap_name, heap_histograms[heap]);
+	}
+
+	if (fclose(file) != 0)
+	{
+		MALI_GRALLOC_LOGE("Unable to write latency file %s: %s", path, strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_PERF_H_
+#define MALI_GRALLOC_PERF_H_
+
+#include <stdint.h>
+#include <utils/String8.h>
+
+/*
+ * Stages of the allocation pipeline, and buffer operations after it, timed individually.
+ */
+typedef enum
+{
+	MALI_GRALLOC_STAGE_SELECT_FORMAT,   /* mali_gralloc_select_format(). */
+	MALI_GRALLOC_STAGE_CALC_SIZE,       /* Dimension adjustment and calc_allocation_size(). */
+	MALI_GRALLOC_STAGE_ION_ALLOC,       /* ION allocation ioctl(s), including fallback. */
+	MALI_GRALLOC_STAGE_MMAP,            /* Eager CPU mapping of the buffer. */
+	MALI_GRALLOC_STAGE_INIT_AFBC,       /* AFBC header initialisation, including cache sync. */
+	MALI_GRALLOC_STAGE_SHARED_MEMORY,   /* Shared attribute/metadata region allocation. */
+	MALI_GRALLOC_STAGE_TOTAL,           /* Complete allocation of one buffer. */
+	MALI_GRALLOC_STAGE_IMPORT,          /* Mapping of a buffer imported by another process. */
+	MALI_GRALLOC_STAGE_LOCK,            /* CPU lock: cache maintenance and prefault. */
+	MALI_GRALLOC_STAGE_UNLOCK,          /* CPU unlock: cache maintenance. */
+	MALI_GRALLOC_STAGE_FREE,            /* Release of the buffer memory. */
+	MALI_GRALLOC_STAGE_COUNT
+} mali_gralloc_alloc_stage;
+
+/*
+ * Coarse usage classes, so that latencies of different clients are not mixed up.
+ */
+typedef enum
+{
+	MALI_GRALLOC_USAGE_CLASS_CPU,
+	MALI_GRALLOC_USAGE_CLASS_GPU,
+	MALI_GRALLOC_USAGE_CLASS_COMPOSER,
+	MALI_GRALLOC_USAGE_CLASS_VIDEO,
+	MALI_GRALLOC_USAGE_CLASS_CAMERA,
+	MALI_GRALLOC_USAGE_CLASS_PROTECTED,
+	MALI_GRALLOC_USAGE_CLASS_COUNT
+} mali_gralloc_usage_class;
+
+/* Number of ION heap types tracked individually. Larger heap types share the last slot. */
+#define MALI_GRALLOC_PERF_MAX_HEAPS 16
+
+/*
+ * Current time of the monotonic clock.
+ *
+ * @return time in nanoseconds.
+ */
+uint64_t mali_gralloc_perf_now(void);
+
+/*
+ * Maps buffer usage to the usage class used to bucket latencies.
+ *
+ * @param usage [in]  Combined producer and consumer usage.
+ */
+mali_gralloc_usage_class mali_gralloc_perf_usage_class(uint64_t usage);
+
+/*
+ * Short name of a usage class, for dumps.
+ */
+const char *mali_gralloc_perf_usage_class_name(mali_gralloc_usage_class usage_class);
+
+/*
+ * Records the latency of an allocation stage. Lock-free, safe to call from any thread.
+ *
+ * @param stage     [in]  Allocation stage.
+ * @param usage     [in]  Combined producer and consumer usage of the buffer.
+ * @param start_ns  [in]  Start of the stage, from mali_gralloc_perf_now().
+ */
+void mali_gralloc_perf_record(mali_gralloc_alloc_stage stage, uint64_t usage, uint64_t start_ns);
+
+/*
+ * Records the latency of an ION allocation against the heap which satisfied it.
+ *
+ * @param heap_type [in]  ION heap type the buffer was allocated from.
+ * @param start_ns  [in]  Start of the allocation, from mali_gralloc_perf_now().
+ */
+void mali_gralloc_perf_record_heap(unsigned int heap_type, uint64_t start_ns);
+
+/*
+ * Appends a summary of the recorded latencies to a dump.
+ */
+void mali_gralloc_perf_dump(android::String8 &buf);
+
+/*
+ * Writes the recorded latencies to a file as CSV, one line per stage and
+ * usage class or heap, so that they can be compared across releases:
+ *
+ *   stage,class,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns
+ *
+ * @param path [in]  File to write, replaced if it exists.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int mali_gralloc_perf_save(const char *path);
+
+#endif /* MALI_GRALLOC_PERF_H_ */
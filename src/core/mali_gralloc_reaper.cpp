@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cutils/properties.h>
+
+#include "mali_gralloc_reaper.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_budget.h"
+#include "mali_gralloc_debug.h"
+#include "mali_gralloc_log.h"
+
+/*
+ * Time the worker waits for more buffers once the first one is queued, so
+ * that a swapchain being destroyed is released as a single batch.
+ */
+#define REAPER_BATCH_WINDOW_MS 4
+
+struct reaper_entry
+{
+	native_handle_t *handle;
+	mali_gralloc_release_fn release;
+};
+
+static pthread_once_t reaper_once = PTHREAD_ONCE_INIT;
+/* Maximum number of queued buffers, 0 when reclamation is synchronous. Written once by reaper_init(). */
+static size_t reaper_depth;
+
+/*
+ * Never destroyed: the worker thread is detached and may still be running
+ * when static objects are destroyed at process exit.
+ */
+static std::mutex &reaper_lock = *new std::mutex;
+static std::condition_variable &reaper_queued = *new std::condition_variable;
+static std::condition_variable &reaper_drained = *new std::condition_variable;
+static std::vector<reaper_entry> &reaper_queue = *new std::vector<reaper_entry>;
+/* Buffers taken by the worker and not released yet. */
+static size_t reaper_in_flight;
+
+/* Statistics, protected by reaper_lock. */
+static uint64_t stat_deferred;
+static uint64_t stat_synchronous;
+static uint64_t stat_batches;
+static size_t stat_max_queued;
+
+/*
+ * Releases a batch of buffers.
+ *
+ * @return number of backing store bytes released.
+ */
+static size_t reaper_release_batch(const std::vector<reaper_entry> &batch)
+{
+	size_t bytes = 0;
+
+	for (const reaper_entry &entry : batch)
+	{
+		bytes += static_cast<const private_handle_t *>(entry.handle)->backing_store_size;
+		entry.release(entry.handle);
+	}
+
+	return bytes;
+}
+
+static void reaper_worker(void)
+{
+	std::vector<reaper_entry> batch;
+	std::unique_lock<std::mutex> guard(reaper_lock);
+
+	while (true)
+	{
+		reaper_queued.wait(guard, [] { return !reaper_queue.empty(); });
+		reaper_queued.wait_for(guard, std::chrono::milliseconds(REAPER_BATCH_WINDOW_MS),
+		                       [] { return reaper_queue.size() >= reaper_depth / 2; });
+		if (reaper_queue.empty())
+		{
+			/* Emptied by mali_gralloc_reaper_flush(). */
+			continue;
+		}
+
+		batch.swap(reaper_queue);
+		reaper_in_flight = batch.size();
+		stat_batches++;
+
+		guard.unlock();
+		reaper_release_batch(batch);
+		batch.clear();
+		guard.lock();
+
+		reaper_in_flight = 0;
+		reaper_drained.notify_all();
+	}
+}
+
+static size_t reaper_trim(void)
+{
+	return mali_gralloc_reaper_flush();
+}
+
+static void reaper_init(void)
+{
+	const int32_t depth = property_get_int32("vendor.gralloc.reaper_depth", 0);
+	if (depth <= 0)
+	{
+		return;
+	}
+
+	reaper_depth = depth;
+	reaper_queue.reserve(reaper_depth);
+	std::thread(reaper_worker).detach();
+
+	/* Memory waiting in the queue is given back before allocations fail. */
+	mali_gralloc_budget_register_trim(reaper_trim);
+}
+
+void mali_gralloc_reaper_release(native_handle_t *handle, const mali_gralloc_release_fn release)
+{
+	pthread_once(&reaper_once, reaper_init);
+
+	if (reaper_depth != 0)
+	{
+		std::unique_lock<std::mutex> guard(reaper_lock);
+
+		if (reaper_queue.size() < reaper_depth)
+		{
+			reaper_queue.push_back({ handle, release });
+			stat_deferred++;
+			stat_max_queued = std::max(stat_max_queued, reaper_queue.size());
+
+			guard.unlock();
+			reaper_queued.notify_one();
+			return;
+		}
+
+		/* Queue full: the caller pays for the release. */
+		stat_synchronous++;
+	}
+
+	reaper_release_batch({ { handle, release } });
+}
+
+size_t mali_gralloc_reaper_flush(void)
+{
+	pthread_once(&reaper_once, reaper_init);
+
+	if (reaper_depth == 0)
+	{
+		return 0;
+	}
+
+	std::vector<reaper_entry> batch;
+	{
+		std::lock_guard<std::mutex> guard(reaper_lock);
+		batch.swap(reaper_queue);
+	}
+
+	const size_t bytes = reaper_release_batch(batch);
+
+	std::unique_lock<std::mutex> guard(reaper_lock);
+	reaper_drained.wait(guard, [] { return reaper_in_flight == 0; });
+
+	return bytes;
+}
+
+void mali_gralloc_reaper_dump(android::String8 &buf)
+{
+	pthread_once(&reaper_once, reaper_init);
+
+	if (reaper_depth == 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(reaper_lock);
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc deferred reclamation-----------------------------\n");
+	mali_gralloc_dump_string(buf, " queued %zu/%zu (max %zu) in flight %zu\n", reaper_queue.size(), reaper_depth,
+	                         stat_max_queued, reaper_in_flight);
+	mali_gralloc_dump_string(buf, " deferred %" PRIu64 " in %" PRIu64 " batches, synchronous %" PRIu64 "\n",
+	                         stat_deferred, stat_batches, stat_synchronous);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_REAPER_H_
+#define MALI_GRALLOC_REAPER_H_
+
+/*
+ * Deferred buffer reclamation.
+ *
+ * Unmapping a buffer shoots down TLB entries on all cores, and closing its
+ * last fd tears the dma-buf down in the context of the caller. Both are slow
+ * enough to stall the compositor when a swapchain is destroyed.
+ *
+ * When vendor.gralloc.reaper_depth is non-zero, released buffers are queued
+ * instead, and a worker thread releases them in batches. The queue holds at
+ * most reaper_depth buffers: once full, buffers are released synchronously
+ * by the caller, so that memory can never pile up behind a stalled worker.
+ */
+
+#include <stddef.h>
+#include <utils/String8.h>
+#include <cutils/native_handle.h>
+
+/*
+ * Releases all resources of a buffer handle, including the handle itself.
+ */
+typedef void (*mali_gralloc_release_fn)(native_handle_t *handle);
+
+/*
+ * Releases a buffer, on the worker thread when deferred reclamation is enabled.
+ *
+ * @param handle  [in]  Buffer to release. Owned by the reaper from now on.
+ * @param release [in]  Function releasing the buffer.
+ */
+void mali_gralloc_reaper_release(native_handle_t *handle, mali_gralloc_release_fn release);
+
+/*
+ * Releases all queued buffers on the calling thread, and waits for the batch
+ * in progress on the worker thread.
+ *
+ * @return number of backing store bytes released by the caller.
+ */
+size_t mali_gralloc_reaper_flush(void);
+
+void mali_gralloc_reaper_dump(android::String8 &buf);
+
+#endif /* MALI_GRALLOC_REAPER_H_ */
@@ -25,6 +25,7 @@
 #include "gralloc_buffer_priv.h"
 #include "mali_gralloc_bufferallocation.h"
 #include "mali_gralloc_debug.h"
+#include "mali_gralloc_perf.h"
 
 static pthread_mutex_t s_map_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -59,7 +60,9 @@ int mali_gralloc_reference_retain(buffer_handle_t handle)
 	}
 	else if (hnd->flags & (private_handle_t::PRIV_FLAGS_USES_ION))
 	{
+		const uint64_t map_start = mali_gralloc_perf_now();
 		retval = mali_gralloc_ion_map(hnd);
+		mali_gralloc_perf_record(MALI_GRALLOC_STAGE_IMPORT, hnd->producer_usage | hnd->consumer_usage, map_start);
 	}
 	else
 	{
@@ -99,10 +102,6 @@ int mali_gralloc_reference_release(buffer_handle_t handle, bool canFree)
 			{
 				close(hnd->fd);
 			}
-			else
-			{
-				mali_gralloc_dump_buffer_erase(hnd);
-			}
 			mali_gralloc_buffer_free(handle);
 			native_handle_delete(const_cast<native_handle_t *>(handle));
 
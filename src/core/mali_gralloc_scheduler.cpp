@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include <cutils/properties.h>
+
+#include "mali_gralloc_scheduler.h"
+#include "mali_gralloc_debug.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_usages.h"
+
+/* Usage of buffers on a frame deadline. */
+#define SCHED_URGENT_USAGE \
+	(GRALLOC_USAGE_HW_FB | GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_CAMERA_READ)
+
+struct sched_ticket
+{
+	bool admitted;
+};
+
+struct sched_stats
+{
+	uint64_t requests;
+	uint64_t queued;
+	uint64_t total_delay_ns;
+	uint64_t max_delay_ns;
+};
+
+static pthread_once_t sched_once = PTHREAD_ONCE_INIT;
+/* Number of allocations allowed to run at the same time, 0 when unlimited. Written once by sched_init(). */
+static uint32_t sched_slots;
+
+/* Never destroyed: binder threads may still be waiting at process exit. */
+static std::mutex &sched_lock = *new std::mutex;
+static std::condition_variable &sched_admitted = *new std::condition_variable;
+static std::deque<sched_ticket *> &sched_waiting_urgent = *new std::deque<sched_ticket *>;
+static std::deque<sched_ticket *> &sched_waiting_normal = *new std::deque<sched_ticket *>;
+static uint32_t sched_active;
+
+/* Statistics, protected by sched_lock. */
+static sched_stats stats[MALI_GRALLOC_SCHED_CLASS_COUNT];
+static size_t stat_max_waiting;
+
+static const char *const sched_class_names[MALI_GRALLOC_SCHED_CLASS_COUNT] = {
+	"urgent",
+	"normal",
+};
+
+static void sched_init(void)
+{
+	const int32_t slots = property_get_int32("vendor.gralloc.alloc_workers", 0);
+	if (slots > 0)
+	{
+		sched_slots = slots;
+	}
+}
+
+static std::deque<sched_ticket *> &sched_waiting(const mali_gralloc_sched_class sched_class)
+{
+	return sched_class == MALI_GRALLOC_SCHED_URGENT ? sched_waiting_urgent : sched_waiting_normal;
+}
+
+/*
+ * Takes a slot for the calling thread, waiting for one if needed. Called with sched_lock held.
+ *
+ * @return whether the request had to wait.
+ */
+static bool sched_acquire(std::unique_lock<std::mutex> &guard, const mali_gralloc_sched_class sched_class)
+{
+	if (sched_active < sched_slots && sched_waiting_urgent.empty() && sched_waiting_normal.empty())
+	{
+		sched_active++;
+		return false;
+	}
+
+	sched_ticket ticket = { false };
+	sched_waiting(sched_class).push_back(&ticket);
+	stat_max_waiting = std::max(stat_max_waiting, sched_waiting_urgent.size() + sched_waiting_normal.size());
+
+	sched_admitted.wait(guard, [&ticket] { return ticket.admitted; });
+	return true;
+}
+
+/*
+ * Gives the slot of the calling thread to the next request, urgent ones first. Called with sched_lock held.
+ */
+static void sched_release(void)
+{
+	sched_active--;
+
+	for (std::deque<sched_ticket *> *waiting : { &sched_waiting_urgent, &sched_waiting_normal })
+	{
+		if (!waiting->empty())
+		{
+			waiting->front()->admitted = true;
+			waiting->pop_front();
+			sched_active++;
+			sched_admitted.notify_all();
+			return;
+		}
+	}
+}
+
+mali_gralloc_sched_class mali_gralloc_sched_classify(const uint64_t usage)
+{
+	if ((usage & SCHED_URGENT_USAGE) != 0)
+	{
+		return MALI_GRALLOC_SCHED_URGENT;
+	}
+
+	return MALI_GRALLOC_SCHED_NORMAL;
+}
+
+void mali_gralloc_sched_run(const mali_gralloc_sched_class sched_class, const std::function<void()> &work)
+{
+	pthread_once(&sched_once, sched_init);
+
+	if (sched_slots == 0)
+	{
+		work();
+		return;
+	}
+
+	const uint64_t start_ns = mali_gralloc_perf_now();
+	{
+		std::unique_lock<std::mutex> guard(sched_lock);
+		const bool queued = sched_acquire(guard, sched_class);
+		const uint64_t delay_ns = mali_gralloc_perf_now() - start_ns;
+
+		sched_stats &s = stats[sched_class];
+		s.requests++;
+		if (queued)
+		{
+			s.queued++;
+			s.total_delay_ns += delay_ns;
+			s.max_delay_ns = std::max(s.max_delay_ns, delay_ns);
+		}
+	}
+
+	work();
+
+	std::lock_guard<std::mutex> guard(sched_lock);
+	sched_release();
+}
+
+void mali_gralloc_sched_dump(android::String8 &buf)
+{
+	pthread_once(&sched_once, sched_init);
+
+	if (sched_slots == 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(sched_lock);
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc allocation scheduling----------------------------\n");
+	mali_gralloc_dump_string(buf, " slots %u active %u waiting %zu (max %zu)\n", sched_slots, sched_active,
+	                         sched_waiting_urgent.size() + sched_waiting_normal.size(), stat_max_waiting);
+
+	for (int i = 0; i < MALI_GRALLOC_SCHED_CLASS_COUNT; i++)
+	{
+		const sched_stats &s = stats[i];
+		mali_gralloc_dump_string(buf, " %-6s requests %" PRIu64 " queued %" PRIu64 " delay avg %" PRIu64 " us max %" PRIu64
+		                              " us\n",
+		                         sched_class_names[i], s.requests, s.queued,
+		                         s.queued != 0 ? s.total_delay_ns / s.queued / 1000 : 0, s.max_delay_ns / 1000);
+	}
+}
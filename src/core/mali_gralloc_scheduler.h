@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_SCHEDULER_H_
+#define MALI_GRALLOC_SCHEDULER_H_
+
+/*
+ * Priority-aware admission of allocation requests.
+ *
+ * The allocator service handles requests on its binder threads first come,
+ * first served, so a burst of codec or background allocations delays the
+ * allocations of the compositor or of a camera preview, which sit on a frame
+ * deadline.
+ *
+ * When vendor.gralloc.alloc_workers is non-zero, at most that many
+ * allocations run at the same time. Requests beyond it wait for a slot, and
+ * slots go to urgent requests first, then in arrival order. The service
+ * should run more binder threads than there are slots (see
+ * vendor.gralloc.allocator.threads) so that urgent requests are received
+ * while the slots are busy.
+ *
+ * The work runs on the binder thread once admitted, as HIDL callbacks must
+ * be invoked on the thread that received the request.
+ */
+
+#include <stdint.h>
+#include <functional>
+#include <utils/String8.h>
+
+typedef enum
+{
+	/* Display, composer and camera buffers. */
+	MALI_GRALLOC_SCHED_URGENT,
+	MALI_GRALLOC_SCHED_NORMAL,
+	MALI_GRALLOC_SCHED_CLASS_COUNT
+} mali_gralloc_sched_class;
+
+/*
+ * Classifies an allocation request by the usage of its buffers.
+ *
+ * The caller identity is deliberately ignored: the compositor also
+ * allocates plenty of buffers that are not on a deadline.
+ *
+ * @param usage  [in]  Combined producer and consumer usage of the buffers.
+ */
+mali_gralloc_sched_class mali_gralloc_sched_classify(uint64_t usage);
+
+/*
+ * Runs allocation work on the calling thread, once admitted.
+ *
+ * @param sched_class  [in]  Class of the request.
+ * @param work         [in]  Allocation work.
+ */
+void mali_gralloc_sched_run(mali_gralloc_sched_class sched_class, const std::function<void()> &work);
+
+void mali_gralloc_sched_dump(android::String8 &buf);
+
+#endif /* MALI_GRALLOC_SCHEDULER_H_ */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+
+#include <cutils/properties.h>
+
+#include "mali_gralloc_trace.h"
+#include "mali_gralloc_perf.h"
+#include "mali_gralloc_debug.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_log.h"
+
+/* Number of records in the ring. Must be a power of 2. */
+#define TRACE_RING_SIZE 1024
+/* Number of most recent records included in text dumps. */
+#define TRACE_DUMP_RECORDS 256
+/* Interval between checks of the trace level property. */
+#define TRACE_LEVEL_REFRESH_NS 1000000000ULL
+
+/* 'seq' of a slot being written. Never a published value: sequences are 64-bit. */
+#define TRACE_SLOT_BUSY UINT64_MAX
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of 2");
+
+static mali_gralloc_trace_record ring[TRACE_RING_SIZE];
+static std::atomic<uint64_t> next_seq(0);
+
+static std::atomic<int> trace_level(-1);
+static std::atomic<uint64_t> trace_level_checked_ns(0);
+
+mali_gralloc_trace_level mali_gralloc_trace_get_level(void)
+{
+	const uint64_t now = mali_gralloc_perf_now();
+	int level = trace_level.load(std::memory_order_relaxed);
+
+	if (level < 0 || now - trace_level_checked_ns.load(std::memory_order_relaxed) > TRACE_LEVEL_REFRESH_NS)
+	{
+		level = property_get_int32("vendor.gralloc.trace_level", MALI_GRALLOC_TRACE_LEVEL_RING);
+		trace_level.store(level, std::memory_order_relaxed);
+		trace_level_checked_ns.store(now, std::memory_order_relaxed);
+	}
+
+	return static_cast<mali_gralloc_trace_level>(level);
+}
+
+void mali_gralloc_trace(const mali_gralloc_trace_event event, const private_handle_t *hnd, const uint64_t duration_ns)
+{
+	if (hnd == nullptr || mali_gralloc_trace_get_level() == MALI_GRALLOC_TRACE_LEVEL_OFF)
+	{
+		return;
+	}
+
+	/*
+	 * Each slot is published like a seqlock: the writer claims it by swapping
+	 * 'seq' to TRACE_SLOT_BUSY and sets it once the record is complete, so
+	 * readers can skip torn records. The claim fails when another writer, a
+	 * whole ring ahead or behind, holds the slot or has published a newer
+	 * record in it: the older record is then dropped.
+	 */
+	const uint64_t seq = next_seq.fetch_add(1, std::memory_order_relaxed);
+	mali_gralloc_trace_record *record = &ring[seq & (TRACE_RING_SIZE - 1)];
+
+	uint64_t published = __atomic_load_n(&record->seq, __ATOMIC_RELAXED);
+	do
+	{
+		if (published == TRACE_SLOT_BUSY || published > seq)
+		{
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&record->seq, &published, TRACE_SLOT_BUSY, true, __ATOMIC_RELAXED,
+	                                      __ATOMIC_RELAXED));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	record->timestamp_ns = mali_gralloc_perf_now();
+	record->buffer_id = hnd->backing_store_id;
+	record->alloc_format = hnd->alloc_format;
+	record->usage = hnd->producer_usage | hnd->consumer_usage;
+	record->duration_ns = static_cast<uint32_t>(std::min<uint64_t>(duration_ns, UINT32_MAX));
+	record->size = hnd->size;
+	record->width = static_cast<uint16_t>(hnd->width);
+	record->height = static_cast<uint16_t>(hnd->height);
+	record->event = static_cast<uint8_t>(event);
+	record->tid = static_cast<int32_t>(syscall(SYS_gettid));
+
+	__atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Copies the complete records of the ring, ordered by sequence. */
+static std::vector<mali_gralloc_trace_record> trace_snapshot(void)
+{
+	std::vector<mali_gralloc_trace_record> records;
+	records.reserve(TRACE_RING_SIZE);
+
+	for (int i = 0; i < TRACE_RING_SIZE; i++)
+	{
+		const uint64_t seq = __atomic_load_n(&ring[i].seq, __ATOMIC_ACQUIRE);
+		if (seq == 0 || seq == TRACE_SLOT_BUSY)
+		{
+			continue;
+		}
+
+		mali_gralloc_trace_record record = ring[i];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ring[i].seq, __ATOMIC_RELAXED) != seq)
+		{
+			continue;
+		}
+
+		record.seq = seq;
+		records.push_back(record);
+	}
+
+	std::sort(records.begin(), records.end(),
+	          [](const mali_gralloc_trace_record &a, const mali_gralloc_trace_record &b) { return a.seq < b.seq; });
+	return records;
+}
+
+void mali_gralloc_trace_dump(android::String8 &buf)
+{
+	const std::vector<mali_gralloc_trace_record> records = trace_snapshot();
+	const size_t first = records.size() > TRACE_DUMP_RECORDS ? records.size() - TRACE_DUMP_RECORDS : 0;
+
+	mali_gralloc_dump_string(buf, "-------------------------Gralloc trace (%zu of %" PRIu64 " events)--------------------\n",
+	                         records.size() - first, next_seq.load(std::memory_order_relaxed));
+
+	for (size_t i = first; i < records.size(); i++)
+	{
+		char line[256];
+		mali_gralloc_trace_format(&records[i], line, sizeof(line));
+		mali_gralloc_dump_string(buf, "%s", line);
+	}
+}
+
+int mali_gralloc_trace_save(const char *path)
+{
+	const std::vector<mali_gralloc_trace_record> records = trace_snapshot();
+
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		const int err = errno;
+		MALI_GRALLOC_LOGE("Unable to open trace file %s: %s", path, strerror(err));
+		return -err;
+	}
+
+	const mali_gralloc_trace_file_header header = {
+		.magic = MALI_GRALLOC_TRACE_MAGIC,
+		.version = MALI_GRALLOC_TRACE_VERSION,
+		.record_size = sizeof(mali_gralloc_trace_record),
+		.count = static_cast<uint32_t>(records.size()),
+		.pid = getpid(),
+		.reserved = 0,
+	};
+
+	int ret = 0;
+	const size_t records_size = records.size() * sizeof(mali_gralloc_trace_record);
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+	    write(fd, records.data(), records_size) != static_cast<ssize_t>(records_size))
+	{
+		MALI_GRALLOC_LOGE("Unable to write trace file %s: %s", path, strerror(errno));
+		ret = -EIO;
+	}
+
+	close(fd);
+	return ret;
+}
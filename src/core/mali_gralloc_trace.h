@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_TRACE_H_
+#define MALI_GRALLOC_TRACE_H_
+
+/*
+ * Binary trace of buffer lifetime events.
+ *
+ * Events are written as fixed-size records into a per-process ring, without
+ * any string formatting, so tracing can stay enabled on the allocation path.
+ * The ring is decoded when dumping, or saved to a file and decoded offline
+ * with gralloc_trace_decode.
+ *
+ * This header only depends on libc, so that the offline decoder can use it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+struct private_handle_t;
+namespace android
+{
+class String8;
+}
+
+/* Trace levels, selected at runtime with the vendor.gralloc.trace_level property. */
+typedef enum
+{
+	MALI_GRALLOC_TRACE_LEVEL_OFF = 0,   /* No tracing. */
+	MALI_GRALLOC_TRACE_LEVEL_RING = 1,  /* Binary ring only (default). */
+	MALI_GRALLOC_TRACE_LEVEL_TEXT = 2,  /* Binary ring and per-allocation text logging. */
+} mali_gralloc_trace_level;
+
+typedef enum
+{
+	MALI_GRALLOC_TRACE_ALLOC = 1,       /* Buffer allocated (duration: whole allocation). */
+	MALI_GRALLOC_TRACE_FREE,            /* Backing store freed by the allocating process. */
+	MALI_GRALLOC_TRACE_IMPORT,          /* Buffer imported through the mapper. */
+	MALI_GRALLOC_TRACE_RELEASE,         /* Imported buffer freed through the mapper. */
+	MALI_GRALLOC_TRACE_LOCK,            /* CPU access started (duration: cache sync). */
+	MALI_GRALLOC_TRACE_UNLOCK,          /* CPU access ended (duration: cache sync). */
+} mali_gralloc_trace_event;
+
+/* Magic and version of saved trace files. */
+#define MALI_GRALLOC_TRACE_MAGIC 0x43525447 /* "GTRC" */
+#define MALI_GRALLOC_TRACE_VERSION 2
+
+typedef struct
+{
+	uint64_t timestamp_ns;   /* CLOCK_MONOTONIC. */
+	uint64_t buffer_id;      /* Backing store ID, 0 when not yet assigned. */
+	uint64_t alloc_format;
+	uint64_t usage;          /* Combined producer and consumer usage. */
+	uint64_t seq;            /* Sequence number + 1 of the record, 0 for an empty or incomplete slot. */
+	uint32_t duration_ns;    /* Saturated at UINT32_MAX. */
+	int32_t size;
+	uint16_t width;
+	uint16_t height;
+	uint8_t event;           /* mali_gralloc_trace_event. */
+	uint8_t reserved[7];
+	int32_t tid;
+} mali_gralloc_trace_record;
+
+/* Header of saved trace files, followed by 'count' records ordered by sequence. */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t count;
+	int32_t pid;
+	uint32_t reserved;
+} mali_gralloc_trace_file_header;
+
+static_assert(sizeof(mali_gralloc_trace_record) == 64, "Trace record layout is part of the file format");
+
+static inline const char *mali_gralloc_trace_event_name(const uint8_t event)
+{
+	switch (event)
+	{
+	case MALI_GRALLOC_TRACE_ALLOC:
+		return "alloc";
+	case MALI_GRALLOC_TRACE_FREE:
+		return "free";
+	case MALI_GRALLOC_TRACE_IMPORT:
+		return "import";
+	case MALI_GRALLOC_TRACE_RELEASE:
+		return "release";
+	case MALI_GRALLOC_TRACE_LOCK:
+		return "lock";
+	case MALI_GRALLOC_TRACE_UNLOCK:
+		return "unlock";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * Formats a trace record as a single line of text.
+ *
+ * @return number of characters written, as snprintf().
+ */
+static inline int mali_gralloc_trace_format(const mali_gralloc_trace_record *record, char *buf, const size_t len)
+{
+	return snprintf(buf, len,
+	                "%10" PRIu64 ".%06" PRIu64 " tid %6d %-7s id 0x%016" PRIx64 " %5ux%-5u fmt 0x%09" PRIx64
+	                " usage 0x%09" PRIx64 " size %10d %8" PRIu32 "us\n",
+	                static_cast<uint64_t>(record->timestamp_ns / 1000000000),
+	                static_cast<uint64_t>((record->timestamp_ns / 1000) % 1000000), record->tid,
+	                mali_gralloc_trace_event_name(record->event), record->buffer_id, record->width, record->height,
+	                record->alloc_format, record->usage, record->size, record->duration_ns / 1000);
+}
+
+/*
+ * Returns the current trace level. Cheap enough to call on every event.
+ */
+mali_gralloc_trace_level mali_gralloc_trace_get_level(void);
+
+/*
+ * Records a buffer event. Lock-free, safe to call from any thread.
+ *
+ * @param event       [in]  Event type.
+ * @param hnd         [in]  Buffer the event applies to.
+ * @param duration_ns [in]  Duration of the operation, 0 when not applicable.
+ */
+void mali_gralloc_trace(mali_gralloc_trace_event event, const private_handle_t *hnd, uint64_t duration_ns);
+
+/*
+ * Appends the decoded content of the ring to a dump, oldest event first.
+ */
+void mali_gralloc_trace_dump(android::String8 &buf);
+
+/*
+ * Saves the content of the ring in the binary trace file format.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int mali_gralloc_trace_save(const char *path);
+
+#endif /* MALI_GRALLOC_TRACE_H_ */
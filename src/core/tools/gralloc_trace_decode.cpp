@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Offline decoder for gralloc trace files, saved by mali_gralloc_trace_save()
+ * (see the vendor.gralloc.trace_file property).
+ *
+ * Usage: gralloc_trace_decode <trace file>
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../mali_gralloc_trace.h"
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+		return 1;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	mali_gralloc_trace_file_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != MALI_GRALLOC_TRACE_MAGIC)
+	{
+		fprintf(stderr, "%s is not a gralloc trace file\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+
+	if (header.version != MALI_GRALLOC_TRACE_VERSION || header.record_size != sizeof(mali_gralloc_trace_record))
+	{
+		fprintf(stderr, "Unsupported trace version %u (record size %u)\n", header.version, header.record_size);
+		fclose(file);
+		return 1;
+	}
+
+	printf("pid %d, %u events\n", header.pid, header.count);
+
+	mali_gralloc_trace_record record;
+	for (uint32_t i = 0; i < header.count && fread(&record, sizeof(record), 1, file) == 1; i++)
+	{
+		char line[256];
+		mali_gralloc_trace_format(&record, line, sizeof(line));
+		fputs(line, stdout);
+	}
+
+	fclose(file);
+	return 0;
+}
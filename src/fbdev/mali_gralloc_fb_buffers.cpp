@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019-2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fbdev/mali_gralloc_fb_buffers.h"
+
+#include "mali_gralloc_log.h"
+
+uint32_t fb_negotiate_buffers(const struct fb_device_ops *ops, struct fb_var_screeninfo *info, const uint32_t wanted)
+{
+	const uint32_t yres = info->yres;
+
+	for (uint32_t num_buffers = wanted; num_buffers >= FB_MIN_BUFFERS; num_buffers--)
+	{
+		info->yres_virtual = yres * num_buffers;
+		if (ops->put_var(ops->ctx, info) != 0)
+		{
+			MALI_GRALLOC_LOGW("FBIOPUT_VSCREENINFO failed for %u buffers", num_buffers);
+			continue;
+		}
+
+		/* Drivers may clamp the virtual resolution rather than fail. */
+		if (ops->get_var(ops->ctx, info) != 0)
+		{
+			break;
+		}
+
+		const uint32_t available = info->yres_virtual / yres;
+		if (available >= FB_MIN_BUFFERS)
+		{
+			if (available < wanted)
+			{
+				MALI_GRALLOC_LOGW("Using %u framebuffer buffers instead of %u", available, wanted);
+			}
+			return available < num_buffers ? available : num_buffers;
+		}
+	}
+
+	MALI_GRALLOC_LOGW("page flipping not supported (yres_virtual=%d, requested=%d)", info->yres_virtual, yres * 2);
+	info->yres_virtual = yres;
+	ops->put_var(ops->ctx, info);
+	return 1;
+}
+
+uint32_t fb_take_slot(uint32_t *mask, const uint32_t num_buffers)
+{
+	const uint32_t all = (1U << num_buffers) - 1;
+	if ((*mask & all) == all)
+	{
+		*mask = 0;
+	}
+
+	for (uint32_t i = 0; i < num_buffers; i++)
+	{
+		if ((*mask & (1U << i)) == 0)
+		{
+			*mask |= 1U << i;
+			return i;
+		}
+	}
+
+	/* Not reached: a slot is always free after the reset above. */
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019-2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MALI_GRALLOC_FB_BUFFERS_H
+#define MALI_GRALLOC_FB_BUFFERS_H
+
+#include <stdint.h>
+#include <linux/fb.h>
+
+/*
+ * Number of framebuffer page-flip buffers requested from the driver, 2 to 4.
+ * More buffers let the renderer run ahead of the display instead of
+ * stalling in fb_post.
+ */
+#ifndef GRALLOC_FB_NUM_BUFFERS
+#define GRALLOC_FB_NUM_BUFFERS 2
+#endif
+
+#define FB_MIN_BUFFERS 2
+#define FB_MAX_BUFFERS 4
+
+#if GRALLOC_FB_NUM_BUFFERS < FB_MIN_BUFFERS || GRALLOC_FB_NUM_BUFFERS > FB_MAX_BUFFERS
+#error "GRALLOC_FB_NUM_BUFFERS must be between 2 and 4"
+#endif
+
+/*
+ * Screen information access of a framebuffer device. Kept separate from the
+ * framebuffer code so that buffer negotiation can be driven by a fake device.
+ */
+struct fb_device_ops
+{
+	/* FBIOPUT_VSCREENINFO. @return 0 on success, -1 otherwise. */
+	int (*put_var)(void *ctx, struct fb_var_screeninfo *info);
+	/* FBIOGET_VSCREENINFO. @return 0 on success, -1 otherwise. */
+	int (*get_var)(void *ctx, struct fb_var_screeninfo *info);
+	void *ctx;
+};
+
+/*
+ * Sets up the virtual resolution for as many page-flip buffers as possible,
+ * from 'wanted' down to 2, falling back to a single buffer when the driver
+ * cannot provide a virtual resolution of twice the screen height.
+ *
+ * @param ops     [in]     Device access.
+ * @param info    [inout]  Screen information to apply. Updated with the one in use.
+ * @param wanted  [in]     Number of buffers to try first.
+ *
+ * @return number of buffers available, 1 when page flipping is not supported.
+ */
+uint32_t fb_negotiate_buffers(const struct fb_device_ops *ops, struct fb_var_screeninfo *info, uint32_t wanted);
+
+/*
+ * Takes a free page-flip buffer slot.
+ *
+ * Framebuffer buffers are never freed individually: once every slot has been
+ * handed out, the display has been reinitialised and all slots are reused.
+ *
+ * @param mask         [inout]  Bitmask of slots in use.
+ * @param num_buffers  [in]     Number of slots.
+ *
+ * @return index of the slot taken.
+ */
+uint32_t fb_take_slot(uint32_t *mask, uint32_t num_buffers);
+
+#endif
@@ -17,6 +17,7 @@
  */
 
 #include "fbdev/mali_gralloc_framebuffer.h"
+#include "fbdev/mali_gralloc_fb_buffers.h"
 
 #include <string.h>
 #include <errno.h>
@@ -56,14 +57,21 @@ struct fb_dmabuf_export
 };
 #define FBIOGET_DMABUF _IOR('F', 0x21, struct fb_dmabuf_export)
 
-/* Number of buffers for page flipping */
-#define NUM_BUFFERS 2
-
 enum
 {
 	PAGE_FLIP = 0x00000001,
 };
 
+static int fb_put_var(void *ctx, struct fb_var_screeninfo *info)
+{
+	return ioctl(*static_cast<int *>(ctx), FBIOPUT_VSCREENINFO, info) == -1 ? -1 : 0;
+}
+
+static int fb_get_var(void *ctx, struct fb_var_screeninfo *info)
+{
+	return ioctl(*static_cast<int *>(ctx), FBIOGET_VSCREENINFO, info) == -1 ? -1 : 0;
+}
+
 static int init_frame_buffer_locked(struct private_module_t *module)
 {
 	if (module->framebuffer)
@@ -141,26 +149,12 @@ static int init_frame_buffer_locked(struct private_module_t *module)
 #endif
 
 	/*
-	 * Request NUM_BUFFERS screens (at lest 2 for page flipping)
+	 * Request GRALLOC_FB_NUM_BUFFERS screens, or as many as the driver provides (at least 2 for page flipping)
 	 */
-	info.yres_virtual = info.yres * NUM_BUFFERS;
-
-	uint32_t flags = PAGE_FLIP;
-
-	if (ioctl(fd, FBIOPUT_VSCREENINFO, &info) == -1)
-	{
-		info.yres_virtual = info.yres;
-		flags &= ~PAGE_FLIP;
-		MALI_GRALLOC_LOGW("FBIOPUT_VSCREENINFO failed, page flipping not supported fd: %d", fd);
-	}
+	const fb_device_ops ops = { fb_put_var, fb_get_var, &fd };
+	const uint32_t numBuffers = fb_negotiate_buffers(&ops, &info, GRALLOC_FB_NUM_BUFFERS);
 
-	if (info.yres_virtual < info.yres * 2)
-	{
-		// we need at least 2 for page-flipping
-		info.yres_virtual = info.yres;
-		flags &= ~PAGE_FLIP;
-		MALI_GRALLOC_LOGW("page flipping not supported (yres_virtual=%d, requested=%d)", info.yres_virtual, info.yres * 2);
-	}
+	uint32_t flags = numBuffers > 1 ? PAGE_FLIP : 0;
 
 	if (ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
 	{
@@ -270,7 +264,7 @@ static int init_frame_buffer_locked(struct private_module_t *module)
 	                                           finfo.line_length, info.xres_virtual, info.yres_virtual,
 	                                           module->fbdev_format);
 
-	module->numBuffers = info.yres_virtual / info.yres;
+	module->numBuffers = numBuffers;
 	module->bufferMask = 0;
 
 	return 0;
@@ -354,7 +348,6 @@ static int fb_alloc_framebuffer_locked(mali_gralloc_module *m, uint64_t consumer
 		}
 	}
 
-	uint32_t bufferMask = m->bufferMask;
 	const uint32_t numBuffers = m->numBuffers;
 	/* framebufferSize is used for allocating the handle to the framebuffer and refers
 	 *                 to the size of the actual framebuffer.
@@ -379,26 +372,8 @@ static int fb_alloc_framebuffer_locked(mali_gralloc_module *m, uint64_t consumer
 		                                alignedFramebufferSize, newConsumerUsage, newProducerUsage, pHandle);
 	}
 
-	if (bufferMask >= ((1LU << numBuffers) - 1))
-	{
-		// We ran out of buffers, reset bufferMask
-		bufferMask = 0;
-		m->bufferMask = 0;
-	}
-
-	uintptr_t framebufferVaddr = (uintptr_t)m->framebuffer->base;
-
-	// find a free slot
-	for (uint32_t i = 0; i < numBuffers; i++)
-	{
-		if ((bufferMask & (1LU << i)) == 0)
-		{
-			m->bufferMask |= (1LU << i);
-			break;
-		}
-
-		framebufferVaddr += framebufferSize;
-	}
+	const uint32_t slot = fb_take_slot(&m->bufferMask, numBuffers);
+	const uintptr_t framebufferVaddr = (uintptr_t)m->framebuffer->base + slot * framebufferSize;
 
 	// The entire framebuffer memory is already mapped, now create a buffer object for parts of this memory
 	private_handle_t *hnd = new private_handle_t(
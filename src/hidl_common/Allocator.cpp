@@ -26,6 +26,8 @@
 
 #include "Allocator.h"
 
+#include <hwbinder/IPCThreadState.h>
+
 #if GRALLOC_USE_SHARED_METADATA
 #include "SharedMetadata.h"
 #else
@@ -35,6 +37,10 @@
 #include "core/mali_gralloc_bufferallocation.h"
 #include "core/mali_gralloc_bufferdescriptor.h"
 #include "core/format_info.h"
+#include "core/mali_gralloc_perf.h"
+#include "core/mali_gralloc_trace.h"
+#include "core/mali_gralloc_reaper.h"
+#include "core/mali_gralloc_scheduler.h"
 #include "allocator/mali_gralloc_ion.h"
 #include "allocator/mali_gralloc_shared_memory.h"
 #include "gralloc_priv.h"
@@ -46,8 +52,20 @@ namespace allocator
 namespace common
 {
 
-void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllocator::allocate_cb hidl_cb,
-              std::function<int(const buffer_descriptor_t *, buffer_handle_t *)> fb_allocator)
+/*
+ * Frees the allocator's copy of a buffer once it has been handed to the client
+ *
+ * @param bufferHandle [in] Buffer handle owned by the allocator
+ */
+static void releaseBuffer(native_handle_t *bufferHandle)
+{
+	mali_gralloc_buffer_free(bufferHandle);
+	native_handle_delete(bufferHandle);
+}
+
+static void allocateBuffers(const buffer_descriptor_t &bufferDescriptor, uint32_t count,
+                            IAllocator::allocate_cb hidl_cb,
+                            std::function<int(const buffer_descriptor_t *, buffer_handle_t *)> fb_allocator)
 {
 #if DISABLE_FRAMEBUFFER_HAL
 	GRALLOC_UNUSED(fb_allocator);
@@ -61,9 +79,13 @@ void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllo
 	grallocBufferDescriptor[0] = (gralloc_buffer_descriptor_t)(&bufferDescriptor);
 	grallocBuffers.reserve(count);
 
+	/* Keep a whole set ready for the next allocation of pooled buffers. */
+	mali_gralloc_buffer_pool_reserve(&bufferDescriptor, count);
+
 	for (uint32_t i = 0; i < count; i++)
 	{
 		buffer_handle_t tmpBuffer = nullptr;
+		const uint64_t alloc_start = mali_gralloc_perf_now();
 
 		int allocResult;
 #if (DISABLE_FRAMEBUFFER_HAL != 1)
@@ -92,8 +114,11 @@ void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllo
 #else
 			hnd->attr_size = sizeof(attr_region);
 #endif
+			const uint64_t stage_start = mali_gralloc_perf_now();
 			std::tie(hnd->share_attr_fd, hnd->attr_base) =
 			    gralloc_shared_memory_allocate("gralloc_shared_memory", hnd->attr_size);
+			mali_gralloc_perf_record(MALI_GRALLOC_STAGE_SHARED_MEMORY,
+			                         bufferDescriptor.consumer_usage | bufferDescriptor.producer_usage, stage_start);
 			if (hnd->share_attr_fd < 0 || hnd->attr_base == MAP_FAILED)
 			{
 				MALI_GRALLOC_LOGE("%s, shared memory allocation failed with errno %d", __func__, errno);
@@ -129,32 +154,36 @@ void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllo
 			munmap(hnd->attr_base, hnd->attr_size);
 			hnd->attr_base = MAP_FAILED;
 
-			buffer_descriptor_t * const bufDescriptor = (buffer_descriptor_t *)(grallocBufferDescriptor[0]);
-			D("got new private_handle_t instance @%p for buffer '%s'. share_fd : %d, share_attr_fd : %d, "
-				"flags : 0x%x, width : %d, height : %d, "
-				"req_format : 0x%x, producer_usage : 0x%" PRIx64 ", consumer_usage : 0x%" PRIx64 ", "
-				"internal_format : 0x%" PRIx64 ", stride : %d, byte_stride : %d, "
-				"internalWidth : %d, internalHeight : %d, "
-				"alloc_format : 0x%" PRIx64 ", size : %d, layer_count : %u, backing_store_size : %d, "
-				"allocating_pid : %d, ref_count : %d, yuv_info : %d",
-				hnd, (bufDescriptor->name).c_str() == nullptr ? "unset" : (bufDescriptor->name).c_str(),
-			  hnd->share_fd, hnd->share_attr_fd,
-			  hnd->flags, hnd->width, hnd->height,
-			  hnd->req_format, hnd->producer_usage, hnd->consumer_usage,
-			  hnd->internal_format, hnd->stride, hnd->byte_stride,
-			  hnd->internalWidth, hnd->internalHeight,
-			  hnd->alloc_format, hnd->size, hnd->layer_count, hnd->backing_store_size,
-			  hnd->allocating_pid, hnd->ref_count, hnd->yuv_info);
-			ALOGD("plane_info[0]: offset : %u, byte_stride : %u, alloc_width : %u, alloc_height : %u",
-					(hnd->plane_info)[0].offset,
-					(hnd->plane_info)[0].byte_stride,
-					(hnd->plane_info)[0].alloc_width,
-					(hnd->plane_info)[0].alloc_height);
-			ALOGD("plane_info[1]: offset : %u, byte_stride : %u, alloc_width : %u, alloc_height : %u",
-					(hnd->plane_info)[1].offset,
-					(hnd->plane_info)[1].byte_stride,
-					(hnd->plane_info)[1].alloc_width,
-					(hnd->plane_info)[1].alloc_height);
+			/* Per-allocation text logging is only enabled with the highest trace level. */
+			if (mali_gralloc_trace_get_level() >= MALI_GRALLOC_TRACE_LEVEL_TEXT)
+			{
+				buffer_descriptor_t * const bufDescriptor = (buffer_descriptor_t *)(grallocBufferDescriptor[0]);
+				D("got new private_handle_t instance @%p for buffer '%s'. share_fd : %d, share_attr_fd : %d, "
+					"flags : 0x%x, width : %d, height : %d, "
+					"req_format : 0x%x, producer_usage : 0x%" PRIx64 ", consumer_usage : 0x%" PRIx64 ", "
+					"internal_format : 0x%" PRIx64 ", stride : %d, byte_stride : %d, "
+					"internalWidth : %d, internalHeight : %d, "
+					"alloc_format : 0x%" PRIx64 ", size : %d, layer_count : %u, backing_store_size : %d, "
+					"allocating_pid : %d, ref_count : %d, yuv_info : %d",
+					hnd, (bufDescriptor->name).c_str() == nullptr ? "unset" : (bufDescriptor->name).c_str(),
+				  hnd->share_fd, hnd->share_attr_fd,
+				  hnd->flags, hnd->width, hnd->height,
+				  hnd->req_format, hnd->producer_usage, hnd->consumer_usage,
+				  hnd->internal_format, hnd->stride, hnd->byte_stride,
+				  hnd->internalWidth, hnd->internalHeight,
+				  hnd->alloc_format, hnd->size, hnd->layer_count, hnd->backing_store_size,
+				  hnd->allocating_pid, hnd->ref_count, hnd->yuv_info);
+				ALOGD("plane_info[0]: offset : %u, byte_stride : %u, alloc_width : %u, alloc_height : %u",
+						(hnd->plane_info)[0].offset,
+						(hnd->plane_info)[0].byte_stride,
+						(hnd->plane_info)[0].alloc_width,
+						(hnd->plane_info)[0].alloc_height);
+				ALOGD("plane_info[1]: offset : %u, byte_stride : %u, alloc_width : %u, alloc_height : %u",
+						(hnd->plane_info)[1].offset,
+						(hnd->plane_info)[1].byte_stride,
+						(hnd->plane_info)[1].alloc_width,
+						(hnd->plane_info)[1].alloc_height);
+			}
 		}
 
 		int tmpStride = 0;
@@ -181,6 +210,10 @@ void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllo
 			break;
 		}
 
+		mali_gralloc_perf_record(MALI_GRALLOC_STAGE_TOTAL,
+		                         bufferDescriptor.consumer_usage | bufferDescriptor.producer_usage, alloc_start);
+		mali_gralloc_trace(MALI_GRALLOC_TRACE_ALLOC, static_cast<const private_handle_t *>(tmpBuffer),
+		                   mali_gralloc_perf_now() - alloc_start);
 		grallocBuffers.emplace_back(hidl_handle(tmpBuffer));
 	}
 
@@ -197,11 +230,24 @@ void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllo
 	 */
 	for (const auto &buffer : grallocBuffers)
 	{
-		mali_gralloc_buffer_free(buffer.getNativeHandle());
-		native_handle_delete(const_cast<native_handle_t *>(buffer.getNativeHandle()));
+		native_handle_t *bufferHandle = const_cast<native_handle_t *>(buffer.getNativeHandle());
+		mali_gralloc_reaper_release(bufferHandle, releaseBuffer);
 	}
 }
 
+void allocate(const buffer_descriptor_t &bufferDescriptor, uint32_t count, IAllocator::allocate_cb hidl_cb,
+              std::function<int(const buffer_descriptor_t *, buffer_handle_t *)> fb_allocator)
+{
+	const mali_gralloc_sched_class sched_class =
+	    mali_gralloc_sched_classify(bufferDescriptor.producer_usage | bufferDescriptor.consumer_usage);
+
+	/* Buffers are accounted to the client, which keeps them once this process has freed its copy. */
+	buffer_descriptor_t clientDescriptor = bufferDescriptor;
+	clientDescriptor.owner_pid = android::hardware::IPCThreadState::self()->getCallingPid();
+
+	mali_gralloc_sched_run(sched_class, [&]() { allocateBuffers(clientDescriptor, count, hidl_cb, fb_allocator); });
+}
+
 } // namespace common
 } // namespace allocator
 } // namespace arm
@@ -18,6 +18,8 @@
 
 #include <inttypes.h>
 #include <sync/sync.h>
+#include <cutils/properties.h>
+#include <algorithm>
 #include "RegisteredHandlePool.h"
 #include "Mapper.h"
 #include "BufferDescriptor.h"
@@ -27,6 +29,8 @@
 #include "core/mali_gralloc_bufferaccess.h"
 #include "core/mali_gralloc_reference.h"
 #include "core/format_info.h"
+#include "core/mali_gralloc_trace.h"
+#include "core/mali_gralloc_reaper.h"
 #include "allocator/mali_gralloc_ion.h"
 #include "mali_gralloc_buffer.h"
 #include "mali_gralloc_log.h"
@@ -309,18 +313,22 @@ void importBuffer(const hidl_handle& rawHandle, IMapper::importBuffer_cb hidl_cb
 		return;
 	}
 
+	mali_gralloc_trace(MALI_GRALLOC_TRACE_IMPORT, static_cast<const private_handle_t *>(bufferHandle), 0);
 	hidl_cb(Error::NONE, bufferHandle);
 }
 
-Error freeBuffer(void* buffer)
+/*
+ * Releases the resources of a buffer handle that has been removed from the
+ * registered handle pool
+ *
+ * @param bufferHandle [in] Imported buffer handle to release
+ *
+ * @return Error::BAD_BUFFER when failed to release the buffer
+ *         Error::NONE on successful release
+ */
+static Error releaseBuffer(native_handle_t *bufferHandle)
 {
-	native_handle_t * const bufferHandle = gRegisteredHandles->remove(buffer);
-	if (!bufferHandle)
-	{
-		MALI_GRALLOC_LOGE("Invalid buffer handle %p to freeBuffer", buffer);
-		return Error::BAD_BUFFER;
-	}
-
+	mali_gralloc_trace(MALI_GRALLOC_TRACE_RELEASE, static_cast<const private_handle_t *>(bufferHandle), 0);
 #if HIDL_MAPPER_VERSION_SCALED >= 400
 	{
 		auto *private_handle = static_cast<private_handle_t *>(bufferHandle);
@@ -344,6 +352,43 @@ Error freeBuffer(void* buffer)
 	return Error::NONE;
 }
 
+/*
+ * Releases an imported buffer handle on behalf of the reaper
+ *
+ * @param bufferHandle [in] Imported buffer handle to release
+ */
+static void reapBuffer(native_handle_t *bufferHandle)
+{
+	releaseBuffer(bufferHandle);
+}
+
+Error freeBuffer(void* buffer)
+{
+	bool deferred = false;
+	native_handle_t * const bufferHandle = gRegisteredHandles->remove(buffer, &deferred);
+	if (!bufferHandle)
+	{
+		MALI_GRALLOC_LOGE("Invalid buffer handle %p to freeBuffer", buffer);
+		return Error::BAD_BUFFER;
+	}
+
+	if (deferred)
+	{
+		/* The buffer is being dumped, the dump releases it once done. */
+		return Error::NONE;
+	}
+
+	if (private_handle_t::validate(bufferHandle) < 0)
+	{
+		MALI_GRALLOC_LOGE("Buffer: %p is corrupted", bufferHandle);
+		return Error::BAD_BUFFER;
+	}
+
+	/* Errors past validation are only logged, as the release may be deferred. */
+	mali_gralloc_reaper_release(bufferHandle, reapBuffer);
+	return Error::NONE;
+}
+
 void lock(void* buffer, uint64_t cpuUsage, const IMapper::Rect& accessRegion,
           const hidl_handle& acquireFence, IMapper::lock_cb hidl_cb)
 {
@@ -875,13 +920,80 @@ void dumpBuffer(void *buffer, IMapper::dumpBuffer_cb hidl_cb)
 	hidl_cb(Error::NONE, bufferDump);
 }
 
+/* Number of buffers encoded before their pins are dropped in dumpBuffers. */
+#define DUMP_BUFFERS_CHUNK_SIZE 16
+
+/*
+ * Optional filter for dumpBuffers, read from system properties:
+ * vendor.gralloc.dump_pid, vendor.gralloc.dump_usage (any of the bits) and
+ * vendor.gralloc.dump_format (requested format).
+ */
+struct dump_filter
+{
+	int pid;
+	uint64_t usage;
+	int format;
+
+	dump_filter()
+	    : pid(property_get_int32("vendor.gralloc.dump_pid", 0))
+	    , usage(static_cast<uint64_t>(property_get_int64("vendor.gralloc.dump_usage", 0)))
+	    , format(property_get_int32("vendor.gralloc.dump_format", 0))
+	{
+	}
+
+	bool matches(const private_handle_t *handle) const
+	{
+		if (pid != 0 && handle->allocating_pid != pid && handle->remote_pid != pid)
+		{
+			return false;
+		}
+		if (usage != 0 && ((handle->producer_usage | handle->consumer_usage) & usage) == 0)
+		{
+			return false;
+		}
+		if (format != 0 && handle->req_format != format)
+		{
+			return false;
+		}
+		return true;
+	}
+};
+
 void dumpBuffers(IMapper::dumpBuffers_cb hidl_cb)
 {
+	/*
+	 * Only the snapshot is taken under the pool lock. Pinned buffers stay valid
+	 * while their metadata is encoded, so lock/unlock and import/free from other
+	 * threads are never stalled by the dump.
+	 */
+	const std::vector<buffer_handle_t> handles = gRegisteredHandles->pin_all();
+	const dump_filter filter;
+
 	std::vector<IMapper::BufferDump> bufferDumps;
-	gRegisteredHandles->for_each([&bufferDumps](buffer_handle_t buffer) {
-		IMapper::BufferDump bufferDump { dumpBufferHelper(static_cast<const private_handle_t *>(buffer)) };
-		bufferDumps.push_back(bufferDump);
-	});
+	bufferDumps.reserve(handles.size());
+	for (size_t first = 0; first < handles.size(); first += DUMP_BUFFERS_CHUNK_SIZE)
+	{
+		const size_t last = std::min(first + DUMP_BUFFERS_CHUNK_SIZE, handles.size());
+		for (size_t i = first; i < last; i++)
+		{
+			auto handle = static_cast<const private_handle_t *>(handles[i]);
+			if (filter.matches(handle))
+			{
+				bufferDumps.push_back({ dumpBufferHelper(handle) });
+			}
+		}
+
+		/* Unpin the chunk straight away, so buffers freed meanwhile are not held for the whole dump. */
+		for (size_t i = first; i < last; i++)
+		{
+			native_handle_t *removed = gRegisteredHandles->unpin(handles[i]);
+			if (removed != nullptr)
+			{
+				releaseBuffer(removed);
+			}
+		}
+	}
+
 	hidl_cb(Error::NONE, hidl_vec<IMapper::BufferDump>(bufferDumps));
 }
 
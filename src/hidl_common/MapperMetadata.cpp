@@ -35,8 +35,6 @@ namespace mapper
 namespace common
 {
 
-using aidl::android::hardware::graphics::common::PlaneLayout;
-using aidl::android::hardware::graphics::common::PlaneLayoutComponent;
 using aidl::android::hardware::graphics::common::Rect;
 using aidl::android::hardware::graphics::common::Dataspace;
 using aidl::android::hardware::graphics::common::BlendMode;
@@ -53,225 +51,169 @@ static int get_num_planes(const private_handle_t *hnd)
 	return hnd->is_multi_plane() ? (hnd->plane_info[2].offset == 0 ? 2 : 3) : 1;
 }
 
-static std::vector<std::vector<PlaneLayoutComponent>> plane_layout_components_from_handle(const private_handle_t *hnd)
+static const ExtendableType &plane_layout_component_type(const format_component_type_t type)
 {
-	/* Re-define the component constants to make the table easier to read. */
-	const ExtendableType R = android::gralloc4::PlaneLayoutComponentType_R;
-	const ExtendableType G = android::gralloc4::PlaneLayoutComponentType_G;
-	const ExtendableType B = android::gralloc4::PlaneLayoutComponentType_B;
-	const ExtendableType A = android::gralloc4::PlaneLayoutComponentType_A;
-	const ExtendableType CB = android::gralloc4::PlaneLayoutComponentType_CB;
-	const ExtendableType CR = android::gralloc4::PlaneLayoutComponentType_CR;
-	const ExtendableType Y = android::gralloc4::PlaneLayoutComponentType_Y;
-	const ExtendableType RAW = android::gralloc4::PlaneLayoutComponentType_RAW;
-
-	struct table_entry
+	switch (type)
 	{
-		uint32_t drm_fourcc;
-		std::vector<std::vector<PlaneLayoutComponent>> components;
-	};
+	case CMP_R:
+		return android::gralloc4::PlaneLayoutComponentType_R;
+	case CMP_G:
+		return android::gralloc4::PlaneLayoutComponentType_G;
+	case CMP_B:
+		return android::gralloc4::PlaneLayoutComponentType_B;
+	case CMP_A:
+		return android::gralloc4::PlaneLayoutComponentType_A;
+	case CMP_Y:
+		return android::gralloc4::PlaneLayoutComponentType_Y;
+	case CMP_CB:
+		return android::gralloc4::PlaneLayoutComponentType_CB;
+	case CMP_CR:
+		return android::gralloc4::PlaneLayoutComponentType_CR;
+	case CMP_RAW:
+	default:
+		return android::gralloc4::PlaneLayoutComponentType_RAW;
+	}
+}
 
-	/* clang-format off */
-	static table_entry table[] = {
-		/* 16 bit RGB(A) */
-		{
-			.drm_fourcc = DRM_FORMAT_RGB565,
-			.components = { { { B, 0, 5 }, { G, 5, 6 }, { R, 11, 5 } } }
-		},
-		{
-			.drm_fourcc = DRM_FORMAT_BGR565,
-			.components = { { { R, 0, 5 }, { G, 5, 6 }, { B, 11, 5 } } }
-		},
-		/* 24 bit RGB(A) */
-		{
-			.drm_fourcc = DRM_FORMAT_BGR888,
-			.components = { { { R, 0, 8 }, { G, 8, 8 }, { B, 16, 8 } } }
-		},
-		/* 32 bit RGB(A) */
-		{
-			.drm_fourcc = DRM_FORMAT_ARGB8888,
-			.components = { { { B, 0, 8 }, { G, 8, 8 }, { R, 16, 8 }, { A, 24, 8 } } }
-		},
-		{
-			.drm_fourcc = DRM_FORMAT_ABGR8888,
-			.components = { { { R, 0, 8 }, { G, 8, 8 }, { B, 16, 8 }, { A, 24, 8 } } }
-		},
-		{
-			.drm_fourcc = DRM_FORMAT_XBGR8888,
-			.components = { { { R, 0, 8 }, { G, 8, 8 }, { B, 16, 8 } } }
-		},
-		{
-			.drm_fourcc = DRM_FORMAT_ABGR2101010,
-			.components = { { { R, 0, 10 }, { G, 10, 10 }, { B, 20, 10 }, { A, 30, 2 } } }
-		},
-		/* 64 bit RGB(A) */
-		{
-			.drm_fourcc = DRM_FORMAT_ABGR16161616F,
-			.components = { { { R, 0, 16 }, { G, 16, 16 }, { B, 32, 16 }, { A, 48, 16 } } }
-		},
-		/* Single plane 8 bit YUV 4:2:2 */
-		{
-			.drm_fourcc = DRM_FORMAT_YUYV,
-			.components = { { { Y, 0, 8 }, { CB, 8, 8 }, { Y, 16, 8 }, { CR, 24, 8 } } }
-		},
-		/* Single plane 10 bit YUV 4:4:4 */
-		{
-			.drm_fourcc = DRM_FORMAT_Y410,
-			.components = { { { CB, 0, 10 }, { Y, 10, 10 }, { CR, 20, 10 }, { A, 30, 2 } } }
-		},
-		/* Single plane 10 bit YUV 4:2:2 */
-		{
-			.drm_fourcc = DRM_FORMAT_Y210,
-			.components = { { { Y, 6, 10 }, { CB, 22, 10 }, { Y, 38, 10 }, { CR, 54, 10 } } }
-		},
-		/* Single plane 10 bit YUV 4:2:0 */
-		{
-			.drm_fourcc = DRM_FORMAT_Y0L2,
-			.components = { {
-				{ Y, 0, 10 }, { CB, 10, 10 }, { Y, 20, 10 }, { A, 30, 1 }, { A, 31, 1 },
-				{ Y, 32, 10 }, { CR, 42, 10 }, { Y, 52, 10 }, { A, 62, 1 }, { A, 63, 1 }
-			} }
-		},
-		/* Semi-planar 8 bit YUV 4:2:2 */
-		{
-			.drm_fourcc = DRM_FORMAT_NV16,
-			.components = {
-				{ { Y, 0, 8 } },
-				{ { CB, 0, 8 }, { CR, 8, 8 } }
-			}
-		},
-		/* Semi-planar 8 bit YUV 4:2:0 */
-		{
-			.drm_fourcc = DRM_FORMAT_NV12,
-			.components = {
-				{ { Y, 0, 8 } },
-				{ { CB, 0, 8 }, { CR, 8, 8 } }
-			}
-		},
-		{
-			.drm_fourcc = DRM_FORMAT_NV21,
-			.components = {
-				{ { Y, 0, 8 } },
-				{ { CR, 0, 8 }, { CB, 8, 8 } }
-			}
-		},
-		/* Semi-planar 10 bit YUV 4:2:2 */
-		{
-			.drm_fourcc = DRM_FORMAT_P210,
-			.components = {
-				{ { Y, 6, 10 } },
-				{ { CB, 6, 10 }, { CB, 22, 10 } }
-			}
-		},
-		/* Semi-planar 10 bit YUV 4:2:0 */
-		{
-			.drm_fourcc = DRM_FORMAT_P010,
-			.components = {
-				{ { Y, 6, 10 } },
-				{ { CB, 6, 10 }, { CB, 22, 10 } }
-			}
-		},
-		/* Planar 8 bit YUV 4:2:0 */
-		{
-			.drm_fourcc = DRM_FORMAT_YVU420,
-			.components = {
-				{ { Y, 0, 8 } },
-				{ { CR, 0, 8 } },
-				{ { CB, 0, 8 } }
-			}
-		},
-		/* Planar 8 bit YUV 4:4:4 */
-		{
-			.drm_fourcc = DRM_FORMAT_YUV444,
-			.components = {
-				{ { Y, 0, 8 } },
-				{ { CB, 0, 8 } },
-				{ { CR, 0, 8 } }
-			}
-		},
+/*
+ * Writes metadata values using the standard Gralloc 4 encoding (native endian
+ * int64_t values, strings as an int64_t length followed by the characters).
+ * With no output buffer, only the encoded size is accumulated.
+ */
+class metadata_writer
+{
+public:
+	explicit metadata_writer(uint8_t *data)
+	    : m_data(data)
+	    , m_offset(0)
+	{
+	}
 
-		/* AFBC Only FourCC */
-		{.drm_fourcc = DRM_FORMAT_YUV420_8BIT, .components = { {} } },
-		{.drm_fourcc = DRM_FORMAT_YUV420_10BIT, .components = { {} } },
-	};
-	/* clang-format on */
+	void put_int64(const int64_t value)
+	{
+		put_bytes(&value, sizeof(value));
+	}
 
-	/* Special case for formats that can't be represented by a DRM fourcc */
-	switch (hnd->alloc_format)
+	void put_string(const char *str, const size_t length)
 	{
-	case MALI_GRALLOC_FORMAT_INTERNAL_RAW10:
-	case MALI_GRALLOC_FORMAT_INTERNAL_RAW12:
-		std::vector<std::vector<PlaneLayoutComponent>> components = { { { RAW, 0, -1 } } };
-		return components;
+		put_int64(static_cast<int64_t>(length));
+		put_bytes(str, length);
 	}
 
-	const uint32_t drm_fourcc = drm_fourcc_from_handle(hnd);
-	if (drm_fourcc != DRM_FORMAT_INVALID)
+	void put_extendable_type(const char *name, const size_t name_length, const int64_t value)
 	{
-		for (const auto& entry : table)
+		put_string(name, name_length);
+		put_int64(value);
+	}
+
+	size_t size() const
+	{
+		return m_offset;
+	}
+
+private:
+	void put_bytes(const void *src, const size_t size)
+	{
+		if (m_data != nullptr)
 		{
-			if (entry.drm_fourcc == drm_fourcc)
-			{
-				return entry.components;
-			}
+			memcpy(m_data + m_offset, src, size);
 		}
+		m_offset += size;
 	}
 
-	MALI_GRALLOC_LOGW("Could not find component description for FourCC value %x", drm_fourcc);
-	return std::vector<std::vector<PlaneLayoutComponent>>(0);
-}
+	uint8_t *m_data;
+	size_t m_offset;
+};
 
-static android::status_t get_plane_layouts(const private_handle_t *handle, std::vector<PlaneLayout> *layouts)
+/*
+ * Encodes the PLANE_LAYOUTS metadata of a buffer.
+ *
+ * The layouts are written straight into the output from the static component
+ * tables, producing the same bytes as android::gralloc4::encodePlaneLayouts()
+ * without building the intermediate PlaneLayout vectors.
+ */
+static android::status_t encode_plane_layouts(const private_handle_t *handle, hidl_vec<uint8_t> *output)
 {
 	const int num_planes = get_num_planes(handle);
 	int32_t format_index = get_format_index(handle->alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
 	if (format_index < 0)
 	{
-		MALI_GRALLOC_LOGE("Negative format index in get_plane_layouts");
+		MALI_GRALLOC_LOGE("Negative format index in encode_plane_layouts");
 		return android::BAD_VALUE;
 	}
-	const format_info_t format_info = formats[format_index];
-	std::vector<std::vector<PlaneLayoutComponent>> components = plane_layout_components_from_handle(handle);
-	layouts->reserve(num_planes);
-	for (size_t plane_index = 0; plane_index < num_planes; ++plane_index)
+	const format_info_t &format_info = formats[format_index];
+	const format_components_t *components = get_format_components(handle->alloc_format, format_index);
+	if (format_info.linear && components->cmp[0][0].type == CMP_NONE)
 	{
-		int64_t plane_size;
-		if (plane_index < num_planes - 1)
-		{
-			plane_size = handle->plane_info[plane_index + 1].offset;
-		}
-		else
+		MALI_GRALLOC_LOGW("Could not find component description for format 0x%" PRIx64, handle->alloc_format);
+	}
+
+	auto encode = [&](metadata_writer &writer)
+	{
+		const MetadataType &metadata_type = android::gralloc4::MetadataType_PlaneLayouts;
+		writer.put_extendable_type(metadata_type.name.c_str(), metadata_type.name.size(), metadata_type.value);
+		writer.put_int64(num_planes);
+
+		for (int plane_index = 0; plane_index < num_planes; ++plane_index)
 		{
-			int64_t layer_size = handle->size / handle->layer_count;
-			plane_size = layer_size - handle->plane_info[plane_index].offset;
+			const format_component_t *plane_components = components->cmp[plane_index];
+			int num_components = 0;
+			while (num_components < MAX_PLANE_COMPONENTS && plane_components[num_components].type != CMP_NONE)
+			{
+				num_components++;
+			}
+
+			writer.put_int64(num_components);
+			for (int i = 0; i < num_components; i++)
+			{
+				const ExtendableType &type = plane_layout_component_type(plane_components[i].type);
+				writer.put_extendable_type(type.name.c_str(), type.name.size(), type.value);
+				writer.put_int64(plane_components[i].offset);
+				writer.put_int64(plane_components[i].size);
+			}
+
+			int64_t plane_size;
+			if (plane_index < num_planes - 1)
+			{
+				plane_size = handle->plane_info[plane_index + 1].offset;
+			}
+			else
+			{
+				int64_t layer_size = handle->size / handle->layer_count;
+				plane_size = layer_size - handle->plane_info[plane_index].offset;
+			}
+
+			int64_t sample_increment_in_bits = 0;
+			switch (handle->alloc_format)
+			{
+			case MALI_GRALLOC_FORMAT_INTERNAL_RAW10:
+			case MALI_GRALLOC_FORMAT_INTERNAL_RAW12:
+				sample_increment_in_bits = 0;
+				break;
+			default:
+				sample_increment_in_bits = (handle->alloc_format & MALI_GRALLOC_INTFMT_AFBC_BASIC)
+				   ? format_info.bpp_afbc[plane_index]
+				   : format_info.bpp[plane_index];
+				break;
+			}
+
+			writer.put_int64(handle->plane_info[plane_index].offset);
+			writer.put_int64(sample_increment_in_bits);
+			writer.put_int64(handle->plane_info[plane_index].byte_stride);
+			writer.put_int64(handle->plane_info[plane_index].alloc_width);
+			writer.put_int64(handle->plane_info[plane_index].alloc_height);
+			writer.put_int64(plane_size);
+			writer.put_int64(plane_index == 0 ? 1 : format_info.hsub);
+			writer.put_int64(plane_index == 0 ? 1 : format_info.vsub);
 		}
+	};
 
-		int64_t sample_increment_in_bits = 0;
-		switch (handle->alloc_format)
-		{
-		case MALI_GRALLOC_FORMAT_INTERNAL_RAW10:
-		case MALI_GRALLOC_FORMAT_INTERNAL_RAW12:
-			sample_increment_in_bits = 0;
-			break;
-		default:
-			sample_increment_in_bits = (handle->alloc_format & MALI_GRALLOC_INTFMT_AFBC_BASIC)
-			   ? format_info.bpp_afbc[plane_index]
-			   : format_info.bpp[plane_index];
-			break;
-		}
-
-		PlaneLayout layout = {.offsetInBytes = handle->plane_info[plane_index].offset,
-			                  .sampleIncrementInBits = sample_increment_in_bits,
-			                  .strideInBytes = handle->plane_info[plane_index].byte_stride,
-			                  .widthInSamples = handle->plane_info[plane_index].alloc_width,
-			                  .heightInSamples = handle->plane_info[plane_index].alloc_height,
-			                  .totalSizeInBytes = plane_size,
-			                  .horizontalSubsampling = (plane_index == 0 ? 1 : format_info.hsub),
-			                  .verticalSubsampling = (plane_index == 0 ? 1 : format_info.vsub),
-			                  .components = components.size() > plane_index ? components[plane_index] :
-			                                                                  std::vector<PlaneLayoutComponent>(0) };
-		layouts->push_back(layout);
-	}
+	metadata_writer sizer(nullptr);
+	encode(sizer);
+	output->resize(sizer.size());
+
+	metadata_writer writer(output->data());
+	encode(writer);
 
 	return android::OK;
 }
@@ -395,12 +337,7 @@ void get_metadata(const private_handle_t *handle, const IMapper::MetadataType &m
 		}
 		case StandardMetadataType::PLANE_LAYOUTS:
 		{
-			std::vector<PlaneLayout> layouts;
-			err = get_plane_layouts(handle, &layouts);
-			if (!err)
-			{
-				err = android::gralloc4::encodePlaneLayouts(layouts, &vec);
-			}
+			err = encode_plane_layouts(handle, &vec);
 			break;
 		}
 		case StandardMetadataType::DATASPACE:
@@ -713,12 +650,7 @@ void getFromBufferDescriptorInfo(IMapper::BufferDescriptorInfo const &descriptio
 		}
 		case StandardMetadataType::PLANE_LAYOUTS:
 		{
-			std::vector<PlaneLayout> layouts;
-			err = get_plane_layouts(&partial_handle, &layouts);
-			if (!err)
-			{
-				err = android::gralloc4::encodePlaneLayouts(layouts, &vec);
-			}
+			err = encode_plane_layouts(&partial_handle, &vec);
 			break;
 		}
 		case StandardMetadataType::DATASPACE:
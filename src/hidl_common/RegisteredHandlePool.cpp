@@ -24,12 +24,23 @@ bool RegisteredHandlePool::add(buffer_handle_t bufferHandle)
     return bufPool.insert(bufferHandle).second;
 }
 
-native_handle_t* RegisteredHandlePool::remove(void* buffer)
+native_handle_t* RegisteredHandlePool::remove(void* buffer, bool* deferred)
 {
     auto bufferHandle = static_cast<native_handle_t*>(buffer);
 
     std::lock_guard<std::mutex> lock(mutex);
-    return bufPool.erase(bufferHandle) == 1 ? bufferHandle : nullptr;
+    if (bufPool.erase(bufferHandle) != 1)
+    {
+        return nullptr;
+    }
+
+    auto pin = pinned.find(bufferHandle);
+    *deferred = (pin != pinned.end());
+    if (*deferred)
+    {
+        pin->second.removed = true;
+    }
+    return bufferHandle;
 }
 
 buffer_handle_t RegisteredHandlePool::get(const void* buffer)
@@ -44,4 +55,30 @@ void RegisteredHandlePool::for_each(std::function<void(const buffer_handle_t &)>
 {
     std::lock_guard<std::mutex> lock(mutex);
     std::for_each(bufPool.begin(), bufPool.end(), fn);
-}
\ No newline at end of file
+}
+
+std::vector<buffer_handle_t> RegisteredHandlePool::pin_all()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<buffer_handle_t> handles(bufPool.begin(), bufPool.end());
+    for (const auto& bufferHandle : handles)
+    {
+        auto &pin = pinned[bufferHandle];
+        pin.count++;
+    }
+    return handles;
+}
+
+native_handle_t* RegisteredHandlePool::unpin(buffer_handle_t bufferHandle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto pin = pinned.find(bufferHandle);
+    if (pin == pinned.end() || --pin->second.count > 0)
+    {
+        return nullptr;
+    }
+
+    const bool removed = pin->second.removed;
+    pinned.erase(pin);
+    return removed ? const_cast<native_handle_t*>(bufferHandle) : nullptr;
+}
@@ -22,8 +22,10 @@
 #include <cutils/native_handle.h>
 #include <mutex>
 #include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
 #include <functional>
+#include <vector>
 
 /* An unordered set to internally store / retrieve imported buffer handles */
 class RegisteredHandlePool
@@ -32,8 +34,10 @@ public:
 	/* Stores the buffer handle in the internal list */
 	bool add(buffer_handle_t bufferHandle);
 
-	/* Retrieves and removes the buffer handle from internal list */
-	native_handle_t* remove(void* buffer);
+	/* Retrieves and removes the buffer handle from internal list.
+	 * When the handle is pinned, 'deferred' is set and the final release is left
+	 * to the last unpin() */
+	native_handle_t* remove(void* buffer, bool* deferred);
 
 	/* Retrieves the buffer handle from internal list */
 	buffer_handle_t get(const void* buffer);
@@ -41,9 +45,24 @@ public:
 	/* Applies a function to each buffer handle */
 	void for_each(std::function<void(const buffer_handle_t &)> fn);
 
+	/* Takes a snapshot of the buffer handles, pinning each of them so that they
+	 * remain valid after the internal lock is dropped */
+	std::vector<buffer_handle_t> pin_all();
+
+	/* Releases a pin taken by pin_all(). Returns the handle when it was removed
+	 * while pinned and must now be released by the caller, nullptr otherwise */
+	native_handle_t* unpin(buffer_handle_t bufferHandle);
+
 private:
+	struct pin_state
+	{
+		int count;
+		bool removed;
+	};
+
 	std::mutex mutex;
 	std::unordered_set<buffer_handle_t> bufPool;
+	std::unordered_map<buffer_handle_t, pin_state> pinned;
 };
 
 #endif /* GRALLOC_COMMON_REGISTERED_HANDLE_POOL_H */
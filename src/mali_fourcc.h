@@ -37,6 +37,10 @@ extern "C"
 #define DRM_FORMAT_P010 fourcc_code('P', '0', '1', '0')
 #endif
 
+#ifndef DRM_FORMAT_NV15
+#define DRM_FORMAT_NV15 fourcc_code('N', 'V', '1', '5')
+#endif
+
 #ifndef DRM_FORMAT_Y0L2
 #define DRM_FORMAT_Y0L2 fourcc_code('Y', '0', 'L', '2')
 #endif
@@ -136,7 +136,11 @@ struct private_handle_t
 		PRIV_FLAGS_FRAMEBUFFER = 0x00000001,
 		PRIV_FLAGS_USES_ION_COMPOUND_HEAP = 0x00000002,
 		PRIV_FLAGS_USES_ION = 0x00000004,
-		PRIV_FLAGS_USES_ION_DMA_HEAP = 0x00000008
+		PRIV_FLAGS_USES_ION_DMA_HEAP = 0x00000008,
+		/* Process-local: the CPU mapping was prefaulted for reads, or for writes. Cleared when (un)mapped. */
+		PRIV_FLAGS_PREFAULTED_READ = 0x00000010,
+		PRIV_FLAGS_PREFAULTED_WRITE = 0x00000020,
+		PRIV_FLAGS_PREFAULTED = PRIV_FLAGS_PREFAULTED_READ | PRIV_FLAGS_PREFAULTED_WRITE
 	};
 
 	enum
@@ -120,6 +120,12 @@ typedef enum
 	MALI_GRALLOC_FORMAT_INTERNAL_YUV420_10BIT_I,
 	MALI_GRALLOC_FORMAT_INTERNAL_YUV444_10BIT_I,
 
+	/*
+	 * Y:UV 4:2:0 10-bit with the samples packed back to back (4 samples in
+	 * 5 bytes), as written by the rk video decoder.
+	 */
+	MALI_GRALLOC_FORMAT_INTERNAL_NV15,
+
 	/* Add more internal formats here. */
 
 	/* These are legacy 0.3 gralloc formats used only by the wrap/unwrap macros. */
@@ -361,7 +367,8 @@ void mali_gralloc_adjust_dimensions(const uint64_t internal_format,
 uint64_t mali_gralloc_select_format(const uint64_t req_format,
                                     const mali_gralloc_format_type type,
                                     const uint64_t usage,
-                                    const int buffer_size,
+                                    const int width,
+                                    const int height,
                                     uint64_t * const internal_format);
 
 bool is_subsampled_yuv(const uint32_t base_format);
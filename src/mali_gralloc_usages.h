@@ -64,6 +64,7 @@
 #define GRALLOC_USAGE_PRIVATE_1 GRALLOC1_CONSUMER_USAGE_PRIVATE_1
 #define GRALLOC_USAGE_PRIVATE_2 GRALLOC1_CONSUMER_USAGE_PRIVATE_2
 #define GRALLOC_USAGE_PRIVATE_3 GRALLOC1_CONSUMER_USAGE_PRIVATE_3
+#define GRALLOC_USAGE_PRIVATE_10 GRALLOC1_PRODUCER_USAGE_PRIVATE_10
 #define GRALLOC_USAGE_PRIVATE_11 GRALLOC1_PRODUCER_USAGE_PRIVATE_11
 #define GRALLOC_USAGE_PRIVATE_12 GRALLOC1_PRODUCER_USAGE_PRIVATE_12
 #define GRALLOC_USAGE_PRIVATE_13 GRALLOC1_PRODUCER_USAGE_PRIVATE_13
@@ -96,10 +97,20 @@
 
 #define GRALLOC_USAGE_SENSOR_DIRECT_DATA GRALLOC1_PRODUCER_USAGE_SENSOR_DIRECT_DATA
 #define GRALLOC_USAGE_GPU_DATA_BUFFER GRALLOC1_CONSUMER_USAGE_GPU_DATA_BUFFER
+#define GRALLOC_USAGE_VIDEO_DECODER GRALLOC1_PRODUCER_USAGE_VIDEO_DECODER
 
 
 typedef enum
 {
+	/*
+	 * The client gives the expected byte stride of the buffer through its width,
+	 * as per the Rockchip allocation semantics.
+	 */
+	RK_GRALLOC_USAGE_SPECIFY_STRIDE = GRALLOC_USAGE_PRIVATE_2,
+
+	/* The backing pages must be physically contiguous: allocated from the ION DMA (CMA) heap. */
+	RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER = GRALLOC_USAGE_PRIVATE_3,
+
 	/*
 	 * Allocation will be used as a front-buffer, which
 	 * supports concurrent producer-consumer access.
@@ -139,6 +150,24 @@ typedef enum
 	 */
 	MALI_GRALLOC_USAGE_PRIVATE_FORMAT = GRALLOC1_PRODUCER_USAGE_PRIVATE_15,
 
+	/*
+	 * Buffers of the same parameters are allocated repeatedly, as sets.
+	 * The allocator keeps a pool of spare buffers ready for the next set.
+	 */
+	MALI_GRALLOC_USAGE_POOLED = GRALLOC1_PRODUCER_USAGE_PRIVATE_12,
+
+	/*
+	 * The display is expected to scan the buffer out rotated by 90 or 270
+	 * degrees. AFBC superblocks are chosen for rotated reads.
+	 */
+	MALI_GRALLOC_USAGE_ROTATED_90 = GRALLOC1_PRODUCER_USAGE_PRIVATE_10,
+
+	/*
+	 * The video decoder stores no side-band data (e.g. co-located motion vectors)
+	 * after the picture in this buffer: the buffer is sized for the picture only.
+	 */
+	RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND = GRALLOC1_PRODUCER_USAGE_PRIVATE_11,
+
 	/* YUV only. */
 	MALI_GRALLOC_USAGE_YUV_COLOR_SPACE_DEFAULT = 0,
 	MALI_GRALLOC_USAGE_YUV_COLOR_SPACE_BT601 = GRALLOC1_PRODUCER_USAGE_PRIVATE_18,
@@ -172,6 +201,7 @@ namespace hidl_common = android::hardware::graphics::common::V1_1;
 #define GRALLOC_USAGE_PRIVATE_1 1ULL << 29
 #define GRALLOC_USAGE_PRIVATE_2 1ULL << 30
 #define GRALLOC_USAGE_PRIVATE_3 1ULL << 31
+#define GRALLOC_USAGE_PRIVATE_10 1ULL << 57
 #define GRALLOC_USAGE_PRIVATE_11 1ULL << 56
 #define GRALLOC_USAGE_PRIVATE_12 1ULL << 55
 #define GRALLOC_USAGE_PRIVATE_13 1ULL << 54
@@ -195,6 +225,11 @@ typedef enum
 	 */
 	RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER = GRALLOC_USAGE_PRIVATE_3,
 
+	/* The video decoder stores no side-band data (e.g. co-located motion vectors)
+	 * after the picture in this buffer: the buffer is sized for the picture only.
+	 */
+	RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND = GRALLOC_USAGE_PRIVATE_11,
+
 	/* See comment for Gralloc 1.0, above. */
 	MALI_GRALLOC_USAGE_FRONTBUFFER = GRALLOC_USAGE_PRIVATE_0,
 
@@ -210,6 +245,12 @@ typedef enum
 	/* See comment for Gralloc 1.0, above. */
 	MALI_GRALLOC_USAGE_PRIVATE_FORMAT = GRALLOC_USAGE_PRIVATE_15,
 
+	/* See comment for Gralloc 1.0, above. */
+	MALI_GRALLOC_USAGE_POOLED = GRALLOC_USAGE_PRIVATE_12,
+
+	/* See comment for Gralloc 1.0, above. */
+	MALI_GRALLOC_USAGE_ROTATED_90 = GRALLOC_USAGE_PRIVATE_10,
+
 	/* YUV-only. */
 	MALI_GRALLOC_USAGE_YUV_COLOR_SPACE_DEFAULT = 0,
 	MALI_GRALLOC_USAGE_YUV_COLOR_SPACE_BT601 = GRALLOC_USAGE_PRIVATE_18,
@@ -247,6 +288,7 @@ typedef enum
 
 #define GRALLOC_USAGE_SENSOR_DIRECT_DATA static_cast<uint64_t>(hidl_common::BufferUsage::SENSOR_DIRECT_DATA)
 #define GRALLOC_USAGE_GPU_DATA_BUFFER static_cast<uint64_t>(hidl_common::BufferUsage::GPU_DATA_BUFFER)
+#define GRALLOC_USAGE_VIDEO_DECODER static_cast<uint64_t>(hidl_common::BufferUsage::VIDEO_DECODER)
 
 #endif
 
@@ -284,6 +326,9 @@ static const uint64_t VALID_USAGE =
     GRALLOC_USAGE_PRIVATE_15 |         /* 1U << 52 */
     GRALLOC_USAGE_PRIVATE_14 |         /* 1U << 53 */
     GRALLOC_USAGE_PRIVATE_13 |         /* 1U << 54 */
+    GRALLOC_USAGE_PRIVATE_12 |         /* 1U << 55 */
+    GRALLOC_USAGE_PRIVATE_11 |         /* 1U << 56 */
+    GRALLOC_USAGE_PRIVATE_10 |         /* 1U << 57 */
     GRALLOC_USAGE_PRIVATE_0 |          /* 1U << 28 */
     GRALLOC_USAGE_PRIVATE_1 |          /* 1U << 29 */
     0;
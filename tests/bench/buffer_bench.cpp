@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Buffer lifecycle on the memfd ION stand-in: allocation to free, CPU access
+ * and metadata.
+ */
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "gralloc_host.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "core/mali_gralloc_bufferaccess.h"
+
+namespace
+{
+
+const uint64_t cpu_usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+
+struct buffer_kind
+{
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+	uint64_t format;
+	uint64_t usage;
+};
+
+const buffer_kind kinds[] = {
+	{ "rgba 1080p", 1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888, cpu_usage },
+	{ "nv12 1080p", 1920, 1080, HAL_PIXEL_FORMAT_YCrCb_NV12, cpu_usage | GRALLOC_USAGE_VIDEO_DECODER },
+	{ "rgba 256x256", 256, 256, HAL_PIXEL_FORMAT_RGBA_8888, cpu_usage },
+};
+const int num_kinds = sizeof(kinds) / sizeof(kinds[0]);
+
+int64_t minor_faults()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_minflt;
+}
+
+/*
+ * IAllocator::allocate(), then IMapper::importBuffer(), lock(), unlock() and
+ * freeBuffer() in a client, and the free of the allocator's copy.
+ */
+void BM_BufferCycle(benchmark::State &state)
+{
+	const buffer_kind &kind = kinds[state.range(0)];
+	state.SetLabel(kind.name);
+
+	const buffer_descriptor_t descriptor = gralloc_host_descriptor(kind.width, kind.height, kind.format, kind.usage);
+	for (auto _ : state)
+	{
+		native_handle_t *allocated = nullptr;
+		if (gralloc_host_allocate(descriptor, &allocated) != 0)
+		{
+			state.SkipWithError("allocation failed");
+			break;
+		}
+
+		native_handle_t *handle = gralloc_host_import(allocated);
+		if (handle == nullptr)
+		{
+			gralloc_host_free_allocated(allocated);
+			state.SkipWithError("import failed");
+			break;
+		}
+
+		void *vaddr = nullptr;
+		if (mali_gralloc_lock(handle, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, kind.width, kind.height, &vaddr) == 0)
+		{
+			mali_gralloc_unlock(handle);
+		}
+
+		gralloc_host_release(handle);
+		gralloc_host_free_allocated(allocated);
+	}
+}
+BENCHMARK(BM_BufferCycle)->DenseRange(0, num_kinds - 1);
+
+/*
+ * First CPU pass over a buffer just imported, writing every page: through a
+ * plain mapping of the buffer (0), or through lock(), which populates the
+ * locked region (1). Page faults are counted per pass.
+ */
+void BM_FirstTouch(benchmark::State &state)
+{
+	const bool locked = state.range(0) == 1;
+	state.SetLabel(locked ? "lock" : "mmap");
+
+	native_handle_t *allocated = nullptr;
+	if (gralloc_host_allocate(gralloc_host_descriptor(1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888, cpu_usage),
+	                          &allocated) != 0)
+	{
+		state.SkipWithError("allocation failed");
+		return;
+	}
+
+	const auto *allocated_hnd = static_cast<const private_handle_t *>(allocated);
+	const size_t size = allocated_hnd->size;
+	const size_t page_size = getpagesize();
+
+	const int64_t faults_before = minor_faults();
+	for (auto _ : state)
+	{
+		native_handle_t *handle = nullptr;
+		uint8_t *vaddr = nullptr;
+		if (locked)
+		{
+			handle = gralloc_host_import(allocated);
+			void *lock_vaddr = nullptr;
+			if (handle == nullptr ||
+			    mali_gralloc_lock(handle, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, 1920, 1080, &lock_vaddr) != 0)
+			{
+				state.SkipWithError("lock failed");
+				break;
+			}
+			vaddr = static_cast<uint8_t *>(lock_vaddr);
+		}
+		else
+		{
+			void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, allocated_hnd->share_fd, 0);
+			if (map == MAP_FAILED)
+			{
+				state.SkipWithError("mmap failed");
+				break;
+			}
+			vaddr = static_cast<uint8_t *>(map);
+		}
+
+		for (size_t offset = 0; offset < size; offset += page_size)
+		{
+			vaddr[offset] = 1;
+		}
+		benchmark::ClobberMemory();
+
+		if (locked)
+		{
+			mali_gralloc_unlock(handle);
+			gralloc_host_release(handle);
+		}
+		else
+		{
+			munmap(vaddr, size);
+		}
+	}
+
+	state.counters["faults"] =
+	    benchmark::Counter(minor_faults() - faults_before, benchmark::Counter::kAvgIterations);
+	state.SetBytesProcessed(state.iterations() * size);
+
+	gralloc_host_free_allocated(allocated);
+}
+BENCHMARK(BM_FirstTouch)->Arg(0)->Arg(1);
+
+/*
+ * Metadata of an imported buffer, as stored in its attribute region and read
+ * or written by the IMapper metadata accessors.
+ */
+void BM_AttributeRegion(benchmark::State &state)
+{
+	const bool write = state.range(0) == 1;
+	state.SetLabel(write ? "set" : "get");
+
+	native_handle_t *allocated = nullptr;
+	if (gralloc_host_allocate(gralloc_host_descriptor(1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888, cpu_usage),
+	                          &allocated) != 0)
+	{
+		state.SkipWithError("allocation failed");
+		return;
+	}
+
+	native_handle_t *handle = gralloc_host_import(allocated);
+	int dataspace = 0;
+	if (handle == nullptr || gralloc_host_get_attr(handle, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &dataspace) != 0)
+	{
+		state.SkipWithError("attribute region not mapped");
+		gralloc_host_free_allocated(allocated);
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		if (write)
+		{
+			gralloc_host_set_attr(handle, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &dataspace);
+		}
+		else
+		{
+			gralloc_host_get_attr(handle, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &dataspace);
+		}
+		benchmark::DoNotOptimize(dataspace);
+	}
+
+	gralloc_host_release(handle);
+	gralloc_host_free_allocated(allocated);
+}
+BENCHMARK(BM_AttributeRegion)->Arg(0)->Arg(1);
+
+} /* anonymous namespace */
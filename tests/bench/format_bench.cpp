@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Format selection and buffer sizes, run for each allocation. Built in both
+ * manners of selecting formats, see Android.bp.
+ */
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "gralloc_host.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_formats.h"
+#include "core/format_info.h"
+#include "core/mali_gralloc_bufferallocation.h"
+
+namespace
+{
+
+struct request
+{
+	const char *name;
+	uint64_t format;
+	uint64_t usage;
+};
+
+/* Typical requests of SurfaceFlinger, apps, codecs and cameras. */
+const request requests[] = {
+	{ "client layer", HAL_PIXEL_FORMAT_RGBA_8888,
+	  GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER },
+	{ "framebuffer", HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_FB },
+	{ "texture", HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE },
+	{ "cpu", HAL_PIXEL_FORMAT_RGBA_8888,
+	  GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE },
+	{ "video decode", HAL_PIXEL_FORMAT_YCbCr_420_888, GRALLOC_USAGE_DECODER },
+#if USE_RK_SELECTING_FORMAT_MANNER
+	/* No camera writes any format of the Arm IP support table. */
+	{ "rk video decode", HAL_PIXEL_FORMAT_YCrCb_NV12, GRALLOC_USAGE_VIDEO_DECODER | GRALLOC_USAGE_HW_TEXTURE },
+	{ "camera", HAL_PIXEL_FORMAT_YCbCr_420_888, GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_TEXTURE },
+#endif
+};
+const int num_requests = sizeof(requests) / sizeof(requests[0]);
+
+struct allocation
+{
+	const char *name;
+	uint64_t alloc_format;
+};
+
+const allocation allocations[] = {
+	{ "rgba linear", MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 },
+	{ "rgba afbc", MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 | MALI_GRALLOC_INTFMT_AFBC_BASIC },
+	{ "rgba afbc 32x8 split", MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 | MALI_GRALLOC_INTFMT_AFBC_BASIC |
+	                              MALI_GRALLOC_INTFMT_AFBC_WIDEBLK | MALI_GRALLOC_INTFMT_AFBC_SPLITBLK },
+	{ "nv12 linear", MALI_GRALLOC_FORMAT_INTERNAL_NV12 },
+	{ "nv12 afbc", MALI_GRALLOC_FORMAT_INTERNAL_NV12 | MALI_GRALLOC_INTFMT_AFBC_BASIC },
+};
+const int num_allocations = sizeof(allocations) / sizeof(allocations[0]);
+
+const int width = 1920;
+const int height = 1080;
+
+void BM_SelectFormat(benchmark::State &state)
+{
+	const request &req = requests[state.range(0)];
+	state.SetLabel(req.name);
+
+	for (auto _ : state)
+	{
+		uint64_t internal_format = 0;
+		const uint64_t alloc_format = mali_gralloc_select_format(req.format, MALI_GRALLOC_FORMAT_TYPE_USAGE,
+		                                                         req.usage, width, height, &internal_format);
+		if (alloc_format == MALI_GRALLOC_FORMAT_INTERNAL_UNDEFINED)
+		{
+			state.SkipWithError("format not supported");
+			break;
+		}
+		benchmark::DoNotOptimize(alloc_format);
+	}
+}
+BENCHMARK(BM_SelectFormat)->DenseRange(0, num_requests - 1);
+
+void BM_DeriveFormatAndSize(benchmark::State &state)
+{
+	const request &req = requests[state.range(0)];
+	state.SetLabel(req.name);
+
+	const buffer_descriptor_t descriptor = gralloc_host_descriptor(width, height, req.format, req.usage);
+	for (auto _ : state)
+	{
+		buffer_descriptor_t derived = descriptor;
+		if (mali_gralloc_derive_format_and_size(&derived) != 0)
+		{
+			state.SkipWithError("format not supported");
+			break;
+		}
+		benchmark::DoNotOptimize(derived.size);
+	}
+}
+BENCHMARK(BM_DeriveFormatAndSize)->DenseRange(0, num_requests - 1);
+
+void BM_GetFormatIndex(benchmark::State &state)
+{
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < num_formats; i++)
+		{
+			benchmark::DoNotOptimize(get_format_index(formats[i].id));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * num_formats);
+}
+BENCHMARK(BM_GetFormatIndex);
+
+/*
+ * calc_allocation_size() is internal to the allocation: measured through the
+ * traffic estimate of the AFBC cost model, which only adds a loop over the
+ * planes to it.
+ */
+void BM_CalcAllocationSize(benchmark::State &state)
+{
+	const allocation &alloc = allocations[state.range(0)];
+	state.SetLabel(alloc.name);
+
+	for (auto _ : state)
+	{
+		uint64_t bytes = 0;
+		if (mali_gralloc_estimate_pass_bytes(alloc.alloc_format, width, height, GRALLOC_USAGE_HW_TEXTURE, 60,
+		                                     &bytes) != 0)
+		{
+			state.SkipWithError("format not supported");
+			break;
+		}
+		benchmark::DoNotOptimize(bytes);
+	}
+}
+BENCHMARK(BM_CalcAllocationSize)->DenseRange(0, num_allocations - 1);
+
+void BM_InitAfbc(benchmark::State &state)
+{
+	const allocation &alloc = allocations[state.range(0)];
+	state.SetLabel(alloc.name);
+
+	/* Superblock aligned, as when allocated: a 16 byte header per 256 pixels. */
+	const int afbc_height = (height + 15) & ~15;
+	std::vector<uint8_t> headers(width * afbc_height / 256 * 16);
+
+	for (auto _ : state)
+	{
+		init_afbc(headers.data(), alloc.alloc_format, false, width, afbc_height);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * headers.size());
+}
+BENCHMARK(BM_InitAfbc)->Arg(1)->Arg(2)->Arg(4);
+
+/*
+ * Components of each plane, as described by the PLANE_LAYOUTS metadata of
+ * Gralloc 4 for every format.
+ */
+void BM_PlaneLayoutComponents(benchmark::State &state)
+{
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < num_formats; i++)
+		{
+			const int32_t format_idx = get_format_index(formats[i].id);
+			benchmark::DoNotOptimize(get_format_components(formats[i].id, format_idx));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * num_formats);
+}
+BENCHMARK(BM_PlaneLayoutComponents);
+
+} /* anonymous namespace */
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Handles on their way between processes: sending, import, registration
+ * in IMapper and queries of their properties.
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "gralloc_host.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "buffer_info.h"
+#include "hidl_common/RegisteredHandlePool.h"
+
+namespace
+{
+
+const uint64_t client_layer_usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
+
+/* A buffer as sent by the allocator service. */
+class sent_buffer
+{
+public:
+	sent_buffer()
+	{
+		if (gralloc_host_allocate(gralloc_host_descriptor(1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888, client_layer_usage),
+		                          &handle) != 0)
+		{
+			handle = nullptr;
+		}
+	}
+
+	~sent_buffer()
+	{
+		if (handle != nullptr)
+		{
+			gralloc_host_free_allocated(handle);
+		}
+	}
+
+	native_handle_t *handle = nullptr;
+};
+
+size_t parcel_bytes(const native_handle_t *handle)
+{
+	/* Header, then the ints; the file descriptors are sent out of band. */
+	return (3 + handle->numInts) * sizeof(int);
+}
+
+/* Handles sent by the allocator service, through a UNIX socket as binder would. */
+void BM_HandleSend(benchmark::State &state)
+{
+	sent_buffer buffer;
+	if (buffer.handle == nullptr)
+	{
+		state.SkipWithError("allocation failed");
+		return;
+	}
+
+	int socks[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socks) != 0)
+	{
+		state.SkipWithError("socketpair failed");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		if (gralloc_host_send_handle(socks[0], buffer.handle) != 0)
+		{
+			state.SkipWithError("send failed");
+			break;
+		}
+		native_handle_t *received = gralloc_host_recv_handle(socks[1]);
+		native_handle_close(received);
+		native_handle_delete(received);
+	}
+	state.counters["parcel_bytes"] = parcel_bytes(buffer.handle);
+
+	close(socks[0]);
+	close(socks[1]);
+}
+BENCHMARK(BM_HandleSend);
+
+/* native_handle_clone() of a received handle, as done on every import. */
+void BM_HandleClone(benchmark::State &state)
+{
+	sent_buffer buffer;
+	if (buffer.handle == nullptr)
+	{
+		state.SkipWithError("allocation failed");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		native_handle_t *clone = native_handle_clone(buffer.handle);
+		native_handle_close(clone);
+		native_handle_delete(clone);
+	}
+}
+BENCHMARK(BM_HandleClone);
+
+/* IMapper::importBuffer() and freeBuffer() of a received handle. */
+void BM_HandleImport(benchmark::State &state)
+{
+	sent_buffer buffer;
+	if (buffer.handle == nullptr)
+	{
+		state.SkipWithError("allocation failed");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		native_handle_t *handle = gralloc_host_import(buffer.handle);
+		if (handle == nullptr)
+		{
+			state.SkipWithError("import failed");
+			break;
+		}
+		gralloc_host_release(handle);
+	}
+}
+BENCHMARK(BM_HandleImport);
+
+/*
+ * Buffers imported by the threads of a client, such as the binder threads of
+ * SurfaceFlinger, looked up by each IMapper call.
+ */
+const int pool_handles = 256;
+native_handle_t pool_handle_storage[pool_handles];
+RegisteredHandlePool pool;
+
+void BM_HandlePoolGet(benchmark::State &state)
+{
+	if (state.thread_index() == 0)
+	{
+		for (int i = 0; i < pool_handles; i++)
+		{
+			pool.add(&pool_handle_storage[i]);
+		}
+	}
+
+	int i = state.thread_index() * 17;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(pool.get(&pool_handle_storage[i++ % pool_handles]));
+	}
+}
+BENCHMARK(BM_HandlePoolGet)->ThreadRange(1, 8)->UseRealTime();
+
+/* Imports and frees of the threads' own buffers, among lookups of the others. */
+void BM_HandlePoolImportFree(benchmark::State &state)
+{
+	native_handle_t own[4];
+	bool deferred = false;
+
+	int i = state.thread_index() * 17;
+	for (auto _ : state)
+	{
+		native_handle_t *handle = &own[i % 4];
+		pool.add(handle);
+		benchmark::DoNotOptimize(pool.get(handle));
+		benchmark::DoNotOptimize(pool.get(&pool_handle_storage[i++ % pool_handles]));
+		benchmark::DoNotOptimize(pool.remove(handle, &deferred));
+	}
+}
+BENCHMARK(BM_HandlePoolImportFree)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ * Properties of a layer queried by composition, through the passthrough
+ * privatebuffer IAccessor: with the seven calls of IAccessor 1.0, each
+ * validating the handle, or with getBufferInfo(). The IAccessor methods need
+ * HIDL: these stand for them down to the result callbacks, around the same
+ * field extraction.
+ */
+const private_handle_t *get_private_handle(const native_handle_t *handle)
+{
+	auto hnd = reinterpret_cast<const private_handle_t *>(handle);
+	return private_handle_t::validate(hnd) < 0 ? nullptr : hnd;
+}
+
+/*
+ * Calls 'cb' with the fields extracted by 'get' from a valid handle, or with
+ * an error. Callbacks are passed as std::function, as the HIDL ones.
+ */
+template <typename Get, typename Callback>
+__attribute__((noinline)) void query(const native_handle_t *handle, const Get &get, const Callback &cb)
+{
+	using result = decltype(get(nullptr));
+	const std::function<void(int, const result &)> hidl_cb = cb;
+
+	const private_handle_t *hnd = get_private_handle(handle);
+	if (hnd == nullptr)
+	{
+		hidl_cb(-EINVAL, result{});
+		return;
+	}
+
+	hidl_cb(0, get(hnd));
+}
+
+void BM_BufferInfoCalls(benchmark::State &state)
+{
+	sent_buffer buffer;
+	native_handle_t *handle = buffer.handle != nullptr ? gralloc_host_import(buffer.handle) : nullptr;
+	if (handle == nullptr)
+	{
+		state.SkipWithError("import failed");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		buffer_info info = {};
+		query(handle, [&](const private_handle_t *hnd) { return std::make_pair(hnd->share_fd, hnd->size); },
+		      [&](int, const auto &allocation) { std::tie(info.fd, info.size) = allocation; });
+		query(handle, [&](const private_handle_t *hnd) { return buffer_drm_format(hnd, &info.drm_modifier); },
+		      [&](int, const auto &drm_fourcc) { info.drm_fourcc = drm_fourcc; });
+		query(handle, [&](const private_handle_t *hnd) { return std::make_pair(hnd->width, hnd->height); },
+		      [&](int, const auto &dimensions) { std::tie(info.width, info.height) = dimensions; });
+		query(handle, [&](const private_handle_t *hnd) { return hnd->req_format; },
+		      [&](int, const auto &format) { info.requested_format = format; });
+		query(handle, [&](const private_handle_t *hnd) { return buffer_usage(hnd); },
+		      [&](int, const auto &usage) { info.usage = usage; });
+		query(handle, [&](const private_handle_t *hnd) { return hnd->layer_count; },
+		      [&](int, const auto &layer_count) { info.layer_count = layer_count; });
+		query(handle, [&](const private_handle_t *hnd) { return buffer_plane_layouts(hnd, info.planes); },
+		      [&](int, const auto &plane_count) { info.plane_count = plane_count; });
+		benchmark::DoNotOptimize(info);
+	}
+
+	gralloc_host_release(handle);
+}
+BENCHMARK(BM_BufferInfoCalls);
+
+void BM_BufferInfoSingleCall(benchmark::State &state)
+{
+	sent_buffer buffer;
+	native_handle_t *handle = buffer.handle != nullptr ? gralloc_host_import(buffer.handle) : nullptr;
+	if (handle == nullptr)
+	{
+		state.SkipWithError("import failed");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		buffer_info info;
+		query(handle,
+		      [&](const private_handle_t *hnd)
+		      {
+			      buffer_info result;
+			      buffer_info_from_handle(hnd, &result);
+			      return result;
+		      },
+		      [&](int, const auto &result) { info = result; });
+		benchmark::DoNotOptimize(info);
+	}
+
+	gralloc_host_release(handle);
+}
+BENCHMARK(BM_BufferInfoSingleCall);
+
+} /* anonymous namespace */
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The AFBC cost model choosing between AFBC and linear buffers for the
+ * client layers of SurfaceFlinger on rk356x.
+ */
+
+#include <string>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_formats.h"
+#include "core/mali_gralloc_bufferallocation.h"
+
+namespace
+{
+
+/* Rendered by the GPU, composed by the GPU or the VOP. */
+const uint64_t client_layer_usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
+
+const int fb_width = 1920;
+const int fb_height = 1080;
+
+bool allocated_as_afbc(int width, int height, uint64_t usage = client_layer_usage)
+{
+	native_handle_t *handle = nullptr;
+	if (gralloc_host_allocate(gralloc_host_descriptor(width, height, HAL_PIXEL_FORMAT_RGBA_8888, usage), &handle) != 0)
+	{
+		ADD_FAILURE() << "allocating " << width << "x" << height;
+		return false;
+	}
+
+	const bool afbc = static_cast<const private_handle_t *>(handle)->alloc_format & MALI_GRALLOC_INTFMT_AFBC_BASIC;
+	gralloc_host_free_allocated(handle);
+	return afbc;
+}
+
+/*
+ * Default policy: AFBC when it saves at least 10% of the traffic, and at least
+ * what a layer covering a quarter of the framebuffer saves at 60% bodies.
+ */
+bool expected_afbc(int width, int height)
+{
+	uint64_t linear_bytes = 0;
+	uint64_t afbc_bytes = 0;
+	EXPECT_EQ(0, mali_gralloc_estimate_pass_bytes(MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888, width, height,
+	                                              client_layer_usage, 60, &linear_bytes));
+	EXPECT_EQ(0, mali_gralloc_estimate_pass_bytes(MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 |
+	                                                  MALI_GRALLOC_INTFMT_AFBC_BASIC,
+	                                              width, height, client_layer_usage, 60, &afbc_bytes));
+
+	/* Written by the GPU, read once to compose. */
+	const uint64_t saving = linear_bytes > afbc_bytes ? (linear_bytes - afbc_bytes) * 2 : 0;
+	const uint64_t min_saving = (uint64_t)fb_width * fb_height * 2 * 40 / 100;
+
+	return saving > 0 && saving * 100 >= linear_bytes * 2 * 10 && saving >= min_saving;
+}
+
+void set_fb_size()
+{
+	gralloc_host_set_property("vendor.gralloc.fb_size", std::to_string(fb_width * fb_height).c_str());
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostAfbcCost, PassBytes)
+{
+	uint64_t linear_bytes = 0;
+	uint64_t afbc_full = 0;
+	uint64_t afbc_compressed = 0;
+
+	ASSERT_EQ(0, mali_gralloc_estimate_pass_bytes(MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888, 1920, 1088,
+	                                              client_layer_usage, 60, &linear_bytes));
+	EXPECT_EQ(1920u * 1088 * 4, linear_bytes);
+
+	/* Uncompressed bodies cost more than linear, by the headers. */
+	ASSERT_EQ(0, mali_gralloc_estimate_pass_bytes(MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 |
+	                                                  MALI_GRALLOC_INTFMT_AFBC_BASIC,
+	                                              1920, 1088, client_layer_usage, 100, &afbc_full));
+	EXPECT_EQ(linear_bytes + 1920u * 1088 / 256 * 16, afbc_full);
+
+	ASSERT_EQ(0, mali_gralloc_estimate_pass_bytes(MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888 |
+	                                                  MALI_GRALLOC_INTFMT_AFBC_BASIC,
+	                                              1920, 1088, client_layer_usage, 60, &afbc_compressed));
+	EXPECT_EQ(1920u * 1088 / 256 * 16 + 1920u * 1088 * 4 * 60 / 100, afbc_compressed);
+
+	/* Formats without AFBC, and unknown formats. */
+	EXPECT_EQ(-EINVAL, mali_gralloc_estimate_pass_bytes(MALI_GRALLOC_FORMAT_INTERNAL_NV15 |
+	                                                        MALI_GRALLOC_INTFMT_AFBC_BASIC,
+	                                                    1920, 1088, client_layer_usage, 60, &afbc_full));
+	EXPECT_EQ(-EINVAL, mali_gralloc_estimate_pass_bytes(0x7fff, 64, 64, client_layer_usage, 60, &afbc_full));
+}
+
+TEST(GrallocHostAfbcCost, Crossover)
+{
+	run_in_child(
+	    []()
+	    {
+		    set_fb_size();
+
+		    /* Square layers: linear below the crossover, AFBC above it. */
+		    int crossover = 0;
+		    for (int side = 16; side <= fb_height; side += 16)
+		    {
+			    SCOPED_TRACE(std::to_string(side) + "x" + std::to_string(side));
+
+			    const bool afbc = allocated_as_afbc(side, side);
+			    EXPECT_EQ(expected_afbc(side, side), afbc);
+			    if (afbc && crossover == 0)
+			    {
+				    crossover = side;
+			    }
+			    EXPECT_TRUE(crossover == 0 || afbc);
+		    }
+
+		    /* Saving what a quarter of the framebuffer saves takes about a quarter of its area. */
+		    ASSERT_NE(0, crossover);
+		    EXPECT_GT(crossover * crossover, fb_width * fb_height / 8);
+		    EXPECT_LT(crossover * crossover, fb_width * fb_height / 2);
+
+		    EXPECT_TRUE(allocated_as_afbc(fb_width, fb_height));
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, 64));
+		    EXPECT_FALSE(allocated_as_afbc(64, 64));
+	    });
+}
+
+TEST(GrallocHostAfbcCost, UnknownFramebufferSize)
+{
+	/* Before the framebuffer target is allocated, any saving is enough. */
+	run_in_child(
+	    []()
+	    {
+		    EXPECT_TRUE(allocated_as_afbc(64, 64));
+		    EXPECT_TRUE(allocated_as_afbc(fb_width, fb_height));
+	    });
+}
+
+TEST(GrallocHostAfbcCost, MinSavingProperty)
+{
+	run_in_child(
+	    []()
+	    {
+		    set_fb_size();
+		    gralloc_host_set_property("vendor.gralloc.afbc_cost.min_saving_kb", "0");
+		    EXPECT_TRUE(allocated_as_afbc(64, 64));
+
+		    /* Above what the full framebuffer saves. */
+		    gralloc_host_set_property("vendor.gralloc.afbc_cost.min_saving_kb", "100000");
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, fb_height));
+	    });
+}
+
+TEST(GrallocHostAfbcCost, BodyAndMarginProperties)
+{
+	run_in_child(
+	    []()
+	    {
+		    set_fb_size();
+
+		    /* Incompressible content: AFBC never saves anything. */
+		    gralloc_host_set_property("vendor.gralloc.afbc_cost.body_percent", "100");
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, fb_height));
+
+		    /* Well compressed content saves more than the default margin... */
+		    gralloc_host_set_property("vendor.gralloc.afbc_cost.body_percent", "30");
+		    EXPECT_TRUE(allocated_as_afbc(fb_width, fb_height));
+
+		    /* ...but not all of the traffic. */
+		    gralloc_host_set_property("vendor.gralloc.afbc_cost.margin_percent", "80");
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, fb_height));
+	    });
+}
+
+TEST(GrallocHostAfbcCost, OverriddenByUsageAndProperties)
+{
+	run_in_child(
+	    []()
+	    {
+		    set_fb_size();
+
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, fb_height, client_layer_usage | MALI_GRALLOC_USAGE_NO_AFBC));
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, fb_height, client_layer_usage | GRALLOC_USAGE_SW_READ_OFTEN));
+
+		    gralloc_host_set_property("vendor.gralloc.not_to_use_non_afbc_for_small_buffers", "1");
+		    EXPECT_TRUE(allocated_as_afbc(64, 64));
+
+		    /* Turning AFBC off wins over turning the model off. */
+		    gralloc_host_set_property("vendor.gralloc.no_afbc_for_sf_client_layer", "1");
+		    EXPECT_FALSE(allocated_as_afbc(64, 64));
+		    EXPECT_FALSE(allocated_as_afbc(fb_width, fb_height));
+	    });
+}
+
+TEST(GrallocHostAfbcCost, RotatedLayersChargedGpuComposition)
+{
+	run_in_child(
+	    []()
+	    {
+		    set_fb_size();
+
+		    /* Below the crossover of unrotated layers. */
+		    EXPECT_FALSE(allocated_as_afbc(512, 512));
+
+		    /* Linear, the VOP can't rotate it: composed by the GPU instead. */
+		    EXPECT_TRUE(allocated_as_afbc(512, 512, client_layer_usage | MALI_GRALLOC_USAGE_ROTATED_90));
+
+		    /* Not scanned out: the hint costs nothing. */
+		    EXPECT_FALSE(allocated_as_afbc(512, 512, GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE |
+		                                                 MALI_GRALLOC_USAGE_ROTATED_90));
+
+		    /* Too small to save anything worth it, even rotated. */
+		    EXPECT_FALSE(allocated_as_afbc(128, 128, client_layer_usage | MALI_GRALLOC_USAGE_ROTATED_90));
+	    });
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * AFBC superblocks of buffers scanned out rotated by 90/270 degrees
+ * (MALI_GRALLOC_USAGE_ROTATED_90), for every combination of wide block
+ * capabilities of the GPU and the DPU.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_formats.h"
+#include "mali_gralloc_usages.h"
+
+namespace
+{
+
+/* Capabilities of caps/caps_provider.cpp, without wide blocks. */
+const uint64_t gpu_caps = MALI_GRALLOC_FORMAT_CAPABILITY_OPTIONS_PRESENT | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_BASIC |
+                          MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_SPLITBLK | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_YUV_READ |
+                          MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_YUV_WRITE |
+                          MALI_GRALLOC_FORMAT_CAPABILITY_PIXFMT_RGBA1010102 |
+                          MALI_GRALLOC_FORMAT_CAPABILITY_PIXFMT_RGBA16161616;
+const uint64_t dpu_caps = MALI_GRALLOC_FORMAT_CAPABILITY_OPTIONS_PRESENT | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_BASIC |
+                          MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_SPLITBLK | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_YUV_READ |
+                          MALI_GRALLOC_FORMAT_CAPABILITY_PIXFMT_RGBA1010102;
+
+struct consumer_set
+{
+	uint64_t usage;
+	const char *name;
+	bool dpu;
+};
+
+const consumer_set consumer_sets[] = {
+	{ GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER, "client layer", true },
+	{ GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_FB, "framebuffer", true },
+	{ GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE, "texture", false },
+};
+
+uint64_t select_format(uint64_t usage)
+{
+	uint64_t internal_format = 0;
+	return mali_gralloc_select_format(HAL_PIXEL_FORMAT_RGBA_8888, MALI_GRALLOC_FORMAT_TYPE_USAGE, usage, 1920, 1080,
+	                                  &internal_format);
+}
+
+void set_caps(const char *env, uint64_t caps)
+{
+	char value[32];
+	snprintf(value, sizeof(value), "0x%" PRIx64, caps);
+	setenv(env, value, 1);
+}
+
+/*
+ * Checks the superblocks selected with and without the hint, given whether
+ * the GPU and the DPU support wide blocks.
+ */
+void check_matrix(bool gpu_wide, bool dpu_wide)
+{
+	run_in_child(
+	    [gpu_wide, dpu_wide]()
+	    {
+		    /* Read by the capability libraries as they are loaded, on the first query. */
+		    set_caps("GRALLOC_HOST_CAPS_GPU", gpu_caps | (gpu_wide ? MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_WIDEBLK : 0));
+		    set_caps("GRALLOC_HOST_CAPS_DPU", dpu_caps | (dpu_wide ? MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_WIDEBLK : 0));
+
+		    for (const consumer_set &consumers : consumer_sets)
+		    {
+			    for (const bool rotated : { false, true })
+			    {
+				    SCOPED_TRACE(std::string(consumers.name) + (rotated ? ", rotated" : ""));
+
+				    const uint64_t alloc_format =
+				        select_format(consumers.usage | (rotated ? MALI_GRALLOC_USAGE_ROTATED_90 : 0));
+				    ASSERT_EQ((uint64_t)MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888,
+				              alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
+				    ASSERT_TRUE(alloc_format & MALI_GRALLOC_INTFMT_AFBC_BASIC);
+
+				    /* 32x8 superblocks only for unrotated scanout by a DPU reading them. */
+				    const bool wide = gpu_wide && dpu_wide && consumers.dpu && !rotated;
+				    EXPECT_EQ(wide, (alloc_format & MALI_GRALLOC_INTFMT_AFBC_WIDEBLK) != 0);
+
+				    /* The hint leaves the other modifiers to the capabilities. */
+				    EXPECT_EQ(consumers.dpu, (alloc_format & MALI_GRALLOC_INTFMT_AFBC_SPLITBLK) != 0);
+			    }
+		    }
+	    });
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostAfbcRotation, NoWideBlocks)
+{
+	check_matrix(false, false);
+}
+
+TEST(GrallocHostAfbcRotation, GpuWideBlocksOnly)
+{
+	check_matrix(true, false);
+}
+
+TEST(GrallocHostAfbcRotation, DpuWideBlocksOnly)
+{
+	check_matrix(false, true);
+}
+
+TEST(GrallocHostAfbcRotation, WideBlocks)
+{
+	check_matrix(true, true);
+}
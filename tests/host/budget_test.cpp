@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Memory budgets of the allocator service, charged to its clients while they
+ * hold their buffers.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <utils/String8.h>
+
+#include "gralloc_host_test.h"
+#include "ion_host.h"
+#include "gralloc_priv.h"
+#include "core/mali_gralloc_budget.h"
+#include "core/mali_gralloc_lifetime.h"
+
+namespace
+{
+
+const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+
+/*
+ * @return KiB charged to a process in the budget dump, -1 when it has no charge.
+ */
+int64_t budget_kib_of(int pid)
+{
+	android::String8 dump;
+	mali_gralloc_budget_dump(dump);
+
+	char key[32];
+	snprintf(key, sizeof(key), " pid %-12d", pid);
+	const char *line = strstr(dump.c_str(), key);
+	int64_t kib = -1;
+	if (line == nullptr || sscanf(line + strlen(key), " %" SCNd64, &kib) != 1)
+	{
+		return -1;
+	}
+
+	return kib;
+}
+
+/*
+ * @return times a step of the degradation ladder was taken, from the budget dump.
+ */
+uint64_t degrade_steps(const char *step)
+{
+	android::String8 dump;
+	mali_gralloc_budget_dump(dump);
+
+	const char *steps = strstr(dump.c_str(), " degradation steps:");
+	char key[32];
+	snprintf(key, sizeof(key), " %s ", step);
+	const char *count = steps != nullptr ? strstr(steps, key) : nullptr;
+	uint64_t n = 0;
+	if (count == nullptr || sscanf(count + strlen(key), "%" SCNu64, &n) != 1)
+	{
+		ADD_FAILURE() << "no " << step << " counter in the budget dump";
+	}
+
+	return n;
+}
+
+/* Opaque buffers only accessed by hardware, which may be degraded to RGB_565. */
+const uint64_t hw_usage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
+
+int allocate_for(int pid)
+{
+	buffer_descriptor_t descriptor = gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+	descriptor.owner_pid = pid;
+
+	native_handle_t *handle = nullptr;
+	const int ret = gralloc_host_allocate(descriptor, &handle);
+	if (ret == 0)
+	{
+		gralloc_host_free_allocated(handle);
+	}
+	return ret;
+}
+
+bool lifetime_unavailable(void *)
+{
+	return false;
+}
+
+bool lifetime_never_alive(void *, uint64_t)
+{
+	return false;
+}
+
+/* Cache trimmed by the ladder, with the ION failures seen when it is. */
+size_t trim_calls = 0;
+uint64_t failures_when_trimmed = 0;
+
+size_t trim_cache(void)
+{
+	trim_calls++;
+	failures_when_trimmed = ion_host_get_stats(ION_HEAP_TYPE_SYSTEM).failures;
+	return 4096;
+}
+
+/* A kernel without dma-buf statistics. */
+const mali_gralloc_lifetime_backend untracked_backend = { lifetime_unavailable, lifetime_never_alive, nullptr };
+
+} /* anonymous namespace */
+
+TEST(GrallocHostBudget, ChargedToClientUntilReleased)
+{
+	run_in_child(
+	    []()
+	    {
+		    /* Room for one 256KiB buffer per process. */
+		    gralloc_host_set_property("vendor.gralloc.budget.pid_kb", "384");
+		    gralloc_host_track_lifetimes(true);
+
+		    /* Started first, so that it does not inherit the service's buffers. */
+		    client holder = start_client(hold_buffer);
+		    ASSERT_GE(holder.pid, 0);
+
+		    buffer_descriptor_t descriptor = gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+		    descriptor.owner_pid = holder.pid;
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    ASSERT_EQ(0, gralloc_host_send_handle(holder.sock, handle));
+		    gralloc_host_free_allocated(handle);
+		    ASSERT_TRUE(recv_byte(holder.sock));
+
+		    /* Freed by the service, still charged to the client holding it. */
+		    EXPECT_GE(budget_kib_of(holder.pid), 256);
+		    EXPECT_EQ(-1, budget_kib_of(getpid()));
+		    EXPECT_NE(0, allocate_for(holder.pid));
+
+		    /* Other processes have their own budget. */
+		    EXPECT_EQ(0, allocate_for(0));
+		    EXPECT_EQ(-1, budget_kib_of(getpid()));
+
+		    /* Released by the client: its budget is available again. */
+		    ASSERT_TRUE(send_byte(holder.sock));
+		    EXPECT_EQ(0, finish_client(holder));
+		    EXPECT_EQ(0, allocate_for(holder.pid));
+		    EXPECT_EQ(-1, budget_kib_of(holder.pid));
+
+		    gralloc_host_track_lifetimes(false);
+	    });
+}
+
+TEST(GrallocHostBudget, UntrackedLifetimesEndWithTheServiceHandle)
+{
+	run_in_child(
+	    []()
+	    {
+		    /* Without dma-buf lifetimes, the charge ends when the service frees its handle. */
+		    gralloc_host_set_property("vendor.gralloc.budget.pid_kb", "384");
+		    mali_gralloc_lifetime_set_backend(&untracked_backend);
+
+		    client holder = start_client(hold_buffer);
+		    ASSERT_GE(holder.pid, 0);
+
+		    buffer_descriptor_t descriptor = gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+		    descriptor.owner_pid = holder.pid;
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_GE(budget_kib_of(holder.pid), 256);
+		    ASSERT_EQ(0, gralloc_host_send_handle(holder.sock, handle));
+		    gralloc_host_free_allocated(handle);
+		    ASSERT_TRUE(recv_byte(holder.sock));
+
+		    EXPECT_EQ(-1, budget_kib_of(holder.pid));
+		    EXPECT_EQ(0, allocate_for(holder.pid));
+
+		    ASSERT_TRUE(send_byte(holder.sock));
+		    EXPECT_EQ(0, finish_client(holder));
+
+		    mali_gralloc_lifetime_set_backend(nullptr);
+	    });
+}
+
+TEST(GrallocHostBudget, CachesTrimmedOnFirstFailure)
+{
+	run_in_child(
+	    []()
+	    {
+		    mali_gralloc_budget_register_trim(trim_cache);
+
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage),
+		                                       &handle));
+		    gralloc_host_free_allocated(handle);
+		    EXPECT_EQ(0u, trim_calls);
+		    EXPECT_EQ(0u, degrade_steps("trim"));
+
+		    /* Trimmed once the first attempt failed, before the retry. */
+		    ion_host_fail(ION_HEAP_TYPE_SYSTEM, 1);
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage),
+		                                       &handle));
+		    gralloc_host_free_allocated(handle);
+		    EXPECT_EQ(1u, trim_calls);
+		    EXPECT_EQ(1u, failures_when_trimmed);
+		    EXPECT_EQ(1u, degrade_steps("trim"));
+	    });
+}
+
+TEST(GrallocHostBudget, RetriedAfterTransientFailure)
+{
+	run_in_child(
+	    []()
+	    {
+		    const buffer_descriptor_t descriptor = gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    const int size = static_cast<const private_handle_t *>(handle)->size;
+		    gralloc_host_free_allocated(handle);
+
+		    /* The retry allocates the buffer as requested. */
+		    ion_host_fail(ION_HEAP_TYPE_SYSTEM, 1);
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    const private_handle_t *hnd = static_cast<const private_handle_t *>(handle);
+		    EXPECT_EQ(size, hnd->size);
+		    EXPECT_EQ(static_cast<uint64_t>(MALI_GRALLOC_FORMAT_INTERNAL_RGBA_8888),
+		              hnd->alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
+		    gralloc_host_free_allocated(handle);
+
+		    EXPECT_EQ(2u, ion_host_get_stats(ION_HEAP_TYPE_SYSTEM).allocs);
+		    EXPECT_EQ(1u, degrade_steps("retry"));
+		    EXPECT_EQ(1u, degrade_steps("recovered"));
+		    EXPECT_EQ(0u, degrade_steps("format"));
+		    EXPECT_EQ(0u, degrade_steps("failed"));
+
+		    /* A second failure fails the allocation when formats are not degraded. */
+		    ion_host_fail(ION_HEAP_TYPE_SYSTEM, 2);
+		    EXPECT_NE(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_EQ(2u, degrade_steps("retry"));
+		    EXPECT_EQ(1u, degrade_steps("failed"));
+	    });
+}
+
+TEST(GrallocHostBudget, HeapFallbackToSystem)
+{
+	run_in_child(
+	    []()
+	    {
+		    const buffer_descriptor_t descriptor =
+		        gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage | RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER);
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    const int size = static_cast<const private_handle_t *>(handle)->size;
+		    gralloc_host_free_allocated(handle);
+
+		    /* Allocated on the first attempt, from the system heap. */
+		    ion_host_fail(ION_HEAP_TYPE_DMA, 1);
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_EQ(size, static_cast<const private_handle_t *>(handle)->size);
+		    gralloc_host_free_allocated(handle);
+
+		    EXPECT_EQ(1u, ion_host_get_stats(ION_HEAP_TYPE_SYSTEM).allocs);
+		    EXPECT_EQ(1u, degrade_steps("heap_fallback"));
+		    EXPECT_EQ(0u, degrade_steps("retry"));
+	    });
+}
+
+TEST(GrallocHostBudget, OpaqueFormatsDegradedTo565)
+{
+	run_in_child(
+	    []()
+	    {
+		    gralloc_host_set_property("vendor.gralloc.degrade_format", "1");
+
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGB_565, hw_usage),
+		                                       &handle));
+		    const int rgb565_size = static_cast<const private_handle_t *>(handle)->size;
+		    gralloc_host_free_allocated(handle);
+
+		    uint64_t degraded = 0;
+		    for (const uint64_t format : { HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_RGB_888 })
+		    {
+			    SCOPED_TRACE(format);
+
+			    /* Both the first attempt and the retry fail. */
+			    ion_host_fail(ION_HEAP_TYPE_SYSTEM, 2);
+			    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(256, 256, format, hw_usage), &handle));
+			    const private_handle_t *hnd = static_cast<const private_handle_t *>(handle);
+			    EXPECT_EQ(rgb565_size, hnd->size);
+			    EXPECT_EQ(static_cast<uint64_t>(MALI_GRALLOC_FORMAT_INTERNAL_RGB_565),
+			              hnd->alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
+			    /* Clients still see the format they asked for. */
+			    EXPECT_EQ(static_cast<int>(format), hnd->req_format);
+			    gralloc_host_free_allocated(handle);
+
+			    EXPECT_EQ(++degraded, degrade_steps("format"));
+		    }
+		    EXPECT_EQ(degraded, degrade_steps("recovered"));
+
+		    /* Buffers the CPU accesses keep their format, and fail. */
+		    ion_host_fail(ION_HEAP_TYPE_SYSTEM, 2);
+		    EXPECT_NE(0, gralloc_host_allocate(gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBX_8888, usage),
+		                                       &handle));
+		    EXPECT_EQ(degraded, degrade_steps("format"));
+		    EXPECT_EQ(1u, degrade_steps("failed"));
+	    });
+}
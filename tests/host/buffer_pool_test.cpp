@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Pools of MALI_GRALLOC_USAGE_POOLED buffers, on a stand-in backend and
+ * through the allocation path with a per-process budget.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <utils/String8.h>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "core/mali_gralloc_buffer_pool.h"
+#include "core/mali_gralloc_bufferallocation.h"
+#include "core/mali_gralloc_budget.h"
+#include "core/mali_gralloc_lifetime.h"
+
+namespace
+{
+
+const uint64_t pooled_usage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER | MALI_GRALLOC_USAGE_POOLED;
+
+/* Buffers handed out by the stand-in backend, with the processes allowed to take them. */
+struct fake_backend_state
+{
+	std::mutex lock;
+	bool failing = false;
+	int refused_pid = -1;
+	int allocated = 0;
+	int freed = 0;
+} fake;
+
+int fake_alloc(buffer_descriptor_t *descriptor, buffer_handle_t *handle)
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	if (fake.failing)
+	{
+		return -ENOMEM;
+	}
+
+	descriptor->alloc_format = descriptor->hal_format;
+	descriptor->pixel_stride = descriptor->width;
+	descriptor->size = descriptor->width * descriptor->height * 4;
+	descriptor->plane_info[0].byte_stride = descriptor->width * 4;
+	descriptor->plane_info[0].alloc_width = descriptor->width;
+	descriptor->plane_info[0].alloc_height = descriptor->height;
+
+	*handle = make_private_handle(0, descriptor->size, descriptor->consumer_usage, descriptor->producer_usage, -1,
+	                              descriptor->hal_format, descriptor->alloc_format, descriptor->alloc_format,
+	                              descriptor->width, descriptor->height, descriptor->pixel_stride, descriptor->width,
+	                              descriptor->height, descriptor->width * 4, descriptor->size, 1,
+	                              descriptor->plane_info);
+	fake.allocated++;
+	return 0;
+}
+
+void fake_free(buffer_handle_t handle)
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	native_handle_delete(const_cast<native_handle_t *>(handle));
+	fake.freed++;
+}
+
+bool fake_hand_over(const buffer_descriptor_t &descriptor, buffer_handle_t)
+{
+	return descriptor.owner_pid != fake.refused_pid;
+}
+
+const buffer_pool_backend fake_backend = { fake_alloc, fake_free, fake_hand_over };
+
+void reset_fake()
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	fake.failing = false;
+	fake.refused_pid = -1;
+	fake.allocated = 0;
+	fake.freed = 0;
+}
+
+int fake_allocated()
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	return fake.allocated;
+}
+
+int fake_freed()
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	return fake.freed;
+}
+
+buffer_descriptor_t pooled_descriptor(const char *name)
+{
+	buffer_descriptor_t descriptor = gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, pooled_usage);
+	descriptor.name = name;
+	return descriptor;
+}
+
+std::string dump_of(buffer_pools &pools)
+{
+	android::String8 buf;
+	pools.dump(buf);
+	return buf.c_str();
+}
+
+/* Waits for a condition set by a worker thread. */
+template <typename Condition>
+bool wait_for(Condition condition)
+{
+	for (int i = 0; i < 500 && !condition(); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	return condition();
+}
+
+bool lifetime_unavailable(void *)
+{
+	return false;
+}
+
+bool lifetime_never_alive(void *, uint64_t)
+{
+	return false;
+}
+
+/* A kernel without dma-buf statistics. */
+const mali_gralloc_lifetime_backend untracked_backend = { lifetime_unavailable, lifetime_never_alive, nullptr };
+
+/*
+ * @return times allocations were refused by a budget, from the budget dump.
+ */
+uint64_t budget_refusals()
+{
+	android::String8 dump;
+	mali_gralloc_budget_dump(dump);
+
+	uint64_t n = 0;
+	const char *steps = strstr(dump.c_str(), " degradation steps: budget ");
+	if (steps == nullptr || sscanf(steps + strlen(" degradation steps: budget "), "%" SCNu64, &n) != 1)
+	{
+		ADD_FAILURE() << "no budget counter in the budget dump";
+	}
+
+	return n;
+}
+
+class GrallocHostBufferPool : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		reset_fake();
+	}
+};
+
+} /* anonymous namespace */
+
+TEST_F(GrallocHostBufferPool, ReserveFillsThePool)
+{
+	buffer_pools pools(fake_backend, 8, 3000);
+	pools.reserve(pooled_descriptor("codec"), 3);
+	EXPECT_EQ(3u, pools.refill());
+	EXPECT_EQ(0u, pools.refill());
+
+	for (int i = 0; i < 3; i++)
+	{
+		buffer_descriptor_t descriptor = pooled_descriptor("codec");
+		buffer_handle_t handle = pools.take(&descriptor);
+		ASSERT_NE(nullptr, handle);
+		/* The calculated fields are the ones of the pooled buffers. */
+		EXPECT_EQ(256u * 256 * 4, descriptor.size);
+		EXPECT_EQ(256 * 4, (int)descriptor.plane_info[0].byte_stride);
+		fake_free(handle);
+	}
+
+	buffer_descriptor_t descriptor = pooled_descriptor("codec");
+	EXPECT_EQ(nullptr, pools.take(&descriptor));
+	EXPECT_NE(std::string::npos, dump_of(pools).find(" ready 0/3 hits 3 misses 1"));
+
+	/* Refilled behind the requests. */
+	EXPECT_EQ(3u, pools.refill());
+}
+
+TEST_F(GrallocHostBufferPool, ClampedToMaxBuffers)
+{
+	buffer_pools pools(fake_backend, 2, 3000);
+	pools.reserve(pooled_descriptor("camera"), 6);
+	EXPECT_EQ(2u, pools.refill());
+	EXPECT_NE(std::string::npos, dump_of(pools).find(" ready 2/2"));
+}
+
+TEST_F(GrallocHostBufferPool, NameIsPartOfTheKey)
+{
+	buffer_pools pools(fake_backend, 8, 3000);
+	pools.reserve(pooled_descriptor("decoder 0"), 1);
+	ASSERT_EQ(1u, pools.refill());
+
+	/* Same parameters, other client: the buffers keep the name they were allocated with. */
+	buffer_descriptor_t other = pooled_descriptor("decoder 1");
+	EXPECT_EQ(nullptr, pools.take(&other));
+
+	buffer_descriptor_t same = pooled_descriptor("decoder 0");
+	buffer_handle_t handle = pools.take(&same);
+	EXPECT_NE(nullptr, handle);
+	fake_free(handle);
+
+	const std::string dump = dump_of(pools);
+	EXPECT_NE(std::string::npos, dump.find("decoder 0"));
+	EXPECT_EQ(std::string::npos, dump.find("decoder 1"));
+	EXPECT_NE(std::string::npos, dump.find(" hits 1 misses 0"));
+}
+
+TEST_F(GrallocHostBufferPool, RefusedBuffersStayInThePool)
+{
+	buffer_pools pools(fake_backend, 8, 3000);
+	pools.reserve(pooled_descriptor("codec"), 1);
+	ASSERT_EQ(1u, pools.refill());
+
+	fake.refused_pid = 1234;
+	buffer_descriptor_t descriptor = pooled_descriptor("codec");
+	descriptor.owner_pid = 1234;
+	EXPECT_EQ(nullptr, pools.take(&descriptor));
+	const std::string dump = dump_of(pools);
+	EXPECT_NE(std::string::npos, dump.find(" refill failures 0 refused 1"));
+	EXPECT_NE(std::string::npos, dump.find(" ready 1/1 hits 0 misses 0"));
+	EXPECT_EQ(0u, pools.refill());
+
+	/* Handed to another process. */
+	descriptor.owner_pid = 5678;
+	buffer_handle_t handle = pools.take(&descriptor);
+	EXPECT_NE(nullptr, handle);
+	fake_free(handle);
+}
+
+TEST_F(GrallocHostBufferPool, FailedRefillIsCounted)
+{
+	buffer_pools pools(fake_backend, 8, 3000);
+	fake.failing = true;
+	pools.reserve(pooled_descriptor("codec"), 2);
+	EXPECT_EQ(0u, pools.refill());
+	EXPECT_NE(std::string::npos, dump_of(pools).find(" refill failures 1"));
+
+	fake.failing = false;
+	EXPECT_EQ(2u, pools.refill());
+}
+
+TEST_F(GrallocHostBufferPool, TrimReleasesSpareBuffers)
+{
+	buffer_pools pools(fake_backend, 8, 3000);
+	pools.reserve(pooled_descriptor("codec"), 2);
+	pools.reserve(pooled_descriptor("camera"), 1);
+	ASSERT_EQ(3u, pools.refill());
+
+	EXPECT_EQ(3u * 256 * 256 * 4, pools.trim());
+	EXPECT_EQ(3, fake_freed());
+
+	/* Pools are destroyed: nothing is refilled until reserved again. */
+	buffer_descriptor_t descriptor = pooled_descriptor("codec");
+	EXPECT_EQ(nullptr, pools.take(&descriptor));
+	EXPECT_EQ(0u, pools.refill());
+}
+
+TEST_F(GrallocHostBufferPool, WorkerFillsAndExpiresPools)
+{
+	{
+		buffer_pools pools(fake_backend, 8, 50);
+		pools.start();
+		pools.reserve(pooled_descriptor("codec"), 2);
+		ASSERT_TRUE(wait_for([]() { return fake_allocated() == 2; }));
+
+		/* Unused for idle_ms. */
+		EXPECT_TRUE(wait_for([]() { return fake_freed() == 2; }));
+		EXPECT_NE(std::string::npos, dump_of(pools).find(" expired pools 1"));
+	}
+
+	EXPECT_EQ(2, fake_freed());
+}
+
+TEST(GrallocHostBufferPoolAllocation, BudgetCheckedBeforeTakingABuffer)
+{
+	run_in_child(
+	    []()
+	    {
+		    /* Room for one 256KiB buffer per process, charged until the service frees its handle. */
+		    gralloc_host_set_property("vendor.gralloc.budget.pid_kb", "384");
+		    mali_gralloc_lifetime_set_backend(&untracked_backend);
+
+		    const int client_pid = 4242;
+		    buffer_descriptor_t descriptor = pooled_descriptor("codec");
+		    descriptor.owner_pid = client_pid;
+		    auto pool_dump = []()
+		    {
+			    android::String8 buf;
+			    mali_gralloc_buffer_pool_dump(buf);
+			    return std::string(buf.c_str());
+		    };
+
+		    mali_gralloc_buffer_pool_reserve(&descriptor, 1);
+		    ASSERT_TRUE(wait_for([&]() { return pool_dump().find(" ready 1/1") != std::string::npos; }));
+
+		    /* The client already holds a buffer: its budget has no room for the pooled one. */
+		    native_handle_t *held = nullptr;
+		    buffer_descriptor_t plain = gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888,
+		                                                        pooled_usage & ~MALI_GRALLOC_USAGE_POOLED);
+		    plain.owner_pid = client_pid;
+		    ASSERT_EQ(0, gralloc_host_allocate(plain, &held));
+
+		    /* Refused by the pool, then by the degradation ladder, which trims the pool on its way. */
+		    native_handle_t *handle = nullptr;
+		    const uint64_t refusals = budget_refusals();
+		    EXPECT_NE(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_NE(std::string::npos, pool_dump().find(" refused 1"));
+		    EXPECT_LT(refusals, budget_refusals());
+
+		    /* Released: the pooled buffer is handed over. */
+		    gralloc_host_free_allocated(held);
+		    mali_gralloc_buffer_pool_reserve(&descriptor, 1);
+		    ASSERT_TRUE(wait_for([&]() { return pool_dump().find(" ready 1/1") != std::string::npos; }));
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_NE(std::string::npos, pool_dump().find(" hits 1 misses 0"));
+		    gralloc_host_free_allocated(handle);
+
+		    mali_gralloc_lifetime_set_backend(nullptr);
+	    });
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the capabilities exported by the GPU, display and video
+ * libraries, built once per IP under the name the allocator dlopens.
+ *
+ * The capabilities default to those of an RK356x class SoC, and can be
+ * replaced through the environment of the process, e.g.
+ * GRALLOC_HOST_CAPS_GPU=0x1 for a GPU without AFBC.
+ */
+
+#include <stdlib.h>
+
+#include "mali_gralloc_formats.h"
+
+#if defined(CAPS_PROVIDER_GPU)
+#define CAPS_PROVIDER_ENV "GRALLOC_HOST_CAPS_GPU"
+#define CAPS_PROVIDER_DEFAULT                                                                            \
+	(MALI_GRALLOC_FORMAT_CAPABILITY_OPTIONS_PRESENT | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_BASIC |     \
+	 MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_SPLITBLK | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_WIDEBLK |     \
+	 MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_YUV_READ | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_YUV_WRITE |   \
+	 MALI_GRALLOC_FORMAT_CAPABILITY_PIXFMT_RGBA1010102 | MALI_GRALLOC_FORMAT_CAPABILITY_PIXFMT_RGBA16161616)
+#elif defined(CAPS_PROVIDER_DPU)
+#define CAPS_PROVIDER_ENV "GRALLOC_HOST_CAPS_DPU"
+#define CAPS_PROVIDER_DEFAULT                                                                            \
+	(MALI_GRALLOC_FORMAT_CAPABILITY_OPTIONS_PRESENT | MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_BASIC |     \
+	 MALI_GRALLOC_FORMAT_CAPABILITY_AFBC_YUV_READ | MALI_GRALLOC_FORMAT_CAPABILITY_PIXFMT_RGBA1010102)
+#elif defined(CAPS_PROVIDER_VPU)
+#define CAPS_PROVIDER_ENV "GRALLOC_HOST_CAPS_VPU"
+#define CAPS_PROVIDER_DEFAULT (MALI_GRALLOC_FORMAT_CAPABILITY_OPTIONS_PRESENT)
+#else
+#error "Define one of CAPS_PROVIDER_GPU, CAPS_PROVIDER_DPU or CAPS_PROVIDER_VPU"
+#endif
+
+extern "C"
+{
+mali_gralloc_format_caps MALI_GRALLOC_FORMATCAPS_SYM_NAME = { CAPS_PROVIDER_DEFAULT };
+}
+
+__attribute__((constructor)) static void caps_provider_init(void)
+{
+	const char *caps = getenv(CAPS_PROVIDER_ENV);
+	if (caps != nullptr)
+	{
+		MALI_GRALLOC_FORMATCAPS_SYM_NAME.caps_mask = strtoull(caps, nullptr, 0);
+	}
+}
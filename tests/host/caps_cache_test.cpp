@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cache of the IP capabilities, stored in the working directory on the host.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include "gralloc_host_test.h"
+#include "capabilities/gralloc_capabilities.h"
+#include "capabilities/src/gralloc_capabilities_cache.h"
+
+namespace
+{
+
+const char cache_path[] = "ip_caps64.bin";
+
+/* Libraries probed by get_ip_capabilities() on the host, in its order. */
+const char *const probed_libs[] = {
+	"./hwcomposer.drm.so", "./dpu_aeu_fake_caps.so", "./libGLES_mali.so", "./libGLES_mali.so", "./libstagefrighthw.so",
+};
+const size_t num_probed_libs = sizeof(probed_libs) / sizeof(probed_libs[0]);
+
+/* CPU, DPU, DPU AEU, VPU, GPU and camera. */
+const size_t num_probed_caps = 6;
+const size_t gpu_caps_index = 4;
+
+const char *const stub_libs[] = { "./libstub.so", "./libstub_missing.so" };
+const size_t num_stub_libs = sizeof(stub_libs) / sizeof(stub_libs[0]);
+
+bool write_file(const char *path, const char *content, int flags = O_TRUNC)
+{
+	const int fd = open(path, O_WRONLY | O_CREAT | flags, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+	const bool written = write(fd, content, strlen(content)) == (ssize_t)strlen(content);
+	close(fd);
+	return written;
+}
+
+std::vector<mali_gralloc_format_caps> caps_of(std::initializer_list<uint64_t> masks)
+{
+	std::vector<mali_gralloc_format_caps> caps;
+	for (const uint64_t mask : masks)
+	{
+		caps.push_back({ mask });
+	}
+	return caps;
+}
+
+bool loads(const char *const libs[], size_t num_libs, const std::vector<mali_gralloc_format_caps> &expected)
+{
+	std::vector<mali_gralloc_format_caps> caps(expected.size());
+	if (!caps_cache_load(libs, num_libs, caps.data(), caps.size()))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < caps.size(); i++)
+	{
+		EXPECT_EQ(expected[i].caps_mask, caps[i].caps_mask) << "capabilities " << i;
+	}
+	return true;
+}
+
+uint64_t probed_gpu_caps()
+{
+	mali_gralloc_format_caps gpu, vpu, dpu, dpu_aeu, cam;
+	mali_gralloc_get_caps(&gpu, &vpu, &dpu, &dpu_aeu, &cam);
+	return gpu.caps_mask;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostCapsCache, StoredAndLoaded)
+{
+	run_in_child(
+	    []()
+	    {
+		    const auto caps = caps_of({ 0x1, 0x23, 0x456 });
+		    ASSERT_TRUE(write_file(stub_libs[0], "stub"));
+
+		    EXPECT_FALSE(loads(stub_libs, num_stub_libs, caps));
+		    caps_cache_store(stub_libs, num_stub_libs, caps.data(), caps.size());
+		    EXPECT_EQ(0, access(cache_path, R_OK));
+		    EXPECT_TRUE(loads(stub_libs, num_stub_libs, caps));
+
+		    /* Keyed by the libraries probed, and by the number of capabilities. */
+		    EXPECT_FALSE(loads(stub_libs, 1, caps));
+		    EXPECT_FALSE(loads(stub_libs, num_stub_libs, caps_of({ 0x1, 0x23 })));
+	    });
+}
+
+TEST(GrallocHostCapsCache, StaleWhenLibrariesChange)
+{
+	run_in_child(
+	    []()
+	    {
+		    const auto caps = caps_of({ 0x1, 0x23 });
+		    ASSERT_TRUE(write_file(stub_libs[0], "stub"));
+
+		    /* An updated driver. */
+		    caps_cache_store(stub_libs, num_stub_libs, caps.data(), caps.size());
+		    ASSERT_TRUE(write_file(stub_libs[0], " v2", O_APPEND));
+		    EXPECT_FALSE(loads(stub_libs, num_stub_libs, caps));
+
+		    /* A driver installed where there was none. */
+		    caps_cache_store(stub_libs, num_stub_libs, caps.data(), caps.size());
+		    ASSERT_TRUE(loads(stub_libs, num_stub_libs, caps));
+		    ASSERT_TRUE(write_file(stub_libs[1], "stub"));
+		    EXPECT_FALSE(loads(stub_libs, num_stub_libs, caps));
+	    });
+}
+
+TEST(GrallocHostCapsCache, InvalidFilesIgnored)
+{
+	run_in_child(
+	    []()
+	    {
+		    const auto caps = caps_of({ 0x1, 0x23 });
+		    ASSERT_TRUE(write_file(stub_libs[0], "stub"));
+		    caps_cache_store(stub_libs, num_stub_libs, caps.data(), caps.size());
+
+		    struct stat st;
+		    ASSERT_EQ(0, stat(cache_path, &st));
+
+		    /* Truncated. */
+		    ASSERT_EQ(0, truncate(cache_path, st.st_size - 1));
+		    EXPECT_FALSE(loads(stub_libs, num_stub_libs, caps));
+
+		    /* Not a cache. */
+		    caps_cache_store(stub_libs, num_stub_libs, caps.data(), caps.size());
+		    const int fd = open(cache_path, O_WRONLY);
+		    ASSERT_GE(fd, 0);
+		    ASSERT_EQ(4, pwrite(fd, "XXXX", 4, 0));
+		    close(fd);
+		    EXPECT_FALSE(loads(stub_libs, num_stub_libs, caps));
+
+		    /* Rewritten by the next prober. */
+		    caps_cache_store(stub_libs, num_stub_libs, caps.data(), caps.size());
+		    EXPECT_TRUE(loads(stub_libs, num_stub_libs, caps));
+	    });
+}
+
+TEST(GrallocHostCapsCache, ProbedCapabilitiesStored)
+{
+	run_in_child(
+	    []()
+	    {
+		    ASSERT_NE(0, access(cache_path, F_OK));
+
+		    /* Read by the GPU library as it is loaded. */
+		    setenv("GRALLOC_HOST_CAPS_GPU", "0x41", 1);
+		    EXPECT_EQ(0x41u, probed_gpu_caps());
+
+		    std::vector<mali_gralloc_format_caps> caps(num_probed_caps);
+		    ASSERT_TRUE(caps_cache_load(probed_libs, num_probed_libs, caps.data(), caps.size()));
+		    EXPECT_EQ(0x41u, caps[gpu_caps_index].caps_mask);
+	    });
+}
+
+TEST(GrallocHostCapsCache, CachedCapabilitiesNotProbed)
+{
+	run_in_child(
+	    []()
+	    {
+		    std::vector<mali_gralloc_format_caps> caps(num_probed_caps);
+		    caps[gpu_caps_index].caps_mask = 0x5;
+		    caps_cache_store(probed_libs, num_probed_libs, caps.data(), caps.size());
+
+		    /* The GPU library would report 0x41. */
+		    setenv("GRALLOC_HOST_CAPS_GPU", "0x41", 1);
+		    EXPECT_EQ(0x5u, probed_gpu_caps());
+	    });
+}
+
+TEST(GrallocHostCapsCache, StaleCacheProbedAgain)
+{
+	run_in_child(
+	    []()
+	    {
+		    /* Stored for other drivers. */
+		    std::vector<mali_gralloc_format_caps> caps(num_probed_caps);
+		    caps[gpu_caps_index].caps_mask = 0x5;
+		    std::vector<const char *> other_libs(probed_libs, probed_libs + num_probed_libs);
+		    other_libs[2] = "./libGLES_other.so";
+		    caps_cache_store(other_libs.data(), other_libs.size(), caps.data(), caps.size());
+
+		    setenv("GRALLOC_HOST_CAPS_GPU", "0x41", 1);
+		    EXPECT_EQ(0x41u, probed_gpu_caps());
+
+		    /* Replaced with the probed capabilities. */
+		    ASSERT_TRUE(caps_cache_load(probed_libs, num_probed_libs, caps.data(), caps.size()));
+		    EXPECT_EQ(0x41u, caps[gpu_caps_index].caps_mask);
+	    });
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Reserve of contiguous buffers, on a stand-in backend and behind the memfd
+ * ION stand-in.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/String8.h>
+
+#include "gralloc_host_test.h"
+#include "ion_host.h"
+#include "gralloc_priv.h"
+#include "allocator/mali_gralloc_contig_pool.h"
+#include "allocator/mali_gralloc_ion.h"
+
+namespace
+{
+
+const size_t KiB = 1024;
+
+/* Chunks handed out by the stand-in backend, as fake fds. */
+struct fake_backend_state
+{
+	std::mutex lock;
+	int next_fd = 100;
+	bool failing = false;
+	std::vector<size_t> allocated;
+	std::vector<int> freed;
+} fake;
+
+int fake_alloc(size_t size)
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	if (fake.failing)
+	{
+		return -1;
+	}
+	fake.allocated.push_back(size);
+	return fake.next_fd++;
+}
+
+void fake_free(int fd)
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	fake.freed.push_back(fd);
+}
+
+const contig_pool_backend fake_backend = { fake_alloc, fake_free };
+
+void reset_fake()
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	fake.next_fd = 100;
+	fake.failing = false;
+	fake.allocated.clear();
+	fake.freed.clear();
+}
+
+size_t fake_allocated()
+{
+	std::lock_guard<std::mutex> guard(fake.lock);
+	return fake.allocated.size();
+}
+
+std::string dump_of(contig_pool &pool)
+{
+	android::String8 buf;
+	pool.dump(buf);
+	return buf.c_str();
+}
+
+/* Waits for a condition set by a worker thread. */
+template <typename Condition>
+bool wait_for(Condition condition)
+{
+	for (int i = 0; i < 500 && !condition(); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	return condition();
+}
+
+class GrallocHostContigPool : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		reset_fake();
+	}
+
+	const std::vector<size_t> chunks = { 1024 * KiB, 2048 * KiB, 4096 * KiB };
+};
+
+} /* anonymous namespace */
+
+TEST_F(GrallocHostContigPool, RefillAllocatesTheReserve)
+{
+	contig_pool pool(fake_backend, chunks);
+	EXPECT_NE(std::string::npos, dump_of(pool).find(" free 0 chunks, 0 of 7168 KiB (0%)"));
+
+	EXPECT_EQ(3u, pool.refill());
+	EXPECT_EQ(3u, fake_allocated());
+	EXPECT_NE(std::string::npos,
+	          dump_of(pool).find(" free 3 chunks, 7168 of 7168 KiB (100%), largest 4096 KiB, fragmentation 42%"));
+
+	/* Nothing missing. */
+	EXPECT_EQ(0u, pool.refill());
+}
+
+TEST_F(GrallocHostContigPool, BestFitWithinTwiceTheRequest)
+{
+	contig_pool pool(fake_backend, chunks);
+	ASSERT_EQ(3u, pool.refill());
+
+	size_t chunk_size = 0;
+	EXPECT_LE(0, pool.take(1536 * KiB, &chunk_size));
+	EXPECT_EQ(2048 * KiB, chunk_size);
+	EXPECT_LE(0, pool.take(600 * KiB, &chunk_size));
+	EXPECT_EQ(1024 * KiB, chunk_size);
+
+	/* Only the 4MiB chunk is left: more than twice the request. */
+	chunk_size = 0;
+	EXPECT_EQ(-1, pool.take(1024 * KiB, &chunk_size));
+	EXPECT_EQ(0u, chunk_size);
+	/* Larger than any chunk. */
+	EXPECT_EQ(-1, pool.take(8192 * KiB, &chunk_size));
+
+	const std::string dump = dump_of(pool);
+	EXPECT_NE(std::string::npos, dump.find(" free 1 chunks, 4096 of 7168 KiB (57%), largest 4096 KiB, fragmentation 0%"));
+	EXPECT_NE(std::string::npos, dump.find(" hits 2 misses 2 wasted 936 KiB refill failures 0"));
+}
+
+TEST_F(GrallocHostContigPool, RefillReplacesTakenChunks)
+{
+	contig_pool pool(fake_backend, chunks);
+	ASSERT_EQ(3u, pool.refill());
+
+	size_t chunk_size = 0;
+	const int taken = pool.take(2048 * KiB, &chunk_size);
+	EXPECT_LE(0, taken);
+	EXPECT_LE(0, pool.take(1024 * KiB, &chunk_size));
+
+	EXPECT_EQ(2u, pool.refill());
+	{
+		std::lock_guard<std::mutex> guard(fake.lock);
+		EXPECT_EQ(std::vector<size_t>({ 4096 * KiB, 2048 * KiB, 1024 * KiB, 1024 * KiB, 2048 * KiB }), fake.allocated);
+	}
+	EXPECT_NE(std::string::npos, dump_of(pool).find(" free 3 chunks, 7168 of 7168 KiB (100%)"));
+
+	/* The new chunks are handed over, not the taken one. */
+	EXPECT_NE(taken, pool.take(2048 * KiB, &chunk_size));
+}
+
+TEST_F(GrallocHostContigPool, FailedRefillResumesWithTheNextRequest)
+{
+	contig_pool pool(fake_backend, chunks);
+	fake.failing = true;
+	EXPECT_EQ(0u, pool.refill());
+	EXPECT_NE(std::string::npos, dump_of(pool).find(" refill failures 1"));
+
+	/* Not retried until requested. */
+	fake.failing = false;
+	EXPECT_EQ(0u, pool.refill());
+
+	size_t chunk_size = 0;
+	EXPECT_EQ(-1, pool.take(1024 * KiB, &chunk_size));
+	EXPECT_EQ(3u, pool.refill());
+	EXPECT_LE(0, pool.take(1024 * KiB, &chunk_size));
+}
+
+TEST_F(GrallocHostContigPool, TrimReleasesFreeChunks)
+{
+	contig_pool pool(fake_backend, chunks);
+	ASSERT_EQ(3u, pool.refill());
+
+	size_t chunk_size = 0;
+	const int taken = pool.take(4096 * KiB, &chunk_size);
+	EXPECT_LE(0, taken);
+
+	EXPECT_EQ(3072 * KiB, pool.trim());
+	{
+		std::lock_guard<std::mutex> guard(fake.lock);
+		EXPECT_EQ(2u, fake.freed.size());
+		EXPECT_EQ(fake.freed.end(), std::find(fake.freed.begin(), fake.freed.end(), taken));
+	}
+	EXPECT_NE(std::string::npos, dump_of(pool).find(" free 0 chunks, 0 of 7168 KiB (0%)"));
+
+	/* Refilling is cancelled until the next request. */
+	EXPECT_EQ(0u, pool.refill());
+	EXPECT_EQ(-1, pool.take(1024 * KiB, &chunk_size));
+	EXPECT_EQ(3u, pool.refill());
+}
+
+TEST_F(GrallocHostContigPool, WorkerRefillsInTheBackground)
+{
+	{
+		contig_pool pool(fake_backend, chunks);
+		pool.start();
+		ASSERT_TRUE(wait_for([]() { return fake_allocated() == 3; }));
+
+		size_t chunk_size = 0;
+		EXPECT_LE(0, pool.take(1024 * KiB, &chunk_size));
+		EXPECT_TRUE(wait_for([]() { return fake_allocated() == 4; }));
+	}
+
+	/* Free chunks are released on destruction, not the one taken. */
+	std::lock_guard<std::mutex> guard(fake.lock);
+	EXPECT_EQ(3u, fake.freed.size());
+}
+
+TEST_F(GrallocHostContigPool, ServesContiguousAllocations)
+{
+	run_in_child(
+	    []()
+	    {
+		    gralloc_host_set_property("vendor.gralloc.contig_pool_kb", "1024,2048");
+
+		    const uint64_t usage =
+		        GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE | RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER;
+		    auto ion_dump = []()
+		    {
+			    android::String8 buf;
+			    mali_gralloc_ion_dump(buf);
+			    return std::string(buf.c_str());
+		    };
+
+		    /* The first request starts filling the reserve, too late for itself. */
+		    native_handle_t *first = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(64, 64, HAL_PIXEL_FORMAT_RGBA_8888, usage), &first));
+		    ASSERT_TRUE(wait_for([&]() { return ion_dump().find(" free 2 chunks") != std::string::npos; }));
+		    EXPECT_EQ(3u, ion_host_get_stats(ION_HEAP_TYPE_DMA).allocs);
+
+		    /* 1000KiB: the 1MiB chunk. */
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(512, 500, HAL_PIXEL_FORMAT_RGBA_8888, usage),
+		                                       &handle));
+		    EXPECT_EQ(1024 * 1024, static_cast<const private_handle_t *>(handle)->backing_store_size);
+		    EXPECT_NE(std::string::npos, ion_dump().find(" hits 1 misses 1"));
+
+		    /* Replaced in the background. */
+		    EXPECT_TRUE(wait_for([&]() { return ion_dump().find(" free 2 chunks") != std::string::npos; }));
+		    EXPECT_EQ(4u, ion_host_get_stats(ION_HEAP_TYPE_DMA).allocs);
+
+		    gralloc_host_free_allocated(handle);
+		    gralloc_host_free_allocated(first);
+	    });
+}
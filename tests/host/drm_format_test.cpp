@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * DRM fourcc and modifier of allocated buffers, derived from their alloc_format.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_formats.h"
+#include "core/format_info.h"
+#include "drmutils.h"
+
+namespace
+{
+
+/*
+ * Checks the values drm_*_from_handle() derive for an allocated handle.
+ */
+void check_derived(const native_handle_t *handle)
+{
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+
+	char name[48];
+	snprintf(name, sizeof(name), "alloc_format 0x%" PRIx64, hnd->alloc_format);
+	SCOPED_TRACE(name);
+
+	const uint64_t modifier = drm_modifier_from_handle(hnd);
+	EXPECT_EQ(drm_fourcc_from_format(hnd->alloc_format), drm_fourcc_from_handle(hnd));
+	EXPECT_EQ(drm_modifier_from_format(hnd->alloc_format, hnd->is_multi_plane()), modifier);
+
+	/* Linear buffers have the linear modifier, AFBC buffers an Arm one. */
+	if (hnd->alloc_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK)
+	{
+		EXPECT_EQ((uint64_t)DRM_FORMAT_MOD_VENDOR_ARM, modifier >> 56);
+		EXPECT_NE(DRM_FORMAT_MOD_ARM_AFBC(0), modifier);
+	}
+	else
+	{
+		EXPECT_EQ(0u, modifier);
+	}
+}
+
+/*
+ * @return whether the format could be allocated, and its values checked.
+ */
+bool allocate_and_check(const buffer_descriptor_t &descriptor)
+{
+	native_handle_t *handle = nullptr;
+	if (gralloc_host_allocate(descriptor, &handle) != 0)
+	{
+		return false;
+	}
+
+	check_derived(handle);
+	gralloc_host_free_allocated(handle);
+	return true;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostDrmFormat, DerivedForPublicFormats)
+{
+	const uint64_t hal_formats[] = {
+		HAL_PIXEL_FORMAT_RGBA_8888,     HAL_PIXEL_FORMAT_RGBX_8888,     HAL_PIXEL_FORMAT_RGB_888,
+		HAL_PIXEL_FORMAT_RGB_565,       HAL_PIXEL_FORMAT_BGRA_8888,     HAL_PIXEL_FORMAT_RGBA_1010102,
+		HAL_PIXEL_FORMAT_RGBA_FP16,     HAL_PIXEL_FORMAT_YCrCb_NV12,    HAL_PIXEL_FORMAT_YCrCb_NV12_10,
+		HAL_PIXEL_FORMAT_YCbCr_422_SP,  HAL_PIXEL_FORMAT_YCBCR_P010,    HAL_PIXEL_FORMAT_YCRCB_420_SP,
+		HAL_PIXEL_FORMAT_YV12,          HAL_PIXEL_FORMAT_YCbCr_420_888, HAL_PIXEL_FORMAT_Y8,
+		HAL_PIXEL_FORMAT_RAW16,         HAL_PIXEL_FORMAT_BLOB,
+	};
+	const uint64_t usages[] = {
+		GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
+		GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER,
+		GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_FB,
+		GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE,
+		GRALLOC_USAGE_VIDEO_DECODER | GRALLOC_USAGE_HW_TEXTURE,
+	};
+
+	size_t checked = 0;
+	size_t afbc = 0;
+	for (const uint64_t hal_format : hal_formats)
+	{
+		for (const uint64_t usage : usages)
+		{
+			const uint32_t height = hal_format == HAL_PIXEL_FORMAT_BLOB ? 1 : 1080;
+			native_handle_t *handle = nullptr;
+			if (gralloc_host_allocate(gralloc_host_descriptor(1920, height, hal_format, usage), &handle) != 0)
+			{
+				continue;
+			}
+
+			check_derived(handle);
+			checked++;
+			if (static_cast<const private_handle_t *>(handle)->alloc_format & MALI_GRALLOC_INTFMT_AFBCENABLE_MASK)
+			{
+				afbc++;
+			}
+			gralloc_host_free_allocated(handle);
+		}
+	}
+
+	EXPECT_GT(checked, sizeof(hal_formats) / sizeof(hal_formats[0]));
+	EXPECT_GT(afbc, 0u);
+}
+
+#if USE_RK_SELECTING_FORMAT_MANNER == 0
+TEST(GrallocHostDrmFormat, DerivedForEveryAfbcModifier)
+{
+	/* Every combination of the modifiers with a DRM counterpart. */
+	const uint64_t modifiers[] = {
+		MALI_GRALLOC_INTFMT_AFBC_SPARSE,
+		MALI_GRALLOC_INTFMT_AFBC_SPLITBLK | MALI_GRALLOC_INTFMT_AFBC_SPARSE,
+		MALI_GRALLOC_INTFMT_AFBC_WIDEBLK | MALI_GRALLOC_INTFMT_AFBC_SPARSE,
+		MALI_GRALLOC_INTFMT_AFBC_WIDEBLK | MALI_GRALLOC_INTFMT_AFBC_SPLITBLK | MALI_GRALLOC_INTFMT_AFBC_SPARSE,
+		MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS,
+		MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS | MALI_GRALLOC_INTFMT_AFBC_WIDEBLK,
+		MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS | MALI_GRALLOC_INTFMT_AFBC_EXTRAWIDEBLK,
+		MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS | MALI_GRALLOC_INTFMT_AFBC_EXTRAWIDEBLK | MALI_GRALLOC_INTFMT_AFBC_WIDEBLK,
+		MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS | MALI_GRALLOC_INTFMT_AFBC_DOUBLE_BODY,
+		MALI_GRALLOC_INTFMT_AFBC_YUV_TRANSFORM | MALI_GRALLOC_INTFMT_AFBC_SPARSE,
+	};
+
+	size_t checked = 0;
+	for (size_t i = 0; i < num_formats; i++)
+	{
+		for (const uint64_t modifier : modifiers)
+		{
+			if (!formats[i].afbc)
+			{
+				continue;
+			}
+
+			buffer_descriptor_t descriptor = gralloc_host_descriptor(
+			    256, 256, formats[i].id | MALI_GRALLOC_INTFMT_AFBC_BASIC | modifier,
+			    GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE);
+			descriptor.format_type = MALI_GRALLOC_FORMAT_TYPE_INTERNAL;
+			if (allocate_and_check(descriptor))
+			{
+				checked++;
+			}
+		}
+	}
+
+	EXPECT_GT(checked, num_formats);
+}
+
+TEST(GrallocHostDrmFormat, BlockSizeOfMultiPlaneFormats)
+{
+	/* Wide blocks of the chroma planes are 64x4. */
+	buffer_descriptor_t descriptor =
+	    gralloc_host_descriptor(256, 256,
+	                            MALI_GRALLOC_FORMAT_INTERNAL_NV12 | MALI_GRALLOC_INTFMT_AFBC_BASIC |
+	                                MALI_GRALLOC_INTFMT_AFBC_TILED_HEADERS | MALI_GRALLOC_INTFMT_AFBC_EXTRAWIDEBLK |
+	                                MALI_GRALLOC_INTFMT_AFBC_WIDEBLK,
+	                            GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE);
+	descriptor.format_type = MALI_GRALLOC_FORMAT_TYPE_INTERNAL;
+
+	native_handle_t *handle = nullptr;
+	ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+	EXPECT_EQ(DRM_FORMAT_NV12, drm_fourcc_from_handle(hnd));
+	EXPECT_EQ(DRM_FORMAT_MOD_ARM_AFBC(AFBC_FORMAT_MOD_BLOCK_SIZE_32x8_64x4 | AFBC_FORMAT_MOD_TILED),
+	          drm_modifier_from_handle(hnd));
+	check_derived(handle);
+	gralloc_host_free_allocated(handle);
+}
+#endif
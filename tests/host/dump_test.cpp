@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Attribution of the buffers listed by the allocator service dump.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include <utils/String8.h>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "core/mali_gralloc_debug.h"
+
+namespace
+{
+
+const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+
+/*
+ * @return pid a backing store is attributed to in the dump, -1 when it is not listed.
+ */
+int dump_pid_of(uint64_t backing_store_id, std::string *name = nullptr)
+{
+	android::String8 dump;
+	uint32_t size = 0;
+	mali_gralloc_dump_buffers(dump, &size);
+
+	char key[32];
+	snprintf(key, sizeof(key), "\n %016" PRIx64 " ", backing_store_id);
+	const char *line = strstr(dump.c_str(), key);
+	int pid = -1;
+	if (line == nullptr || sscanf(line + strlen(key), "%d", &pid) != 1)
+	{
+		return -1;
+	}
+
+	if (name != nullptr)
+	{
+		const char *end = strchr(line + 1, '\n');
+		const char *start = end;
+		while (start > line && start[-1] != ' ')
+		{
+			start--;
+		}
+		name->assign(start, end - start);
+	}
+
+	return pid;
+}
+
+/*
+ * Allocates a buffer for a client, and hands it over.
+ *
+ * @return backing store ID of the buffer, 0 on failure.
+ */
+uint64_t hand_over(client &c, const char *name)
+{
+	buffer_descriptor_t descriptor = gralloc_host_descriptor(64, 64, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+	descriptor.owner_pid = c.pid;
+	descriptor.name = name;
+
+	native_handle_t *handle = nullptr;
+	if (gralloc_host_allocate(descriptor, &handle) != 0)
+	{
+		return 0;
+	}
+
+	const uint64_t id = static_cast<const private_handle_t *>(handle)->backing_store_id;
+	EXPECT_EQ(c.pid, dump_pid_of(id));
+	const int ret = gralloc_host_send_handle(c.sock, handle);
+	gralloc_host_free_allocated(handle);
+
+	return ret == 0 && recv_byte(c.sock) ? id : 0;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostDump, AttributedToClientWhileHeld)
+{
+	run_in_child(
+	    []()
+	    {
+		    gralloc_host_track_lifetimes(true);
+
+		    client holder = start_client(hold_buffer);
+		    ASSERT_GE(holder.pid, 0);
+
+		    const uint64_t id = hand_over(holder, "held_by_client");
+		    ASSERT_NE(0u, id);
+
+		    /* Freed by the service, listed under the client while it holds the buffer. */
+		    std::string name;
+		    EXPECT_EQ(holder.pid, dump_pid_of(id, &name));
+		    EXPECT_EQ("held_by_client", name);
+
+		    ASSERT_TRUE(send_byte(holder.sock));
+		    EXPECT_EQ(0, finish_client(holder));
+		    EXPECT_EQ(-1, dump_pid_of(id));
+
+		    gralloc_host_track_lifetimes(false);
+	    });
+}
+
+TEST(GrallocHostDump, ServiceBuffersAttributedToService)
+{
+	run_in_child(
+	    []()
+	    {
+		    gralloc_host_track_lifetimes(true);
+
+		    native_handle_t *handle = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(64, 64, HAL_PIXEL_FORMAT_RGBA_8888, usage),
+		                                       &handle));
+		    const uint64_t id = static_cast<const private_handle_t *>(handle)->backing_store_id;
+		    EXPECT_EQ(getpid(), dump_pid_of(id));
+
+		    /* Not handed over: the record ends with the handle. */
+		    gralloc_host_free_allocated(handle);
+		    EXPECT_EQ(-1, dump_pid_of(id));
+
+		    gralloc_host_track_lifetimes(false);
+	    });
+}
@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Allocation, import, lock, metadata and free across processes: the test
+ * process plays the allocator service, and forked children the clients.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <utils/String8.h>
+
+#include "gralloc_host_test.h"
+#include "ion_host.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "core/mali_gralloc_bufferaccess.h"
+#include "allocator/mali_gralloc_ion.h"
+
+namespace
+{
+
+enum client_step
+{
+	CLIENT_OK,
+	CLIENT_RECV,
+	CLIENT_IMPORT,
+	CLIENT_LOCK,
+	CLIENT_CONTENT,
+	CLIENT_DATASPACE,  /* Metadata. */
+	CLIENT_UNLOCK,
+	CLIENT_RELEASE,
+	CLIENT_SYNC,
+};
+
+/*
+ * @return KiB of CPU mappings prefaulted so far, populated or hinted.
+ */
+uint64_t prefaulted_kib()
+{
+	android::String8 dump;
+	mali_gralloc_ion_dump(dump);
+
+	uint64_t populated = 0, hinted = 0;
+	const char *line = strstr(dump.c_str(), " populated ");
+	if (line == nullptr ||
+	    sscanf(line, " populated %" SCNu64 " KiB, hinted %" SCNu64 " KiB", &populated, &hinted) != 2)
+	{
+		ADD_FAILURE() << "no prefault counters in the ION dump";
+	}
+
+	return populated + hinted;
+}
+
+uint8_t pattern_at(int x, int y)
+{
+	return (uint8_t)(x * 7 + y * 13);
+}
+
+/*
+ * Imports the buffer sent by the test, writes a pattern through the CPU and
+ * keeps the buffer until told to release it.
+ */
+int producer(int sock)
+{
+	native_handle_t *raw = gralloc_host_recv_handle(sock);
+	if (raw == nullptr)
+	{
+		return CLIENT_RECV;
+	}
+
+	native_handle_t *handle = gralloc_host_import(raw);
+	native_handle_close(raw);
+	native_handle_delete(raw);
+	if (handle == nullptr)
+	{
+		return CLIENT_IMPORT;
+	}
+
+	auto *hnd = static_cast<private_handle_t *>(handle);
+	void *vaddr = nullptr;
+	if (mali_gralloc_lock(handle, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, hnd->width, hnd->height, &vaddr) != 0 ||
+	    vaddr == nullptr)
+	{
+		return CLIENT_LOCK;
+	}
+
+	for (int y = 0; y < hnd->height; y++)
+	{
+		uint8_t *row = static_cast<uint8_t *>(vaddr) + y * hnd->plane_info[0].byte_stride;
+		for (int x = 0; x < hnd->width * 4; x++)
+		{
+			row[x] = pattern_at(x, y);
+		}
+	}
+
+	if (mali_gralloc_unlock(handle) != 0)
+	{
+		return CLIENT_UNLOCK;
+	}
+
+	int dataspace = 0;
+	if (gralloc_host_get_attr(handle, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &dataspace) != 0 ||
+	    dataspace != HAL_DATASPACE_UNKNOWN)
+	{
+		return CLIENT_DATASPACE;
+	}
+
+	int crop[4] = { 2, 4, hnd->height - 6, hnd->width - 8 };
+	dataspace = HAL_DATASPACE_V0_SRGB;
+	if (gralloc_host_set_attr(handle, GRALLOC_ARM_BUFFER_ATTR_CROP_RECT, crop) != 0 ||
+	    gralloc_host_set_attr(handle, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &dataspace) != 0)
+	{
+		return CLIENT_DATASPACE;
+	}
+
+	if (!send_byte(sock) || !recv_byte(sock))
+	{
+		return CLIENT_SYNC;
+	}
+
+	return gralloc_host_release(handle) == 0 ? CLIENT_OK : CLIENT_RELEASE;
+}
+
+/*
+ * Imports the buffer sent by the test and checks its content and metadata.
+ */
+int consumer(int sock)
+{
+	native_handle_t *raw = gralloc_host_recv_handle(sock);
+	if (raw == nullptr)
+	{
+		return CLIENT_RECV;
+	}
+
+	native_handle_t *handle = gralloc_host_import(raw);
+	native_handle_close(raw);
+	native_handle_delete(raw);
+	if (handle == nullptr)
+	{
+		return CLIENT_IMPORT;
+	}
+
+	/* Wait for the producer. */
+	if (!recv_byte(sock))
+	{
+		return CLIENT_SYNC;
+	}
+
+	auto *hnd = static_cast<private_handle_t *>(handle);
+	void *vaddr = nullptr;
+	if (mali_gralloc_lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, hnd->width, hnd->height, &vaddr) != 0 ||
+	    vaddr == nullptr)
+	{
+		return CLIENT_LOCK;
+	}
+
+	for (int y = 0; y < hnd->height; y++)
+	{
+		const uint8_t *row = static_cast<const uint8_t *>(vaddr) + y * hnd->plane_info[0].byte_stride;
+		for (int x = 0; x < hnd->width * 4; x++)
+		{
+			if (row[x] != pattern_at(x, y))
+			{
+				return CLIENT_CONTENT;
+			}
+		}
+	}
+
+	if (mali_gralloc_unlock(handle) != 0)
+	{
+		return CLIENT_UNLOCK;
+	}
+
+	/* Metadata set by the producer. */
+	int dataspace = 0;
+	int crop[4] = {};
+	if (gralloc_host_get_attr(handle, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &dataspace) != 0 ||
+	    dataspace != HAL_DATASPACE_V0_SRGB ||
+	    gralloc_host_get_attr(handle, GRALLOC_ARM_BUFFER_ATTR_CROP_RECT, crop) != 0 || crop[0] != 2 || crop[1] != 4 ||
+	    crop[2] != hnd->height - 6 || crop[3] != hnd->width - 8)
+	{
+		return CLIENT_DATASPACE;
+	}
+
+	return gralloc_host_release(handle) == 0 ? CLIENT_OK : CLIENT_RELEASE;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostE2E, AllocateImportLockFree)
+{
+	const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+
+	client producer_client = start_client(producer);
+	client consumer_client = start_client(consumer);
+	ASSERT_GE(producer_client.pid, 0);
+	ASSERT_GE(consumer_client.pid, 0);
+
+	buffer_descriptor_t descriptor = gralloc_host_descriptor(96, 64, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+	descriptor.owner_pid = producer_client.pid;
+
+	native_handle_t *handle = nullptr;
+	ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+	EXPECT_EQ(NUM_INTS_IN_PRIVATE_HANDLE, (size_t)handle->numInts);
+
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+	EXPECT_EQ(96, hnd->width);
+	EXPECT_EQ(64, hnd->height);
+	EXPECT_GE(hnd->plane_info[0].byte_stride, 96u * 4);
+	EXPECT_GE((size_t)hnd->size, (size_t)hnd->plane_info[0].byte_stride * 64);
+
+	/* As the allocator service: send, then free the service's copy. */
+	ASSERT_EQ(0, gralloc_host_send_handle(producer_client.sock, handle));
+	ASSERT_EQ(0, gralloc_host_send_handle(consumer_client.sock, handle));
+	gralloc_host_free_allocated(handle);
+
+	/* The consumer only starts reading once the producer has written. */
+	ASSERT_TRUE(recv_byte(producer_client.sock));
+	ASSERT_TRUE(send_byte(consumer_client.sock));
+	EXPECT_EQ(CLIENT_OK, finish_client(consumer_client));
+
+	ASSERT_TRUE(send_byte(producer_client.sock));
+	EXPECT_EQ(CLIENT_OK, finish_client(producer_client));
+}
+
+TEST(GrallocHostE2E, MultiPlaneLayout)
+{
+	const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+	buffer_descriptor_t descriptor = gralloc_host_descriptor(128, 72, HAL_PIXEL_FORMAT_YCrCb_NV12, usage);
+
+	native_handle_t *handle = nullptr;
+	ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+	EXPECT_TRUE(hnd->is_multi_plane());
+	EXPECT_GE(hnd->plane_info[1].offset, hnd->plane_info[0].byte_stride * hnd->plane_info[0].alloc_height);
+	EXPECT_LE(hnd->plane_info[1].offset + hnd->plane_info[1].byte_stride * hnd->plane_info[1].alloc_height,
+	          (uint32_t)hnd->size);
+
+	client c = start_client(
+	    [](int sock)
+	    {
+		    native_handle_t *raw = gralloc_host_recv_handle(sock);
+		    native_handle_t *imported = raw != nullptr ? gralloc_host_import(raw) : nullptr;
+		    if (imported == nullptr)
+		    {
+			    return (int)CLIENT_IMPORT;
+		    }
+		    native_handle_close(raw);
+		    native_handle_delete(raw);
+
+		    auto *imported_hnd = static_cast<private_handle_t *>(imported);
+		    android_ycbcr ycbcr = {};
+		    if (mali_gralloc_lock_ycbcr(imported, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, imported_hnd->width,
+		                                imported_hnd->height, &ycbcr) != 0)
+		    {
+			    return (int)CLIENT_LOCK;
+		    }
+
+		    const uint8_t *base = static_cast<const uint8_t *>(ycbcr.y);
+		    if (ycbcr.cb != base + imported_hnd->plane_info[1].offset || ycbcr.cr != base + imported_hnd->plane_info[1].offset + 1 ||
+		        ycbcr.chroma_step != 2 || ycbcr.ystride != imported_hnd->plane_info[0].byte_stride)
+		    {
+			    return (int)CLIENT_CONTENT;
+		    }
+
+		    if (mali_gralloc_unlock(imported) != 0)
+		    {
+			    return (int)CLIENT_UNLOCK;
+		    }
+		    return gralloc_host_release(imported) == 0 ? (int)CLIENT_OK : (int)CLIENT_RELEASE;
+	    });
+	ASSERT_GE(c.pid, 0);
+
+	ASSERT_EQ(0, gralloc_host_send_handle(c.sock, handle));
+	gralloc_host_free_allocated(handle);
+	EXPECT_EQ(CLIENT_OK, finish_client(c));
+}
+
+TEST(GrallocHostE2E, IonFailuresAndFallback)
+{
+	run_in_child(
+	    []()
+	    {
+		    const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE | RK_GRALLOC_USAGE_PHY_CONTIG_BUFFER;
+		    buffer_descriptor_t descriptor = gralloc_host_descriptor(64, 64, HAL_PIXEL_FORMAT_RGBA_8888, usage);
+		    native_handle_t *handle = nullptr;
+
+		    /* Physically contiguous buffers come from the DMA heap. */
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_EQ(1u, ion_host_get_stats(ION_HEAP_TYPE_DMA).allocs);
+		    gralloc_host_free_allocated(handle);
+
+		    /* A DMA heap failure falls back to the system heap. */
+		    ion_host_fail(ION_HEAP_TYPE_DMA, 1);
+		    ASSERT_EQ(0, gralloc_host_allocate(descriptor, &handle));
+		    EXPECT_EQ(1u, ion_host_get_stats(ION_HEAP_TYPE_DMA).failures);
+		    EXPECT_EQ(1u, ion_host_get_stats(ION_HEAP_TYPE_SYSTEM).allocs);
+		    gralloc_host_free_allocated(handle);
+
+		    /* Nothing left to fall back on. */
+		    ion_host_fail(ION_HEAP_TYPE_DMA, -1);
+		    ion_host_fail(ION_HEAP_TYPE_SYSTEM, -1);
+		    EXPECT_NE(0, gralloc_host_allocate(descriptor, &handle));
+	    });
+}
+
+TEST(GrallocHostE2E, PrefaultedOncePerMapping)
+{
+	run_in_child(
+	    []()
+	    {
+		    const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+		    native_handle_t *allocated = nullptr;
+		    ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(256, 256, HAL_PIXEL_FORMAT_RGBA_8888, usage),
+		                                       &allocated));
+
+		    for (int mapping = 0; mapping < 2; mapping++)
+		    {
+			    SCOPED_TRACE(mapping);
+
+			    native_handle_t *handle = gralloc_host_import(allocated);
+			    ASSERT_NE(nullptr, handle);
+			    const uint64_t size_kib = static_cast<const private_handle_t *>(handle)->size / 1024;
+			    void *vaddr = nullptr;
+
+			    /* Populated for reading by the first lock only. */
+			    uint64_t before = prefaulted_kib();
+			    ASSERT_EQ(0, mali_gralloc_lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, 256, 256, &vaddr));
+			    mali_gralloc_unlock(handle);
+			    EXPECT_EQ(before + size_kib, prefaulted_kib());
+
+			    before = prefaulted_kib();
+			    ASSERT_EQ(0, mali_gralloc_lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, 256, 256, &vaddr));
+			    mali_gralloc_unlock(handle);
+			    EXPECT_EQ(before, prefaulted_kib());
+
+			    /* Again for the first write, then never. */
+			    ASSERT_EQ(0, mali_gralloc_lock(handle, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, 256, 256, &vaddr));
+			    mali_gralloc_unlock(handle);
+			    EXPECT_EQ(before + size_kib, prefaulted_kib());
+
+			    before = prefaulted_kib();
+			    ASSERT_EQ(0, mali_gralloc_lock(handle, usage, 0, 0, 256, 256, &vaddr));
+			    mali_gralloc_unlock(handle);
+			    ASSERT_EQ(0, mali_gralloc_lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, 256, 256, &vaddr));
+			    mali_gralloc_unlock(handle);
+			    EXPECT_EQ(before, prefaulted_kib());
+
+			    /* A new mapping is prefaulted again. */
+			    gralloc_host_release(handle);
+		    }
+
+		    gralloc_host_free_allocated(allocated);
+	    });
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Negotiation of the fbdev page-flip buffers with a fake framebuffer device.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fbdev/mali_gralloc_fb_buffers.h"
+
+namespace
+{
+
+const uint32_t yres = 1080;
+
+/* Screen information as kept by a driver. */
+struct fake_fb
+{
+	/* Largest virtual resolution accepted, in screens. */
+	uint32_t max_screens;
+	/* Larger virtual resolutions are clamped rather than rejected. */
+	bool clamps;
+	bool get_fails;
+
+	fb_var_screeninfo var;
+	/* yres_virtual of every FBIOPUT_VSCREENINFO. */
+	std::vector<uint32_t> puts;
+};
+
+int fake_put_var(void *ctx, fb_var_screeninfo *info)
+{
+	fake_fb *fb = static_cast<fake_fb *>(ctx);
+
+	fb->puts.push_back(info->yres_virtual);
+	if (info->yres_virtual > fb->max_screens * info->yres)
+	{
+		if (!fb->clamps)
+		{
+			return -1;
+		}
+		info->yres_virtual = fb->max_screens * info->yres;
+	}
+
+	fb->var = *info;
+	return 0;
+}
+
+int fake_get_var(void *ctx, fb_var_screeninfo *info)
+{
+	fake_fb *fb = static_cast<fake_fb *>(ctx);
+
+	if (fb->get_fails)
+	{
+		return -1;
+	}
+	*info = fb->var;
+	return 0;
+}
+
+uint32_t negotiate(fake_fb &fb, uint32_t wanted, fb_var_screeninfo *info)
+{
+	memset(&fb.var, 0, sizeof(fb.var));
+	fb.var.xres = 1920;
+	fb.var.yres = yres;
+	fb.var.yres_virtual = yres;
+	*info = fb.var;
+
+	const fb_device_ops ops = { fake_put_var, fake_get_var, &fb };
+	return fb_negotiate_buffers(&ops, info, wanted);
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostFbBuffers, AllBuffersProvided)
+{
+	for (uint32_t wanted = FB_MIN_BUFFERS; wanted <= FB_MAX_BUFFERS; wanted++)
+	{
+		fake_fb fb = { FB_MAX_BUFFERS, false, false, {}, {} };
+		fb_var_screeninfo info;
+
+		EXPECT_EQ(wanted, negotiate(fb, wanted, &info));
+		EXPECT_EQ(wanted * yres, info.yres_virtual);
+		EXPECT_EQ(std::vector<uint32_t>({ wanted * yres }), fb.puts);
+	}
+}
+
+TEST(GrallocHostFbBuffers, StepsDownWhenRejected)
+{
+	fake_fb fb = { 2, false, false, {}, {} };
+	fb_var_screeninfo info;
+
+	EXPECT_EQ(2u, negotiate(fb, 4, &info));
+	EXPECT_EQ(2 * yres, info.yres_virtual);
+	EXPECT_EQ(std::vector<uint32_t>({ 4 * yres, 3 * yres, 2 * yres }), fb.puts);
+	EXPECT_EQ(2 * yres, fb.var.yres_virtual);
+}
+
+TEST(GrallocHostFbBuffers, UsesWhatClampingDriversProvide)
+{
+	fake_fb fb = { 3, true, false, {}, {} };
+	fb_var_screeninfo info;
+
+	EXPECT_EQ(3u, negotiate(fb, 4, &info));
+	EXPECT_EQ(3 * yres, info.yres_virtual);
+	EXPECT_EQ(std::vector<uint32_t>({ 4 * yres }), fb.puts);
+}
+
+TEST(GrallocHostFbBuffers, SingleBufferWithoutPageFlipping)
+{
+	/* Rejected, clamped to one screen, or not readable back. */
+	const fake_fb devices[] = {
+		{ 1, false, false, {}, {} },
+		{ 1, true, false, {}, {} },
+		{ FB_MAX_BUFFERS, false, true, {}, {} },
+	};
+
+	for (const fake_fb &device : devices)
+	{
+		fake_fb fb = device;
+		fb_var_screeninfo info;
+
+		EXPECT_EQ(1u, negotiate(fb, 3, &info));
+		EXPECT_EQ(yres, info.yres_virtual);
+		ASSERT_FALSE(fb.puts.empty());
+		EXPECT_EQ(yres, fb.puts.back());
+		EXPECT_EQ(yres, fb.var.yres_virtual);
+	}
+}
+
+TEST(GrallocHostFbBuffers, SlotsReusedOnceAllTaken)
+{
+	for (uint32_t num_buffers = 1; num_buffers <= FB_MAX_BUFFERS; num_buffers++)
+	{
+		uint32_t mask = 0;
+		for (uint32_t round = 0; round < 3; round++)
+		{
+			for (uint32_t slot = 0; slot < num_buffers; slot++)
+			{
+				EXPECT_EQ(slot, fb_take_slot(&mask, num_buffers));
+			}
+			EXPECT_EQ((1u << num_buffers) - 1, mask);
+		}
+	}
+
+	/* Slots taken out of order. */
+	uint32_t mask = 0x5;
+	EXPECT_EQ(1u, fb_take_slot(&mask, 4));
+	EXPECT_EQ(3u, fb_take_slot(&mask, 4));
+	EXPECT_EQ(0u, fb_take_slot(&mask, 4));
+	EXPECT_EQ(0x1u, mask);
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Asynchronous page flips of the fbdev path, driven by a fake display.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "1.x/gralloc_flip_queue.h"
+
+namespace
+{
+
+native_handle_t handles[8];
+
+buffer_handle_t buffer(int i)
+{
+	return &handles[i];
+}
+
+int index_of(buffer_handle_t handle)
+{
+	return static_cast<int>(handle - handles);
+}
+
+/* A display flipping on the worker thread of the queue. */
+class fake_display
+{
+public:
+	fb_flip_backend backend()
+	{
+		return { flip_cb, release_cb, vsync_enabled_cb, this };
+	}
+
+	/* Holds the next flips until opened. */
+	void close_gate()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		gate_open = false;
+	}
+
+	void open_gate()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			gate_open = true;
+		}
+		gate.notify_all();
+	}
+
+	std::vector<int> flipped()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return flips;
+	}
+
+	std::vector<int> released()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return releases;
+	}
+
+	/* Flip of a buffer failing with this error. */
+	int failing_buffer = -1;
+	int failure = -EIO;
+	/* Time a flip takes for each buffer, none by default. */
+	std::vector<int> flip_ms;
+	bool vsync = true;
+
+private:
+	static int flip_cb(void *ctx, buffer_handle_t handle)
+	{
+		fake_display *display = static_cast<fake_display *>(ctx);
+		const int i = index_of(handle);
+
+		std::unique_lock<std::mutex> guard(display->lock);
+		display->gate.wait(guard, [display] { return display->gate_open; });
+		display->flips.push_back(i);
+		guard.unlock();
+
+		if (i < (int)display->flip_ms.size())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(display->flip_ms[i]));
+		}
+		return i == display->failing_buffer ? display->failure : 0;
+	}
+
+	static void release_cb(void *ctx, buffer_handle_t handle)
+	{
+		fake_display *display = static_cast<fake_display *>(ctx);
+
+		std::lock_guard<std::mutex> guard(display->lock);
+		display->releases.push_back(index_of(handle));
+	}
+
+	static bool vsync_enabled_cb(void *ctx)
+	{
+		return static_cast<fake_display *>(ctx)->vsync;
+	}
+
+	std::mutex lock;
+	std::condition_variable gate;
+	bool gate_open = true;
+	std::vector<int> flips;
+	std::vector<int> releases;
+};
+
+const int64_t period_ns = 16666667;
+
+} /* anonymous namespace */
+
+TEST(GrallocHostFlipQueue, FlippedInOrder)
+{
+	fake_display display;
+	fb_flip_queue queue(display.backend(), 2, period_ns);
+	queue.start();
+
+	for (int i = 0; i < 6; i++)
+	{
+		EXPECT_EQ(0, queue.post(buffer(i)));
+	}
+	queue.drain();
+
+	EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3, 4, 5 }), display.flipped());
+
+	/* Each buffer leaves the screen once the next one is on it. */
+	EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3, 4 }), display.released());
+
+	const fb_flip_stats stats = queue.stats();
+	EXPECT_EQ(6u, stats.posted);
+	EXPECT_EQ(6u, stats.flipped);
+	EXPECT_EQ(0u, stats.failed);
+	EXPECT_GE(stats.max_latency_ns, stats.avg_latency_ns);
+	EXPECT_GT(stats.avg_latency_ns, 0);
+}
+
+TEST(GrallocHostFlipQueue, FrontBufferReleasedOnDestruction)
+{
+	fake_display display;
+	{
+		fb_flip_queue queue(display.backend(), 2, period_ns);
+		queue.start();
+
+		/* Still queued when destroyed. */
+		display.close_gate();
+		EXPECT_EQ(0, queue.post(buffer(0)));
+		EXPECT_EQ(0, queue.post(buffer(1)));
+		EXPECT_TRUE(display.released().empty());
+		display.open_gate();
+	}
+
+	EXPECT_EQ(std::vector<int>({ 0, 1 }), display.flipped());
+	EXPECT_EQ(std::vector<int>({ 0, 1 }), display.released());
+
+	/* Never started, nothing on screen. */
+	fake_display idle;
+	{
+		fb_flip_queue queue(idle.backend(), 2, period_ns);
+	}
+	EXPECT_TRUE(idle.released().empty());
+}
+
+TEST(GrallocHostFlipQueue, FailedFlipReported)
+{
+	fake_display display;
+	display.failing_buffer = 1;
+
+	fb_flip_queue queue(display.backend(), 2, period_ns);
+	queue.start();
+
+	EXPECT_EQ(0, queue.post(buffer(0)));
+	EXPECT_EQ(0, queue.post(buffer(1)));
+	queue.drain();
+
+	/* The failed buffer is released, the previous one stays on screen. */
+	EXPECT_EQ(std::vector<int>({ 1 }), display.released());
+
+	/* Returned by the next post, once. */
+	EXPECT_EQ(display.failure, queue.post(buffer(2)));
+	EXPECT_EQ(0, queue.post(buffer(3)));
+	queue.drain();
+
+	EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3 }), display.flipped());
+	EXPECT_EQ(std::vector<int>({ 1, 0, 2 }), display.released());
+
+	const fb_flip_stats stats = queue.stats();
+	EXPECT_EQ(4u, stats.posted);
+	EXPECT_EQ(3u, stats.flipped);
+	EXPECT_EQ(1u, stats.failed);
+}
+
+TEST(GrallocHostFlipQueue, PostsStallOnFullQueue)
+{
+	for (const uint32_t depth : { 1u, 2u, 3u })
+	{
+		SCOPED_TRACE("depth " + std::to_string(depth));
+
+		fake_display display;
+		fb_flip_queue queue(display.backend(), depth, period_ns);
+		queue.start();
+
+		/* 'depth' flips pending, including the one held by the display. */
+		display.close_gate();
+		for (uint32_t i = 0; i < depth; i++)
+		{
+			EXPECT_EQ(0, queue.post(buffer(i)));
+		}
+		EXPECT_EQ(0u, queue.stats().stalls);
+
+		std::atomic<bool> posted(false);
+		std::thread poster(
+		    [&]()
+		    {
+			    EXPECT_EQ(0, queue.post(buffer(depth)));
+			    posted = true;
+		    });
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		EXPECT_FALSE(posted);
+
+		display.open_gate();
+		poster.join();
+		queue.drain();
+
+		const fb_flip_stats stats = queue.stats();
+		EXPECT_EQ(1u, stats.stalls);
+		EXPECT_EQ(depth + 1, stats.flipped);
+	}
+}
+
+TEST(GrallocHostFlipQueue, DrainWaitsForPendingFlips)
+{
+	fake_display display;
+	display.flip_ms = { 5, 5, 5, 5 };
+
+	fb_flip_queue queue(display.backend(), 4, period_ns);
+	queue.start();
+
+	for (int i = 0; i < 4; i++)
+	{
+		EXPECT_EQ(0, queue.post(buffer(i)));
+	}
+	queue.drain();
+	EXPECT_EQ(4u, display.flipped().size());
+	EXPECT_EQ(4u, queue.stats().flipped);
+
+	/* Nothing pending. */
+	queue.drain();
+}
+
+TEST(GrallocHostFlipQueue, MissedVsyncsCounted)
+{
+	const int64_t slow_period_ns = 20000000;
+
+	for (const bool vsync : { true, false })
+	{
+		SCOPED_TRACE(vsync ? "vsync" : "no vsync");
+
+		fake_display display;
+		display.vsync = vsync;
+		/* On time, then displayed three vsyncs after the previous frame. */
+		display.flip_ms = { 20, 20, 60, 20 };
+
+		fb_flip_queue queue(display.backend(), 4, slow_period_ns);
+		queue.start();
+
+		for (int i = 0; i < 4; i++)
+		{
+			EXPECT_EQ(0, queue.post(buffer(i)));
+		}
+		queue.drain();
+		EXPECT_EQ(vsync ? 2u : 0u, queue.stats().missed);
+
+		/* Not ready before the previous flip completed: nothing missed. */
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		EXPECT_EQ(0, queue.post(buffer(4)));
+		queue.drain();
+		EXPECT_EQ(vsync ? 2u : 0u, queue.stats().missed);
+	}
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gralloc_host.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <cutils/properties.h>
+
+#include "ion_host.h"
+#include "gralloc_priv.h"
+#include "gralloc_buffer_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "core/mali_gralloc_bufferallocation.h"
+#include "core/mali_gralloc_reference.h"
+#include "core/mali_gralloc_lifetime.h"
+#include "core/format_info.h"
+#include "allocator/mali_gralloc_shared_memory.h"
+
+/* Libraries dlopen'd by the capabilities, see caps/caps_provider.cpp. */
+static const char *const caps_libraries[] = {
+	"libGLES_mali.so",
+	"hwcomposer.drm.so",
+	"libstagefrighthw.so",
+};
+
+static std::string workdir;
+static pid_t workdir_owner;
+
+static void remove_workdir(void)
+{
+	/* Children forked by the tests share the directory of their parent. */
+	if (workdir.empty() || getpid() != workdir_owner)
+	{
+		return;
+	}
+
+	const std::string command = "rm -rf '" + workdir + "'";
+	if (system(command.c_str()) != 0)
+	{
+		fprintf(stderr, "Unable to remove %s\n", workdir.c_str());
+	}
+}
+
+static std::string executable_dir(const char *argv0)
+{
+	char path[PATH_MAX];
+	const ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	std::string exe = len > 0 ? std::string(path, len) : std::string(argv0);
+
+	const size_t slash = exe.rfind('/');
+	return slash == std::string::npos ? std::string(".") : exe.substr(0, slash);
+}
+
+bool gralloc_host_setup(const char *argv0)
+{
+	const char *tmp = getenv("TMPDIR");
+	std::string pattern = std::string(tmp != nullptr ? tmp : "/tmp") + "/gralloc_host.XXXXXX";
+	std::vector<char> dir(pattern.begin(), pattern.end());
+	dir.push_back('\0');
+
+	if (mkdtemp(dir.data()) == nullptr)
+	{
+		fprintf(stderr, "mkdtemp %s: %s\n", pattern.c_str(), strerror(errno));
+		return false;
+	}
+	workdir = dir.data();
+	workdir_owner = getpid();
+	atexit(remove_workdir);
+
+	const std::string exe_dir = executable_dir(argv0);
+	const std::string search_dirs[] = { exe_dir, exe_dir + "/lib64", exe_dir + "/../lib64" };
+
+	for (const char *library : caps_libraries)
+	{
+		for (const std::string &search_dir : search_dirs)
+		{
+			const std::string source = search_dir + "/" + library;
+			char resolved[PATH_MAX];
+			if (realpath(source.c_str(), resolved) != nullptr &&
+			    symlink(resolved, (workdir + "/" + library).c_str()) == 0)
+			{
+				break;
+			}
+		}
+	}
+
+	/* Read once by the RK format selection: tests of another platform set it in a child process. */
+	gralloc_host_set_property("ro.board.platform", "rk356x");
+
+	if (chdir(workdir.c_str()) != 0)
+	{
+		fprintf(stderr, "chdir %s: %s\n", workdir.c_str(), strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+const char *gralloc_host_workdir(void)
+{
+	return workdir.c_str();
+}
+
+void gralloc_host_set_property(const char *key, const char *value)
+{
+	/* Host libcutils keeps properties in the process. */
+	property_set(key, value);
+}
+
+buffer_descriptor_t gralloc_host_descriptor(uint32_t width, uint32_t height, uint64_t format, uint64_t usage)
+{
+	buffer_descriptor_t descriptor;
+
+	descriptor.width = width;
+	descriptor.height = height;
+	descriptor.layer_count = 1;
+	descriptor.hal_format = format;
+	descriptor.producer_usage = usage;
+	descriptor.consumer_usage = usage;
+	descriptor.format_type = MALI_GRALLOC_FORMAT_TYPE_USAGE;
+	descriptor.name = "gralloc_host";
+
+	return descriptor;
+}
+
+int gralloc_host_allocate(const buffer_descriptor_t &descriptor, native_handle_t **handle)
+{
+	buffer_descriptor_t allocation = descriptor;
+	gralloc_buffer_descriptor_t descriptors[1] = { (gralloc_buffer_descriptor_t)(&allocation) };
+	buffer_handle_t buffer = nullptr;
+
+	int ret = mali_gralloc_buffer_allocate(descriptors, 1, &buffer, nullptr);
+	if (ret != 0)
+	{
+		return ret < 0 ? ret : -ret;
+	}
+
+	auto *hnd = const_cast<private_handle_t *>(static_cast<const private_handle_t *>(buffer));
+	hnd->attr_size = sizeof(attr_region);
+	std::tie(hnd->share_attr_fd, hnd->attr_base) = gralloc_shared_memory_allocate("gralloc_shared_memory", hnd->attr_size);
+	if (hnd->share_attr_fd < 0 || hnd->attr_base == MAP_FAILED)
+	{
+		mali_gralloc_buffer_free(buffer);
+		native_handle_delete(hnd);
+		return -ENOMEM;
+	}
+
+	new(hnd->attr_base) attr_region;
+	android_dataspace_t dataspace;
+	get_format_dataspace(allocation.alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK,
+	                     allocation.consumer_usage | allocation.producer_usage, hnd->width, hnd->height, &dataspace,
+	                     &hnd->yuv_info);
+	int temp_dataspace = static_cast<int>(dataspace);
+	gralloc_buffer_attr_write(hnd, GRALLOC_ARM_BUFFER_ATTR_DATASPACE, &temp_dataspace);
+
+	munmap(hnd->attr_base, hnd->attr_size);
+	hnd->attr_base = MAP_FAILED;
+
+	*handle = hnd;
+	return 0;
+}
+
+void gralloc_host_free_allocated(native_handle_t *handle)
+{
+	/* The allocator service frees through its reaper thread: done in place here. */
+	mali_gralloc_buffer_free(handle);
+	native_handle_delete(handle);
+}
+
+native_handle_t *gralloc_host_import(const native_handle_t *raw_handle)
+{
+	native_handle_t *handle = native_handle_clone(raw_handle);
+	if (handle == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (mali_gralloc_reference_retain(handle) < 0)
+	{
+		native_handle_close(handle);
+		native_handle_delete(handle);
+		return nullptr;
+	}
+
+	return handle;
+}
+
+int gralloc_host_release(native_handle_t *handle)
+{
+	auto *hnd = static_cast<private_handle_t *>(handle);
+	if (hnd->attr_base != MAP_FAILED)
+	{
+		gralloc_buffer_attr_unmap(hnd);
+	}
+
+	const int ret = mali_gralloc_reference_release(handle, true);
+	if (ret != 0)
+	{
+		return ret;
+	}
+
+	native_handle_close(handle);
+	native_handle_delete(handle);
+	return 0;
+}
+
+int gralloc_host_get_attr(native_handle_t *handle, buf_attr attr, int *val)
+{
+	auto *hnd = static_cast<private_handle_t *>(handle);
+	if (hnd->attr_base == MAP_FAILED && gralloc_buffer_attr_map(hnd, 1) != 0)
+	{
+		return -EINVAL;
+	}
+
+	return gralloc_buffer_attr_read(hnd, attr, val);
+}
+
+int gralloc_host_set_attr(native_handle_t *handle, buf_attr attr, int *val)
+{
+	auto *hnd = static_cast<private_handle_t *>(handle);
+	if (hnd->attr_base == MAP_FAILED && gralloc_buffer_attr_map(hnd, 1) != 0)
+	{
+		return -EINVAL;
+	}
+
+	return gralloc_buffer_attr_write(hnd, attr, val);
+}
+
+int gralloc_host_send_handle(int sock, const native_handle_t *handle)
+{
+	const size_t fds_size = handle->numFds * sizeof(int);
+	std::vector<char> control(CMSG_SPACE(fds_size));
+
+	/* Header and ints, without the file descriptors. */
+	std::vector<int> data;
+	data.push_back(handle->version);
+	data.push_back(handle->numFds);
+	data.push_back(handle->numInts);
+	data.insert(data.end(), &handle->data[handle->numFds], &handle->data[handle->numFds + handle->numInts]);
+
+	struct iovec iov = { data.data(), data.size() * sizeof(int) };
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.data();
+	msg.msg_controllen = control.size();
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(fds_size);
+	memcpy(CMSG_DATA(cmsg), handle->data, fds_size);
+
+	return sendmsg(sock, &msg, 0) == (ssize_t)iov.iov_len ? 0 : -errno;
+}
+
+native_handle_t *gralloc_host_recv_handle(int sock)
+{
+	int data[3 + NATIVE_HANDLE_MAX_INTS];
+	std::vector<char> control(CMSG_SPACE(GRALLOC_ARM_NUM_FDS * sizeof(int)));
+
+	struct iovec iov = { data, sizeof(data) };
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.data();
+	msg.msg_controllen = control.size();
+
+	const ssize_t len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (len < (ssize_t)(3 * sizeof(int)) || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS)
+	{
+		return nullptr;
+	}
+
+	const int num_fds = data[1];
+	const int num_ints = data[2];
+	if (num_fds != GRALLOC_ARM_NUM_FDS || cmsg->cmsg_len != CMSG_LEN(num_fds * sizeof(int)) ||
+	    len != (ssize_t)((3 + num_ints) * sizeof(int)))
+	{
+		return nullptr;
+	}
+
+	native_handle_t *handle = native_handle_create(num_fds, num_ints);
+	if (handle == nullptr)
+	{
+		return nullptr;
+	}
+	memcpy(handle->data, CMSG_DATA(cmsg), num_fds * sizeof(int));
+	memcpy(&handle->data[num_fds], &data[3], num_ints * sizeof(int));
+
+	return handle;
+}
+
+static bool ion_lifetime_available(void *)
+{
+	return true;
+}
+
+static bool ion_lifetime_alive(void *, uint64_t inode)
+{
+	return ion_host_buffer_alive(inode);
+}
+
+static const mali_gralloc_lifetime_backend ion_lifetime_backend = { ion_lifetime_available, ion_lifetime_alive, nullptr };
+
+void gralloc_host_track_lifetimes(bool enable)
+{
+	mali_gralloc_lifetime_set_backend(enable ? &ion_lifetime_backend : nullptr);
+}
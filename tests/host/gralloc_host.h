@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_HOST_H_
+#define GRALLOC_HOST_H_
+
+/*
+ * Host harness of the allocator and mapper cores.
+ *
+ * Drives the core libraries the way the allocator service (hidl_common/Allocator.cpp)
+ * and IMapper (hidl_common/Mapper.cpp) do, without HIDL: buffers are
+ * allocated from the memfd ION stand-in, sent over a UNIX socket as binder
+ * would, and imported by cloning them.
+ */
+
+#include <stdint.h>
+
+#include <cutils/native_handle.h>
+
+#include "core/mali_gralloc_bufferdescriptor.h"
+#include "mali_gralloc_private_interface_types.h"
+
+/*
+ * Prepares the process: creates a private working directory holding links to
+ * the capability libraries found next to the executable (or in its lib64/
+ * and ../lib64/ directories) and makes it the current directory, where the
+ * host build looks for them and for the capabilities cache. The platform is
+ * an RK356x unless "ro.board.platform" is set again.
+ *
+ * @return false when the working directory cannot be prepared.
+ */
+bool gralloc_host_setup(const char *argv0);
+
+/*
+ * @return the working directory made by gralloc_host_setup().
+ */
+const char *gralloc_host_workdir(void);
+
+/*
+ * Sets a system property read by the cores. Properties are read once per
+ * process: tests changing them run in a child process.
+ */
+void gralloc_host_set_property(const char *key, const char *value);
+
+/*
+ * Returns a descriptor as built by IMapper::createDescriptor().
+ */
+buffer_descriptor_t gralloc_host_descriptor(uint32_t width, uint32_t height, uint64_t format, uint64_t usage);
+
+/*
+ * Allocates a buffer and its attribute region as IAllocator::allocate() does.
+ *
+ * @param descriptor [in]  Buffer descriptor, 'owner_pid' is the calling client.
+ * @param handle     [out] Handle owned by the allocator.
+ *
+ * @return 0 on success, a negative value otherwise.
+ */
+int gralloc_host_allocate(const buffer_descriptor_t &descriptor, native_handle_t **handle);
+
+/*
+ * Frees the allocator's copy of a buffer, once sent.
+ */
+void gralloc_host_free_allocated(native_handle_t *handle);
+
+/*
+ * Imports a buffer as IMapper::importBuffer() does.
+ *
+ * @return the imported handle, nullptr on failure.
+ */
+native_handle_t *gralloc_host_import(const native_handle_t *raw_handle);
+
+/*
+ * Releases an imported buffer as IMapper::freeBuffer() does.
+ */
+int gralloc_host_release(native_handle_t *handle);
+
+/*
+ * Reads or writes an attribute of an imported buffer, as the metadata
+ * accessors of IMapper do.
+ *
+ * @return 0 on success, a negative value otherwise.
+ */
+int gralloc_host_get_attr(native_handle_t *handle, buf_attr attr, int *val);
+int gralloc_host_set_attr(native_handle_t *handle, buf_attr attr, int *val);
+
+/*
+ * Sends a handle over a UNIX socket: file descriptors are duplicated into
+ * the receiving process as binder does.
+ */
+int gralloc_host_send_handle(int sock, const native_handle_t *handle);
+
+/*
+ * Receives a handle sent by gralloc_host_send_handle(), to be closed and
+ * deleted by the caller.
+ */
+native_handle_t *gralloc_host_recv_handle(int sock);
+
+/*
+ * Probes dma-buf lifetimes through the ION stand-in, as the dma-buf sysfs
+ * statistics would on a device. Disabling it restores the sysfs probe.
+ */
+void gralloc_host_track_lifetimes(bool enable);
+
+#endif /* GRALLOC_HOST_H_ */
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_HOST_TEST_H_
+#define GRALLOC_HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <gtest/gtest.h>
+#include <gtest/gtest-spi.h>
+
+#include "gralloc_host.h"
+
+/*
+ * Runs a test body, reporting its failures on stderr: death test children
+ * report nothing themselves.
+ *
+ * @return number of failures.
+ */
+template <typename Body>
+static int run_and_report(Body body)
+{
+	::testing::TestPartResultArray results;
+	{
+		::testing::ScopedFakeTestPartResultReporter reporter(
+		    ::testing::ScopedFakeTestPartResultReporter::INTERCEPT_ALL_THREADS, &results);
+		body();
+	}
+
+	int failures = 0;
+	for (int i = 0; i < results.size(); i++)
+	{
+		const ::testing::TestPartResult &result = results.GetTestPartResult(i);
+		if (result.failed())
+		{
+			fprintf(stderr, "%s:%d: %s\n", result.file_name() != nullptr ? result.file_name() : "?",
+			        result.line_number(), result.message());
+			failures++;
+		}
+	}
+
+	return failures;
+}
+
+/*
+ * Runs a test body in a child process, for tests which depend on state the
+ * cores set up once per process: properties, capabilities and ION heaps.
+ */
+template <typename Body>
+static void run_in_child(Body body)
+{
+	EXPECT_EXIT(exit(run_and_report(body) != 0 ? 1 : 0), ::testing::ExitedWithCode(0), "");
+}
+
+/* A client process, connected to the test through a socket. */
+struct client
+{
+	pid_t pid = -1;
+	int sock = -1;
+};
+
+/*
+ * Forks a client running body(sock), whose return value is its exit code.
+ */
+template <typename Body>
+static client start_client(Body body)
+{
+	int socks[2];
+	client c;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socks) != 0)
+	{
+		return c;
+	}
+
+	c.pid = fork();
+	if (c.pid == 0)
+	{
+		close(socks[0]);
+		_exit(body(socks[1]));
+	}
+
+	close(socks[1]);
+	c.sock = socks[0];
+	return c;
+}
+
+/*
+ * Waits for a client.
+ *
+ * @return its exit code, -1 when it did not exit.
+ */
+static inline int finish_client(client &c)
+{
+	int status = -1;
+	close(c.sock);
+	if (waitpid(c.pid, &status, 0) != c.pid || !WIFEXITED(status))
+	{
+		return -1;
+	}
+	return WEXITSTATUS(status);
+}
+
+static inline bool send_byte(int sock)
+{
+	const char byte = 0;
+	return write(sock, &byte, 1) == 1;
+}
+
+static inline bool recv_byte(int sock)
+{
+	char byte;
+	return read(sock, &byte, 1) == 1;
+}
+
+/*
+ * Client body importing the buffer sent by the test, and holding it until
+ * told to release it. A byte is sent back once the buffer is imported.
+ */
+static inline int hold_buffer(int sock)
+{
+	native_handle_t *raw = gralloc_host_recv_handle(sock);
+	native_handle_t *handle = raw != nullptr ? gralloc_host_import(raw) : nullptr;
+	if (handle == nullptr)
+	{
+		return 1;
+	}
+	native_handle_close(raw);
+	native_handle_delete(raw);
+
+	if (!send_byte(sock) || !recv_byte(sock))
+	{
+		return 2;
+	}
+
+	return gralloc_host_release(handle) == 0 ? 0 : 3;
+}
+
+#endif /* GRALLOC_HOST_TEST_H_ */
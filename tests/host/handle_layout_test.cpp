@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Layout of private_handle_t as seen by other processes, and its round trip
+ * from the allocator service to clients.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+
+namespace
+{
+
+/*
+ * private_handle_t as shipped to clients built against older releases, up to
+ * imapper_version: these offsets must never change.
+ */
+struct frozen_handle
+{
+	native_handle base;
+	int share_fd;
+	int share_attr_fd;
+	int magic;
+	int flags;
+	int width;
+	int height;
+	int req_format;
+	uint64_t producer_usage;
+	uint64_t consumer_usage;
+	uint64_t internal_format;
+	int stride;
+	int byte_stride;
+	int internalWidth;
+	int internalHeight;
+	uint64_t alloc_format;
+	plane_info_t plane_info[MAX_PLANES];
+	int size;
+	uint32_t layer_count;
+	uint64_t base_ptr;
+	uint64_t backing_store_id;
+	int backing_store_size;
+	int cpu_read;
+	int cpu_write;
+	int allocating_pid;
+	int remote_pid;
+	int ref_count;
+	uint64_t attr_base;
+	mali_gralloc_yuv_info yuv_info;
+	int fd;
+	uint64_t offset;
+	uint64_t attr_size;
+	uint64_t reserved_region_size;
+	uint64_t imapper_version;
+};
+
+/* Fields of a handle which are the same in every process. */
+struct shared_fields
+{
+	int width;
+	int height;
+	int req_format;
+	uint64_t producer_usage;
+	uint64_t consumer_usage;
+	uint64_t alloc_format;
+	plane_info_t plane_info[MAX_PLANES];
+	int size;
+	uint64_t backing_store_id;
+	int allocating_pid;
+	int yuv_info;
+	uint64_t attr_size;
+};
+
+shared_fields shared_fields_of(const private_handle_t *hnd)
+{
+	shared_fields fields;
+
+	memset(&fields, 0, sizeof(fields));
+	fields.width = hnd->width;
+	fields.height = hnd->height;
+	fields.req_format = hnd->req_format;
+	fields.producer_usage = hnd->producer_usage;
+	fields.consumer_usage = hnd->consumer_usage;
+	fields.alloc_format = hnd->alloc_format;
+	memcpy(fields.plane_info, hnd->plane_info, sizeof(fields.plane_info));
+	fields.size = hnd->size;
+	fields.backing_store_id = hnd->backing_store_id;
+	fields.allocating_pid = hnd->allocating_pid;
+	fields.yuv_info = hnd->yuv_info;
+	fields.attr_size = hnd->attr_size;
+
+	return fields;
+}
+
+enum import_step
+{
+	IMPORT_OK,
+	IMPORT_RECV,
+	IMPORT_LAYOUT,
+	IMPORT_IMPORT,
+	IMPORT_FIELDS,
+	IMPORT_RELEASE,
+};
+
+/*
+ * Sends a buffer to a client, which imports it and checks it against the
+ * allocator's copy.
+ */
+void round_trip(uint64_t format, uint64_t usage)
+{
+	native_handle_t *handle = nullptr;
+	ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(100, 60, format, usage), &handle));
+
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+	const shared_fields expected = shared_fields_of(hnd);
+
+	client c = start_client(
+	    [&expected](int sock)
+	    {
+		    native_handle_t *raw = gralloc_host_recv_handle(sock);
+		    if (raw == nullptr)
+		    {
+			    return (int)IMPORT_RECV;
+		    }
+		    if (private_handle_t::validate(raw) != 0)
+		    {
+			    return (int)IMPORT_LAYOUT;
+		    }
+
+		    native_handle_t *imported = gralloc_host_import(raw);
+		    native_handle_close(raw);
+		    native_handle_delete(raw);
+		    if (imported == nullptr || private_handle_t::validate(imported) != 0)
+		    {
+			    return (int)IMPORT_IMPORT;
+		    }
+
+		    const auto *imported_hnd = static_cast<const private_handle_t *>(imported);
+		    const shared_fields fields = shared_fields_of(imported_hnd);
+		    if (memcmp(&fields, &expected, sizeof(fields)) != 0)
+		    {
+			    return (int)IMPORT_FIELDS;
+		    }
+		    return gralloc_host_release(imported) == 0 ? (int)IMPORT_OK : (int)IMPORT_RELEASE;
+	    });
+	ASSERT_GE(c.pid, 0);
+
+	EXPECT_EQ(0, gralloc_host_send_handle(c.sock, handle));
+	gralloc_host_free_allocated(handle);
+	EXPECT_EQ(IMPORT_OK, finish_client(c));
+}
+
+} /* anonymous namespace */
+
+/* private_handle_t derives from native_handle: offsetof is supported by the compilers in use. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+
+#define EXPECT_FROZEN_OFFSET(handle_field, frozen_field) \
+	EXPECT_EQ(offsetof(frozen_handle, frozen_field), offsetof(private_handle_t, handle_field)) << #handle_field
+
+TEST(GrallocHostHandleLayout, FrozenOffsets)
+{
+	EXPECT_FROZEN_OFFSET(share_fd, share_fd);
+	EXPECT_FROZEN_OFFSET(share_attr_fd, share_attr_fd);
+	EXPECT_FROZEN_OFFSET(magic, magic);
+	EXPECT_FROZEN_OFFSET(flags, flags);
+	EXPECT_FROZEN_OFFSET(width, width);
+	EXPECT_FROZEN_OFFSET(height, height);
+	EXPECT_FROZEN_OFFSET(req_format, req_format);
+	EXPECT_FROZEN_OFFSET(producer_usage, producer_usage);
+	EXPECT_FROZEN_OFFSET(consumer_usage, consumer_usage);
+	EXPECT_FROZEN_OFFSET(internal_format, internal_format);
+	EXPECT_FROZEN_OFFSET(stride, stride);
+	EXPECT_FROZEN_OFFSET(byte_stride, byte_stride);
+	EXPECT_FROZEN_OFFSET(internalWidth, internalWidth);
+	EXPECT_FROZEN_OFFSET(internalHeight, internalHeight);
+	EXPECT_FROZEN_OFFSET(alloc_format, alloc_format);
+	EXPECT_FROZEN_OFFSET(plane_info, plane_info);
+	EXPECT_FROZEN_OFFSET(size, size);
+	EXPECT_FROZEN_OFFSET(layer_count, layer_count);
+	EXPECT_FROZEN_OFFSET(base, base_ptr);
+	EXPECT_FROZEN_OFFSET(backing_store_id, backing_store_id);
+	EXPECT_FROZEN_OFFSET(backing_store_size, backing_store_size);
+	EXPECT_FROZEN_OFFSET(cpu_read, cpu_read);
+	EXPECT_FROZEN_OFFSET(cpu_write, cpu_write);
+	EXPECT_FROZEN_OFFSET(allocating_pid, allocating_pid);
+	EXPECT_FROZEN_OFFSET(remote_pid, remote_pid);
+	EXPECT_FROZEN_OFFSET(ref_count, ref_count);
+	EXPECT_FROZEN_OFFSET(attr_base, attr_base);
+	EXPECT_FROZEN_OFFSET(yuv_info, yuv_info);
+	EXPECT_FROZEN_OFFSET(fd, fd);
+	EXPECT_FROZEN_OFFSET(offset, offset);
+	EXPECT_FROZEN_OFFSET(attr_size, attr_size);
+	EXPECT_FROZEN_OFFSET(reserved_region_size, reserved_region_size);
+	EXPECT_FROZEN_OFFSET(imapper_version, imapper_version);
+}
+
+TEST(GrallocHostHandleLayout, FrozenSize)
+{
+	/* Consumers validate numInts against the size they were built with. */
+	EXPECT_EQ(sizeof(frozen_handle), sizeof(private_handle_t));
+	EXPECT_EQ((sizeof(frozen_handle) - sizeof(native_handle)) / sizeof(int) - GRALLOC_ARM_NUM_FDS,
+	          NUM_INTS_IN_PRIVATE_HANDLE);
+}
+
+#pragma GCC diagnostic pop
+
+TEST(GrallocHostHandleLayout, RoundTrip)
+{
+	const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+
+	round_trip(HAL_PIXEL_FORMAT_RGBA_8888, usage);
+	round_trip(HAL_PIXEL_FORMAT_YCrCb_NV12, usage);
+	round_trip(HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER);
+}
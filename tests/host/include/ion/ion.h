@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_HOST_ION_H_
+#define GRALLOC_HOST_ION_H_
+
+/*
+ * Host stand-in for the libion API used by the allocator, implemented by
+ * tests/host/ion_host.cpp on top of memfd. Buffers are shareable and mappable
+ * like dma-bufs, but have no physical placement: heaps only differ by their
+ * type, name, injected latency and injected failures (see ion_host.h).
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Heap types of the legacy ION UAPI. */
+enum ion_heap_type
+{
+	ION_HEAP_TYPE_SYSTEM,
+	ION_HEAP_TYPE_SYSTEM_CONTIG,
+	ION_HEAP_TYPE_CARVEOUT,
+	ION_HEAP_TYPE_CHUNK,
+	ION_HEAP_TYPE_DMA,
+	ION_HEAP_TYPE_CUSTOM,
+	ION_NUM_HEAPS = 16,
+};
+
+#define ION_FLAG_CACHED 1
+#define ION_FLAG_CACHED_NEEDS_SYNC 2
+
+int ion_open(void);
+int ion_close(int fd);
+int ion_alloc_fd(int fd, size_t len, size_t align, unsigned int heap_mask, unsigned int flags, int *handle_fd);
+int ion_sync_fd(int fd, int handle_fd);
+
+/* Interface of 4.12+ kernels. */
+int ion_query_heap_cnt(int fd, int *cnt);
+int ion_query_get_heaps(int fd, int cnt, void *buffers);
+int ion_is_legacy(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRALLOC_HOST_ION_H_ */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_HOST_ION_4_12_H_
+#define GRALLOC_HOST_ION_4_12_H_
+
+/*
+ * Host stand-in for the heap query structures of 4.12+ kernels.
+ */
+
+#include <stdint.h>
+
+#define MAX_HEAP_NAME 32
+
+struct ion_heap_data
+{
+	char name[MAX_HEAP_NAME];
+	uint32_t type;
+	uint32_t heap_id;
+	uint32_t reserved0;
+	uint32_t reserved1;
+	uint32_t reserved2;
+};
+
+#define ION_NUM_HEAP_IDS (sizeof(unsigned int) * 8)
+
+#endif /* GRALLOC_HOST_ION_4_12_H_ */
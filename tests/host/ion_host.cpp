@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ion_host.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ion/ion_4.12.h>
+
+namespace
+{
+
+struct heap_state
+{
+	std::string name;
+	enum ion_heap_type type;
+	unsigned int heap_id;
+};
+
+struct fault_state
+{
+	uint32_t delay_us;
+	int fail_count;
+	ion_host_stats stats;
+};
+
+std::mutex ion_lock;
+std::vector<heap_state> heaps;
+fault_state faults[ION_NUM_HEAPS];
+
+const ion_host_heap default_heaps[] = {
+	{ "ion_system_heap", ION_HEAP_TYPE_SYSTEM, 0 },
+	{ "ion_cma_heap", ION_HEAP_TYPE_DMA, 1 },
+};
+
+void set_heaps_locked(const ion_host_heap *new_heaps, size_t count)
+{
+	if (new_heaps == nullptr)
+	{
+		new_heaps = default_heaps;
+		count = sizeof(default_heaps) / sizeof(default_heaps[0]);
+	}
+
+	heaps.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		heaps.push_back({ new_heaps[i].name, new_heaps[i].type, new_heaps[i].heap_id });
+	}
+}
+
+std::vector<heap_state> &get_heaps_locked()
+{
+	if (heaps.empty())
+	{
+		set_heaps_locked(nullptr, 0);
+	}
+	return heaps;
+}
+
+fault_state *faults_of(const enum ion_heap_type type)
+{
+	return (unsigned int)type < ION_NUM_HEAPS ? &faults[type] : nullptr;
+}
+
+/*
+ * Whether a /proc/<pid>/maps line maps the given inode.
+ */
+bool maps_line_has_inode(const char *line, const uint64_t inode)
+{
+	char perms[8], dev[16];
+	unsigned long long start, end, offset, line_inode;
+
+	return sscanf(line, "%llx-%llx %7s %llx %15s %llu", &start, &end, perms, &offset, dev, &line_inode) == 6 &&
+	       line_inode == inode;
+}
+
+bool process_has_inode(const char *pid, const uint64_t inode)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%s/fd", pid);
+
+	DIR *fds = opendir(path);
+	if (fds != nullptr)
+	{
+		bool found = false;
+		struct dirent *entry;
+		while (!found && (entry = readdir(fds)) != nullptr)
+		{
+			char target[256];
+			struct stat st;
+			const ssize_t len = readlinkat(dirfd(fds), entry->d_name, target, sizeof(target) - 1);
+			if (len > 0)
+			{
+				target[len] = '\0';
+				found = strncmp(target, "/memfd:ion:", strlen("/memfd:ion:")) == 0 &&
+				        fstatat(dirfd(fds), entry->d_name, &st, 0) == 0 && (uint64_t)st.st_ino == inode;
+			}
+		}
+		closedir(fds);
+		if (found)
+		{
+			return true;
+		}
+	}
+
+	snprintf(path, sizeof(path), "/proc/%s/maps", pid);
+	FILE *maps = fopen(path, "re");
+	if (maps == nullptr)
+	{
+		return false;
+	}
+
+	bool found = false;
+	char line[512];
+	while (!found && fgets(line, sizeof(line), maps) != nullptr)
+	{
+		found = strstr(line, "/memfd:ion:") != nullptr && maps_line_has_inode(line, inode);
+	}
+	fclose(maps);
+
+	return found;
+}
+
+} /* anonymous namespace */
+
+extern "C" int ion_open(void)
+{
+	return open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+extern "C" int ion_close(int fd)
+{
+	return close(fd) == 0 ? 0 : -errno;
+}
+
+extern "C" int ion_is_legacy(int)
+{
+	return 0;
+}
+
+extern "C" int ion_query_heap_cnt(int, int *cnt)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	*cnt = (int)get_heaps_locked().size();
+	return 0;
+}
+
+extern "C" int ion_query_get_heaps(int, int cnt, void *buffers)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	const std::vector<heap_state> &all = get_heaps_locked();
+	ion_heap_data *data = static_cast<ion_heap_data *>(buffers);
+
+	if (cnt < 0 || (size_t)cnt < all.size())
+	{
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < all.size(); i++)
+	{
+		memset(&data[i], 0, sizeof(data[i]));
+		strncpy(data[i].name, all[i].name.c_str(), sizeof(data[i].name) - 1);
+		data[i].type = all[i].type;
+		data[i].heap_id = all[i].heap_id;
+	}
+
+	return 0;
+}
+
+extern "C" int ion_alloc_fd(int, size_t len, size_t, unsigned int heap_mask, unsigned int, int *handle_fd)
+{
+	std::string name;
+	uint32_t delay_us = 0;
+	fault_state *fault = nullptr;
+	bool fail = false;
+
+	{
+		std::lock_guard<std::mutex> lock(ion_lock);
+		for (const heap_state &heap : get_heaps_locked())
+		{
+			if (heap.heap_id < ION_NUM_HEAP_IDS && (heap_mask & (1u << heap.heap_id)))
+			{
+				name = "ion:" + heap.name;
+				fault = faults_of(heap.type);
+				break;
+			}
+		}
+
+		if (name.empty())
+		{
+			return -ENODEV;
+		}
+
+		if (fault != nullptr)
+		{
+			delay_us = fault->delay_us;
+			if (fault->fail_count != 0)
+			{
+				fail = true;
+				if (fault->fail_count > 0)
+				{
+					fault->fail_count--;
+				}
+			}
+		}
+	}
+
+	if (delay_us != 0)
+	{
+		usleep(delay_us);
+	}
+
+	int fd = -1;
+	if (!fail)
+	{
+		fd = memfd_create(name.c_str(), MFD_CLOEXEC);
+		if (fd >= 0 && ftruncate(fd, (off_t)len) != 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(ion_lock);
+	if (fd < 0)
+	{
+		if (fault != nullptr)
+		{
+			fault->stats.failures++;
+		}
+		return -ENOMEM;
+	}
+
+	if (fault != nullptr)
+	{
+		fault->stats.allocs++;
+		fault->stats.bytes += len;
+	}
+	*handle_fd = fd;
+	return 0;
+}
+
+extern "C" int ion_sync_fd(int, int)
+{
+	return 0;
+}
+
+void ion_host_set_heaps(const ion_host_heap *new_heaps, size_t count)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	set_heaps_locked(new_heaps, count);
+}
+
+void ion_host_set_delay(enum ion_heap_type type, uint32_t delay_us)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	fault_state *fault = faults_of(type);
+	if (fault != nullptr)
+	{
+		fault->delay_us = delay_us;
+	}
+}
+
+void ion_host_fail(enum ion_heap_type type, int count)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	fault_state *fault = faults_of(type);
+	if (fault != nullptr)
+	{
+		fault->fail_count = count;
+	}
+}
+
+ion_host_stats ion_host_get_stats(enum ion_heap_type type)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	fault_state *fault = faults_of(type);
+	return fault != nullptr ? fault->stats : ion_host_stats{};
+}
+
+void ion_host_reset(void)
+{
+	std::lock_guard<std::mutex> lock(ion_lock);
+	set_heaps_locked(nullptr, 0);
+	memset(faults, 0, sizeof(faults));
+}
+
+bool ion_host_buffer_alive(uint64_t inode)
+{
+	DIR *proc = opendir("/proc");
+	if (proc == nullptr)
+	{
+		return false;
+	}
+
+	bool alive = false;
+	struct dirent *entry;
+	while (!alive && (entry = readdir(proc)) != nullptr)
+	{
+		if (entry->d_name[0] >= '1' && entry->d_name[0] <= '9')
+		{
+			alive = process_has_inode(entry->d_name, inode);
+		}
+	}
+	closedir(proc);
+
+	return alive;
+}
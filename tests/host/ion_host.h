@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_ION_HOST_H_
+#define GRALLOC_ION_HOST_H_
+
+/*
+ * Controls of the memfd ION stand-in (include/ion/ion.h).
+ *
+ * Each heap is described by a name, a type and an id, as reported by the
+ * ION heap query. Allocations are memfds named "ion:<heap name>", so that
+ * the buffers of each heap can be told apart and their lifetime probed like
+ * dma-bufs. Latency and failures can be injected per heap type.
+ *
+ * The allocator queries the heaps once: changes to the heap list only take
+ * effect after mali_gralloc_ion_close().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ion/ion.h>
+
+struct ion_host_heap
+{
+	const char *name;
+	enum ion_heap_type type;
+	unsigned int heap_id;
+};
+
+struct ion_host_stats
+{
+	uint64_t allocs;     /* Successful allocations. */
+	uint64_t failures;   /* Allocations failed, injected or not. */
+	uint64_t bytes;      /* Bytes allocated successfully. */
+};
+
+/*
+ * Replaces the heaps reported to the allocator, nullptr to restore the
+ * default system ("ion_system_heap") and DMA ("ion_cma_heap") heaps.
+ */
+void ion_host_set_heaps(const ion_host_heap *heaps, size_t count);
+
+/*
+ * Delays every allocation from heaps of the given type.
+ */
+void ion_host_set_delay(enum ion_heap_type type, uint32_t delay_us);
+
+/*
+ * Fails the next 'count' allocations from heaps of the given type with
+ * -ENOMEM, -1 to fail all of them, 0 to stop failing.
+ */
+void ion_host_fail(enum ion_heap_type type, int count);
+
+/*
+ * Returns the counters of the heaps of the given type.
+ */
+ion_host_stats ion_host_get_stats(enum ion_heap_type type);
+
+/*
+ * Restores the default heaps and clears injected faults and counters.
+ */
+void ion_host_reset(void);
+
+/*
+ * @return true when the buffer of the given inode is still open or mapped in any process of this user.
+ */
+bool ion_host_buffer_alive(uint64_t inode);
+
+#endif /* GRALLOC_ION_HOST_H_ */
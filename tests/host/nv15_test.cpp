@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Layout of the packed 10-bit NV15 buffers of the rk video decoder.
+ */
+
+#include <string.h>
+
+#include <string>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+#include "mali_gralloc_formats.h"
+#include "core/mali_gralloc_bufferaccess.h"
+#include "drmutils.h"
+
+namespace
+{
+
+enum nv15_step
+{
+	NV15_OK,
+	NV15_IMPORT,
+	NV15_LOCK,
+	NV15_YCBCR,
+	NV15_CONTENT,
+	NV15_RELEASE,
+};
+
+/* Four 10-bit samples in five bytes: rows in bytes of a width in pixels. */
+uint32_t packed_row_bytes(uint32_t width)
+{
+	return (width * 10 + 7) / 8;
+}
+
+/*
+ * Checks the planes of an allocated NV15 buffer: a full resolution luma plane
+ * and a half height chroma plane sharing its stride, both rows ending on a
+ * byte boundary.
+ */
+void check_layout(const private_handle_t *hnd, uint32_t width, uint32_t height)
+{
+	EXPECT_EQ((uint64_t)MALI_GRALLOC_FORMAT_INTERNAL_NV15, hnd->alloc_format);
+	EXPECT_TRUE(hnd->is_multi_plane());
+
+	const plane_info_t &luma = hnd->plane_info[0];
+	const plane_info_t &chroma = hnd->plane_info[1];
+
+	EXPECT_EQ(0u, luma.offset);
+	EXPECT_GE(luma.alloc_width, width);
+	EXPECT_GE(luma.alloc_height, height);
+	EXPECT_EQ(0u, luma.alloc_width % 4);
+	EXPECT_GE(luma.byte_stride, packed_row_bytes(luma.alloc_width));
+
+	EXPECT_EQ(luma.byte_stride, chroma.byte_stride);
+	EXPECT_EQ(luma.alloc_width / 2, chroma.alloc_width);
+	EXPECT_EQ(luma.alloc_height / 2, chroma.alloc_height);
+	EXPECT_EQ(luma.byte_stride * luma.alloc_height, chroma.offset);
+	EXPECT_GE((uint32_t)hnd->size, chroma.offset + chroma.byte_stride * chroma.alloc_height);
+	EXPECT_EQ(hnd->plane_info[2].byte_stride, 0u);
+
+	EXPECT_EQ(DRM_FORMAT_NV15, drm_fourcc_from_handle(hnd));
+	EXPECT_EQ(0u, drm_modifier_from_handle(hnd));
+}
+
+/*
+ * Imports the buffer, writes the last byte of each plane through lock(), and
+ * checks that lock_ycbcr() refuses it.
+ */
+int client_lock(int sock)
+{
+	native_handle_t *raw = gralloc_host_recv_handle(sock);
+	native_handle_t *handle = raw != nullptr ? gralloc_host_import(raw) : nullptr;
+	if (handle == nullptr)
+	{
+		return NV15_IMPORT;
+	}
+	native_handle_close(raw);
+	native_handle_delete(raw);
+
+	auto *hnd = static_cast<private_handle_t *>(handle);
+	void *vaddr = nullptr;
+	if (mali_gralloc_lock(handle, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, hnd->width, hnd->height, &vaddr) != 0 ||
+	    vaddr == nullptr)
+	{
+		return NV15_LOCK;
+	}
+
+	uint8_t *base = static_cast<uint8_t *>(vaddr);
+	const plane_info_t &luma = hnd->plane_info[0];
+	const plane_info_t &chroma = hnd->plane_info[1];
+	base[luma.byte_stride * luma.alloc_height - 1] = 0x5a;
+	base[chroma.offset + chroma.byte_stride * chroma.alloc_height - 1] = 0xa5;
+	if (mali_gralloc_unlock(handle) != 0)
+	{
+		return NV15_LOCK;
+	}
+
+	/* Packed samples are not byte addressable. */
+	android_ycbcr ycbcr;
+	memset(&ycbcr, 0, sizeof(ycbcr));
+	if (mali_gralloc_lock_ycbcr(handle, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, hnd->width, hnd->height, &ycbcr) == 0)
+	{
+		mali_gralloc_unlock(handle);
+		return NV15_YCBCR;
+	}
+
+	if (mali_gralloc_lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, hnd->width, hnd->height, &vaddr) != 0)
+	{
+		return NV15_LOCK;
+	}
+	base = static_cast<uint8_t *>(vaddr);
+	const bool content = base[luma.byte_stride * luma.alloc_height - 1] == 0x5a &&
+	                     base[chroma.offset + chroma.byte_stride * chroma.alloc_height - 1] == 0xa5;
+	mali_gralloc_unlock(handle);
+	if (!content)
+	{
+		return NV15_CONTENT;
+	}
+
+	return gralloc_host_release(handle) == 0 ? NV15_OK : NV15_RELEASE;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostNV15, Layout)
+{
+	const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+	const struct
+	{
+		uint32_t width;
+		uint32_t height;
+	} sizes[] = { { 1920, 1080 }, { 3840, 2160 }, { 1922, 1082 }, { 100, 50 }, { 2, 2 } };
+
+	for (const auto &size : sizes)
+	{
+		SCOPED_TRACE(std::to_string(size.width) + "x" + std::to_string(size.height));
+
+		native_handle_t *handle = nullptr;
+		ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(size.width, size.height,
+		                                                          HAL_PIXEL_FORMAT_YCrCb_NV12_10, usage),
+		                                   &handle));
+		check_layout(static_cast<const private_handle_t *>(handle), size.width, size.height);
+		gralloc_host_free_allocated(handle);
+	}
+}
+
+TEST(GrallocHostNV15, StrideSpecifiedByDecoder)
+{
+	/* The decoder gives the pixel stride as the width: rows are exactly packed. */
+	const uint64_t usage = GRALLOC_USAGE_VIDEO_DECODER | GRALLOC_USAGE_HW_TEXTURE | RK_GRALLOC_USAGE_SPECIFY_STRIDE |
+	                       RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND;
+	native_handle_t *handle = nullptr;
+
+	ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(1920, 1088, HAL_PIXEL_FORMAT_YCrCb_NV12_10, usage),
+	                                   &handle));
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+	check_layout(hnd, 1920, 1088);
+	EXPECT_EQ(packed_row_bytes(1920), hnd->plane_info[0].byte_stride);
+	EXPECT_EQ(packed_row_bytes(1920) * 1088 * 3 / 2, (uint32_t)hnd->size);
+	gralloc_host_free_allocated(handle);
+}
+
+TEST(GrallocHostNV15, LockedThroughPlanesOnly)
+{
+	const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+	native_handle_t *handle = nullptr;
+
+	ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(1280, 720, HAL_PIXEL_FORMAT_YCrCb_NV12_10, usage),
+	                                   &handle));
+
+	client c = start_client(client_lock);
+	ASSERT_GE(c.pid, 0);
+	ASSERT_EQ(0, gralloc_host_send_handle(c.sock, handle));
+	gralloc_host_free_allocated(handle);
+	EXPECT_EQ(NV15_OK, finish_client(c));
+}
+
+TEST(GrallocHostNV15, P010Unchanged)
+{
+	/* Only NV12_10 is packed: P010 keeps 16-bit samples. */
+	const uint64_t usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+	native_handle_t *handle = nullptr;
+
+	ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(1920, 1080, HAL_PIXEL_FORMAT_YCBCR_P010, usage),
+	                                   &handle));
+	const auto *hnd = static_cast<const private_handle_t *>(handle);
+	EXPECT_EQ((uint64_t)MALI_GRALLOC_FORMAT_INTERNAL_P010, hnd->alloc_format & MALI_GRALLOC_INTFMT_FMT_MASK);
+	EXPECT_GE(hnd->plane_info[0].byte_stride, 1920u * 2);
+	EXPECT_EQ(DRM_FORMAT_P010, drm_fourcc_from_handle(hnd));
+	gralloc_host_free_allocated(handle);
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Components reported in PLANE_LAYOUTS for every format, checked against the
+ * table IMapper used to look up by DRM fourcc.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gralloc_host_test.h"
+#include "mali_gralloc_formats.h"
+#include "core/format_info.h"
+#include "drmutils.h"
+
+namespace
+{
+
+#define R(off, size) { CMP_R, off, size }
+#define G(off, size) { CMP_G, off, size }
+#define B(off, size) { CMP_B, off, size }
+#define A(off, size) { CMP_A, off, size }
+#define Y(off, size) { CMP_Y, off, size }
+#define CB(off, size) { CMP_CB, off, size }
+#define CR(off, size) { CMP_CR, off, size }
+
+struct reference_layout
+{
+	uint32_t drm_fourcc;
+	format_component_t cmp[MAX_PLANES][MAX_PLANE_COMPONENTS];
+};
+
+/*
+ * Components by DRM fourcc, as reported before the constexpr tables. Fourccs
+ * missing here reported no components.
+ */
+/* clang-format off */
+const reference_layout reference_layouts[] = {
+	{ DRM_FORMAT_RGB565,        { { B(0, 5), G(5, 6), R(11, 5) } } },
+	{ DRM_FORMAT_BGR565,        { { R(0, 5), G(5, 6), B(11, 5) } } },
+	{ DRM_FORMAT_BGR888,        { { R(0, 8), G(8, 8), B(16, 8) } } },
+	{ DRM_FORMAT_ARGB8888,      { { B(0, 8), G(8, 8), R(16, 8), A(24, 8) } } },
+	{ DRM_FORMAT_ABGR8888,      { { R(0, 8), G(8, 8), B(16, 8), A(24, 8) } } },
+	{ DRM_FORMAT_XBGR8888,      { { R(0, 8), G(8, 8), B(16, 8) } } },
+	{ DRM_FORMAT_ABGR2101010,   { { R(0, 10), G(10, 10), B(20, 10), A(30, 2) } } },
+	{ DRM_FORMAT_ABGR16161616F, { { R(0, 16), G(16, 16), B(32, 16), A(48, 16) } } },
+	{ DRM_FORMAT_YUYV,          { { Y(0, 8), CB(8, 8), Y(16, 8), CR(24, 8) } } },
+	{ DRM_FORMAT_Y410,          { { CB(0, 10), Y(10, 10), CR(20, 10), A(30, 2) } } },
+	{ DRM_FORMAT_Y210,          { { Y(6, 10), CB(22, 10), Y(38, 10), CR(54, 10) } } },
+	{ DRM_FORMAT_Y0L2,          { { Y(0, 10), CB(10, 10), Y(20, 10), A(30, 1), A(31, 1),
+	                                Y(32, 10), CR(42, 10), Y(52, 10), A(62, 1), A(63, 1) } } },
+	{ DRM_FORMAT_NV16,          { { Y(0, 8) }, { CB(0, 8), CR(8, 8) } } },
+	{ DRM_FORMAT_NV12,          { { Y(0, 8) }, { CB(0, 8), CR(8, 8) } } },
+	{ DRM_FORMAT_NV21,          { { Y(0, 8) }, { CR(0, 8), CB(8, 8) } } },
+	{ DRM_FORMAT_P210,          { { Y(6, 10) }, { CB(6, 10), CB(22, 10) } } },
+	{ DRM_FORMAT_P010,          { { Y(6, 10) }, { CB(6, 10), CB(22, 10) } } },
+	{ DRM_FORMAT_YVU420,        { { Y(0, 8) }, { CR(0, 8) }, { CB(0, 8) } } },
+	{ DRM_FORMAT_YUV444,        { { Y(0, 8) }, { CB(0, 8) }, { CR(0, 8) } } },
+	/* Added with the native NV15 format. */
+	{ DRM_FORMAT_NV15,          { { Y(0, 10) }, { CB(0, 10), CR(10, 10) } } },
+};
+/* clang-format on */
+
+#undef R
+#undef G
+#undef B
+#undef A
+#undef Y
+#undef CB
+#undef CR
+
+const format_component_t raw_components[MAX_PLANES][MAX_PLANE_COMPONENTS] = { { { CMP_RAW, 0, -1 } } };
+const format_component_t no_components[MAX_PLANES][MAX_PLANE_COMPONENTS] = {};
+
+/*
+ * @return components the fourcc table reported for an allocated format.
+ */
+const format_component_t (*reference_components(const uint64_t alloc_format))[MAX_PLANE_COMPONENTS]
+{
+	/* Formats without a DRM fourcc. */
+	if (alloc_format == MALI_GRALLOC_FORMAT_INTERNAL_RAW10 || alloc_format == MALI_GRALLOC_FORMAT_INTERNAL_RAW12)
+	{
+		return raw_components;
+	}
+
+	const uint32_t drm_fourcc = drm_fourcc_from_format(alloc_format);
+	for (const reference_layout &layout : reference_layouts)
+	{
+		if (drm_fourcc != DRM_FORMAT_INVALID && layout.drm_fourcc == drm_fourcc)
+		{
+			return layout.cmp;
+		}
+	}
+
+	return no_components;
+}
+
+std::string describe(const format_component_t (*cmp)[MAX_PLANE_COMPONENTS])
+{
+	std::string out;
+
+	for (int pln = 0; pln < MAX_PLANES; pln++)
+	{
+		out += "{";
+		for (int i = 0; i < MAX_PLANE_COMPONENTS && cmp[pln][i].type != CMP_NONE; i++)
+		{
+			char component[32];
+			snprintf(component, sizeof(component), " %d:%d:%d", cmp[pln][i].type, cmp[pln][i].offset, cmp[pln][i].size);
+			out += component;
+		}
+		out += " }";
+	}
+
+	return out;
+}
+
+/* Allocated formats of a base format: linear and AFBC when supported. */
+std::vector<uint64_t> alloc_formats_of(const format_info_t &format)
+{
+	std::vector<uint64_t> alloc_formats;
+
+	if (format.linear)
+	{
+		alloc_formats.push_back(format.id);
+	}
+	if (format.afbc)
+	{
+		alloc_formats.push_back(format.id | MALI_GRALLOC_INTFMT_AFBC_BASIC);
+		alloc_formats.push_back(format.id | MALI_GRALLOC_INTFMT_AFBC_BASIC | MALI_GRALLOC_INTFMT_AFBC_SPLITBLK);
+		alloc_formats.push_back(format.id | MALI_GRALLOC_INTFMT_AFBC_BASIC | MALI_GRALLOC_INTFMT_AFBC_WIDEBLK);
+	}
+
+	return alloc_formats;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostPlaneLayout, EveryFormatMatchesFourccTable)
+{
+	size_t checked = 0;
+
+	for (size_t i = 0; i < num_formats; i++)
+	{
+		const int32_t format_idx = get_format_index(formats[i].id);
+		ASSERT_EQ((int32_t)i, format_idx);
+
+		for (const uint64_t alloc_format : alloc_formats_of(formats[i]))
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "alloc_format 0x%" PRIx64, alloc_format);
+			SCOPED_TRACE(name);
+
+			const format_components_t *components = get_format_components(alloc_format, format_idx);
+			ASSERT_NE(nullptr, components);
+			EXPECT_EQ(describe(reference_components(alloc_format)), describe(components->cmp));
+			checked++;
+		}
+	}
+
+	EXPECT_GT(checked, num_formats);
+}
+
+TEST(GrallocHostPlaneLayout, ComponentsOnlyInExistingPlanes)
+{
+	for (size_t i = 0; i < num_formats; i++)
+	{
+		for (int pln = formats[i].npln; pln < MAX_PLANES; pln++)
+		{
+			EXPECT_EQ(CMP_NONE, format_components[i].cmp[pln][0].type)
+			    << "format 0x" << std::hex << formats[i].id << " plane " << pln;
+		}
+	}
+}
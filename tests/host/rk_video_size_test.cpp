@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sizes of the buffers of the rk video decoder: the picture, plus the side-band
+ * area for the decoder output and camera buffers, for every format, usage hint
+ * and vendor.gralloc.rk_video_sideband policy.
+ */
+
+#include <string>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "mali_gralloc_buffer.h"
+
+namespace
+{
+
+/* Width is the pixel stride asked for by the decoder. */
+const uint32_t width = 1920;
+const uint32_t height = 1088;
+
+struct video_format
+{
+	uint64_t hal_format;
+	const char *name;
+	uint32_t plane0_bits;   /* Bits per pixel of the first plane. */
+	uint32_t picture;       /* Eighths of a byte per pixel. */
+	uint32_t sideband;      /* 0 for formats without side-band area. */
+};
+
+const video_format video_formats[] = {
+	{ HAL_PIXEL_FORMAT_YCrCb_NV12, "NV12", 8, 12, 4 },
+	{ HAL_PIXEL_FORMAT_YCbCr_422_SP, "NV16", 8, 16, 4 },
+	{ HAL_PIXEL_FORMAT_YCrCb_NV12_10, "NV15", 10, 15, 4 },
+	{ HAL_PIXEL_FORMAT_RGBA_8888, "RGBA_8888", 32, 32, 0 },
+};
+
+struct usage_hint
+{
+	uint64_t usage;
+	const char *name;
+	bool video;             /* Side-band area kept by default: decoder output and camera buffers. */
+};
+
+const usage_hint usage_hints[] = {
+	{ GRALLOC_USAGE_VIDEO_DECODER | GRALLOC_USAGE_HW_TEXTURE, "VIDEO_DECODER", true },
+	{ GRALLOC_USAGE_DECODER, "legacy DECODER", true },
+	{ GRALLOC_USAGE_VIDEO_DECODER | GRALLOC_USAGE_HW_TEXTURE | RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND,
+	  "VIDEO_DECODER | NO_VIDEO_SIDEBAND", false },
+	{ GRALLOC_USAGE_DECODER | RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND, "legacy DECODER | NO_VIDEO_SIDEBAND", false },
+	{ GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_TEXTURE, "camera", true },
+	{ GRALLOC_USAGE_HW_CAMERA_READ | GRALLOC_USAGE_SW_WRITE_OFTEN, "camera input", true },
+	{ GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_TEXTURE | RK_GRALLOC_USAGE_NO_VIDEO_SIDEBAND,
+	  "camera | NO_VIDEO_SIDEBAND", false },
+	{ GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN, "CPU", false },
+};
+
+enum sideband_policy
+{
+	SIDEBAND_NONE = 0,
+	SIDEBAND_VIDEO = 1,
+	SIDEBAND_ALL = 2,
+};
+
+bool expects_sideband(const sideband_policy policy, const usage_hint &hint)
+{
+	switch (policy)
+	{
+	case SIDEBAND_ALL:
+		return true;
+	case SIDEBAND_VIDEO:
+		return hint.video;
+	default:
+		return false;
+	}
+}
+
+size_t size_without_specified_stride(const video_format &format, const usage_hint &hint)
+{
+	native_handle_t *handle = nullptr;
+	if (gralloc_host_allocate(gralloc_host_descriptor(width, height, format.hal_format, hint.usage), &handle) != 0)
+	{
+		return 0;
+	}
+
+	const size_t size = static_cast<const private_handle_t *>(handle)->size;
+	gralloc_host_free_allocated(handle);
+	return size;
+}
+
+/*
+ * Allocates every format with every hint, and checks the sizes against the
+ * layouts of the decoder.
+ */
+void check_sizes(const sideband_policy policy)
+{
+	for (const video_format &format : video_formats)
+	{
+		for (const usage_hint &hint : usage_hints)
+		{
+			SCOPED_TRACE(std::string(format.name) + " with " + hint.name);
+
+			const uint64_t usage = hint.usage | RK_GRALLOC_USAGE_SPECIFY_STRIDE;
+			native_handle_t *handle = nullptr;
+			ASSERT_EQ(0, gralloc_host_allocate(gralloc_host_descriptor(width, height, format.hal_format, usage),
+			                                   &handle));
+			const auto *hnd = static_cast<const private_handle_t *>(handle);
+
+			const size_t pixels = (size_t)width * height;
+			size_t expected = pixels * format.picture / 8;
+			if (format.sideband == 0)
+			{
+				/* Not a format of the decoder: sized as when no stride is specified. */
+				expected = size_without_specified_stride(format, hint);
+			}
+			else if (expects_sideband(policy, hint))
+			{
+				expected = pixels * (format.picture + format.sideband) / 8;
+			}
+
+			EXPECT_EQ(expected, (size_t)hnd->size);
+			/* The stride is the one given by the decoder, whatever the size. */
+			EXPECT_EQ(width * format.plane0_bits / 8, hnd->plane_info[0].byte_stride);
+
+			gralloc_host_free_allocated(handle);
+		}
+	}
+}
+
+void check_policy(const sideband_policy policy, const char *value)
+{
+	run_in_child(
+	    [policy, value]()
+	    {
+		    if (value != nullptr)
+		    {
+			    gralloc_host_set_property("vendor.gralloc.rk_video_sideband", value);
+		    }
+		    check_sizes(policy);
+	    });
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostRkVideoSize, VideoBuffersByDefault)
+{
+	check_policy(SIDEBAND_VIDEO, nullptr);
+}
+
+TEST(GrallocHostRkVideoSize, NoSideband)
+{
+	check_policy(SIDEBAND_NONE, "0");
+}
+
+TEST(GrallocHostRkVideoSize, VideoBuffers)
+{
+	check_policy(SIDEBAND_VIDEO, "1");
+}
+
+TEST(GrallocHostRkVideoSize, EveryStrideSpecifiedBuffer)
+{
+	check_policy(SIDEBAND_ALL, "2");
+}
+
+TEST(GrallocHostRkVideoSize, InvalidPolicyKeepsDefault)
+{
+	check_policy(SIDEBAND_VIDEO, "3");
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Binary trace ring, written by concurrent threads and saved to a file.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "gralloc_host_test.h"
+#include "gralloc_priv.h"
+#include "core/mali_gralloc_trace.h"
+
+namespace
+{
+
+/* Set in the buffer ID of the records written by the tests. */
+const uint64_t test_marker = 1ULL << 62;
+
+/* Records an event whose fields are all derived from 'value', so torn records can be told apart. */
+void trace_value(private_handle_t *hnd, const uint64_t value)
+{
+	hnd->backing_store_id = value;
+	hnd->alloc_format = value;
+	hnd->producer_usage = value;
+	hnd->consumer_usage = 0;
+	hnd->size = static_cast<int>(value & 0x7fffffff);
+	hnd->width = static_cast<int>(value & 0xffff);
+	hnd->height = static_cast<int>(value & 0xffff);
+	mali_gralloc_trace(MALI_GRALLOC_TRACE_LOCK, hnd, value);
+}
+
+bool read_trace(const char *path, mali_gralloc_trace_file_header *header, std::vector<mali_gralloc_trace_record> *records)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	bool ok = fread(header, sizeof(*header), 1, file) == 1;
+	if (ok)
+	{
+		records->resize(header->count);
+		ok = fread(records->data(), sizeof(mali_gralloc_trace_record), header->count, file) == header->count;
+	}
+
+	fclose(file);
+	return ok;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostTrace, ConcurrentWritersNeverPublishTornRecords)
+{
+	run_in_child(
+	    []()
+	    {
+		    const int num_threads = 8;
+		    const uint64_t per_thread = 20000;
+
+		    std::vector<std::thread> writers;
+		    for (int t = 0; t < num_threads; t++)
+		    {
+			    writers.emplace_back(
+			        [t]()
+			        {
+				        private_handle_t hnd(0, 0, nullptr, 0, 0, -1, 0, 0, 0, 0, 0);
+				        for (uint64_t i = 0; i < per_thread; i++)
+				        {
+					        trace_value(&hnd, test_marker | (static_cast<uint64_t>(t) << 32) | i);
+				        }
+			        });
+		    }
+		    for (std::thread &writer : writers)
+		    {
+			    writer.join();
+		    }
+
+		    char path[64];
+		    snprintf(path, sizeof(path), "trace_test_%d.bin", getpid());
+		    ASSERT_EQ(0, mali_gralloc_trace_save(path));
+
+		    mali_gralloc_trace_file_header header;
+		    std::vector<mali_gralloc_trace_record> records;
+		    ASSERT_TRUE(read_trace(path, &header, &records));
+		    unlink(path);
+
+		    EXPECT_EQ(static_cast<uint32_t>(MALI_GRALLOC_TRACE_MAGIC), header.magic);
+		    EXPECT_EQ(static_cast<uint32_t>(MALI_GRALLOC_TRACE_VERSION), header.version);
+		    EXPECT_EQ(sizeof(mali_gralloc_trace_record), header.record_size);
+		    EXPECT_LE(header.count, 1024u);
+
+		    uint32_t written = 0;
+		    for (size_t i = 0; i < records.size(); i++)
+		    {
+			    const mali_gralloc_trace_record &record = records[i];
+			    if (i > 0)
+			    {
+				    EXPECT_LT(records[i - 1].seq, record.seq);
+			    }
+			    if ((record.buffer_id & test_marker) == 0)
+			    {
+				    continue;
+			    }
+
+			    written++;
+			    const uint64_t value = record.buffer_id;
+			    EXPECT_EQ(value, record.alloc_format);
+			    EXPECT_EQ(value, record.usage);
+			    EXPECT_EQ(static_cast<int32_t>(value & 0x7fffffff), record.size);
+			    EXPECT_EQ(value & 0xffff, record.width);
+			    EXPECT_EQ(value & 0xffff, record.height);
+			    EXPECT_EQ(static_cast<uint8_t>(MALI_GRALLOC_TRACE_LOCK), record.event);
+		    }
+
+		    /* Only records overtaken by a writer a whole ring ahead are dropped. */
+		    EXPECT_GT(written, 0u);
+	    });
+}
+
+TEST(GrallocHostTrace, SlotsHoldTheMostRecentRecords)
+{
+	run_in_child(
+	    []()
+	    {
+		    private_handle_t hnd(0, 0, nullptr, 0, 0, -1, 0, 0, 0, 0, 0);
+		    for (uint64_t i = 0; i < 3000; i++)
+		    {
+			    trace_value(&hnd, test_marker | i);
+		    }
+
+		    char path[64];
+		    snprintf(path, sizeof(path), "trace_test_%d.bin", getpid());
+		    ASSERT_EQ(0, mali_gralloc_trace_save(path));
+
+		    mali_gralloc_trace_file_header header;
+		    std::vector<mali_gralloc_trace_record> records;
+		    ASSERT_TRUE(read_trace(path, &header, &records));
+		    unlink(path);
+
+		    /* A single writer never drops records: the ring holds the last 1024, in order. */
+		    ASSERT_EQ(1024u, records.size());
+		    for (size_t i = 0; i < records.size(); i++)
+		    {
+			    EXPECT_EQ(test_marker | (3000 - 1024 + i), records[i].buffer_id);
+		    }
+	    });
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2020 ARM Limited. All rights reserved.
+ *
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Vsync period and phase estimated from the wake-up times of vsync waits,
+ * which jitter and miss vsyncs.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gralloc_host_test.h"
+#include "1.x/gralloc_vsync_model.h"
+
+namespace
+{
+
+const int64_t period_60hz = 16666667;
+const int64_t period_90hz = 11111111;
+const int64_t base_ns = 1000000000;
+
+/* Samples n vsyncs, from vsync first on, as woken up late by latency_ns[i]. */
+void sample_vsyncs(vsync_model &model, int64_t period, int first, int n, const int64_t *latency_ns = nullptr)
+{
+	for (int i = 0; i < n; i++)
+	{
+		model.sample(base_ns + (first + i) * period + (latency_ns ? latency_ns[i] : 0));
+	}
+}
+
+int64_t monotonic_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} /* anonymous namespace */
+
+TEST(GrallocHostVsyncModel, ValidAfterFourIntervals)
+{
+	vsync_model model;
+	EXPECT_FALSE(model.valid());
+	EXPECT_EQ(0, model.period_ns());
+	EXPECT_EQ(-1, model.predict_next(base_ns));
+
+	for (int i = 0; i < 4; i++)
+	{
+		model.sample(base_ns + i * period_60hz);
+		EXPECT_FALSE(model.valid());
+	}
+
+	model.sample(base_ns + 4 * period_60hz);
+	ASSERT_TRUE(model.valid());
+	EXPECT_EQ(period_60hz, model.period_ns());
+	EXPECT_EQ(base_ns + 5 * period_60hz, model.predict_next(base_ns + 4 * period_60hz));
+
+	model.reset();
+	EXPECT_FALSE(model.valid());
+	EXPECT_EQ(-1, model.predict_next(base_ns));
+}
+
+TEST(GrallocHostVsyncModel, MedianOfJitteredSamples)
+{
+	/* Mostly tens of microseconds, with a few descheduled wake-ups. */
+	const int64_t latency_ns[] = {
+		20000, 60000, 35000, 3000000, 10000, 45000, 25000, 50000,
+		15000, 4000000, 30000, 40000, 55000, 20000, 35000, 25000,
+	};
+	const int n = sizeof(latency_ns) / sizeof(latency_ns[0]);
+
+	vsync_model model;
+	sample_vsyncs(model, period_60hz, 0, n, latency_ns);
+	ASSERT_TRUE(model.valid());
+	EXPECT_NEAR(period_60hz, model.period_ns(), 50000);
+
+	/*
+	 * On the vsync grid, offset by the typical latency and the period error
+	 * over the history, far less than by the outliers.
+	 */
+	const int64_t next = model.predict_next(base_ns + (n - 1) * period_60hz + period_60hz / 2);
+	EXPECT_NEAR(base_ns + n * period_60hz, next, 500000);
+}
+
+TEST(GrallocHostVsyncModel, MissedVsyncs)
+{
+	/* Before and after the period is known. */
+	const int vsyncs[] = { 0, 1, 3, 4, 5, 8, 9, 11, 12, 13, 17 };
+
+	vsync_model model;
+	for (const int vsync : vsyncs)
+	{
+		model.sample(base_ns + vsync * period_60hz);
+	}
+
+	ASSERT_TRUE(model.valid());
+	EXPECT_NEAR(period_60hz, model.period_ns(), 1);
+	EXPECT_NEAR(base_ns + 18 * period_60hz, model.predict_next(base_ns + 17 * period_60hz), 16);
+}
+
+TEST(GrallocHostVsyncModel, RefreshRateChange)
+{
+	vsync_model model;
+	sample_vsyncs(model, period_60hz, 0, 16);
+	ASSERT_EQ(period_60hz, model.period_ns());
+
+	/* Once most of the history is at the new rate. */
+	const int64_t switch_ns = base_ns + 16 * period_60hz;
+	for (int i = 0; i < 10; i++)
+	{
+		model.sample(switch_ns + i * period_90hz);
+	}
+	EXPECT_EQ(period_90hz, model.period_ns());
+	EXPECT_EQ(switch_ns + 10 * period_90hz, model.predict_next(switch_ns + 9 * period_90hz));
+}
+
+TEST(GrallocHostVsyncModel, LongGapRestarts)
+{
+	vsync_model model;
+	sample_vsyncs(model, period_60hz, 0, 8);
+	ASSERT_TRUE(model.valid());
+
+	/* Display off for a second, back on at another rate. */
+	const int64_t resume_ns = base_ns + 7 * period_60hz + 1000000000;
+	for (int i = 0; i < 5; i++)
+	{
+		model.sample(resume_ns + i * period_90hz);
+		EXPECT_EQ(i == 4, model.valid());
+	}
+	EXPECT_EQ(period_90hz, model.period_ns());
+
+	/* Gaps up to 32 periods are missed vsyncs. */
+	model.sample(resume_ns + 36 * period_90hz);
+	EXPECT_TRUE(model.valid());
+	model.sample(resume_ns + 70 * period_90hz);
+	EXPECT_FALSE(model.valid());
+}
+
+TEST(GrallocHostVsyncModel, NonMonotonicSamplesIgnored)
+{
+	vsync_model model;
+	sample_vsyncs(model, period_60hz, 0, 5);
+	ASSERT_TRUE(model.valid());
+	const int64_t next = model.predict_next(base_ns + 4 * period_60hz);
+
+	model.sample(base_ns + 4 * period_60hz);
+	model.sample(base_ns + 2 * period_60hz + period_60hz / 2);
+	model.sample(0);
+
+	EXPECT_EQ(period_60hz, model.period_ns());
+	EXPECT_EQ(next, model.predict_next(base_ns + 4 * period_60hz));
+
+	/* The sequence goes on from the last valid sample. */
+	model.sample(base_ns + 5 * period_60hz);
+	EXPECT_EQ(period_60hz, model.period_ns());
+}
+
+TEST(GrallocHostVsyncModel, PredictionsStrictlyAfter)
+{
+	vsync_model model;
+	sample_vsyncs(model, period_60hz, 0, 8);
+	ASSERT_TRUE(model.valid());
+	const int64_t last_ns = base_ns + 7 * period_60hz;
+
+	/* Before the samples. */
+	EXPECT_EQ(base_ns, model.predict_next(base_ns - 1));
+	EXPECT_EQ(base_ns, model.predict_next(base_ns - period_60hz / 2));
+	EXPECT_EQ(base_ns - period_60hz, model.predict_next(base_ns - period_60hz - 1));
+
+	/* On a vsync, the next one. */
+	EXPECT_EQ(base_ns + period_60hz, model.predict_next(base_ns));
+	EXPECT_EQ(last_ns + period_60hz, model.predict_next(last_ns));
+
+	/* Long after the samples. */
+	EXPECT_EQ(last_ns + 100 * period_60hz, model.predict_next(last_ns + 99 * period_60hz + 1));
+	EXPECT_EQ(last_ns + 100 * period_60hz, model.predict_next(last_ns + 100 * period_60hz - 1));
+}
+
+TEST(GrallocHostVsyncModel, PredictedWaits)
+{
+	run_in_child(
+	    []()
+	    {
+		    int64_t next_ns = 0;
+		    EXPECT_EQ(-EAGAIN, gralloc_vsync_predict(&next_ns));
+		    EXPECT_FALSE(gralloc_vsync_wait_predicted());
+
+		    /* A 2 ms display. */
+		    for (int i = 0; i < 5; i++)
+		    {
+			    usleep(2000);
+			    gralloc_vsync_sample_now();
+		    }
+
+		    const int64_t now_ns = monotonic_ns();
+		    ASSERT_EQ(0, gralloc_vsync_predict(&next_ns));
+		    EXPECT_GT(next_ns, now_ns);
+		    EXPECT_LT(next_ns, now_ns + 100000000);
+
+		    /* Waits on the display again every 16 vsyncs, to correct drift. */
+		    for (int i = 0; i < 16; i++)
+		    {
+			    ASSERT_EQ(0, gralloc_vsync_predict(&next_ns));
+			    ASSERT_TRUE(gralloc_vsync_wait_predicted());
+			    EXPECT_GE(monotonic_ns(), next_ns);
+		    }
+		    EXPECT_FALSE(gralloc_vsync_wait_predicted());
+
+		    gralloc_vsync_sample_now();
+		    EXPECT_TRUE(gralloc_vsync_wait_predicted());
+	    });
+}